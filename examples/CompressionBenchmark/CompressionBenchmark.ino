@@ -0,0 +1,82 @@
+/**
+ * NetworkComm Compression Benchmark Example
+ *
+ * This example runs the frame body compressor over typical payloads - serial
+ * log lines, a JSON status message and random bytes - and prints the bytes
+ * that would go on air and the CPU time per KB to compress and decompress.
+ *
+ * It needs no network; any board with a serial port will do. The same
+ * payloads can be used to compare boards, or against a host build.
+ */
+
+#include <Arduino.h>
+
+#include "NetworkCore.h"
+
+// Rounds per measurement
+const int benchmarkRounds = 1000;
+
+// Payloads, each the size of a typical frame body
+const char* logLines =
+    "[12345] sensor: temp=23.41C humidity=45.2% pressure=1013.2hPa ok\r\n"
+    "[12346] sensor: temp=23.42C humidity=45.1% pressure=1013.2hPa ok\r\n"
+    "[12347] sensor: temp=23.42C humidity=45.1% pressure=1013.1hPa ok\r\n";
+
+const char* jsonStatus =
+    "{\"rooms\":[{\"name\":\"kitchen\",\"temp\":23.4,\"humidity\":45},"
+    "{\"name\":\"hall\",\"temp\":21.9,\"humidity\":48},"
+    "{\"name\":\"study\",\"temp\":22.7,\"humidity\":44}],\"status\":\"ok\"}";
+
+uint8_t randomBytes[200];
+
+void runBenchmark(const char* name, const uint8_t* data, size_t length) {
+  uint8_t packed[COMPRESSION_MAX_INPUT];
+  uint8_t unpacked[COMPRESSION_MAX_INPUT];
+
+  uint32_t start = micros();
+  size_t packedLength = 0;
+  for (int round = 0; round < benchmarkRounds; round++) {
+    packedLength = NetworkCore::compress(data, length, packed, length - 1);
+  }
+  uint32_t compressTime = micros() - start;
+
+  uint32_t decompressTime = 0;
+  if (packedLength > 0) {
+    start = micros();
+    for (int round = 0; round < benchmarkRounds; round++) {
+      NetworkCore::decompress(packed, packedLength, unpacked,
+                              sizeof(unpacked));
+    }
+    decompressTime = micros() - start;
+  }
+
+  // Incompressible bodies are sent as they are
+  size_t sentLength = packedLength > 0 ? packedLength : length;
+  float perKb = 1024.0 / length / benchmarkRounds;
+
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(length);
+  Serial.print(" -> ");
+  Serial.print(sentLength);
+  Serial.print(" bytes, compress ");
+  Serial.print(compressTime * perKb, 1);
+  Serial.print(" us/KB, decompress ");
+  Serial.print(decompressTime * perKb, 1);
+  Serial.println(" us/KB");
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm Compression Benchmark Example");
+
+  for (size_t i = 0; i < sizeof(randomBytes); i++) {
+    randomBytes[i] = random(256);
+  }
+
+  runBenchmark("Log lines", (const uint8_t*)logLines, strlen(logLines));
+  runBenchmark("JSON status", (const uint8_t*)jsonStatus, strlen(jsonStatus));
+  runBenchmark("Random bytes", randomBytes, sizeof(randomBytes));
+}
+
+void loop() {}
@@ -0,0 +1,56 @@
+/**
+ * NetworkComm Fast Startup Example
+ *
+ * This example measures how long a board takes from begin() to its first
+ * ESP-NOW frame, joining an access point or in ESP-NOW-only mode.
+ *
+ * Set useAccessPoint to choose the mode. In ESP-NOW-only mode every board
+ * must use the same channel as espNowChannel. The board does not wait for
+ * the network in setup(); loop() reports once the first frame is sent.
+ */
+
+#include <Arduino.h>
+
+#include "NetworkComm.h"
+
+// Network configuration
+const char* ssid = "YourWiFiSSID";
+const char* password = "YourWiFiPassword";
+const bool useAccessPoint = false;
+const uint8_t espNowChannel = 6;
+
+// Board configuration
+const char* boardId = "fast-startup";
+
+// NetworkComm instance
+NetworkComm netComm;
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm Fast Startup Example");
+
+  bool started = useAccessPoint
+                     ? netComm.begin(ssid, password, boardId)
+                     : netComm.beginEspNowOnly(boardId, espNowChannel);
+  if (!started) {
+    Serial.println("Failed to start");
+    while (1) {
+      delay(1000);
+    }
+  }
+}
+
+void loop() {
+  netComm.update();
+
+  // Discovery sends the first frame as soon as ESP-NOW is up
+  static bool reported = false;
+  int32_t firstFrameMs = netComm.getTimeToFirstFrame();
+  if (!reported && firstFrameMs >= 0) {
+    reported = true;
+    Serial.print(useAccessPoint ? "Access point" : "ESP-NOW only");
+    Serial.print(" mode: first frame ");
+    Serial.print(firstFrameMs);
+    Serial.println(" ms after begin()");
+  }
+}
@@ -0,0 +1,165 @@
+/**
+ * NetworkComm Group Pin Benchmark Example
+ *
+ * This example compares switching a pin on many boards with one group
+ * command (a single broadcast frame plus compact per-member acks) against
+ * one unicast controlRemotePin call per board.
+ *
+ * Flash the same sketch on every board. The board named "controller" runs
+ * the benchmark against every board it has discovered; all other boards
+ * simply handle pin control.
+ *
+ * Unicast confirmations come from a table of 10 pin commands awaiting
+ * acknowledgement, and each entry is held for 2 * ACK_TIMEOUT after it is
+ * sent. The unicast rounds therefore use at most 10 members and wait for
+ * the table to drain between rounds, outside the measured time.
+ */
+
+#include <Arduino.h>
+
+#include "NetworkComm.h"
+
+// Network configuration
+const char* ssid = "YourWiFiSSID";
+const char* password = "YourWiFiPassword";
+
+// Board configuration - give every board a unique ID
+const char* boardId = "controller";
+const char* controllerId = "controller";
+
+// Pin switched on the member boards
+const int benchmarkPin = 13;
+
+// Number of rounds per method
+const int benchmarkRounds = 10;
+
+// Pin commands a board tracks for confirmation at once
+// (NetworkCore::MAX_TRACKED_MESSAGES)
+const uint8_t maxUnicastMembers = 10;
+
+// NetworkComm instance
+NetworkComm netComm;
+
+// Benchmark state
+volatile bool groupDone = false;
+volatile int unicastConfirmed = 0;
+const char* members[MAX_GROUP_MEMBERS];
+uint8_t memberCount = 0;
+
+// Called once every member confirmed or the retries ran out
+void onGroupDone(const char* group, uint8_t pin, uint8_t value,
+                 uint32_t ackedMask, uint8_t count) {
+  groupDone = true;
+}
+
+// Called for each unicast pin command once the send status is known
+void onUnicastDone(const char* sender, uint8_t pin, uint8_t value,
+                   bool success) {
+  unicastConfirmed++;
+}
+
+// Wait for a condition while servicing the network, with a timeout
+bool waitFor(volatile bool& flag, uint32_t timeoutMs) {
+  uint32_t start = millis();
+  while (!flag && millis() - start < timeoutMs) netComm.update();
+  return flag;
+}
+
+void runBenchmark() {
+  // Use every discovered board as a group member
+  memberCount = 0;
+  String names[MAX_GROUP_MEMBERS];
+  for (int i = 0;
+       i < netComm.getAvailableBoardsCount() && memberCount < MAX_GROUP_MEMBERS;
+       i++) {
+    names[memberCount] = netComm.getAvailableBoardName(i);
+    members[memberCount] = names[memberCount].c_str();
+    memberCount++;
+  }
+
+  if (memberCount == 0) {
+    Serial.println("No boards discovered yet");
+    return;
+  }
+
+  netComm.defineBoardGroup("bench", members, memberCount);
+  delay(100);
+
+  // Group command: one broadcast, compact acks
+  uint32_t groupTotal = 0;
+  for (int round = 0; round < benchmarkRounds; round++) {
+    groupDone = false;
+    uint32_t start = micros();
+    netComm.controlGroupPin("bench", benchmarkPin, round & 1, onGroupDone);
+    waitFor(groupDone, 1000);
+    groupTotal += micros() - start;
+  }
+
+  // Per-board unicast: one frame and one tracked message per member, for
+  // as many members as can be tracked
+  uint8_t unicastCount =
+      memberCount < maxUnicastMembers ? memberCount : maxUnicastMembers;
+  uint32_t unicastTotal = 0;
+  int unicastTimeouts = 0;
+  for (int round = 0; round < benchmarkRounds; round++) {
+    unicastConfirmed = 0;
+    uint32_t roundStart = millis();
+    uint32_t start = micros();
+    for (uint8_t i = 0; i < unicastCount; i++) {
+      netComm.controlRemotePin(members[i], benchmarkPin, round & 1,
+                               onUnicastDone);
+    }
+    while (unicastConfirmed < unicastCount &&
+           millis() - roundStart < 1000) {
+      netComm.update();
+    }
+    unicastTotal += micros() - start;
+    if (unicastConfirmed < unicastCount) unicastTimeouts++;
+
+    // Let the tracked commands expire before the next round
+    while (millis() - roundStart < ACK_TIMEOUT * 2 + 100) netComm.update();
+  }
+
+  Serial.print("Members: ");
+  Serial.print(memberCount);
+  Serial.print(", group avg: ");
+  Serial.print(groupTotal / benchmarkRounds);
+  Serial.print(" us; unicast to ");
+  Serial.print(unicastCount);
+  Serial.print(" members (at most ");
+  Serial.print(maxUnicastMembers);
+  Serial.print(" tracked) avg: ");
+  Serial.print(unicastTotal / benchmarkRounds);
+  Serial.print(" us, ");
+  Serial.print(unicastTimeouts);
+  Serial.println(" rounds timed out");
+  if (memberCount > unicastCount) {
+    Serial.println("Compare per member: the group covered more boards");
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm Group Pin Benchmark Example");
+
+  if (!netComm.begin(ssid, password, boardId)) {
+    Serial.println("Failed to connect");
+    while (1) {
+      delay(1000);
+    }
+  }
+
+  // Member boards apply pin commands directly
+  netComm.handlePinControl();
+}
+
+void loop() {
+  netComm.update();
+
+  // The controller re-runs the benchmark 30 seconds after the last run
+  static unsigned long lastRun = 0;
+  if (strcmp(boardId, controllerId) == 0 && millis() - lastRun > 30000) {
+    runBenchmark();
+    lastRun = millis();
+  }
+}
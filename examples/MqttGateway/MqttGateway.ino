@@ -0,0 +1,66 @@
+/**
+ * NetworkComm MQTT Gateway Example
+ *
+ * This example bridges ESP-NOW topics to an MQTT broker and back. Sensor
+ * readings published by any board under "sensors/" appear on the broker as
+ * "espnow/sensors/...", and anything published on the broker under
+ * "espnow-cmd/" is published to the boards under "control/".
+ *
+ * Only the gateway board needs this sketch; the other boards use the
+ * regular publish and subscribe API.
+ */
+
+#include <Arduino.h>
+
+#include "NetworkComm.h"
+
+// Network configuration
+const char* ssid = "YourWiFiSSID";
+const char* password = "YourWiFiPassword";
+
+// Broker configuration
+const char* mqttHost = "192.168.1.10";
+const uint16_t mqttPort = 1883;
+
+// Board configuration
+const char* boardId = "gateway";
+
+// NetworkComm instance
+NetworkComm netComm;
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm MQTT Gateway Example");
+
+  if (!netComm.begin(ssid, password, boardId)) {
+    Serial.println("Failed to connect");
+    while (1) {
+      delay(1000);
+    }
+  }
+
+  // ESP-NOW to MQTT
+  netComm.bridgeTopicToMqtt("sensors/#", "espnow/");
+
+  // MQTT to ESP-NOW
+  netComm.bridgeTopicFromMqtt("espnow-cmd/", "control/");
+
+  // Connects from update(), reconnecting whenever the broker drops
+  netComm.startMqttGateway(mqttHost, mqttPort);
+}
+
+void loop() {
+  netComm.update();
+
+  // Report the gateway state every 10 seconds
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport > 10000) {
+    lastReport = millis();
+    Serial.print("MQTT connected: ");
+    Serial.print(netComm.isMqttConnected() ? "yes" : "no");
+    Serial.print(", backlog: ");
+    Serial.print(netComm.getGatewayBacklog());
+    Serial.print(", dropped: ");
+    Serial.println(netComm.getGatewayDropped());
+  }
+}
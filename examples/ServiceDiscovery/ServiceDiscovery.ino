@@ -0,0 +1,82 @@
+/**
+ * NetworkComm Service Discovery Example
+ *
+ * This example shows how boards advertise services in their capability
+ * record, and how a controller finds the boards offering a service without
+ * sending them anything.
+ *
+ * Flash it on several boards with different board IDs. Boards with an ID
+ * starting with "thermostat" offer the thermostat service; every board lists
+ * the thermostats it knows of every ten seconds.
+ */
+
+#include <Arduino.h>
+
+#include "NetworkComm.h"
+
+// Network configuration
+const char* ssid = "YourWiFiSSID";
+const char* password = "YourWiFiPassword";
+
+// Board configuration
+const char* boardId = "thermostat-1";
+const char* firmwareVersion = "1.0.0";
+
+// The service looked for
+const char* thermostatService = "thermostat";
+
+// NetworkComm instance
+NetworkComm netComm;
+
+void listThermostats() {
+  int count = netComm.getBoardsWithServiceCount(thermostatService);
+  Serial.print("Thermostats found: ");
+  Serial.println(count);
+
+  for (int i = 0; i < count; i++) {
+    String board = netComm.getBoardWithService(thermostatService, i);
+
+    Serial.print("  ");
+    Serial.print(board);
+    Serial.print(", firmware ");
+    Serial.print(netComm.getBoardFirmwareVersion(board.c_str()));
+    Serial.print(", protocol ");
+    Serial.print(netComm.getBoardProtocolVersion(board.c_str()));
+    if (netComm.getBoardFeatures(board.c_str()) & PEER_FEATURE_PIN_CONTROL) {
+      Serial.print(", pin control");
+    }
+    if (netComm.boardMaySubscribe(board.c_str(), "control/#")) {
+      Serial.print(", listens on control/#");
+    }
+    Serial.println();
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm Service Discovery Example");
+
+  if (!netComm.begin(ssid, password, boardId)) {
+    Serial.println("Failed to connect");
+    while (1) {
+      delay(1000);
+    }
+  }
+
+  netComm.setFirmwareVersion(firmwareVersion);
+  if (strncmp(boardId, thermostatService, strlen(thermostatService)) == 0) {
+    netComm.advertiseService(thermostatService);
+  }
+
+  Serial.println("Setup complete");
+}
+
+void loop() {
+  netComm.update();
+
+  static unsigned long lastListTime = 0;
+  if (millis() - lastListTime > 10000) {
+    lastListTime = millis();
+    listThermostats();
+  }
+}
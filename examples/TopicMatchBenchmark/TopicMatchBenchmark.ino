@@ -0,0 +1,121 @@
+/**
+ * NetworkComm Topic Match Benchmark Example
+ *
+ * This example measures how long it takes to dispatch one incoming topic
+ * message against hundreds of subscriptions, comparing the compiled topic
+ * trie used by NetworkMessaging with a linear scan over the same filters.
+ *
+ * Raise the subscription limits with build flags to run it at full size,
+ * for example in platformio.ini:
+ *
+ *   build_flags = -DMAX_TOPIC_SUBSCRIPTIONS=512 -DMAX_TOPIC_TRIE_NODES=2048
+ */
+
+#include <Arduino.h>
+
+#include "NetworkCore.h"
+#include "NetworkMessaging.h"
+
+// Network configuration
+const char* ssid = "YourWiFiSSID";
+const char* password = "YourWiFiPassword";
+const char* boardId = "topic-benchmark";
+
+// Messaging service used on its own, without the other modules
+NetworkCore core;
+NetworkMessaging messaging(core);
+
+// Subscription filters, kept for the linear scan
+char filters[MAX_TOPIC_SUBSCRIPTIONS][32];
+int filterCount = 0;
+
+// Dispatch rounds per measurement
+const int benchmarkRounds = 2000;
+
+volatile int delivered = 0;
+
+void onMessage(const char* sender, const char* topic, const char* message) {
+  delivered++;
+}
+
+// Straightforward MQTT filter match, as a per-subscription scan would use
+bool linearMatch(const char* filter, const char* topic) {
+  while (true) {
+    if (*filter == '#') return true;
+    if (*filter == '+') {
+      filter++;
+      while (*topic && *topic != '/') topic++;
+    } else {
+      while (*filter && *filter != '/') {
+        if (*filter++ != *topic++) return false;
+      }
+      if (*topic && *topic != '/') return false;
+    }
+    if (*filter == '\0') return *topic == '\0';
+    if (*topic == '\0') return strcmp(filter, "/#") == 0;
+    filter++;
+    topic++;
+  }
+}
+
+// Subscribe up to count filters: mostly exact topics, with every tenth a
+// "+" filter and every fiftieth a "#" filter
+void addSubscriptions(int count) {
+  while (filterCount < count && filterCount < MAX_TOPIC_SUBSCRIPTIONS) {
+    int i = filterCount;
+    if (i % 50 == 49) {
+      snprintf(filters[i], sizeof(filters[i]), "site/f%d/#", i % 8);
+    } else if (i % 10 == 9) {
+      snprintf(filters[i], sizeof(filters[i]), "site/+/r%d/temp", i);
+    } else {
+      snprintf(filters[i], sizeof(filters[i]), "site/f%d/r%d/temp", i % 8, i);
+    }
+    if (!messaging.subscribeTopic(filters[i], onMessage)) break;
+    filterCount++;
+  }
+}
+
+void runBenchmark(const char* topic) {
+  uint32_t start = micros();
+  for (int round = 0; round < benchmarkRounds; round++) {
+    messaging.handleTopicMessage(boardId, topic, "1");
+  }
+  uint32_t trieTime = micros() - start;
+
+  start = micros();
+  for (int round = 0; round < benchmarkRounds; round++) {
+    for (int i = 0; i < filterCount; i++) {
+      if (linearMatch(filters[i], topic)) delivered++;
+    }
+  }
+  uint32_t linearTime = micros() - start;
+
+  Serial.print("Subscriptions: ");
+  Serial.print(filterCount);
+  Serial.print(", trie: ");
+  Serial.print(trieTime * 1000.0 / benchmarkRounds, 0);
+  Serial.print(" ns, linear scan: ");
+  Serial.print(linearTime * 1000.0 / benchmarkRounds, 0);
+  Serial.println(" ns per message");
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("NetworkComm Topic Match Benchmark Example");
+
+  if (!core.begin(ssid, password, boardId)) {
+    Serial.println("Failed to connect");
+    while (1) {
+      delay(1000);
+    }
+  }
+
+  const int sizes[] = {25, 50, 100, 200, 400};
+  for (int s = 0; s < 5; s++) {
+    addSubscriptions(sizes[s]);
+    runBenchmark("site/f3/r123/temp");
+    if (filterCount < sizes[s]) break;  // Limits reached
+  }
+}
+
+void loop() {}
@@ -21,9 +21,11 @@
 #include "NetworkCore.h"
 #include "NetworkDiagnostics.h"
 #include "NetworkDiscovery.h"
+#include "NetworkGateway.h"
 #include "NetworkMessaging.h"
 #include "NetworkPinControl.h"
 #include "NetworkSerial.h"
+#include "NetworkStream.h"
 
 // Message types
 #define MSG_TYPE_PIN_CONTROL 1
@@ -74,17 +76,76 @@ class NetworkComm {
    */
   NetworkComm();
 
+  /**
+   * Destructor for NetworkComm
+   */
+  ~NetworkComm();
+
+  NetworkComm(const NetworkComm&) = delete;
+  NetworkComm& operator=(const NetworkComm&) = delete;
+
   /**
    * Initialize the network communication
    *
+   * Returns at once; the board joins the access point in the background
+   * and starts ESP-NOW from update() once it is connected, on the access
+   * point's channel. If the access point is not reached within
+   * WIFI_CONNECT_TIMEOUT ms, ESP-NOW starts without it on
+   * ESPNOW_DEFAULT_CHANNEL and stays there; see enableWifiRetry() to try
+   * the access point again. isConnected() turns true when ESP-NOW is up.
+   * Subscriptions and other registrations may be made before that; they
+   * are announced to the other boards once ESP-NOW is up.
+   *
    * @param ssid WiFi network SSID to connect to
    * @param password WiFi network password
    * @param boardId Unique identifier for this board (must be unique on the
    * network)
-   * @return true if initialization was successful, false otherwise
+   * @return true if initialization was started successfully, false otherwise
    */
   bool begin(const char* ssid, const char* password, const char* boardId);
 
+  /**
+   * Initialize ESP-NOW without joining an access point
+   *
+   * The radio is set to a fixed channel and ESP-NOW starts straight away,
+   * so frames can be exchanged within milliseconds of boot. Every board
+   * must use the same channel; boards that joined an access point are on
+   * its channel.
+   *
+   * @param boardId Unique identifier for this board (must be unique on the
+   * network)
+   * @param channel WiFi channel, 1 to 14
+   * @return true if ESP-NOW was started successfully, false otherwise
+   */
+  bool beginEspNowOnly(const char* boardId,
+                       uint8_t channel = ESPNOW_DEFAULT_CHANNEL);
+
+  /**
+   * Try the access point again after begin() fell back to ESP-NOW only
+   *
+   * Off by default. Each attempt only looks for the access point on the
+   * channel ESP-NOW is on, so the board never leaves the boards it talks
+   * to; an access point on another channel is not joined. Joining can
+   * still keep the radio from hearing ESP-NOW frames for up to
+   * WIFI_CONNECT_TIMEOUT ms per attempt, long enough for peers to count
+   * the board as suspect, so use an interval well above the peer timeout.
+   *
+   * @param intervalMs Time between attempts, 0 to stop retrying
+   */
+  void enableWifiRetry(uint32_t intervalMs = WIFI_RETRY_INTERVAL);
+
+  /**
+   * Set the rate ESP-NOW frames are sent at
+   *
+   * Boards receive frames sent at any rate. Faster rates carry more data
+   * but reach less far. May be called before begin(); the rate is then set
+   * once ESP-NOW starts.
+   *
+   * @param rate The PHY rate, e.g. WIFI_PHY_RATE_2M_L
+   * @return true if the rate was set or stored until ESP-NOW starts
+   */
+  bool setEspNowRate(wifi_phy_rate_t rate);
+
   /**
    * Main loop function that must be called regularly
    *
@@ -96,10 +157,29 @@ class NetworkComm {
   /**
    * Check if the board is connected to the network
    *
-   * @return true if connected to WiFi and ESP-NOW is initialized
+   * ESP-NOW keeps working while the access point is out of reach, so this
+   * does not depend on the WiFi connection.
+   *
+   * @return true if ESP-NOW is initialized
    */
   bool isConnected();
 
+  /**
+   * Get the startup state
+   *
+   * @return STARTUP_IDLE before begin(), STARTUP_CONNECTING while joining
+   * the access point, STARTUP_READY once ESP-NOW is up, or STARTUP_FAILED
+   */
+  uint8_t getStartupState();
+
+  /**
+   * Get the time from begin() to the first frame sent
+   *
+   * @return Milliseconds until the radio reported the first frame sent, or
+   * -1 if no frame has been sent yet
+   */
+  int32_t getTimeToFirstFrame();
+
   // ==================== Board Discovery & Network Status ====================
   /**
    * Check if a specific board is available on the network
@@ -125,13 +205,392 @@ class NetworkComm {
   String getAvailableBoardName(int index);
 
   /**
-   * Set a callback for when a new board is discovered
+   * Add a callback for when a new board is discovered
+   *
+   * Up to MAX_DISCOVERY_CALLBACKS callbacks are notified. Passing NULL
+   * removes all of them.
    *
    * @param callback Function to call when a new board is discovered
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool onBoardDiscovered(DiscoveryCallback callback);
 
+  /**
+   * Add a discovery callback that receives a user context
+   *
+   * @param callback Function to call when a new board is discovered
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool onBoardDiscovered(DiscoveryContextCallback callback, void* context);
+
+  /**
+   * Remove the discovery callbacks registered with a context
+   *
+   * @param context The context passed to onBoardDiscovered()
+   * @return true if a callback was removed
+   */
+  bool removeDiscoveryCallbacks(void* context);
+
+  /**
+   * Add a callback for when a board is lost
+   *
+   * A board that stays silent is probed and, if it does not answer,
+   * dropped from the available boards and reported here. Passing NULL
+   * removes all lost callbacks.
+   *
+   * @param callback Function to call with the ID of the lost board
+   * @return true if the callback was added successfully
+   */
+  bool onBoardLost(DiscoveryCallback callback);
+
+  /**
+   * Add a lost board callback that receives a user context
+   *
+   * @param callback Function to call with the ID of the lost board
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool onBoardLost(DiscoveryContextCallback callback, void* context);
+
+  /**
+   * Set how long a board may stay silent before it is probed
+   *
+   * @param timeoutMs The silence in milliseconds, PEER_SUSPECT_TIMEOUT by
+   * default
+   * @return true if the setting was applied successfully
+   */
+  bool setPeerTimeout(uint32_t timeoutMs);
+
+  /**
+   * Check if a board has gone silent and is being probed
+   *
+   * @param boardId The ID of the board to check
+   * @return true if the board is suspect, false otherwise
+   */
+  bool isBoardSuspect(const char* boardId);
+
+  /**
+   * Advertise a service offered by this board, such as "thermostat"
+   *
+   * Up to MAX_BOARD_SERVICES services are carried in the capability record.
+   * They travel as hashes of their names, so names of any length cost two
+   * bytes each.
+   *
+   * @param service The name of the service
+   * @return true if the service is advertised
+   */
+  bool advertiseService(const char* service);
+
+  /**
+   * Stop advertising a service
+   *
+   * @param service The name of the service
+   * @return true if the service was advertised before
+   */
+  bool withdrawService(const char* service);
+
+  /**
+   * Set the firmware version carried in the capability record
+   *
+   * @param version Up to FIRMWARE_VERSION_SIZE - 1 characters, e.g. "1.4.2"
+   * @return true if the version was set successfully
+   */
+  bool setFirmwareVersion(const char* version);
+
+  /**
+   * Get the features a board advertised
+   *
+   * @param boardId The ID of the board
+   * @return The board's PEER_FEATURE_* flags, or 0 if it is not known
+   */
+  uint8_t getBoardFeatures(const char* boardId);
+
+  /**
+   * Get the wire format version a board runs
+   *
+   * @param boardId The ID of the board
+   * @return NETWORK_PROTOCOL_VERSION of the board, or 0 until its capability
+   * record has been received
+   */
+  uint8_t getBoardProtocolVersion(const char* boardId);
+
+  /**
+   * Get the firmware version a board advertised
+   *
+   * @param boardId The ID of the board
+   * @return The version, or empty string if the board has not set one
+   */
+  String getBoardFirmwareVersion(const char* boardId);
+
+  /**
+   * Check if a board offers a service
+   *
+   * @param boardId The ID of the board
+   * @param service The name of the service
+   * @return true if the board advertises the service
+   */
+  bool boardOffersService(const char* boardId, const char* service);
+
+  /**
+   * Get the number of boards offering a service
+   *
+   * @param service The name of the service
+   * @return The number of available boards advertising the service
+   */
+  int getBoardsWithServiceCount(const char* service);
+
+  /**
+   * Get a board offering a service by index
+   *
+   * @param service The name of the service
+   * @param index The index of the board (0 to getBoardsWithServiceCount()-1)
+   * @return The board ID as a String, or empty string if index is out of range
+   */
+  String getBoardWithService(const char* service, int index);
+
+  /**
+   * Check if a board may be subscribed to a topic filter
+   *
+   * The capability record carries a digest of the board's subscription
+   * filters, so the answer may be a false positive but never a false
+   * negative. Filters are compared as written, not matched against topics.
+   *
+   * @param boardId The ID of the board
+   * @param topicFilter The subscription filter, e.g. "sensors/#"
+   * @return true if the board may be subscribed to the filter
+   */
+  bool boardMaySubscribe(const char* boardId, const char* topicFilter);
+
+  // ==================== Mesh Relay ====================
+  /**
+   * Enable or disable multi-hop mesh relaying
+   *
+   * When enabled, boards out of radio range are reached through other
+   * boards, and broadcasts are flooded across the mesh. Enable it on every
+   * board that should relay or reach boards out of range.
+   *
+   * @param enable true to relay and route frames, false to stay single-hop
+   * @param ttl Maximum number of transmissions of a frame, 1 to 15
+   * @return true if the setting was applied successfully
+   */
+  bool enableMeshRelay(bool enable, uint8_t ttl = MESH_DEFAULT_TTL);
+
+  /**
+   * Check if mesh relaying is enabled
+   *
+   * @return true if mesh relaying is enabled, false otherwise
+   */
+  bool isMeshRelayEnabled();
+
+  /**
+   * Get the number of hops to a board
+   *
+   * @param boardId The board to look up
+   * @return 1 for boards in radio range, the learned hop count for boards
+   * reached through relays, or -1 if no route is known
+   */
+  int getHopCount(const char* boardId);
+
+  // ==================== Store and Forward ====================
+  /**
+   * Set the lifetime of messages stored from now on
+   *
+   * Stored messages that are not acknowledged within their lifetime are
+   * dropped and reported through the onSendFailure callback. The lifetime
+   * counts the time this board runs and carries on across reboots; each
+   * reboot may charge up to STORED_AGE_SAVE_INTERVAL ms extra, never less.
+   *
+   * @param lifetimeMs Lifetime in milliseconds
+   * @return true if the setting was applied successfully
+   */
+  bool setStoredMessageLifetime(uint32_t lifetimeMs);
+
+  /**
+   * Get the number of stored messages waiting for delivery
+   *
+   * @param boardId Count only messages for this board, or NULL for all
+   * @return The number of stored messages
+   */
+  int getStoredMessageCount(const char* boardId = NULL);
+
+  /**
+   * Drop every stored message for a board
+   *
+   * @param boardId The target board, or NULL for all boards
+   * @return true if the messages were dropped successfully
+   */
+  bool clearStoredMessages(const char* boardId = NULL);
+
+  // ==================== Peer Cache ====================
+  /**
+   * Enable or disable the peer cache in flash
+   *
+   * Known boards, with their MAC address, channel and capability record,
+   * are kept in flash and restored by begin(), so messages to them go out
+   * straight after a reboot. Enabled by default; call before begin() to
+   * start without the cached boards.
+   *
+   * @param enable true to enable the cache, false to disable it
+   * @return true if the setting was applied successfully
+   */
+  bool enablePeerCache(bool enable);
+
+  /**
+   * Write pending peer cache changes to flash now
+   *
+   * Changes are otherwise written PEER_CACHE_WRITE_DELAY ms after the first
+   * one, so a burst of discovery costs one write per board. Call this
+   * before deep sleep or a planned restart.
+   *
+   * @return true if the cache is up to date in flash
+   */
+  bool savePeerCache();
+
+  /**
+   * Erase the peer cache from flash
+   *
+   * The boards currently known stay available, and are written again when
+   * they change.
+   *
+   * @return true if the cache was erased successfully
+   */
+  bool clearPeerCache();
+
+  // ==================== Compression ====================
+  /**
+   * Enable or disable compression of serial data and message payloads
+   *
+   * Payloads are compressed only for boards that advertised support when
+   * they were discovered, and only when they get smaller. Text messages
+   * for such boards are sent in binary frames so they can be compressed
+   * as well. Compression is chosen per message type, not per peer or
+   * channel. Received payloads are always decompressed.
+   *
+   * @param enable true to compress serial data and messages, false for none
+   * @return true if the setting was applied successfully
+   */
+  bool enableCompression(bool enable);
+
+  /**
+   * Enable or disable compression for a single message type
+   *
+   * @param messageType The message type, e.g. MSG_TYPE_SERIAL_DATA
+   * @param enable true to compress frames of this type
+   * @return true if the setting was applied successfully
+   */
+  bool setCompression(uint8_t messageType, bool enable);
+
+  /**
+   * Allow compressed broadcasts
+   *
+   * Broadcasts are sent uncompressed by default, since boards that have not
+   * been discovered yet may not decompress them. When enabled, they are
+   * compressed if every known board can decompress them.
+   *
+   * @param enable true to compress broadcasts
+   * @return true if the setting was applied successfully
+   */
+  bool setBroadcastCompression(bool enable);
+
+  /**
+   * Check if compression is enabled for a message type
+   *
+   * @param messageType The message type, or 0 for any type
+   * @return true if compression is enabled, false otherwise
+   */
+  bool isCompressionEnabled(uint8_t messageType = 0);
+
+  /**
+   * Get the payload bytes handed to the compressor and the bytes sent
+   *
+   * @param payloadBytes Set to the payload bytes before compression
+   * @param sentBytes Set to the payload bytes put on air
+   * @return true if the statistics were read successfully
+   */
+  bool getCompressionStats(uint32_t& payloadBytes, uint32_t& sentBytes);
+
+  // ==================== MQTT Gateway ====================
+  // The gateway's connection, routes and backlog are allocated by the first
+  // call that configures it, so boards that never bridge to MQTT do not pay
+  // for them.
+
+  /**
+   * Use a different network client for the broker connection
+   *
+   * @param client The client, which must outlive the NetworkComm instance
+   * @return true if the client was set successfully
+   */
+  bool setMqttClient(Client& client);
+
+  /**
+   * Start bridging topics to an MQTT broker
+   *
+   * @param host The broker host name or address
+   * @param port The broker port
+   * @param clientId The MQTT client ID, or NULL to use the board ID
+   * @param username The user name, or NULL for none
+   * @param password The password, or NULL for none
+   * @return true if the gateway was started successfully
+   */
+  bool startMqttGateway(const char* host, uint16_t port = 1883,
+                        const char* clientId = NULL,
+                        const char* username = NULL,
+                        const char* password = NULL);
+
+  /**
+   * Stop bridging and disconnect from the broker
+   *
+   * @return true if the gateway was stopped successfully
+   */
+  bool stopMqttGateway();
+
+  /**
+   * Check if the gateway is connected to the broker
+   *
+   * @return true if connected, false otherwise
+   */
+  bool isMqttConnected();
+
+  /**
+   * Bridge ESP-NOW topics matching a filter to the broker
+   *
+   * @param topicFilter ESP-NOW topic filter, may use + and # wildcards
+   * @param mqttPrefix Prefix for the MQTT topic, may be empty
+   * @return true if the route was added successfully
+   */
+  bool bridgeTopicToMqtt(const char* topicFilter, const char* mqttPrefix);
+
+  /**
+   * Bridge MQTT topics under a prefix to ESP-NOW
+   *
+   * @param mqttPrefix MQTT topic prefix, empty or ending in '/'
+   * @param topicPrefix Prefix for the ESP-NOW topic, may be empty
+   * @return true if the route was added successfully
+   */
+  bool bridgeTopicFromMqtt(const char* mqttPrefix, const char* topicPrefix);
+
+  /**
+   * Remove all gateway bridge routes
+   *
+   * @return true if the routes were removed successfully
+   */
+  bool clearGatewayRoutes();
+
+  /**
+   * Get the number of publishes waiting for the broker
+   *
+   * @return The number of queued publishes
+   */
+  int getGatewayBacklog();
+
+  /**
+   * Get the number of publishes dropped because the backlog was full
+   *
+   * @return The number of dropped publishes since initialization
+   */
+  uint32_t getGatewayDropped();
+
   // ==================== Debug & Diagnostic Features ====================
   /**
    * Enable or disable message acknowledgements
@@ -258,66 +717,298 @@ class NetworkComm {
    */
   uint8_t readRemotePin(const char* targetBoardId, uint8_t pin);
 
-  // ==================== Remote Pin Control (Responder Side)
-  // ====================
+  // ==================== Scheduled Pin Control ====================
   /**
-   * Set up handling of pin control messages
+   * Get the current network time of this board
    *
-   * @param callback Optional callback to process pin control requests. If NULL
-   * (default), the library will automatically set pins directly
-   * (pinMode+digitalWrite). If provided, your callback is responsible for
-   * handling the pin.
-   * @return true if successful
+   * Use this as the base for controlRemotePinAt() target times, e.g.
+   * getNetworkTime() + 50000 to switch 50 ms from now.
+   *
+   * @return The current network time in microseconds
    */
-  bool handlePinControl(PinChangeCallback callback = NULL);
+  uint32_t getNetworkTime();
 
   /**
-   * Stop handling pin control messages
+   * Set a pin on a remote board at a given network time
    *
-   * @return true if successful
+   * The responder applies the command from a hardware timer at the target
+   * time instead of whenever the frame arrives. Once the target's clock
+   * offset is known (see syncClockWith()) the target time is converted to
+   * its clock, so delivery latency and retries do not move the switching
+   * instant; until then the command fires late by the delivery latency.
+   *
+   * @param targetBoardId The ID of the target board
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param networkTime Target time in microseconds on this board's clock
+   * @return true if the message was sent successfully
    */
-  bool stopHandlingPinControl();
+  bool controlRemotePinAt(const char* targetBoardId, uint8_t pin, uint8_t value,
+                          uint32_t networkTime);
 
   /**
-   * Accept pin control from a specific board for a specific pin
+   * Set a pin on several remote boards at the same network time
    *
-   * This method allows specific pin control from specific boards.
-   * Consider using handlePinControl for more flexible pin control handling.
+   * Sent as one broadcast frame carrying each target's clock offset, or
+   * several when the board IDs do not fit one frame.
    *
-   * @param controllerBoardId The ID of the board to accept control from
-   * @param pin The pin to allow control of
-   * @param callback Function to call when pin control is received
-   * @return true if the subscription was added successfully
+   * @param targetBoardIds The IDs of the target boards
+   * @param boardCount Number of boards (at most MAX_SCHEDULE_GROUP_SIZE)
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param networkTime Target time in microseconds on this board's clock
+   * @return true if every broadcast was sent successfully
    */
-  bool acceptPinControlFrom(const char* controllerBoardId, uint8_t pin,
-                            PinChangeCallback callback);
+  bool controlRemotePinsAt(const char* const* targetBoardIds,
+                           uint8_t boardCount, uint8_t pin, uint8_t value,
+                           uint32_t networkTime);
 
   /**
-   * Stop accepting pin control from a specific board for a specific pin
+   * Estimate the clock offset to a board ahead of scheduling on it
    *
-   * @param controllerBoardId The ID of the board to stop accepting control from
-   * @param pin The pin to stop allowing control of
-   * @return true if the subscription was removed successfully
+   * Scheduled commands start the estimate by themselves, but the first one
+   * then fires late by its delivery latency.
+   *
+   * @param targetBoardId The ID of the board
+   * @return true if a round of probes is under way or scheduled
    */
-  bool stopAcceptingPinControlFrom(const char* controllerBoardId, uint8_t pin);
+  bool syncClockWith(const char* targetBoardId);
 
-  // ==================== Pin State Broadcasting ====================
   /**
-   * Broadcast the state of a pin to all boards on the network
+   * Set a callback for scheduled pin command outcomes
    *
-   * This is useful for informing other boards about the state of a pin,
-   * without expecting them to control it.
+   * Called once per responder with PIN_SCHEDULE_ON_TIME, PIN_SCHEDULE_LATE or
+   * PIN_SCHEDULE_REJECTED and the achieved skew in microseconds, measured
+   * against the target time on this board's clock once the responder's
+   * clock offset is known.
    *
-   * @param pin The pin number to broadcast
-   * @param value The pin value to broadcast
-   * @return true if the broadcast was sent successfully
+   * @param callback Function to call when an outcome is reported
+   * @return true if the callback was set successfully
    */
-  bool broadcastPinState(uint8_t pin, uint8_t value);
+  bool onScheduledPinResult(PinScheduleCallback callback);
 
+  // ==================== Group Pin Control ====================
   /**
-   * Listen for pin state broadcasts from a specific board for a specific pin
+   * Define a named group of boards for group pin control
    *
-   * @param broadcasterBoardId The ID of the board to listen to
+   * Each member is told its index in the group so that group commands can be
+   * sent as one broadcast frame and acknowledged compactly. Members are told
+   * once they can be reached, so groups may be defined before the network
+   * is up.
+   *
+   * @param groupName Name of the group
+   * @param boardIds IDs of the member boards
+   * @param memberCount Number of members (at most MAX_GROUP_MEMBERS)
+   * @return true if the group was defined
+   */
+  bool defineBoardGroup(const char* groupName, const char* const* boardIds,
+                        uint8_t memberCount);
+
+  /**
+   * Remove a board group
+   *
+   * @param groupName Name of the group
+   * @return true if the group existed
+   */
+  bool removeBoardGroup(const char* groupName);
+
+  /**
+   * Get the ID of a group member by index (bit index in the acked mask)
+   *
+   * @param groupName Name of the group
+   * @param index Member index
+   * @return The member's board ID, or NULL if out of range
+   */
+  const char* getBoardGroupMember(const char* groupName, uint8_t index);
+
+  /**
+   * Control a pin on every member of a group
+   *
+   * Sends one broadcast frame; members that do not acknowledge are retried by
+   * unicast only. The callback receives a bit mask of the members that
+   * confirmed.
+   *
+   * @param groupName Name of the group
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param callback Optional callback called once all members confirmed or
+   * the retries ran out
+   * @return true if the broadcast was sent successfully
+   */
+  bool controlGroupPin(const char* groupName, uint8_t pin, uint8_t value,
+                       PinGroupConfirmCallback callback = NULL);
+
+  // ==================== Remote Pin Sequences ====================
+  /**
+   * Upload a pin sequence program to a remote board and start it
+   *
+   * The whole program (pin writes, delays, loops, input waits and progress
+   * reports) travels in one message and runs on the peripheral from a timer,
+   * so step timing does not depend on link latency or loss.
+   *
+   * @param targetBoardId The ID of the target board
+   * @param sequenceId Identifier used in status reports and to stop it
+   * @param sequence The program to run
+   * @return true if the message was sent successfully
+   */
+  bool runRemotePinSequence(const char* targetBoardId, uint8_t sequenceId,
+                            const PinSequence& sequence);
+
+  /**
+   * Stop a pin sequence running on a remote board
+   *
+   * @param targetBoardId The ID of the target board
+   * @param sequenceId The ID passed to runRemotePinSequence()
+   * @return true if the message was sent successfully
+   */
+  bool stopRemotePinSequence(const char* targetBoardId, uint8_t sequenceId);
+
+  /**
+   * Set a callback for pin sequence progress and completion reports
+   *
+   * @param callback Function to call when a peripheral reports a status
+   * @return true if the callback was set successfully
+   */
+  bool onPinSequenceStatus(PinSequenceCallback callback);
+
+  // ==================== Remote Bus Transactions ====================
+  /**
+   * Run a batch of I2C/SPI transactions on a remote board
+   *
+   * Writes, reads and write-then-reads travel in one message and every read
+   * byte comes back in a single response, so many registers can be sampled
+   * per round trip. The target must have called enableBusProxy().
+   *
+   * @param targetBoardId The ID of the target board
+   * @param batchId Identifier echoed in the response
+   * @param batch The transactions to run
+   * @return true if the message was sent successfully
+   */
+  bool submitBusTransactions(const char* targetBoardId, uint8_t batchId,
+                             const BusTransactionBatch& batch);
+
+  /**
+   * Set a callback for bus transaction responses
+   *
+   * @param callback Function to call with the read bytes of a batch
+   * @return true if the callback was set successfully
+   */
+  bool onBusResponse(BusResponseCallback callback);
+
+  // ==================== Remote Pin Control (Responder Side)
+  // ====================
+  /**
+   * Set up handling of pin control messages
+   *
+   * @param callback Optional callback to process pin control requests. If NULL
+   * (default), the library will automatically set pins directly
+   * (pinMode+digitalWrite). If provided, your callback is responsible for
+   * handling the pin.
+   * @return true if successful
+   */
+  bool handlePinControl(PinChangeCallback callback = NULL);
+
+  /**
+   * Set up handling of pin control messages with a callback that receives a
+   * user context
+   *
+   * @param callback Callback responsible for handling the pin
+   * @param context Passed to the callback as its first argument
+   * @return true if successful
+   */
+  bool handlePinControl(PinChangeContextCallback callback, void* context);
+
+  /**
+   * Stop handling pin control messages
+   *
+   * @return true if successful
+   */
+  bool stopHandlingPinControl();
+
+  /**
+   * Accept pin control from a specific board for a specific pin
+   *
+   * The subscription request is sent once the controller can be reached,
+   * so this may be called before the network is up.
+   *
+   * This method allows specific pin control from specific boards.
+   * Consider using handlePinControl for more flexible pin control handling.
+   *
+   * @param controllerBoardId The ID of the board to accept control from
+   * @param pin The pin to allow control of
+   * @param callback Function to call when pin control is received
+   * @return true if the subscription was added successfully
+   */
+  bool acceptPinControlFrom(const char* controllerBoardId, uint8_t pin,
+                            PinChangeCallback callback);
+
+  /**
+   * Accept pin control from a specific board for a specific pin, with a
+   * callback that receives a user context
+   *
+   * @param controllerBoardId The ID of the board to accept control from
+   * @param pin The pin to allow control of
+   * @param callback Function to call when pin control is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool acceptPinControlFrom(const char* controllerBoardId, uint8_t pin,
+                            PinChangeContextCallback callback, void* context);
+
+  /**
+   * Stop accepting pin control from a specific board for a specific pin
+   *
+   * @param controllerBoardId The ID of the board to stop accepting control from
+   * @param pin The pin to stop allowing control of
+   * @return true if the subscription was removed successfully
+   */
+  bool stopAcceptingPinControlFrom(const char* controllerBoardId, uint8_t pin);
+
+  /**
+   * Serve bus transaction batches from other boards
+   *
+   * The buses must already be initialized with begin(). Pass NULL for a bus
+   * that should not be reachable remotely. Only the listed boards may submit
+   * batches, and SPI transfers may only drive the listed chip select pins.
+   *
+   * @param allowedBoardIds Boards allowed to submit batches
+   * @param allowedCount Number of entries in allowedBoardIds
+   * @param wire I2C bus to proxy
+   * @param spi SPI bus to proxy
+   * @param csPins Chip select pins SPI transfers may drive
+   * @param csPinCount Number of entries in csPins
+   * @param spiFrequency SPI clock used for proxied transactions
+   * @return true if successful
+   */
+  bool enableBusProxy(const char* const* allowedBoardIds, uint8_t allowedCount,
+                      TwoWire* wire, SPIClass* spi = NULL,
+                      const uint8_t* csPins = NULL, uint8_t csPinCount = 0,
+                      uint32_t spiFrequency = BUS_PROXY_SPI_FREQUENCY);
+
+  /**
+   * Stop serving bus transaction batches
+   *
+   * @return true if successful
+   */
+  bool disableBusProxy();
+
+  // ==================== Pin State Broadcasting ====================
+  /**
+   * Broadcast the state of a pin to all boards on the network
+   *
+   * This is useful for informing other boards about the state of a pin,
+   * without expecting them to control it.
+   *
+   * @param pin The pin number to broadcast
+   * @param value The pin value to broadcast
+   * @return true if the broadcast was sent successfully
+   */
+  bool broadcastPinState(uint8_t pin, uint8_t value);
+
+  /**
+   * Listen for pin state broadcasts from a specific board for a specific pin
+   *
+   * @param broadcasterBoardId The ID of the board to listen to
    * @param pin The pin to listen for
    * @param callback Function to call when a pin state broadcast is received
    * @return true if the subscription was added successfully
@@ -325,6 +1016,19 @@ class NetworkComm {
   bool listenForPinStateFrom(const char* broadcasterBoardId, uint8_t pin,
                              PinChangeCallback callback);
 
+  /**
+   * Listen for pin state broadcasts with a callback that receives a user
+   * context. Several callbacks may listen to the same board and pin.
+   *
+   * @param broadcasterBoardId The ID of the board to listen to
+   * @param pin The pin to listen for
+   * @param callback Function to call when a pin state broadcast is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool listenForPinStateFrom(const char* broadcasterBoardId, uint8_t pin,
+                             PinChangeContextCallback callback, void* context);
+
   /**
    * Stop listening for pin state broadcasts from a specific board for a
    * specific pin
@@ -340,11 +1044,54 @@ class NetworkComm {
   /**
    * Publish a message to a topic that all boards can subscribe to
    *
-   * @param topic The topic to publish to
+   * With PUBLISH_RETAINED the message is also kept as the topic's last value
+   * and sent to boards that subscribe later. With MESSAGE_QOS1 it is retried
+   * until every interested board acknowledges it, and refused when more than
+   * MAX_OUTBOX_RECIPIENTS boards are interested.
+   *
+   * @param topic The topic to publish to, shorter than 32 characters
    * @param message The message to publish
-   * @return true if the message was sent successfully
+   * @param flags PUBLISH_RETAINED and/or MESSAGE_QOS1, or 0
+   * @return true if the message was sent or queued successfully
+   */
+  bool publishTopic(const char* topic, const char* message,
+                    uint8_t flags = 0);
+
+  /**
+   * Publish raw bytes to a topic, without JSON escaping
+   *
+   * @param topic The topic to publish to, shorter than 32 characters
+   * @param data The payload, may contain NUL bytes
+   * @param length Number of payload bytes
+   * @param flags PUBLISH_RETAINED and/or MESSAGE_QOS1, or 0
+   * @return true if the message was sent or queued successfully
+   */
+  bool publishTopic(const char* topic, const uint8_t* data, size_t length,
+                    uint8_t flags = 0);
+
+  /**
+   * Get the 16-bit ID a topic is carried under on the wire
+   *
+   * @param topic The topic name
+   * @return The topic ID, or 0 if the topic table is full
+   */
+  uint16_t getTopicId(const char* topic);
+
+  /**
+   * Set how many interested boards are reached by unicast before publishing
+   * falls back to broadcast
+   *
+   * Subscriptions are advertised to other boards, so a publish only goes to
+   * boards that subscribe. Each unicast board costs a frame and an
+   * acknowledgement, so the default of 1 keeps airtime at or below a
+   * broadcast; a higher threshold trades airtime for delivery. Set 0 to
+   * always broadcast, e.g. for boards running firmware that does not
+   * advertise subscriptions.
+   *
+   * @param maxPeers Threshold, at most MAX_TOPIC_UNICAST_PEERS
+   * @return true if the threshold was set
    */
-  bool publishTopic(const char* topic, const char* message);
+  bool setTopicUnicastThreshold(uint8_t maxPeers);
 
   /**
    * Subscribe to a topic to receive messages
@@ -355,6 +1102,39 @@ class NetworkComm {
    */
   bool subscribeTopic(const char* topic, MessageCallback callback);
 
+  /**
+   * Subscribe to a topic and receive messages as raw bytes
+   *
+   * @param topic The topic to subscribe to
+   * @param callback Function to call with a pointer into the receive buffer
+   * and the payload length
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, BinaryMessageCallback callback);
+
+  /**
+   * Subscribe to a topic with a callback that receives a user context
+   *
+   * @param topic The topic to subscribe to
+   * @param callback Function to call when a message is received on this topic
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, MessageContextCallback callback,
+                      void* context);
+
+  /**
+   * Subscribe to a topic as raw bytes with a callback that receives a user
+   * context
+   *
+   * @param topic The topic to subscribe to
+   * @param callback Function to call when a message is received on this topic
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, BinaryMessageContextCallback callback,
+                      void* context);
+
   /**
    * Unsubscribe from a topic
    *
@@ -363,6 +1143,15 @@ class NetworkComm {
    */
   bool unsubscribeTopic(const char* topic);
 
+  /**
+   * Remove the subscriptions to a topic made with a given context
+   *
+   * @param topic The topic to unsubscribe from
+   * @param context The context passed to subscribeTopic()
+   * @return true if a subscription was removed
+   */
+  bool unsubscribeTopic(const char* topic, void* context);
+
   // ==================== Serial Data Forwarding ====================
   /**
    * Forward serial data to all boards on the network
@@ -372,39 +1161,400 @@ class NetworkComm {
    */
   bool forwardSerialData(const char* data);
 
+  /**
+   * Forward raw serial bytes to all boards on the network
+   *
+   * @param data The bytes to forward, may contain NUL bytes
+   * @param length Number of bytes
+   * @return true if the data was sent successfully
+   */
+  bool forwardSerialData(const uint8_t* data, size_t length);
+
   /**
    * Receive serial data from other boards
    *
+   * Up to MAX_SERIAL_DATA_CALLBACKS callbacks receive all serial data.
+   * Each call adds a callback rather than replacing the last one. A NULL
+   * callback removes them all; a plain NULL matches both this and the
+   * binary overload, so call stopReceivingSerialData() instead.
+   *
    * @param callback Function to call when serial data is received
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool receiveSerialData(SerialDataCallback callback);
 
+  /**
+   * Receive serial data from other boards as raw bytes
+   *
+   * @param callback Function to call with a pointer into the receive buffer
+   * and the data length
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(BinarySerialDataCallback callback);
+
+  /**
+   * Receive serial data with a callback that receives a user context
+   *
+   * @param callback Function to call when serial data is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(SerialDataContextCallback callback, void* context);
+
+  /**
+   * Receive serial data as raw bytes with a callback that receives a user
+   * context
+   *
+   * @param callback Function to call when serial data is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(BinarySerialDataContextCallback callback,
+                         void* context);
+
   /**
    * Stop receiving serial data
    *
-   * @return true if the callback was cleared successfully
+   * @return true if the callbacks were cleared successfully
    */
   bool stopReceivingSerialData();
 
+  /**
+   * Remove the serial data callbacks registered with a context
+   *
+   * @param context The context passed to receiveSerialData()
+   * @return true if a callback was removed
+   */
+  bool stopReceivingSerialData(void* context);
+
+  /**
+   * Remove a serial data callback registered without a context
+   *
+   * @param callback The callback passed to receiveSerialData()
+   * @return true if the callback was removed
+   */
+  bool removeSerialDataCallback(SerialDataCallback callback);
+
+  /**
+   * Remove a raw byte callback registered without a context
+   *
+   * @param callback The callback passed to receiveSerialData()
+   * @return true if the callback was removed
+   */
+  bool removeSerialDataCallback(BinarySerialDataCallback callback);
+
+  /**
+   * Forward local serial input to all boards automatically
+   *
+   * Input is read from the UART receive event, not from update().
+   *
+   * @param enable true to enable, false to disable
+   * @return true if the setting was applied successfully
+   */
+  bool enableAutoForwarding(bool enable);
+
+  /**
+   * Set the UART whose input is forwarded, Serial by default
+   *
+   * @param port The UART, e.g. &Serial2
+   * @return true if the port was set successfully
+   */
+  bool setAutoForwardingPort(HardwareSerial* port);
+
+  /**
+   * Set when buffered serial input is forwarded
+   *
+   * @param idleGapUs Forward once the line has been idle this long, 0 to
+   * forward whatever each receive event delivers
+   * @param sizeThreshold Forward once this many bytes are buffered
+   * @param delimiters Forward after any of these bytes, or NULL for none
+   * @return true if the policy was applied successfully
+   */
+  bool setAutoForwardingFlush(uint32_t idleGapUs, size_t sizeThreshold,
+                              const char* delimiters);
+
+  /**
+   * Open a numbered virtual serial channel
+   *
+   * @param channel Channel number, 1 to 255
+   * @param targets Boards at the other end, or NULL for all boards
+   * @param targetCount Number of targets, at most MAX_SERIAL_CHANNEL_TARGETS
+   * @return true if the channel was opened successfully
+   */
+  bool openSerialChannel(uint8_t channel, const char* const* targets,
+                         uint8_t targetCount);
+
+  /**
+   * Open a numbered virtual serial channel to a single board
+   *
+   * @param channel Channel number, 1 to 255
+   * @param target The board at the other end, or NULL for all boards
+   * @return true if the channel was opened successfully
+   */
+  bool openSerialChannel(uint8_t channel, const char* target);
+
+  /**
+   * Close a virtual serial channel
+   *
+   * @param channel Channel number
+   * @return true if the channel was closed
+   */
+  bool closeSerialChannel(uint8_t channel);
+
+  /**
+   * Send bytes on a virtual serial channel
+   *
+   * @param channel Channel number
+   * @param data The bytes to send, may contain any value
+   * @param length Number of bytes
+   * @return true if the data was sent to every target
+   */
+  bool writeSerialChannel(uint8_t channel, const uint8_t* data, size_t length);
+
+  /**
+   * Read bytes buffered on a virtual serial channel
+   *
+   * @param channel Channel number
+   * @param buffer Buffer for the bytes
+   * @param length Size of the buffer
+   * @return The number of bytes read
+   */
+  size_t readSerialChannel(uint8_t channel, uint8_t* buffer, size_t length);
+
+  /**
+   * Get the number of bytes buffered on a virtual serial channel
+   *
+   * @param channel Channel number
+   * @return The number of bytes available
+   */
+  int serialChannelAvailable(uint8_t channel);
+
+  /**
+   * Receive the data of a virtual serial channel with a callback
+   *
+   * @param channel Channel number
+   * @param callback Function to call with received data, or NULL to buffer
+   * it instead
+   * @return true if the callback was set successfully
+   */
+  bool receiveSerialChannel(uint8_t channel,
+                            BinarySerialDataCallback callback);
+
+  /**
+   * Receive the data of a virtual serial channel with a callback that
+   * receives a user context
+   *
+   * @param channel Channel number
+   * @param callback Function to call with received data
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was set successfully
+   */
+  bool receiveSerialChannel(uint8_t channel,
+                            BinarySerialDataContextCallback callback,
+                            void* context);
+
+  /**
+   * Bridge a virtual serial channel to a UART, serviced from update()
+   *
+   * @param channel Channel number
+   * @param port The UART, or NULL to stop bridging
+   * @return true if the setting was applied successfully
+   */
+  bool bridgeSerialChannel(uint8_t channel, HardwareSerial* port);
+
+  /**
+   * Get the counters of a virtual serial channel
+   *
+   * @param channel Channel number
+   * @param stats Filled with the counters
+   * @return true if the channel is open
+   */
+  bool getSerialChannelStats(uint8_t channel, SerialChannelStats& stats);
+
+  /**
+   * Open a reliable, ordered byte stream to another board
+   *
+   * Both boards open the stream to each other. Only one stream is open at
+   * a time.
+   *
+   * @param boardId The board at the other end
+   * @return true if the stream was opened successfully
+   */
+  bool openSerialStream(const char* boardId);
+
+  /**
+   * Close the stream, dropping any buffered data
+   *
+   * @return true if a stream was closed
+   */
+  bool closeSerialStream();
+
+  /**
+   * Check if a stream is open
+   *
+   * @return true if a stream is open, false otherwise
+   */
+  bool isSerialStreamOpen();
+
+  /**
+   * Queue bytes for the stream
+   *
+   * @param data The bytes to send, may contain any value
+   * @param length Number of bytes
+   * @return The number of bytes queued, fewer when the buffer is full
+   */
+  size_t writeSerialStream(const uint8_t* data, size_t length);
+
+  /**
+   * Read bytes received on the stream
+   *
+   * @param buffer Buffer for the bytes
+   * @param length Size of the buffer
+   * @return The number of bytes read
+   */
+  size_t readSerialStream(uint8_t* buffer, size_t length);
+
+  /**
+   * Get the number of received stream bytes waiting to be read
+   *
+   * @return The number of bytes available
+   */
+  int serialStreamAvailable();
+
+  /**
+   * Get the free space in the stream transmit buffer
+   *
+   * @return The number of bytes writeSerialStream() would take
+   */
+  int serialStreamWritable();
+
+  /**
+   * Send queued stream bytes now instead of from the next update()
+   *
+   * @return true if a stream is open
+   */
+  bool flushSerialStream();
+
+  /**
+   * Get the stream as an Arduino Stream
+   *
+   * Stream and Print based code, e.g. a command parser or a logger, can
+   * read and write the stream through it. Small writes are coalesced into
+   * full frames.
+   *
+   * @return The Stream adapter for the stream
+   */
+  NetworkStream& getSerialStream();
+
+  /**
+   * Bridge the stream to a UART, moving bytes both ways from update()
+   *
+   * @param port The UART, or NULL to stop bridging
+   * @return true if the setting was applied successfully
+   */
+  bool bridgeSerialStream(HardwareSerial* port);
+
   // ==================== Direct Messaging ====================
   /**
    * Send a direct message to a specific board
    *
    * @param targetBoardId The ID of the board to send the message to
    * @param message The message to send
-   * @return true if the message was sent successfully
+   * @param flags MESSAGE_QOS1 to retry until acknowledged,
+   * MESSAGE_STORE_AND_FORWARD to keep in flash until delivered, or 0
+   * @return true if the message was sent or queued successfully
    */
-  bool sendMessageToBoardId(const char* targetBoardId, const char* message);
+  bool sendMessageToBoardId(const char* targetBoardId, const char* message,
+                            uint8_t flags = 0);
+
+  /**
+   * Send raw bytes as a direct message to a specific board
+   *
+   * @param targetBoardId The ID of the board to send the message to
+   * @param data The payload, may contain NUL bytes
+   * @param length Number of payload bytes
+   * @param flags MESSAGE_QOS1 to retry until acknowledged,
+   * MESSAGE_STORE_AND_FORWARD to keep in flash until delivered, or 0
+   * @return true if the message was sent or queued successfully
+   */
+  bool sendMessageToBoardId(const char* targetBoardId, const uint8_t* data,
+                            size_t length, uint8_t flags = 0);
 
   /**
    * Receive direct messages from other boards
    *
+   * Up to MAX_DIRECT_MESSAGE_CALLBACKS callbacks receive every direct
+   * message.
+   * Each call adds a callback rather than replacing the last one. A NULL
+   * callback removes them all; a plain NULL matches both this and the
+   * binary overload, so call stopReceivingMessages() instead.
+   *
    * @param callback Function to call when a direct message is received
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool receiveMessagesFromBoards(MessageCallback callback);
 
+  /**
+   * Receive direct messages from other boards as raw bytes
+   *
+   * @param callback Function to call with a pointer into the receive buffer
+   * and the payload length
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(BinaryMessageCallback callback);
+
+  /**
+   * Receive direct messages with a callback that receives a user context
+   *
+   * @param callback Function to call when a direct message is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(MessageContextCallback callback,
+                                 void* context);
+
+  /**
+   * Receive direct messages as raw bytes with a callback that receives a
+   * user context
+   *
+   * @param callback Function to call when a direct message is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(BinaryMessageContextCallback callback,
+                                 void* context);
+
+  /**
+   * Stop receiving direct messages
+   *
+   * @return true if the callbacks were cleared successfully
+   */
+  bool stopReceivingMessages();
+
+  /**
+   * Remove the direct message callbacks registered with a context
+   *
+   * @param context The context passed to receiveMessagesFromBoards()
+   * @return true if a callback was removed
+   */
+  bool stopReceivingMessages(void* context);
+
+  /**
+   * Remove a direct message callback registered without a context
+   *
+   * @param callback The callback passed to receiveMessagesFromBoards()
+   * @return true if the callback was removed
+   */
+  bool removeMessageCallback(MessageCallback callback);
+
+  /**
+   * Remove a raw byte callback registered without a context
+   *
+   * @param callback The callback passed to receiveMessagesFromBoards()
+   * @return true if the callback was removed
+   */
+  bool removeMessageCallback(BinaryMessageCallback callback);
+
  private:
   // Core network instance
   NetworkCore _core;
@@ -414,7 +1564,15 @@ class NetworkComm {
   NetworkPinControl _pinControl;
   NetworkMessaging _messaging;
   NetworkSerial _serial;
+  NetworkStream _stream;
   NetworkDiagnostics _diagnostics;
+
+  // Allocated on first use by the MQTT gateway methods
+  NetworkGateway* _gateway;
+
+  // Helper methods
+  void startModules();
+  NetworkGateway* gateway();
 };
 
 #endif
\ No newline at end of file
@@ -11,11 +11,16 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 
-// Forward declaration
+// Forward declarations
 class NetworkDiscovery;
+class NetworkPinControl;
+class NetworkMessaging;
+class NetworkSerial;
 
 // Message types
 #define MSG_TYPE_PIN_CONTROL 1
@@ -27,15 +32,146 @@ class NetworkDiscovery;
 #define MSG_TYPE_DISCOVERY 7
 #define MSG_TYPE_DISCOVERY_RESPONSE 8
 #define MSG_TYPE_ACKNOWLEDGEMENT 9
+#define MSG_TYPE_PIN_SCHEDULE 10
+#define MSG_TYPE_PIN_SCHEDULE_RESULT 11
+#define MSG_TYPE_PIN_SEQUENCE 12
+#define MSG_TYPE_PIN_SEQUENCE_STATUS 13
+#define MSG_TYPE_PIN_GROUP 14
+#define MSG_TYPE_PIN_GROUP_ACK 15
+#define MSG_TYPE_BUS_TRANSACTION 16
+#define MSG_TYPE_BUS_RESPONSE 17
+#define MSG_TYPE_TOPIC_ANNOUNCE 18
+#define MSG_TYPE_TOPIC_INTEREST 19
+#define MSG_TYPE_TOPIC_RETAINED 20
+#define MSG_TYPE_STREAM_DATA 21
+#define MSG_TYPE_STREAM_ACK 22
+#define MSG_TYPE_SERIAL_CHANNEL 23
+#define MSG_TYPE_CLOCK_SYNC 24
+
+// Startup. begin() joins the access point from update() and gives up after
+// the timeout (ms), starting ESP-NOW alone on the default channel. With
+// enableWifiRetry() it then tries the access point again every retry
+// interval (ms).
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT 10000
+#endif
+#ifndef WIFI_RETRY_INTERVAL
+#define WIFI_RETRY_INTERVAL 60000
+#endif
+#ifndef ESPNOW_DEFAULT_CHANNEL
+#define ESPNOW_DEFAULT_CHANNEL 1
+#endif
+// Rate ESP-NOW frames are sent at, see setEspNowRate()
+#ifndef ESPNOW_PHY_RATE
+#define ESPNOW_PHY_RATE WIFI_PHY_RATE_1M_L
+#endif
+#define STARTUP_IDLE 0
+#define STARTUP_CONNECTING 1  // Joining the access point
+#define STARTUP_READY 2       // ESP-NOW is up
+#define STARTUP_FAILED 3      // ESP-NOW could not be started
 
 // Maximum number of peer boards
 #define MAX_PEERS 20
+// Peer liveness states, see NetworkDiscovery
+#define PEER_STATE_ALIVE 0    // Heard from within the suspect timeout
+#define PEER_STATE_SUSPECT 1   // Silent, being probed before it is dropped
+#define PEER_STATE_RESTORED 2  // From the peer cache, not heard since boot
 // Maximum ESP-NOW data size
 #define MAX_ESP_NOW_DATA_SIZE 250
 
+// Binary frames start with this byte; JSON frames always start with '{'
+#define BINARY_FRAME_MAGIC 0xB1
+// Binary frame flags
+#define BINARY_FRAME_HAS_MESSAGE_ID 0x01
+#define BINARY_FRAME_COMPRESSED 0x02  // Body packed with NetworkCore::compress
+// Magic, type, flags and sender length ahead of the sender ID
+#define BINARY_FRAME_HEADER_SIZE 4
+
+// Mesh frames wrap another frame for relaying beyond radio range:
+// [magic][ttl][hops][sequence (2)][origin length][origin]
+// [destination length][destination][frame]. An empty destination floods.
+#define MESH_FRAME_MAGIC 0xB2
+#define MESH_FRAME_HEADER_SIZE 7  // Fixed bytes, without the two board IDs
+#ifndef MESH_DEFAULT_TTL
+#define MESH_DEFAULT_TTL 4  // Transmissions before a frame is dropped
+#endif
+#define MAX_MESH_ROUTES 16
+#define MESH_ROUTE_TIMEOUT 60000  // Routes not refreshed for 60 s are unused
+#define MESH_DEDUPE_SIZE 32       // Recently seen frames, per board
+
+// Payload compression. Each binary frame body is compressed on its own, so
+// a lost frame never stalls the frames after it and no history is kept per
+// peer. Text messages for boards that decompress go in binary frames too.
+#ifndef COMPRESSION_MIN_SIZE
+#define COMPRESSION_MIN_SIZE 32  // Smaller bodies are always sent as they are
+#endif
+#define COMPRESSION_HASH_BITS 8    // Match finder table, 2^bits bytes of stack
+#define COMPRESSION_MAX_INPUT 255  // Positions in the table fit a byte
+// Types compressed by enableCompression(true) when sent in binary frames:
+// serial data and messages
+#define COMPRESSION_DEFAULT_TYPES                                         \
+  ((1UL << MSG_TYPE_SERIAL_DATA) | (1UL << MSG_TYPE_MESSAGE) |            \
+   (1UL << MSG_TYPE_DIRECT_MESSAGE) | (1UL << MSG_TYPE_TOPIC_RETAINED) |  \
+   (1UL << MSG_TYPE_STREAM_DATA) | (1UL << MSG_TYPE_SERIAL_CHANNEL))
+
+// Features a board advertises in its discovery messages, from what it is
+// set up to do at the time
+#define PEER_FEATURE_COMPRESSION 0x01   // Can decompress frame bodies
+#define PEER_FEATURE_PIN_CONTROL 0x02   // Accepts pin control
+#define PEER_FEATURE_MESSAGING 0x04     // Receives messages or topics
+#define PEER_FEATURE_SERIAL 0x08        // Receives serial data or a stream
+#define PEER_FEATURE_MESH_RELAY 0x10    // Relays frames for other boards
+#define PEER_FEATURE_BUS_PROXY 0x20     // Serves bus transaction batches
+#define LOCAL_PEER_FEATURES PEER_FEATURE_COMPRESSION  // Every board has these
+
+// Wire format version, raised on incompatible changes. Boards advertise it in
+// their capability record.
+#define NETWORK_PROTOCOL_VERSION 1
+
+// Capability record of a board: features, protocol version, firmware version,
+// a digest of its topic subscriptions and the services it offers
+#define FIRMWARE_VERSION_SIZE 12  // Including the terminator
+#define TOPIC_DIGEST_SIZE 8       // Bytes
+#define MAX_BOARD_SERVICES 4
+
 // Timeouts
 #define ACK_TIMEOUT 5000  // 5 seconds
 
+// Outbox for messages sent with QoS 1
+#ifndef MAX_OUTBOX_MESSAGES
+#define MAX_OUTBOX_MESSAGES 8
+#endif
+#ifndef MAX_OUTBOX_RECIPIENTS
+#define MAX_OUTBOX_RECIPIENTS 8  // Boards that must acknowledge a message
+#endif
+#if MAX_OUTBOX_RECIPIENTS > 32
+#error "MAX_OUTBOX_RECIPIENTS must fit the 32-bit acknowledgement mask"
+#endif
+#define OUTBOX_RETRY_INTERVAL 250   // First retry (ms), doubled per retry
+#define OUTBOX_MAX_RETRIES 4        // Retries before the message is dropped
+
+// Store-and-forward messages, kept in flash until the target acknowledges
+#ifndef MAX_STORED_MESSAGES
+#define MAX_STORED_MESSAGES 16
+#endif
+#define MAX_STORED_PER_BOARD 8          // Stored messages per target board
+#define STORED_RETRY_INTERVAL 5000      // Resend while the target is silent
+#define STORED_SEEN_RETRY_DELAY 1000    // Resend when the target is seen
+#define STORED_MESSAGE_LIFETIME 86400000UL  // Default lifetime, 24 hours
+#define STORED_MESSAGE_NAMESPACE "nc_store"  // Preferences (NVS) namespace
+// Message ages are written to flash this often, so that the lifetime
+// carries on after a reboot. A reboot counts as a full interval.
+#ifndef STORED_AGE_SAVE_INTERVAL
+#define STORED_AGE_SAVE_INTERVAL 60000
+#endif
+
+// Peer cache, known boards kept in flash across reboots. Changes are written
+// this long after the first one, coalescing bursts to limit flash wear.
+#ifndef PEER_CACHE_WRITE_DELAY
+#define PEER_CACHE_WRITE_DELAY 30000
+#endif
+#define PEER_CACHE_NAMESPACE "nc_peers"  // Preferences (NVS) namespace
+
 // Callback function types for send status
 typedef void (*SendStatusCallback)(const char* targetBoardId,
                                    uint8_t messageType, bool success);
@@ -43,6 +179,21 @@ typedef void (*SendFailureCallback)(const char* targetBoardId,
                                     uint8_t messageType, uint8_t pin,
                                     uint8_t value);
 
+// Callback slot kinds
+#define CALLBACK_NONE 0
+#define CALLBACK_PLAIN 0x01    // Called without a context
+#define CALLBACK_CONTEXT 0x02  // Called with its context as first argument
+#define CALLBACK_BINARY 0x04   // Takes a pointer and a length instead of text
+
+// A registered callback and the user context it is called with. Modules
+// store every callback flavour as a generic function pointer tagged with its
+// kind, so dispatch is a switch and one indirect call.
+struct CallbackSlot {
+  void (*function)();
+  void* context;
+  uint8_t kind;
+};
+
 class NetworkCore {
  public:
   /**
@@ -59,14 +210,65 @@ class NetworkCore {
   /**
    * Initialize the network communication
    *
+   * Returns at once; the board joins the access point in the background
+   * and starts ESP-NOW from update() once it is connected, on the access
+   * point's channel. If the access point is not reached within
+   * WIFI_CONNECT_TIMEOUT ms, ESP-NOW starts without it on
+   * ESPNOW_DEFAULT_CHANNEL and stays there; see enableWifiRetry() to try
+   * the access point again. isConnected() turns true when ESP-NOW is up.
+   * Subscriptions and other registrations may be made before that; they
+   * are announced to the other boards once ESP-NOW is up.
+   *
    * @param ssid WiFi network SSID to connect to
    * @param password WiFi network password
    * @param boardId Unique identifier for this board (must be unique on the
    * network)
-   * @return true if initialization was successful, false otherwise
+   * @return true if initialization was started successfully, false otherwise
    */
   bool begin(const char* ssid, const char* password, const char* boardId);
 
+  /**
+   * Initialize ESP-NOW without joining an access point
+   *
+   * The radio is set to a fixed channel and ESP-NOW starts straight away,
+   * so frames can be exchanged within milliseconds of boot. Every board
+   * must use the same channel; boards that joined an access point are on
+   * its channel.
+   *
+   * @param boardId Unique identifier for this board (must be unique on the
+   * network)
+   * @param channel WiFi channel, 1 to 14
+   * @return true if ESP-NOW was started successfully, false otherwise
+   */
+  bool beginEspNowOnly(const char* boardId,
+                       uint8_t channel = ESPNOW_DEFAULT_CHANNEL);
+
+  /**
+   * Try the access point again after begin() fell back to ESP-NOW only
+   *
+   * Off by default. Each attempt only looks for the access point on the
+   * channel ESP-NOW is on, so the board never leaves the boards it talks
+   * to; an access point on another channel is not joined. Joining can
+   * still keep the radio from hearing ESP-NOW frames for up to
+   * WIFI_CONNECT_TIMEOUT ms per attempt, long enough for peers to count
+   * the board as suspect, so use an interval well above the peer timeout.
+   *
+   * @param intervalMs Time between attempts, 0 to stop retrying
+   */
+  void enableWifiRetry(uint32_t intervalMs = WIFI_RETRY_INTERVAL);
+
+  /**
+   * Set the rate ESP-NOW frames are sent at
+   *
+   * Boards receive frames sent at any rate. Faster rates carry more data
+   * but reach less far. May be called before begin(); the rate is then set
+   * once ESP-NOW starts.
+   *
+   * @param rate The PHY rate, e.g. WIFI_PHY_RATE_2M_L
+   * @return true if the rate was set or stored until ESP-NOW starts
+   */
+  bool setEspNowRate(wifi_phy_rate_t rate);
+
   /**
    * Main loop function that must be called regularly
    *
@@ -78,10 +280,40 @@ class NetworkCore {
   /**
    * Check if the board is connected to the network
    *
-   * @return true if connected to WiFi and ESP-NOW is initialized
+   * ESP-NOW keeps working while the access point is out of reach, so this
+   * does not depend on the WiFi connection.
+   *
+   * @return true if ESP-NOW is initialized
    */
   bool isConnected();
 
+  /**
+   * Get the startup state
+   *
+   * @return STARTUP_IDLE before begin(), STARTUP_CONNECTING while joining
+   * the access point, STARTUP_READY once ESP-NOW is up, or STARTUP_FAILED
+   */
+  uint8_t getStartupState();
+
+  /**
+   * Get the time from begin() to the first frame sent
+   *
+   * @return Milliseconds until the radio reported the first frame sent, or
+   * -1 if no frame has been sent yet
+   */
+  int32_t getTimeToFirstFrame();
+
+  /**
+   * Get the current network time of this board
+   *
+   * Network time is the board's microsecond clock. Boards do not share it;
+   * scheduled pin commands convert target times with an estimate of the
+   * receiver's clock offset.
+   *
+   * @return The current network time in microseconds (wraps every ~71 min)
+   */
+  uint32_t getNetworkTime();
+
   // ==================== Message Handling ====================
   /**
    * Enable or disable message acknowledgements
@@ -124,11 +356,237 @@ class NetworkCore {
    */
   bool registerDiscoveryHandler(NetworkDiscovery* discovery);
 
+  /**
+   * Register the PinControl instance to handle pin control messages
+   *
+   * @param pinControl Pointer to the NetworkPinControl instance
+   * @return true if registered successfully
+   */
+  bool registerPinControlHandler(NetworkPinControl* pinControl);
+
+  /**
+   * Register the Messaging instance to handle topic and direct messages
+   *
+   * @param messaging Pointer to the NetworkMessaging instance
+   * @return true if registered successfully
+   */
+  bool registerMessagingHandler(NetworkMessaging* messaging);
+
+  /**
+   * Register the Serial instance to handle serial data messages
+   *
+   * @param serial Pointer to the NetworkSerial instance
+   * @return true if registered successfully
+   */
+  bool registerSerialHandler(NetworkSerial* serial);
+
+  // ==================== Mesh Relay ====================
+  /**
+   * Enable or disable multi-hop mesh relaying
+   *
+   * When enabled, messages for boards that are not in radio range are
+   * relayed by other boards, and broadcasts are flooded across the mesh.
+   * Every board that should relay or reach boards out of range must enable
+   * it.
+   *
+   * @param enable true to relay and route frames, false to stay single-hop
+   * @param ttl Maximum number of transmissions of a frame, 1 to 15
+   * @return true if the setting was applied successfully
+   */
+  bool enableMeshRelay(bool enable, uint8_t ttl = MESH_DEFAULT_TTL);
+
+  /**
+   * Check if mesh relaying is enabled
+   *
+   * @return true if mesh relaying is enabled, false otherwise
+   */
+  bool isMeshRelayEnabled();
+
+  /**
+   * Get the number of hops to a board
+   *
+   * @param boardId The board to look up
+   * @return 1 for boards in radio range, the learned hop count for boards
+   * reached through relays, or -1 if no route is known
+   */
+  int getHopCount(const char* boardId);
+
+  // ==================== Store and Forward ====================
+  /**
+   * Set the lifetime of messages stored from now on
+   *
+   * Stored messages that are not acknowledged within their lifetime are
+   * dropped and reported through the onSendFailure callback. The lifetime
+   * counts the time this board runs and carries on across reboots; each
+   * reboot may charge up to STORED_AGE_SAVE_INTERVAL ms extra, never less.
+   *
+   * @param lifetimeMs Lifetime in milliseconds
+   * @return true if the setting was applied successfully
+   */
+  bool setStoredMessageLifetime(uint32_t lifetimeMs);
+
+  /**
+   * Get the number of stored messages waiting for delivery
+   *
+   * @param boardId Count only messages for this board, or NULL for all
+   * @return The number of stored messages
+   */
+  int getStoredMessageCount(const char* boardId = NULL);
+
+  /**
+   * Drop every stored message for a board
+   *
+   * @param boardId The target board, or NULL for all boards
+   * @return true if the messages were dropped successfully
+   */
+  bool clearStoredMessages(const char* boardId = NULL);
+
+  // ==================== Peer Cache ====================
+  /**
+   * Enable or disable the peer cache in flash
+   *
+   * Known boards, with their MAC address, channel and capability record,
+   * are kept in flash and restored by begin(), so messages to them go out
+   * straight after a reboot. Enabled by default; call before begin() to
+   * start without the cached boards.
+   *
+   * @param enable true to enable the cache, false to disable it
+   * @return true if the setting was applied successfully
+   */
+  bool enablePeerCache(bool enable);
+
+  /**
+   * Write pending peer cache changes to flash now
+   *
+   * Changes are otherwise written PEER_CACHE_WRITE_DELAY ms after the first
+   * one, so a burst of discovery costs one write per board. Call this
+   * before deep sleep or a planned restart.
+   *
+   * @return true if the cache is up to date in flash
+   */
+  bool savePeerCache();
+
+  /**
+   * Erase the peer cache from flash
+   *
+   * The boards currently known stay available, and are written again when
+   * they change.
+   *
+   * @return true if the cache was erased successfully
+   */
+  bool clearPeerCache();
+
+  // ==================== Compression ====================
+  /**
+   * Enable or disable payload compression for serial data and messages
+   *
+   * Binary frame bodies are compressed before sending when the target
+   * advertised support in discovery and the body gets smaller; anything
+   * else is sent as it is. Text publishTopic() and sendMessageToBoardId()
+   * messages for such targets are sent in binary frames, so they are
+   * compressed too; other JSON frames are not. Compression is chosen per
+   * message type, not per peer or channel.
+   * Broadcasts are sent uncompressed unless enabled with
+   * setBroadcastCompression(). Received frames are always decompressed.
+   *
+   * @param enable true to compress the default types, false for none
+   * @return true if the setting was applied successfully
+   */
+  bool enableCompression(bool enable);
+
+  /**
+   * Enable or disable compression for a single message type
+   *
+   * @param messageType The message type, e.g. MSG_TYPE_SERIAL_DATA
+   * @param enable true to compress frames of this type
+   * @return true if the setting was applied successfully
+   */
+  bool setCompression(uint8_t messageType, bool enable);
+
+  /**
+   * Allow compressed broadcasts
+   *
+   * A broadcast reaches boards that have not been discovered yet, which may
+   * not decompress it, so broadcasts are sent uncompressed by default. When
+   * enabled, they are compressed if every known peer can decompress them.
+   * Only enable this when every board in range runs with compression
+   * support.
+   *
+   * @param enable true to compress broadcasts
+   * @return true if the setting was applied successfully
+   */
+  bool setBroadcastCompression(bool enable);
+
+  /**
+   * Check if compression is enabled for a message type
+   *
+   * @param messageType The message type, or 0 for any type
+   * @return true if compression is enabled, false otherwise
+   */
+  bool isCompressionEnabled(uint8_t messageType = 0);
+
+  /**
+   * Get the bytes handed to the compressor and the bytes sent for them
+   *
+   * Only frame bodies of compressed types sent to capable peers are counted,
+   * incompressible bodies included.
+   *
+   * @param payloadBytes Set to the body bytes before compression
+   * @param sentBytes Set to the body bytes put on air
+   * @return true if the statistics were read successfully
+   */
+  bool getCompressionStats(uint32_t& payloadBytes, uint32_t& sentBytes);
+
+  /**
+   * Compress a buffer with the frame body compressor
+   *
+   * A byte-oriented LZ77 variant with a one-byte window, sized for ESP-NOW
+   * frames. It uses a 256 byte table on the stack and no heap.
+   *
+   * @param data The data to compress, at most COMPRESSION_MAX_INPUT bytes
+   * @param length The number of bytes to compress
+   * @param output Buffer for the compressed data
+   * @param capacity Size of the output buffer
+   * @return The compressed length, or 0 if the data did not get smaller
+   */
+  static size_t compress(const uint8_t* data, size_t length, uint8_t* output,
+                         size_t capacity);
+
+  /**
+   * Decompress a buffer produced by compress()
+   *
+   * @param data The compressed data
+   * @param length The number of compressed bytes
+   * @param output Buffer for the decompressed data
+   * @param capacity Size of the output buffer
+   * @return The decompressed length, or 0 if the data is malformed or does
+   * not fit
+   */
+  static size_t decompress(const uint8_t* data, size_t length,
+                           uint8_t* output, size_t capacity);
+
  protected:
   // Board identification
   char _boardId[32];
   uint8_t _macAddress[6];
   bool _isConnected;
+
+  // Startup state machine, see begin()
+  uint8_t _startupState;
+  bool _espNowOnly;
+  uint32_t _beginTime;
+  wifi_phy_rate_t _espNowRate;
+
+  // Access point to retry after falling back to ESP-NOW only
+  char _ssid[33];
+  char _password[65];
+  uint32_t _wifiRetryInterval;  // 0 when not retrying
+  bool _wifiRetrying;
+  uint32_t _wifiRetryTime;  // Start of the current or last attempt
+  uint8_t _wifiRetryChannel;  // ESP-NOW channel the attempt keeps to
+  uint32_t _firstFrameTime;
+  volatile bool _firstFrameSent;  // Set from the send callback
+  bool _firstFrameReported;
   bool _acknowledgementsEnabled;
   bool _debugLoggingEnabled;
   bool _verboseLoggingEnabled;
@@ -156,33 +614,265 @@ class NetworkCore {
     uint8_t macAddress[6];
     bool active;
     uint32_t lastSeen;
+    uint8_t channel;   // WiFi channel it was seen on
+    uint8_t features;  // PEER_FEATURE_* flags from its discovery messages
+    uint8_t state;     // PEER_STATE_*
+    uint8_t probes;    // Probes sent since the peer became suspect
+    bool cacheDirty;   // Changed since it was written to the peer cache
+
+    // Cached capability record
+    uint16_t record;   // Hash of the record, 0 until it is received
+    uint8_t version;   // Protocol version, 0 if unknown
+    char firmware[FIRMWARE_VERSION_SIZE];
+    uint8_t topics[TOPIC_DIGEST_SIZE];      // Bloom filter of subscriptions
+    uint16_t services[MAX_BOARD_SERVICES];  // hash16 of the service names
+    uint8_t serviceCount;
   };
 
   PeerInfo _peers[MAX_PEERS];
   int _peerCount;
 
+  // QoS 1 messages awaiting acknowledgement
+  struct OutboxEntry {
+    uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+    uint8_t length;
+    uint8_t messageType;
+    char messageId[37];
+    char recipients[MAX_OUTBOX_RECIPIENTS][32];
+    uint8_t recipientCount;
+    uint32_t ackedMask;  // Bit per recipient
+    uint8_t retries;
+    uint32_t sentTime;
+    bool active;
+  };
+
+  OutboxEntry _outbox[MAX_OUTBOX_MESSAGES];
+  portMUX_TYPE _outboxLock;
+
+  // Store-and-forward messages. The frames live in flash, one preallocated
+  // key per slot; RAM holds the index used for ordering and expiry.
+  struct StoredRecord {
+    uint32_t sequence;  // Storage order, kept across reboots
+    uint32_t lifetime;
+    char target[32];
+    char messageId[37];
+    uint8_t messageType;
+    uint8_t length;
+    uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  };
+
+  struct StoredEntry {
+    char target[32];
+    char messageId[37];
+    uint8_t messageType;
+    uint32_t sequence;
+    uint32_t storedAt;  // now - storedAt is the age, kept across reboots
+    uint32_t lifetime;
+    uint32_t lastAttempt;
+    bool acknowledged;
+    bool flooded;  // Sent once by mesh flooding, for want of a route
+    bool used;
+  };
+
+  // Ages of the stored messages, saved under one key. The sequence tells
+  // whether an age belongs to the record now in the slot.
+  struct StoredAge {
+    uint32_t sequence;
+    uint32_t age;
+  };
+
+  StoredEntry _stored[MAX_STORED_MESSAGES];
+  uint32_t _storedSequence;
+  uint32_t _storedAgesSaved;  // When the ages were last written
+  uint32_t _storedLifetime;
+  int _storedCount;
+  Preferences _storedPreferences;
+  bool _storedPreferencesOpen;
+  portMUX_TYPE _storedLock;
+
+  // Peer cache. Each peer slot has its own flash record, so a change to one
+  // board rewrites only that record.
+  struct PeerCacheRecord {
+    char boardId[32];
+    uint8_t macAddress[6];
+    uint8_t channel;
+    uint8_t features;
+    uint16_t record;
+    uint8_t version;
+    char firmware[FIRMWARE_VERSION_SIZE];
+    uint8_t topics[TOPIC_DIGEST_SIZE];
+    uint16_t services[MAX_BOARD_SERVICES];
+    uint8_t serviceCount;
+  };
+
+  Preferences _peerCachePreferences;
+  bool _peerCacheEnabled;
+  bool _peerCacheOpen;
+  bool _peerCacheDirty;
+  uint32_t _peerCacheDirtySince;
+
+  // Mesh relay state. Routes are learned from the origin and the last relay
+  // of every mesh frame; the dedupe ring drops frames already handled.
+  struct MeshRoute {
+    char boardId[32];
+    uint8_t nextHop[6];
+    uint8_t hops;
+    uint32_t lastSeen;
+    bool active;
+  };
+
+  struct MeshSeenFrame {
+    char origin[32];
+    uint16_t originHash;  // hash16 of origin, compared first
+    uint16_t sequence;
+  };
+
+  bool _meshEnabled;
+  uint8_t _meshTtl;
+  uint16_t _meshSequence;
+  MeshRoute _meshRoutes[MAX_MESH_ROUTES];
+  MeshSeenFrame _meshSeen[MESH_DEDUPE_SIZE];
+  uint8_t _meshSeenCount;
+  uint8_t _meshSeenNext;
+  portMUX_TYPE _meshLock;
+
+  // Compression: a bit per message type, and body bytes before and after
+  uint32_t _compressedTypes;
+  bool _compressBroadcasts;
+  uint32_t _compressionPayloadBytes;
+  uint32_t _compressionSentBytes;
+
   // ESP-NOW callbacks
   static void onDataSent(const uint8_t* mac_addr, esp_now_send_status_t status);
   static void onDataReceived(const uint8_t* mac, const uint8_t* data, int len);
 
   void handleSendStatus(const uint8_t* mac_addr, esp_now_send_status_t status);
   void processIncomingMessage(const uint8_t* mac, const uint8_t* data, int len);
+  void dispatchMessage(const uint8_t* mac, const JsonObject& doc,
+                       uint32_t receivedAt);
+  void processBinaryMessage(const uint8_t* data, size_t len,
+                            uint32_t receivedAt);
+  void processMeshFrame(const uint8_t* mac, const uint8_t* data, size_t len);
+  void dispatchBinaryMessage(const char* sender, uint8_t messageType,
+                             const char* messageId, const uint8_t* body,
+                             size_t length, uint32_t receivedAt);
 
   // Callbacks
   SendStatusCallback _sendStatusCallback;
   SendFailureCallback _sendFailureCallback;
 
+  // Fixed-capacity callback lists. Adding a callback that is already
+  // registered with the same context succeeds without adding it twice.
+  static bool addCallback(CallbackSlot* slots, int capacity,
+                          void (*function)(), void* context, uint8_t kind);
+  static bool removeCallbacks(CallbackSlot* slots, int capacity,
+                              void* context);
+  static bool removeCallback(CallbackSlot* slots, int capacity,
+                             void (*function)());
+
   // Helper methods for message handling
   void generateMessageId(char* buffer);
+  static uint16_t hash16(const char* text);
+  static uint16_t hash16(const char* data, size_t length);
+
+  // Bloom filter digests, two bits per entry, for sets of board IDs or
+  // topic filters sent in discovery messages
+  static void addToDigest(uint8_t* digest, size_t size, const char* text);
+  static bool digestContains(const uint8_t* digest, size_t size,
+                             const char* text);
+
+  // Hex encoding of binary fields in JSON frames
+  static void hexEncode(const uint8_t* data, size_t length, char* out);
+  static int hexDecode(const char* hex, uint8_t* out, size_t maxLength);
 
   bool sendMessage(const char* targetBoard, uint8_t messageType,
                    const JsonObject& doc);
   bool broadcastMessage(uint8_t messageType, const JsonObject& doc);
-
+  // Size of the frame a message encodes to, with the sender, the type and,
+  // if withMessageId is set, a message ID added
+  size_t measureJsonFrame(uint8_t messageType, const JsonObject& doc,
+                          bool withMessageId);
+
+  // Binary frames carry a type-specific header followed by the payload as
+  // raw bytes: [magic][type][flags][sender length][sender][message ID][body]
+  bool sendBinaryMessage(const char* targetBoard, uint8_t messageType,
+                         const uint8_t* header, size_t headerLength,
+                         const uint8_t* data, size_t length);
+  bool broadcastBinaryMessage(uint8_t messageType, const uint8_t* header,
+                              size_t headerLength, const uint8_t* data,
+                              size_t length);
+  // With compressBody set, the body is compressed if that makes it smaller
+  size_t buildBinaryFrame(uint8_t* frame, uint8_t messageType,
+                          const char* messageId, const uint8_t* header,
+                          size_t headerLength, const uint8_t* data,
+                          size_t length, bool compressBody = false);
+  // Compress frames of this type for the target, or all peers if NULL
+  bool shouldCompress(const char* targetBoard, uint8_t messageType);
+  bool startEspNow();
+  bool applyEspNowRate();
+  void updateStartup();
+  void updateWifiRetry();
+  bool registerBroadcastPeer();
+  bool registerEspNowPeer(const uint8_t* macAddress);
+  bool releaseEspNowPeer();
+  // With mesh relaying enabled, frames for boards out of range are routed and
+  // broadcasts are flooded unless relay is false
+  bool sendFrame(const char* targetBoard, const uint8_t* frame, size_t length,
+                 bool relay = true);
+
+  // Mesh relay helpers
+  bool sendMeshFrame(const uint8_t* mac, const char* destination,
+                     const uint8_t* frame, size_t length);
+  bool acceptMeshFrame(const char* origin, uint16_t sequence,
+                       const uint8_t* mac, uint8_t hops);
+  void learnMeshRoute(const char* boardId, const uint8_t* mac, uint8_t hops);
+  bool findMeshRoute(const char* boardId, uint8_t* mac, uint8_t* hops = NULL);
+
+  // QoS 1 delivery: the frame is kept in the outbox and resent to the
+  // recipients that have not acknowledged it. With broadcast set, the first
+  // transmission is a single broadcast.
+  bool sendReliableMessage(const char (*targets)[32], int targetCount,
+                           bool broadcast, uint8_t messageType,
+                           const JsonObject& doc);
+  bool sendReliableBinaryMessage(const char (*targets)[32], int targetCount,
+                                 bool broadcast, uint8_t messageType,
+                                 const uint8_t* header, size_t headerLength,
+                                 const uint8_t* data, size_t length);
+  size_t buildJsonFrame(uint8_t* frame, uint8_t messageType,
+                        const JsonObject& doc, const char* messageId);
+  bool queueOutboxFrame(const uint8_t* frame, size_t length,
+                        uint8_t messageType, const char* messageId,
+                        const char (*targets)[32], int targetCount,
+                        bool broadcast);
+  void updateOutbox();
+  bool acknowledgeOutbox(const char* sender, const char* messageId);
+
+  // Store-and-forward delivery: the frame is written to flash and sent, in
+  // order per board, whenever the target is seen, until it is acknowledged
+  bool storeMessage(const char* targetBoard, uint8_t messageType,
+                    const JsonObject& doc);
+  bool storeBinaryMessage(const char* targetBoard, uint8_t messageType,
+                          const uint8_t* header, size_t headerLength,
+                          const uint8_t* data, size_t length);
+  bool storeFrame(const char* targetBoard, uint8_t messageType,
+                  const char* messageId, const uint8_t* frame, size_t length);
+  void loadStoredMessages();
+  void updateStoredMessages();
+  void removeStoredMessage(int slot);
+  void saveStoredAges();
+  bool acknowledgeStored(const char* sender, const char* messageId);
+  void noteBoardSeen(const char* boardId);
+
+  bool isLocalBoard(const char* boardId);
+  bool isReachable(const char* boardId);
+  bool canSendTo(const char* boardId);
   bool getMacForBoardId(const char* boardId, uint8_t* macAddress);
   bool getBoardIdForMac(const uint8_t* macAddress, char* boardId);
 
   // Message acknowledgement handling
+  bool requiresAcknowledgement(uint8_t messageType);
+  void trackMessage(const char* messageId, const char* targetBoard,
+                    uint8_t messageType);
   void sendAcknowledgement(const char* sender, const char* messageId);
   void handleAcknowledgement(const char* sender, const char* messageId);
 
@@ -192,9 +882,19 @@ class NetworkCore {
 
   // Peer management
   bool addPeer(const char* boardId, const uint8_t* macAddress);
+  bool removePeer(const char* boardId);
+  void setPeerFeatures(const char* boardId, uint8_t features);
+
+  // Peer cache helpers
+  void loadPeerCache();
+  void updatePeerCache(bool force);
+  void markPeerDirty(int slot);
 
-  // Discovery handler
+  // Module handlers
   NetworkDiscovery* _discoveryHandler;
+  NetworkPinControl* _pinControlHandler;
+  NetworkMessaging* _messagingHandler;
+  NetworkSerial* _serialHandler;
 
   // Static instance pointer for callbacks
   static NetworkCore* _instance;
@@ -205,6 +905,7 @@ class NetworkCore {
   friend class NetworkMessaging;
   friend class NetworkSerial;
   friend class NetworkDiagnostics;
+  friend class NetworkGateway;
 };
 
 #endif
\ No newline at end of file
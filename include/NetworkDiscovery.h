@@ -11,13 +11,47 @@
 
 #include "NetworkCore.h"
 
-// Discovery broadcast interval (ms)
-#define INITIAL_DISCOVERY_INTERVAL 5000  // 5 seconds initially
-#define ACTIVE_DISCOVERY_INTERVAL 20000  // 20 seconds during active discovery
-#define STABLE_DISCOVERY_INTERVAL 60000  // 60 seconds after stable connection
+// Discovery broadcast interval (ms). It doubles after every broadcast and
+// drops back to the minimum when a board joins or is lost. Broadcasts go out
+// at a random point in the second half of the interval, so boards powered
+// on together do not stay in lockstep.
+#define DISCOVERY_INTERVAL_MIN 2000
+#ifndef DISCOVERY_INTERVAL_MAX
+#define DISCOVERY_INTERVAL_MAX 60000
+#endif
+
+// Peer liveness (ms). A peer silent for the suspect timeout is probed
+// PEER_PROBE_COUNT times, PEER_PROBE_INTERVAL apart, then dropped as lost.
+#ifndef PEER_SUSPECT_TIMEOUT
+#define PEER_SUSPECT_TIMEOUT (DISCOVERY_INTERVAL_MAX + 15000)
+#endif
+#define PEER_PROBE_COUNT 3
+#define PEER_PROBE_INTERVAL 2000
+#define PEER_CHECK_INTERVAL 500
+// Boards restored from the peer cache are probed after this much silence
+#define PEER_RESTORED_TIMEOUT 10000
+
+// Discovery responses go out after a random delay of up to this (ms), so the
+// boards hearing one broadcast do not all answer at once
+#define DISCOVERY_RESPONSE_DELAY_MAX 500
+#define MAX_PENDING_RESPONSES 8
+
+// Broadcasts carry a digest of the boards the sender knows, a Bloom filter
+// of their IDs; boards found in it do not respond. A sender whose peer table
+// is full says so, and the boards it does not know do not respond either.
+#define DISCOVERY_DIGEST_SIZE 16  // Bytes
+
+// Discovery messages carry a hash of the sender's capability record. The
+// record itself is only sent in responses, to boards whose copy is missing
+// or stale.
 
 // Callback function for discovery
 typedef void (*DiscoveryCallback)(const char* boardId);
+typedef void (*DiscoveryContextCallback)(void* context, const char* boardId);
+
+// Callbacks notified of a discovered board, and of a lost board
+#define MAX_DISCOVERY_CALLBACKS 4
+#define MAX_LOST_CALLBACKS 4
 
 class NetworkDiscovery {
  public:
@@ -37,7 +71,7 @@ class NetworkDiscovery {
 
   /**
    * Update function that must be called regularly
-   * This handles periodic discovery broadcasts
+   * This handles periodic discovery broadcasts and peer liveness checks
    */
   void update();
 
@@ -50,13 +84,77 @@ class NetworkDiscovery {
   bool broadcastPresence();
 
   /**
-   * Set a callback for when a new board is discovered
+   * Add a callback for when a new board is discovered
+   *
+   * Up to MAX_DISCOVERY_CALLBACKS callbacks are notified. Passing NULL
+   * removes all of them.
    *
    * @param callback Function to call when a new board is discovered
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool onBoardDiscovered(DiscoveryCallback callback);
 
+  /**
+   * Add a discovery callback that receives a user context
+   *
+   * @param callback Function to call when a new board is discovered
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool onBoardDiscovered(DiscoveryContextCallback callback, void* context);
+
+  /**
+   * Remove the discovery callbacks registered with a context
+   *
+   * @param context The context passed to onBoardDiscovered()
+   * @return true if a callback was removed
+   */
+  bool removeDiscoveryCallbacks(void* context);
+
+  /**
+   * Add a callback for when a board is lost
+   *
+   * A board is lost when it stays silent for the suspect timeout and does
+   * not answer the probes that follow. It is then dropped from the list of
+   * available boards. Passing NULL removes all lost callbacks.
+   *
+   * @param callback Function to call with the ID of the lost board
+   * @return true if the callback was added successfully
+   */
+  bool onBoardLost(DiscoveryCallback callback);
+
+  /**
+   * Add a lost board callback that receives a user context
+   *
+   * @param callback Function to call with the ID of the lost board
+   * @param context Passed to the callback as its first argument, and used
+   * by removeDiscoveryCallbacks()
+   * @return true if the callback was added successfully
+   */
+  bool onBoardLost(DiscoveryContextCallback callback, void* context);
+
+  /**
+   * Set how long a board may stay silent before it is probed
+   *
+   * Any frame from a board counts. Keep the timeout above
+   * DISCOVERY_INTERVAL_MAX, or idle boards are probed needlessly. A board
+   * is reported lost PEER_PROBE_COUNT probe intervals after that.
+   *
+   * @param timeoutMs The silence in milliseconds
+   * @return true if the setting was applied successfully
+   */
+  bool setPeerTimeout(uint32_t timeoutMs);
+
+  /**
+   * Check if a board has gone silent and is being probed
+   *
+   * Suspect boards are still available until they are lost.
+   *
+   * @param boardId The ID of the board to check
+   * @return true if the board is suspect, false otherwise
+   */
+  bool isBoardSuspect(const char* boardId);
+
   /**
    * Check if a specific board is available on the network
    *
@@ -80,15 +178,117 @@ class NetworkDiscovery {
    */
   String getAvailableBoardName(int index);
 
+  /**
+   * Advertise a service offered by this board, such as "thermostat"
+   *
+   * Up to MAX_BOARD_SERVICES services are carried in the capability record.
+   * They travel as hashes of their names, so names of any length cost two
+   * bytes each.
+   *
+   * @param service The name of the service
+   * @return true if the service is advertised
+   */
+  bool advertiseService(const char* service);
+
+  /**
+   * Stop advertising a service
+   *
+   * @param service The name of the service
+   * @return true if the service was advertised before
+   */
+  bool withdrawService(const char* service);
+
+  /**
+   * Set the firmware version carried in the capability record
+   *
+   * @param version Up to FIRMWARE_VERSION_SIZE - 1 characters, e.g. "1.4.2"
+   * @return true if the version was set successfully
+   */
+  bool setFirmwareVersion(const char* version);
+
+  /**
+   * Get the features a board advertised
+   *
+   * @param boardId The ID of the board
+   * @return The board's PEER_FEATURE_* flags, or 0 if it is not known
+   */
+  uint8_t getBoardFeatures(const char* boardId);
+
+  /**
+   * Get the wire format version a board runs
+   *
+   * @param boardId The ID of the board
+   * @return NETWORK_PROTOCOL_VERSION of the board, or 0 until its capability
+   * record has been received
+   */
+  uint8_t getBoardProtocolVersion(const char* boardId);
+
+  /**
+   * Get the firmware version a board advertised
+   *
+   * @param boardId The ID of the board
+   * @return The version, or empty string if the board has not set one
+   */
+  String getBoardFirmwareVersion(const char* boardId);
+
+  /**
+   * Check if a board offers a service
+   *
+   * @param boardId The ID of the board
+   * @param service The name of the service
+   * @return true if the board advertises the service
+   */
+  bool boardOffersService(const char* boardId, const char* service);
+
+  /**
+   * Get the number of boards offering a service
+   *
+   * @param service The name of the service
+   * @return The number of available boards advertising the service
+   */
+  int getBoardsWithServiceCount(const char* service);
+
+  /**
+   * Get a board offering a service by index
+   *
+   * @param service The name of the service
+   * @param index The index of the board (0 to getBoardsWithServiceCount()-1)
+   * @return The board ID as a String, or empty string if index is out of range
+   */
+  String getBoardWithService(const char* service, int index);
+
+  /**
+   * Check if a board may be subscribed to a topic filter
+   *
+   * The capability record carries a digest of the board's subscription
+   * filters, so the answer may be a false positive but never a false
+   * negative. Filters are compared as written, not matched against topics.
+   *
+   * @param boardId The ID of the board
+   * @param topicFilter The subscription filter, e.g. "sensors/#"
+   * @return true if the board may be subscribed to the filter
+   */
+  bool boardMaySubscribe(const char* boardId, const char* topicFilter);
+
   /**
    * Handle a discovery message from another board
    * Called internally by NetworkCore
    *
+   * The response is sent from update() after a random delay, and not at
+   * all if the digest shows that the sender already knows this board, or
+   * if the sender's peer table is full so it could not add this board.
+   *
    * @param senderId The ID of the board that sent the discovery message
    * @param senderMac The MAC address of the board that sent the discovery
    * message
+   * @param knownDigest The sender's known-peers digest, or NULL if the
+   * message has none
+   * @param senderFull true if the sender's peer table has no room for
+   * boards it does not know
    */
-  void handleDiscovery(const char* senderId, const uint8_t* senderMac);
+  void handleDiscovery(const char* senderId, const uint8_t* senderMac,
+                       const char* knownDigest = NULL,
+                       bool senderFull = false);
 
   /**
    * Add a peer to the list of known boards
@@ -99,18 +299,70 @@ class NetworkDiscovery {
    */
   bool addPeer(const char* boardId, const uint8_t* macAddress);
 
+  /**
+   * Handle the capability record fields of a discovery message
+   * Called internally by NetworkCore after the sender was added as a peer
+   *
+   * A message with the full record updates the cached copy. A message with
+   * only the record hash asks the sender for its record if the cached copy
+   * is missing or stale.
+   *
+   * @param senderId The ID of the board that sent the message
+   * @param doc The received message
+   */
+  void handleRecord(const char* senderId, const JsonObject& doc);
+
  private:
   // Reference to the core network instance
   NetworkCore& _core;
 
-  // Discovery callback
-  DiscoveryCallback _discoveryCallback;
+  // Discovery and lost board callbacks
+  CallbackSlot _discoveryCallbacks[MAX_DISCOVERY_CALLBACKS];
+  CallbackSlot _lostCallbacks[MAX_LOST_CALLBACKS];
 
   // Discovery state
-  uint32_t _lastDiscoveryBroadcast;
-  bool _firstMinuteDiscovery;
-  bool _firstFiveMinutesDiscovery;
-  uint32_t _discoveryStartTime;
+  uint32_t _discoveryInterval;
+  uint32_t _nextDiscoveryBroadcast;
+  uint16_t _advertisedRecord;  // Record hash of our last broadcast
+
+  // Liveness state
+  uint32_t _peerTimeout;
+  uint32_t _lastPeerCheck;
+
+  // Capability record of this board
+  uint16_t _services[MAX_BOARD_SERVICES];  // hash16 of the service names
+  uint8_t _serviceCount;
+  char _firmwareVersion[FIRMWARE_VERSION_SIZE];
+
+  // Discovery responses waiting for their random delay, and requests for
+  // another board's record. Queued from the receive path, sent from update().
+  struct PendingResponse {
+    char boardId[32];
+    uint32_t dueTime;
+    bool recordRequest;  // Ask for the board's record instead of answering
+    bool active;
+  };
+
+  PendingResponse _pendingResponses[MAX_PENDING_RESPONSES];
+  portMUX_TYPE _responseLock;
+
+  // Helper methods
+  void scheduleDiscovery(uint32_t currentTime);
+  void speedUpDiscovery();
+  void checkPeers(uint32_t currentTime);
+  bool probePeer(const char* boardId);
+  void notifyBoardLost(const char* boardId);
+  bool queuePending(const char* boardId, uint32_t dueTime,
+                    bool recordRequest);
+  void sendPendingResponses(uint32_t currentTime);
+  bool sendDiscoveryResponse(const char* boardId);
+  void buildKnownDigest(char* hex);
+  bool knownDigestContains(const char* hex, const char* boardId);
+  bool isPeerTableFull();
+  uint8_t localFeatures();
+  uint16_t localRecord(uint8_t* topics);
+  void addRecord(JsonObject doc, bool full);
+  NetworkCore::PeerInfo* findPeer(const char* boardId);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+/**
+ * NetworkGateway.h - MQTT gateway for ESP32 network communication
+ * Created as part of the NetworkComm library refactoring
+ *
+ * This class bridges selected ESP-NOW topics to an MQTT broker and back.
+ */
+
+#ifndef NetworkGateway_h
+#define NetworkGateway_h
+
+#include <PubSubClient.h>
+
+#include "NetworkCore.h"
+#include "NetworkMessaging.h"
+
+// Bridge routes in each direction
+#define MAX_GATEWAY_ROUTES 4
+
+// Outbound publishes waiting for the broker
+#ifndef MQTT_GATEWAY_BACKLOG
+#define MQTT_GATEWAY_BACKLOG 16
+#endif
+#define MQTT_GATEWAY_TOPIC_SIZE 64     // MQTT topic bytes, prefix included
+#define MQTT_GATEWAY_PAYLOAD_SIZE 200  // Payload bytes per publish
+
+// Batching and reconnects
+#define MQTT_GATEWAY_BATCH_SIZE 8         // Publishes sent per update()
+#define MQTT_GATEWAY_FLUSH_INTERVAL 20    // Longest wait for a batch (ms)
+#define MQTT_GATEWAY_RECONNECT_MIN 1000   // First reconnect delay (ms)
+#define MQTT_GATEWAY_RECONNECT_MAX 60000  // Longest reconnect delay (ms)
+#define MQTT_GATEWAY_SOCKET_TIMEOUT 2     // Broker connect timeout (s)
+
+class NetworkGateway {
+ public:
+  /**
+   * Constructor for NetworkGateway
+   *
+   * @param core Reference to the NetworkCore instance
+   * @param messaging Reference to the NetworkMessaging instance
+   */
+  NetworkGateway(NetworkCore& core, NetworkMessaging& messaging);
+
+  /**
+   * Initialize the gateway service
+   *
+   * @return true if initialization was successful
+   */
+  bool begin();
+
+  /**
+   * Update function to be called in the main loop
+   *
+   * Connects to the broker, flushes queued publishes in batches and
+   * delivers messages from the broker.
+   */
+  void update();
+
+  /**
+   * Use a different network client for the broker connection
+   *
+   * The gateway uses a WiFiClient by default. Any Arduino Client works,
+   * e.g. a TLS client or a socket client in a host build.
+   *
+   * @param client The client, which must outlive the gateway
+   * @return true if the client was set successfully
+   */
+  bool setMqttClient(Client& client);
+
+  /**
+   * Start bridging to an MQTT broker
+   *
+   * The connection is made from update(), and remade with a doubling delay
+   * whenever it drops.
+   *
+   * @param host The broker host name or address
+   * @param port The broker port
+   * @param clientId The MQTT client ID, or NULL to use the board ID
+   * @param username The user name, or NULL for none
+   * @param password The password, or NULL for none
+   * @return true if the gateway was started successfully
+   */
+  bool startMqttGateway(const char* host, uint16_t port = 1883,
+                        const char* clientId = NULL,
+                        const char* username = NULL,
+                        const char* password = NULL);
+
+  /**
+   * Stop bridging and disconnect from the broker
+   *
+   * Routes are kept; queued publishes are dropped.
+   *
+   * @return true if the gateway was stopped successfully
+   */
+  bool stopMqttGateway();
+
+  /**
+   * Check if the gateway is connected to the broker
+   *
+   * @return true if connected, false otherwise
+   */
+  bool isMqttConnected();
+
+  /**
+   * Bridge ESP-NOW topics to the broker
+   *
+   * Messages on topics matching the filter are published to the broker
+   * under mqttPrefix followed by the topic, e.g. "sensors/temp" with the
+   * prefix "espnow/" becomes "espnow/sensors/temp".
+   *
+   * @param topicFilter ESP-NOW topic filter, may use + and # wildcards
+   * @param mqttPrefix Prefix for the MQTT topic, may be empty
+   * @return true if the route was added successfully
+   */
+  bool bridgeTopicToMqtt(const char* topicFilter, const char* mqttPrefix);
+
+  /**
+   * Bridge MQTT topics to ESP-NOW
+   *
+   * Messages on MQTT topics starting with mqttPrefix are published on
+   * ESP-NOW with mqttPrefix replaced by topicPrefix. Keep the prefix apart
+   * from the outbound prefixes, or messages loop back to the broker.
+   *
+   * @param mqttPrefix MQTT topic prefix, empty or ending in '/'
+   * @param topicPrefix Prefix for the ESP-NOW topic, may be empty
+   * @return true if the route was added successfully
+   */
+  bool bridgeTopicFromMqtt(const char* mqttPrefix, const char* topicPrefix);
+
+  /**
+   * Remove all bridge routes
+   *
+   * @return true if the routes were removed successfully
+   */
+  bool clearGatewayRoutes();
+
+  /**
+   * Get the number of publishes waiting for the broker
+   *
+   * @return The number of queued publishes
+   */
+  int getGatewayBacklog();
+
+  /**
+   * Get the number of publishes dropped because the backlog was full
+   *
+   * @return The number of dropped publishes since initialization
+   */
+  uint32_t getGatewayDropped();
+
+ private:
+  // References to the core network and messaging instances
+  NetworkCore& _core;
+  NetworkMessaging& _messaging;
+
+  // Broker connection
+  WiFiClient _wifiClient;
+  PubSubClient _mqtt;
+  char _host[64];
+  uint16_t _port;
+  char _clientId[32];
+  char _username[32];
+  char _password[64];
+  bool _started;
+  bool _subscribed;  // Inbound routes subscribed on this connection
+  uint32_t _lastConnectAttempt;
+  uint32_t _reconnectDelay;
+
+  // Bridge routes
+  struct GatewayRoute {
+    NetworkGateway* gateway;
+    char filter[32];  // ESP-NOW filter (out) or MQTT prefix (in)
+    char prefix[32];  // MQTT prefix (out) or ESP-NOW prefix (in)
+    bool active;
+  };
+
+  GatewayRoute _outboundRoutes[MAX_GATEWAY_ROUTES];
+  GatewayRoute _inboundRoutes[MAX_GATEWAY_ROUTES];
+
+  // Publishes queued from the ESP-NOW receive path. The oldest is dropped
+  // when the backlog is full.
+  struct QueuedPublish {
+    char topic[MQTT_GATEWAY_TOPIC_SIZE];
+    uint8_t payload[MQTT_GATEWAY_PAYLOAD_SIZE];
+    uint8_t length;
+  };
+
+  QueuedPublish _backlog[MQTT_GATEWAY_BACKLOG];
+  uint8_t _backlogHead;
+  uint8_t _backlogCount;
+  uint32_t _backlogSince;  // When the oldest queued publish arrived
+  uint32_t _dropped;
+  portMUX_TYPE _backlogLock;
+
+  // Set while publishing a message from the broker on ESP-NOW
+  bool _bridgingInbound;
+
+  // Helper methods
+  bool connectToBroker();
+  void subscribeInboundRoutes();
+  void flushBacklog();
+  void enqueuePublish(const GatewayRoute& route, const char* topic,
+                      const uint8_t* data, size_t length);
+  void handleMqttMessage(const char* topic, const uint8_t* payload,
+                         unsigned int length);
+  static void onBridgedTopic(void* context, const char* sender,
+                             const char* topic, const uint8_t* data,
+                             size_t length);
+};
+
+#endif
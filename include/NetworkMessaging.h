@@ -12,11 +12,68 @@
 #include "NetworkCore.h"
 
 // Maximum number of topic subscriptions
+#ifndef MAX_TOPIC_SUBSCRIPTIONS
 #define MAX_TOPIC_SUBSCRIPTIONS 20
+#endif
+
+// Subscription trie nodes, must be a power of two. Raise together with
+// MAX_TOPIC_SUBSCRIPTIONS for large subscription sets.
+#ifndef MAX_TOPIC_TRIE_NODES
+#define MAX_TOPIC_TRIE_NODES 64
+#endif
+
+// Interest-based publishing
+#define MAX_TOPIC_INTERESTS 32        // Peer subscriptions a publisher tracks
+#define MAX_TOPIC_UNICAST_PEERS 8     // Highest unicast threshold
+#define TOPIC_UNICAST_THRESHOLD 1     // Default peers reached by unicast
+#define TOPIC_INTEREST_REFRESH 30000  // Re-advertise subscriptions (ms)
+#define TOPIC_INTEREST_TIMEOUT 95000  // Forget unrefreshed interests (ms)
+#define TOPIC_INTEREST_PAYLOAD 160    // Filter bytes per advertisement frame
+
+// Interested boards collected for one publish, for QoS 0 or QoS 1
+#define MAX_TOPIC_TARGETS                                                  \
+  (MAX_OUTBOX_RECIPIENTS > MAX_TOPIC_UNICAST_PEERS ? MAX_OUTBOX_RECIPIENTS \
+                                                   : MAX_TOPIC_UNICAST_PEERS)
+
+// Topic levels matched per message
+#define MAX_TOPIC_LEVELS 16
+// Subscriptions a single message is delivered to: all of them can match
+#define MAX_TOPIC_DELIVERIES MAX_TOPIC_SUBSCRIPTIONS
+
+// Interned topic table size, must be a power of two
+#define MAX_TOPIC_IDS 32
+#define TOPIC_NAME_REPEATS 3         // Frames carrying a topic's name
+#define TOPIC_ANNOUNCE_INTERVAL 250  // Queries answered at most this often
+
+// Retained values kept for topics this board publishes
+#ifndef MAX_RETAINED_TOPICS
+#define MAX_RETAINED_TOPICS 8
+#endif
+#ifndef MAX_RETAINED_SIZE
+#define MAX_RETAINED_SIZE 128  // Bytes per retained value
+#endif
+
+// Publish and send flags
+#define PUBLISH_RETAINED 0x01  // Keep as the topic's last value
+#define MESSAGE_QOS1 0x02      // Retry until every recipient acknowledges
+#define MESSAGE_STORE_AND_FORWARD 0x04  // Keep in flash until acknowledged
 
 // Callback function types
 typedef void (*MessageCallback)(const char* sender, const char* topic,
                                 const char* message);
+typedef void (*BinaryMessageCallback)(const char* sender, const char* topic,
+                                      const uint8_t* data, size_t length);
+
+// Callbacks carrying a user context, e.g. the object a message is meant for
+typedef void (*MessageContextCallback)(void* context, const char* sender,
+                                       const char* topic, const char* message);
+typedef void (*BinaryMessageContextCallback)(void* context, const char* sender,
+                                             const char* topic,
+                                             const uint8_t* data,
+                                             size_t length);
+
+// Callbacks a direct message is delivered to
+#define MAX_DIRECT_MESSAGE_CALLBACKS 4
 
 class NetworkMessaging {
  public:
@@ -34,58 +91,259 @@ class NetworkMessaging {
    */
   bool begin();
 
+  /**
+   * Update function that must be called regularly
+   * This advertises our subscriptions and expires stale peer interests
+   */
+  void update();
+
   // ==================== Topic-based Messaging ====================
   /**
    * Publish a message to a topic that all boards can subscribe to
    *
-   * @param topic The topic to publish to
+   * Boards advertise their subscriptions, so the message is sent by unicast
+   * to the interested boards when there are no more of them than the
+   * unicast threshold, and broadcast otherwise. Nothing is sent when no
+   * other board is interested. For TOPIC_INTEREST_REFRESH ms after startup,
+   * and after an interest had to be dropped from a full table, messages are
+   * broadcast since subscribers may not have been heard from yet.
+   *
+   * With PUBLISH_RETAINED the message is also kept as the topic's last
+   * value and sent to boards that subscribe later. Publishing an empty
+   * retained message clears the value.
+   *
+   * Messages are sent with QoS 0 by default: no acknowledgement and no
+   * tracking. With MESSAGE_QOS1 the message is kept in a bounded outbox and
+   * retried until every interested board acknowledges it; the send failure
+   * callback reports boards that never do. QoS 1 covers at most
+   * MAX_OUTBOX_RECIPIENTS subscribers; with more, nothing is sent and false
+   * is returned.
+   *
+   * @param topic The topic to publish to, shorter than 32 characters
    * @param message The message to publish
-   * @return true if the message was sent successfully
+   * @param flags PUBLISH_RETAINED and/or MESSAGE_QOS1, or 0
+   * @return true if the message was sent or queued successfully
+   */
+  bool publishTopic(const char* topic, const char* message,
+                    uint8_t flags = 0);
+
+  /**
+   * Publish raw bytes to a topic
+   *
+   * The payload is carried as it is, without JSON escaping or base64, so it
+   * may contain NUL bytes. Delivery follows the same unicast or broadcast
+   * rules as text messages. Boards running firmware without binary frames
+   * drop these messages.
+   *
+   * @param topic The topic to publish to, shorter than 32 characters
+   * @param data The payload
+   * @param length Number of payload bytes
+   * @param flags PUBLISH_RETAINED and/or MESSAGE_QOS1, or 0
+   * @return true if the message was sent or queued successfully
    */
-  bool publishTopic(const char* topic, const char* message);
+  bool publishTopic(const char* topic, const uint8_t* data, size_t length,
+                    uint8_t flags = 0);
+
+  /**
+   * Get the 16-bit ID a topic is carried under on the wire
+   *
+   * Frames carry this ID instead of the topic string. It is derived from a
+   * hash of the name and only differs from it after a collision.
+   *
+   * @param topic The topic name
+   * @return The topic ID, or 0 if the topic table is full
+   */
+  uint16_t getTopicId(const char* topic);
+
+  /**
+   * Set how many interested boards are reached by unicast before publishing
+   * falls back to broadcast
+   *
+   * Unicast frames are acknowledged and retried by the radio and only wake
+   * the boards that subscribe, but each board costs a frame and an
+   * acknowledgement at the 1 Mbps ESP-NOW rate. Above one board, a higher
+   * threshold trades airtime for delivery. Set 0 to always broadcast, e.g.
+   * when boards running firmware that does not advertise subscriptions must
+   * receive topic messages.
+   *
+   * @param maxPeers Threshold, at most MAX_TOPIC_UNICAST_PEERS
+   * @return true if the threshold was set
+   */
+  bool setTopicUnicastThreshold(uint8_t maxPeers);
 
   /**
    * Subscribe to a topic to receive messages
    *
-   * @param topic The topic to subscribe to
+   * MQTT-style wildcards are supported: "+" matches one topic level and a
+   * trailing "#" matches any number of levels, e.g. "sensors/+/temperature"
+   * or "sensors/#". Wildcards do not match topics starting with "$".
+   *
+   * Boards holding retained values for matching topics send them to the new
+   * subscription straight away.
+   *
+   * @param topic The topic or topic filter to subscribe to
    * @param callback Function to call when a message is received on this topic
    * @return true if the subscription was added successfully
    */
   bool subscribeTopic(const char* topic, MessageCallback callback);
 
+  /**
+   * Subscribe to a topic and receive messages as raw bytes
+   *
+   * Text messages arrive without their terminating NUL. The data pointer
+   * refers to the receive buffer and is only valid during the callback.
+   *
+   * @param topic The topic or topic filter to subscribe to
+   * @param callback Function to call when a message is received on this topic
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, BinaryMessageCallback callback);
+
+  /**
+   * Subscribe to a topic with a callback that receives a user context
+   *
+   * @param topic The topic or topic filter to subscribe to
+   * @param callback Function to call when a message is received on this topic
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, MessageContextCallback callback,
+                      void* context);
+
+  /**
+   * Subscribe to a topic with a binary callback that receives a user context
+   *
+   * @param topic The topic or topic filter to subscribe to
+   * @param callback Function to call when a message is received on this topic
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool subscribeTopic(const char* topic, BinaryMessageContextCallback callback,
+                      void* context);
+
   /**
    * Unsubscribe from a topic
    *
-   * @param topic The topic to unsubscribe from
+   * @param topic The topic or topic filter passed to subscribeTopic()
    * @return true if the subscription was removed successfully
    */
   bool unsubscribeTopic(const char* topic);
 
+  /**
+   * Remove the subscriptions to a topic made with a given context
+   *
+   * @param topic The topic or topic filter passed to subscribeTopic()
+   * @param context The context passed to subscribeTopic()
+   * @return true if a subscription was removed
+   */
+  bool unsubscribeTopic(const char* topic, void* context);
+
   // ==================== Direct Messaging ====================
   /**
    * Send a direct message to a specific board
    *
+   * Direct messages are sent with QoS 0 by default. With MESSAGE_QOS1 the
+   * message is retried from the outbox until the board acknowledges it.
+   * With MESSAGE_STORE_AND_FORWARD it is written to flash and delivered in
+   * order once the board is reachable, surviving reboots of this board.
+   *
    * @param targetBoardId The ID of the board to send the message to
    * @param message The message to send
-   * @return true if the message was sent successfully
+   * @param flags MESSAGE_QOS1, MESSAGE_STORE_AND_FORWARD or 0
+   * @return true if the message was sent or queued successfully
    */
-  bool sendMessageToBoardId(const char* targetBoardId, const char* message);
+  bool sendMessageToBoardId(const char* targetBoardId, const char* message,
+                            uint8_t flags = 0);
+
+  /**
+   * Send raw bytes as a direct message to a specific board
+   *
+   * @param targetBoardId The ID of the board to send the message to
+   * @param data The payload
+   * @param length Number of payload bytes
+   * @param flags MESSAGE_QOS1, MESSAGE_STORE_AND_FORWARD or 0
+   * @return true if the message was sent or queued successfully
+   */
+  bool sendMessageToBoardId(const char* targetBoardId, const uint8_t* data,
+                            size_t length, uint8_t flags = 0);
 
   /**
    * Receive direct messages from other boards
    *
+   * Up to MAX_DIRECT_MESSAGE_CALLBACKS callbacks, of any kind, receive every
+   * direct message.
+   * Each call adds a callback rather than replacing the last one. A NULL
+   * callback removes them all; a plain NULL matches both this and the
+   * binary overload, so call stopReceivingMessages() instead.
+   *
    * @param callback Function to call when a direct message is received
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool receiveMessagesFromBoards(MessageCallback callback);
 
+  /**
+   * Receive direct messages from other boards as raw bytes
+   *
+   * The data pointer refers to the receive buffer and is only valid during
+   * the callback.
+   *
+   * @param callback Function to call when a direct message is received
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(BinaryMessageCallback callback);
+
+  /**
+   * Receive direct messages with a callback that receives a user context
+   *
+   * @param callback Function to call when a direct message is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(MessageContextCallback callback,
+                                 void* context);
+
+  /**
+   * Receive direct messages as raw bytes with a callback that receives a
+   * user context
+   *
+   * @param callback Function to call when a direct message is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveMessagesFromBoards(BinaryMessageContextCallback callback,
+                                 void* context);
+
   /**
    * Stop receiving direct messages
    *
-   * @return true if the callback was cleared successfully
+   * @return true if the callbacks were cleared successfully
    */
   bool stopReceivingMessages();
 
+  /**
+   * Remove the direct message callbacks registered with a context
+   *
+   * @param context The context passed to receiveMessagesFromBoards()
+   * @return true if a callback was removed
+   */
+  bool stopReceivingMessages(void* context);
+
+  /**
+   * Remove a direct message callback registered without a context
+   *
+   * @param callback The callback passed to receiveMessagesFromBoards()
+   * @return true if the callback was removed
+   */
+  bool removeMessageCallback(MessageCallback callback);
+
+  /**
+   * Remove a raw byte callback registered without a context
+   *
+   * @param callback The callback passed to receiveMessagesFromBoards()
+   * @return true if the callback was removed
+   */
+  bool removeMessageCallback(BinaryMessageCallback callback);
+
   /**
    * Handle a topic message
    * Called internally by NetworkCore
@@ -98,6 +356,63 @@ class NetworkMessaging {
   bool handleTopicMessage(const char* sender, const char* topic,
                           const char* message);
 
+  /**
+   * Handle a topic message carried by ID
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the message
+   * @param topicId The interned topic ID
+   * @param topic The topic name if the frame announces it, otherwise NULL
+   * @param message The message content
+   * @return true if the message was handled successfully
+   */
+  bool handleTopicIdMessage(const char* sender, uint16_t topicId,
+                            const char* topic, const char* message);
+
+  /**
+   * Handle a binary topic message
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the message
+   * @param body Topic ID, optional topic name and payload
+   * @param length Number of body bytes
+   * @return true if the message was handled successfully
+   */
+  bool handleBinaryTopicMessage(const char* sender, const uint8_t* body,
+                                size_t length);
+
+  /**
+   * Handle a retained value sent in reply to a new subscription
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the value
+   * @param body Requester, subscription filter, topic and payload
+   * @param length Number of body bytes
+   * @return true if the value was delivered
+   */
+  bool handleTopicRetained(const char* sender, const uint8_t* body,
+                           size_t length);
+
+  /**
+   * Handle a topic ID announcement or query
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the announcement
+   * @param doc The received message
+   * @return true if the announcement was processed
+   */
+  bool handleTopicAnnounce(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a topic interest advertisement, withdrawal or query
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the message
+   * @param doc The received message
+   * @return true if the message was processed
+   */
+  bool handleTopicInterest(const char* sender, const JsonObject& doc);
+
   /**
    * Handle a direct message
    * Called internally by NetworkCore
@@ -108,24 +423,174 @@ class NetworkMessaging {
    */
   bool handleDirectMessage(const char* sender, const char* message);
 
+  /**
+   * Handle a binary direct message
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the message
+   * @param data The payload
+   * @param length Number of payload bytes
+   * @return true if the message was handled successfully
+   */
+  bool handleBinaryDirectMessage(const char* sender, const uint8_t* data,
+                                 size_t length);
+
+  /**
+   * Add the filters of our topic subscriptions to a digest
+   * Called internally by NetworkDiscovery for the capability record
+   *
+   * @param digest The digest to add to
+   * @param size Size of the digest in bytes
+   */
+  void addSubscriptionsToDigest(uint8_t* digest, size_t size);
+
+  /**
+   * Check if messages from other boards are received
+   * Called internally by NetworkDiscovery for the capability record
+   *
+   * @return true if a direct message callback or topic subscription is set
+   */
+  bool hasSubscriptions();
+
  private:
   // Reference to the core network instance
   NetworkCore& _core;
 
-  // Direct message callback
-  MessageCallback _directMessageCallback;
+  // Direct message callbacks
+  CallbackSlot _directCallbacks[MAX_DIRECT_MESSAGE_CALLBACKS];
 
   // Subscription management for topics
   struct TopicSubscription {
     char topic[32];
-    MessageCallback callback;
+    CallbackSlot callback;
+    uint16_t node;  // Trie node the subscription hangs off
+    uint16_t next;  // Next subscription on the same node
     bool active;
   };
 
   TopicSubscription _topicSubscriptions[MAX_TOPIC_SUBSCRIPTIONS];
   int _topicSubscriptionCount;
 
+  // Subscriptions compiled into a trie with one level per node. Exact levels
+  // are found through an edge hash table keyed by parent and level hash, so
+  // matching costs time proportional to the number of topic levels.
+  struct TopicNode {
+    uint16_t firstSubscription;
+    uint16_t plusChild;
+    uint16_t hashChild;
+  };
+
+  struct TopicEdge {
+    uint16_t parent;
+    uint16_t levelHash;
+    uint16_t child;
+  };
+
+  TopicNode _trieNodes[MAX_TOPIC_TRIE_NODES];
+  TopicEdge _trieEdges[MAX_TOPIC_TRIE_NODES * 2];
+  uint16_t _trieNodeCount;
+
+  // Interned topics, an open-addressed hash table keyed by topic ID
+  struct TopicEntry {
+    char name[32];
+    uint16_t id;
+    bool published;        // We publish under this ID
+    bool announcePending;  // Queried or contested, announce from update()
+    uint8_t nameSends;     // Frames left that carry the name
+    uint32_t lastAnnounce;
+    bool used;
+  };
+
+  TopicEntry _topics[MAX_TOPIC_IDS];
+  int _topicCount;
+  uint32_t _lastTopicQuery;
+  portMUX_TYPE _topicLock;
+
+  // Subscriptions advertised by other boards
+  struct TopicInterest {
+    char board[32];
+    char filter[32];
+    uint32_t lastSeen;
+    bool active;
+  };
+
+  TopicInterest _topicInterests[MAX_TOPIC_INTERESTS];
+  uint8_t _topicUnicastThreshold;
+  uint32_t _lastInterestAdvert;
+  bool _interestAdvertDue;
+  bool _interestQuerySent;
+  // Start of the advertisement round that has to complete before the
+  // interest table is trusted: the query at startup, or the last eviction
+  uint32_t _interestRoundStart;
+
+  // Last values of retained topics we publish, evicted least recently used
+  struct RetainedValue {
+    char topic[32];
+    uint8_t data[MAX_RETAINED_SIZE];
+    uint16_t length;
+    uint32_t lastUsed;
+    bool used;
+  };
+
+  RetainedValue _retained[MAX_RETAINED_TOPICS];
+
+  bool retainTopic(const char* topic, const uint8_t* data, size_t length);
+  void sendRetainedValues(const char* requester, const char* filter);
+
+  // Interest helpers
+  int findInterestedBoards(const char* topic,
+                           char (*boards)[32], int maxBoards);
+  void recordTopicInterest(const char* board, const char* filter,
+                           bool remove);
+  bool advertiseTopicInterests();
+  bool areInterestsKnown();
+  bool sendTopicInterest(const char* filter, bool remove);
+
+  // Topic interning and trie helpers, called with _topicLock held
+  TopicEntry* findTopicById(uint16_t id);
+  TopicEntry* insertTopic(uint16_t id, const char* name);
+  TopicEntry* internTopic(const char* name);
+  TopicEntry* learnTopic(uint16_t id, const char* name, bool& collided);
+  bool insertTopicSubscription(int index);
+  bool compileTopicTrie();
+  uint16_t addTrieNode();
+  uint16_t findTrieEdge(uint16_t parent, uint16_t levelHash);
+  void addTrieEdge(uint16_t parent, uint16_t levelHash, uint16_t child);
+  int matchTopicSubscriptions(const char* topic, uint16_t* matches);
+
+  bool announceTopic(uint16_t id, const char* name);
+  void announcePendingTopics(uint32_t currentTime);
+  void resendTopicNames(const char* filter);
+  bool hasTopicSubscriptions();
+
+  // Shared by the text and binary paths; text is NULL for binary payloads
+  bool addTopicSubscription(const char* topic, void (*function)(),
+                            void* context, uint8_t kind);
+  void removeTopicSubscription(int index);
+  static void callMessageCallback(const CallbackSlot& callback,
+                                  const char* sender, const char* topic,
+                                  const char*& text, const uint8_t* data,
+                                  size_t length, char* copy);
+  bool publishTopicFrame(const char* topic, const char* text,
+                         const uint8_t* data, size_t length, bool reliable);
+  bool sendTopicFrame(const char (*targets)[32], int targetCount,
+                      bool broadcast, bool reliable, uint16_t topicId,
+                      const char* name, const char* text, const uint8_t* data,
+                      size_t length);
+  const char* resolveTopicId(const char* sender, uint16_t topicId,
+                             const char* topic, char* name);
+  bool deliverTopicMessage(const char* sender, const char* topic,
+                           const char* text, const uint8_t* data,
+                           size_t length);
+  bool deliverToSubscriptions(const uint16_t* matches, int matchCount,
+                              const char* sender, const char* topic,
+                              const char* text, const uint8_t* data,
+                              size_t length);
+  static bool isValidTopicFilter(const char* filter);
+  static bool topicMatchesFilter(const char* filter, const char* topic);
+
   // Helper methods
+  bool copyTarget(const char* boardId, char* target);
   int findFreeTopicSubscriptionSlot();
   bool findMatchingTopicSubscription(const char* topic, int& index);
 };
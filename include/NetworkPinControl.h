@@ -9,10 +9,99 @@
 #ifndef NetworkPinControl_h
 #define NetworkPinControl_h
 
+#include <esp_timer.h>
+
 #include "NetworkCore.h"
 
+class TwoWire;
+class SPIClass;
+
 // Maximum number of subscriptions
 #define MAX_PIN_SUBSCRIPTIONS 20
+// Retry period for subscription requests and group memberships that could
+// not be sent yet, e.g. before ESP-NOW is up (ms)
+#define PIN_ANNOUNCE_INTERVAL 500
+
+// Maximum number of scheduled pin commands waiting to fire
+#define MAX_SCHEDULED_PIN_COMMANDS 16
+// Maximum number of boards addressed by one scheduled group command
+#define MAX_SCHEDULE_GROUP_SIZE 8
+
+// Clock offset estimation for scheduled commands. Each round sends a few
+// timestamped probes and keeps the shortest trip seen in each direction.
+#define MAX_CLOCK_OFFSETS MAX_SCHEDULE_GROUP_SIZE  // Boards tracked at once
+#define CLOCK_SYNC_SAMPLES 8        // Probes per round
+#define CLOCK_SYNC_PROBE_INTERVAL 20  // Probe spacing and reply wait (ms)
+#ifndef CLOCK_SYNC_INTERVAL
+#define CLOCK_SYNC_INTERVAL 5000    // Rounds while a board is scheduled (ms)
+#endif
+#define CLOCK_SYNC_IDLE_TIMEOUT 60000  // Stop refreshing unused boards (ms)
+// Probe and reply body: [kind][t1 (4)][t2 (4)][t3 (4)]. Both are the same
+// length, so both directions spend as long on air.
+#define CLOCK_SYNC_PROBE 0
+#define CLOCK_SYNC_REPLY 1
+#define CLOCK_SYNC_BODY_SIZE 13
+
+// Scheduled pin command outcomes
+#define PIN_SCHEDULE_ON_TIME 0   // Fired by the timer at the target time
+#define PIN_SCHEDULE_LATE 1      // Arrived after its target time, applied now
+#define PIN_SCHEDULE_REJECTED 2  // Schedule full, command dropped
+
+// Board group limits
+#define MAX_BOARD_GROUPS 2       // Groups a controller can address
+#define MAX_GROUP_MEMBERS 32     // Members per group (one bit each in acks)
+#define MAX_JOINED_GROUPS 4      // Groups a board can be a member of
+#define PIN_GROUP_ACK_TIMEOUT 50  // Wait before unicast retransmission (ms)
+#define PIN_GROUP_MAX_RETRIES 3   // Unicast retransmission rounds
+
+// Pin sequence program limits
+#define MAX_PIN_SEQUENCE_BYTES 64       // Hex-encoded, fits one frame
+#define MAX_PIN_SEQUENCES 2             // Programs running at once per board
+#define MAX_PIN_SEQUENCE_LOOP_DEPTH 4   // Nested loops per program
+#define MAX_PIN_SEQUENCE_EVENTS 8       // Status reports waiting to be sent
+#define PIN_SEQUENCE_POLL_INTERVAL 1000  // Input wait poll period (us)
+#define PIN_SEQUENCE_STEPS_PER_TICK 64   // Steps run per timer callback
+
+// Pin sequence opcodes
+#define PIN_SEQ_OP_SET 1       // pin, value
+#define PIN_SEQ_OP_DELAY 2     // uint32 microseconds
+#define PIN_SEQ_OP_LOOP 3      // uint16 iterations (0 = forever)
+#define PIN_SEQ_OP_END_LOOP 4  // -
+#define PIN_SEQ_OP_WAIT 5      // pin, value, uint16 timeout ms (0 = forever)
+#define PIN_SEQ_OP_REPORT 6    // tag
+
+// Pin sequence status reports
+#define PIN_SEQUENCE_PROGRESS 0  // A report step was reached
+#define PIN_SEQUENCE_COMPLETE 1  // The program ran to the end
+#define PIN_SEQUENCE_STOPPED 2   // Stopped by the controller or replaced
+#define PIN_SEQUENCE_TIMEOUT 3   // An input wait timed out
+#define PIN_SEQUENCE_REJECTED 4  // Invalid program or no free runner
+
+// Bus proxy limits
+#define MAX_BUS_BATCH_BYTES 64     // Hex-encoded, fits one frame
+#define MAX_BUS_TRANSACTIONS 16    // Transactions per batch
+#define MAX_BUS_READ_BYTES 64      // Read bytes returned in one response
+// Binary response body: [batch ID][status][failed index][read bytes]
+#define BUS_RESPONSE_HEADER_SIZE 3
+#define MAX_BUS_REQUESTS 2         // Batches waiting to run on a responder
+#define BUS_PROXY_SPI_FREQUENCY 1000000  // Default SPI clock (Hz)
+#define MAX_BUS_PROXY_CLIENTS 4    // Boards allowed to use a bus proxy
+#define MAX_BUS_PROXY_CS_PINS 4    // SPI chip select pins a proxy may drive
+
+// Bus transaction opcodes, each encoded as
+// op, address or chip select pin, write length, read length, write bytes
+#define BUS_OP_I2C_WRITE 1       // Write with stop
+#define BUS_OP_I2C_READ 2        // Read N bytes
+#define BUS_OP_I2C_WRITE_READ 3  // Write, repeated start, read N bytes
+#define BUS_OP_SPI_TRANSFER 4    // Write then clock in N bytes under CS low
+
+// Bus batch outcomes
+#define BUS_BATCH_OK 0        // Every transaction completed
+#define BUS_BATCH_FAILED 1    // A transaction failed, later ones were skipped
+#define BUS_BATCH_DISABLED 2  // The responder has no bus proxy for that bus
+#define BUS_BATCH_INVALID 3   // Malformed batch
+#define BUS_BATCH_BUSY 4      // Too many batches waiting on the responder
+#define BUS_BATCH_DENIED 5    // Sender or chip select pin not allowed
 
 // Pin control confirmation timeout
 #define PIN_CONTROL_CONFIRM_TIMEOUT 5000  // 5 seconds
@@ -20,8 +109,132 @@
 // Callback function types
 typedef void (*PinChangeCallback)(const char* sender, uint8_t pin,
                                   uint8_t value);
+typedef void (*PinChangeContextCallback)(void* context, const char* sender,
+                                         uint8_t pin, uint8_t value);
 typedef void (*PinControlConfirmCallback)(const char* sender, uint8_t pin,
                                           uint8_t value, bool success);
+typedef void (*PinScheduleCallback)(const char* boardId, uint8_t pin,
+                                    uint8_t value, uint8_t status,
+                                    int32_t skewUs);
+typedef void (*PinSequenceCallback)(const char* boardId, uint8_t sequenceId,
+                                    uint8_t status, uint8_t tag);
+typedef void (*PinGroupConfirmCallback)(const char* groupName, uint8_t pin,
+                                        uint8_t value, uint32_t ackedMask,
+                                        uint8_t memberCount);
+typedef void (*BusResponseCallback)(const char* boardId, uint8_t batchId,
+                                    uint8_t status, uint8_t failedIndex,
+                                    const uint8_t* data, size_t length);
+
+/**
+ * Compact pin sequence program builder
+ *
+ * Steps are encoded into a small byte program that is uploaded to a
+ * peripheral in one message and executed there from a timer.
+ */
+class PinSequence {
+ public:
+  PinSequence();
+
+  /**
+   * Set a pin to a value
+   */
+  bool set(uint8_t pin, uint8_t value);
+
+  /**
+   * Wait before the next step
+   */
+  bool delayMs(uint32_t ms);
+  bool delayMicros(uint32_t us);
+
+  /**
+   * Repeat the steps up to the matching endLoop()
+   *
+   * @param iterations Number of iterations, 0 to repeat until stopped
+   */
+  bool loop(uint16_t iterations);
+  bool endLoop();
+
+  /**
+   * Wait until an input pin reads the given value
+   *
+   * The pin is configured as an input when the program is accepted, unless
+   * the sketch handles pin control of it with a callback; the sketch then
+   * sets its mode.
+   *
+   * @param timeoutMs Abort the program after this long, 0 to wait forever
+   */
+  bool waitInput(uint8_t pin, uint8_t value, uint16_t timeoutMs = 0);
+
+  /**
+   * Report progress back to the controller with a user tag
+   */
+  bool report(uint8_t tag);
+
+  void clear();
+  const uint8_t* data() const { return _program; }
+  size_t length() const { return _length; }
+
+ private:
+  uint8_t _program[MAX_PIN_SEQUENCE_BYTES];
+  size_t _length;
+
+  bool append(const uint8_t* bytes, size_t len);
+};
+
+/**
+ * Batch of I2C/SPI transactions for a remote bus proxy
+ *
+ * All transactions travel in one message and their read bytes come back,
+ * concatenated in order, in a single response frame.
+ */
+class BusTransactionBatch {
+ public:
+  BusTransactionBatch();
+
+  /**
+   * Write bytes to an I2C device
+   */
+  bool i2cWrite(uint8_t address, const uint8_t* data, uint8_t length);
+
+  /**
+   * Read bytes from an I2C device
+   */
+  bool i2cRead(uint8_t address, uint8_t length);
+
+  /**
+   * Write bytes, then read with a repeated start
+   */
+  bool i2cWriteRead(uint8_t address, const uint8_t* data,
+                    uint8_t writeLength, uint8_t readLength);
+
+  /**
+   * Read consecutive registers from an I2C device
+   */
+  bool i2cReadRegister(uint8_t address, uint8_t reg, uint8_t length) {
+    return i2cWriteRead(address, &reg, 1, length);
+  }
+
+  /**
+   * Write bytes to an SPI device, then clock in readLength bytes, with the
+   * chip select pin held low for the whole transaction
+   */
+  bool spiTransfer(uint8_t csPin, const uint8_t* data, uint8_t writeLength,
+                   uint8_t readLength);
+
+  void clear();
+  const uint8_t* data() const { return _batch; }
+  size_t length() const { return _length; }
+  size_t readLength() const { return _readLength; }
+
+ private:
+  uint8_t _batch[MAX_BUS_BATCH_BYTES];
+  size_t _length;
+  size_t _readLength;
+  uint8_t _count;
+
+  bool append(uint8_t op, uint8_t target, const uint8_t* data,
+              uint8_t writeLength, uint8_t readLength);
+};
 
 class NetworkPinControl {
  public:
@@ -39,6 +252,13 @@ class NetworkPinControl {
    */
   bool begin();
 
+  /**
+   * Update function that must be called regularly
+   * This reports the outcome of scheduled pin commands back to their senders
+   * and runs queued bus proxy batches
+   */
+  void update();
+
   // ==================== Remote Pin Control (Controller Side)
   // ====================
   /**
@@ -85,6 +305,184 @@ class NetworkPinControl {
    */
   uint8_t readRemotePin(const char* targetBoardId, uint8_t pin);
 
+  // ==================== Scheduled Pin Control ====================
+  /**
+   * Set a pin on a remote board at a given network time
+   *
+   * The responder queues the command and applies it from a hardware timer.
+   * Once the target's clock offset is known (see syncClockWith()), the frame
+   * carries the target time on the responder's clock and the switching
+   * instant does not depend on delivery latency or retries. Until then the
+   * responder converts it with the lead time left when the frame was built,
+   * and the command fires late by the frame's delivery latency.
+   *
+   * @param targetBoardId The ID of the target board
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param networkTime Target time on this board's clock (see
+   * NetworkCore::getNetworkTime())
+   * @return true if the message was sent successfully
+   */
+  bool controlRemotePinAt(const char* targetBoardId, uint8_t pin, uint8_t value,
+                          uint32_t networkTime);
+
+  /**
+   * Set a pin on several remote boards at the same network time
+   *
+   * A single broadcast frame carries the command with the clock offset of
+   * each target, as for controlRemotePinAt(). Targets whose IDs do not fit
+   * one frame are sent in further broadcasts.
+   *
+   * @param targetBoardIds The IDs of the target boards
+   * @param boardCount Number of entries in targetBoardIds (at most
+   * MAX_SCHEDULE_GROUP_SIZE)
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param networkTime Target time on this board's clock
+   * @return true if every broadcast was sent successfully
+   */
+  bool controlRemotePinsAt(const char* const* targetBoardIds,
+                           uint8_t boardCount, uint8_t pin, uint8_t value,
+                           uint32_t networkTime);
+
+  /**
+   * Estimate the clock offset to a board
+   *
+   * Scheduled commands start a round by themselves and rounds repeat every
+   * CLOCK_SYNC_INTERVAL while a board is scheduled. Call this ahead of the
+   * first command so that it already fires on the responder's clock.
+   *
+   * @param targetBoardId The ID of the board
+   * @return true if a round of probes is under way or scheduled
+   */
+  bool syncClockWith(const char* targetBoardId);
+
+  /**
+   * Set a callback for scheduled pin command outcomes
+   *
+   * Each responder reports whether the command fired on time, arrived late or
+   * was rejected, together with the achieved skew in microseconds. The skew
+   * is measured against the target time on this board's clock when the
+   * responder's clock offset is known, and against the responder's own
+   * conversion otherwise.
+   *
+   * @param callback Function to call when a responder reports an outcome
+   * @return true if the callback was set successfully
+   */
+  bool onScheduledPinResult(PinScheduleCallback callback);
+
+  // ==================== Group Pin Control ====================
+  /**
+   * Define a named group of boards for group pin control
+   *
+   * Each member is told its index in the group so it can recognise group
+   * commands and acknowledge them compactly. Redefining a group replaces its
+   * member list. Members are told once they can be reached, so groups may
+   * be defined before the network is up.
+   *
+   * @param groupName Name of the group
+   * @param boardIds IDs of the member boards
+   * @param memberCount Number of members (at most MAX_GROUP_MEMBERS)
+   * @return true if the group was defined
+   */
+  bool defineBoardGroup(const char* groupName, const char* const* boardIds,
+                        uint8_t memberCount);
+
+  /**
+   * Remove a board group
+   *
+   * @param groupName Name of the group
+   * @return true if the group existed
+   */
+  bool removeBoardGroup(const char* groupName);
+
+  /**
+   * Get the ID of a group member by index
+   *
+   * Bit i of the acked mask passed to a PinGroupConfirmCallback refers to
+   * the member returned for index i.
+   *
+   * @param groupName Name of the group
+   * @param index Member index
+   * @return The member's board ID, or NULL if out of range
+   */
+  const char* getBoardGroupMember(const char* groupName, uint8_t index);
+
+  /**
+   * Control a pin on every member of a group
+   *
+   * The command goes out as a single broadcast frame. Members that have not
+   * acknowledged within PIN_GROUP_ACK_TIMEOUT are retried by unicast only.
+   * A new command for the same group completes the previous one.
+   *
+   * @param groupName Name of the group
+   * @param pin The pin number to control
+   * @param value The value to set (HIGH/LOW)
+   * @param callback Optional callback with the set of members that confirmed
+   * @return true if the broadcast was sent successfully
+   */
+  bool controlGroupPin(const char* groupName, uint8_t pin, uint8_t value,
+                       PinGroupConfirmCallback callback = NULL);
+
+  // ==================== Remote Pin Sequences ====================
+  /**
+   * Upload a pin sequence program to a remote board and start it
+   *
+   * The peripheral runs the program locally from a timer without further
+   * network traffic. A running program with the same ID is replaced. The
+   * program has to fit one frame next to our board ID, so the usable size
+   * shrinks slightly below MAX_PIN_SEQUENCE_BYTES with long board IDs.
+   *
+   * @param targetBoardId The ID of the target board
+   * @param sequenceId Identifier used in status reports and to stop it
+   * @param sequence The program to run
+   * @return true if the message was sent successfully, false if it was not
+   * or the encoded program does not fit one frame
+   */
+  bool runRemotePinSequence(const char* targetBoardId, uint8_t sequenceId,
+                            const PinSequence& sequence);
+
+  /**
+   * Stop a pin sequence running on a remote board
+   *
+   * @param targetBoardId The ID of the target board
+   * @param sequenceId The ID passed to runRemotePinSequence()
+   * @return true if the message was sent successfully
+   */
+  bool stopRemotePinSequence(const char* targetBoardId, uint8_t sequenceId);
+
+  /**
+   * Set a callback for pin sequence progress and completion reports
+   *
+   * @param callback Function to call when a peripheral reports a status
+   * @return true if the callback was set successfully
+   */
+  bool onPinSequenceStatus(PinSequenceCallback callback);
+
+  // ==================== Remote Bus Transactions ====================
+  /**
+   * Run a batch of I2C/SPI transactions on a remote board
+   *
+   * The responder runs the batch from its update() loop and answers with one
+   * response frame holding every read byte. Requests are not acknowledged
+   * separately; a missing response means the batch should be resubmitted.
+   *
+   * @param targetBoardId The ID of the target board
+   * @param batchId Identifier echoed in the response
+   * @param batch The transactions to run
+   * @return true if the message was sent successfully
+   */
+  bool submitBusTransactions(const char* targetBoardId, uint8_t batchId,
+                             const BusTransactionBatch& batch);
+
+  /**
+   * Set a callback for bus transaction responses
+   *
+   * @param callback Function to call with the read bytes of a batch
+   * @return true if the callback was set successfully
+   */
+  bool onBusResponse(BusResponseCallback callback);
+
   // ==================== Remote Pin Control (Responder Side)
   // ====================
   /**
@@ -96,6 +494,16 @@ class NetworkPinControl {
    */
   bool handlePinControl(PinChangeCallback callback = NULL);
 
+  /**
+   * Set up handling of pin control messages with a callback that receives a
+   * user context
+   *
+   * @param callback Callback to process pin control requests
+   * @param context Passed to the callback as its first argument
+   * @return true if successful
+   */
+  bool handlePinControl(PinChangeContextCallback callback, void* context);
+
   /**
    * Stop handling pin control messages
    *
@@ -106,6 +514,9 @@ class NetworkPinControl {
   /**
    * Accept pin control from a specific board for a specific pin
    *
+   * The subscription request is sent once the controller can be reached,
+   * so this may be called before the network is up.
+   *
    * @param controllerBoardId The ID of the board to accept control from
    * @param pin The pin to allow control of
    * @param callback Function to call when pin control is received
@@ -114,15 +525,61 @@ class NetworkPinControl {
   bool acceptPinControlFrom(const char* controllerBoardId, uint8_t pin,
                             PinChangeCallback callback);
 
+  /**
+   * Accept pin control from a specific board for a specific pin, with a
+   * callback that receives a user context
+   *
+   * @param controllerBoardId The ID of the board to accept control from
+   * @param pin The pin to allow control of
+   * @param callback Function to call when pin control is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool acceptPinControlFrom(const char* controllerBoardId, uint8_t pin,
+                            PinChangeContextCallback callback, void* context);
+
   /**
    * Stop accepting pin control from a specific board for a specific pin
    *
+   * Removes every callback registered for the board and pin.
+   *
    * @param controllerBoardId The ID of the board to stop accepting control from
    * @param pin The pin to stop allowing control of
    * @return true if the subscription was removed successfully
    */
   bool stopAcceptingPinControlFrom(const char* controllerBoardId, uint8_t pin);
 
+  /**
+   * Serve bus transaction batches from other boards
+   *
+   * The buses must already be initialized with begin(). Pass NULL for a bus
+   * that should not be reachable remotely. Batches from other boards, and
+   * SPI transfers on any other chip select pin, are answered with
+   * BUS_BATCH_DENIED without touching the bus.
+   *
+   * @param allowedBoardIds Boards allowed to submit batches
+   * @param allowedCount Number of entries in allowedBoardIds (at most
+   * MAX_BUS_PROXY_CLIENTS)
+   * @param wire I2C bus to proxy
+   * @param spi SPI bus to proxy
+   * @param csPins Chip select pins SPI transfers may drive
+   * @param csPinCount Number of entries in csPins (at most
+   * MAX_BUS_PROXY_CS_PINS, and at least one if spi is set)
+   * @param spiFrequency SPI clock used for proxied transactions
+   * @return true if successful
+   */
+  bool enableBusProxy(const char* const* allowedBoardIds, uint8_t allowedCount,
+                      TwoWire* wire, SPIClass* spi = NULL,
+                      const uint8_t* csPins = NULL, uint8_t csPinCount = 0,
+                      uint32_t spiFrequency = BUS_PROXY_SPI_FREQUENCY);
+
+  /**
+   * Stop serving bus transaction batches
+   *
+   * @return true if successful
+   */
+  bool disableBusProxy();
+
   // ==================== Pin State Broadcasting ====================
   /**
    * Broadcast the state of a pin to all boards on the network
@@ -144,10 +601,27 @@ class NetworkPinControl {
   bool listenForPinStateFrom(const char* broadcasterBoardId, uint8_t pin,
                              PinChangeCallback callback);
 
+  /**
+   * Listen for pin state broadcasts from a specific board for a specific pin,
+   * with a callback that receives a user context
+   *
+   * Several callbacks may listen to the same board and pin.
+   *
+   * @param broadcasterBoardId The ID of the board to listen to
+   * @param pin The pin to listen for
+   * @param callback Function to call when a pin state broadcast is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the subscription was added successfully
+   */
+  bool listenForPinStateFrom(const char* broadcasterBoardId, uint8_t pin,
+                             PinChangeContextCallback callback, void* context);
+
   /**
    * Stop listening for pin state broadcasts from a specific board for a
    * specific pin
    *
+   * Removes every callback registered for the board and pin.
+   *
    * @param broadcasterBoardId The ID of the board to stop listening to
    * @param pin The pin to stop listening for
    * @return true if the subscription was removed successfully
@@ -179,32 +653,344 @@ class NetworkPinControl {
    */
   bool handlePinStateMessage(const char* sender, uint8_t pin, uint8_t value);
 
+  /**
+   * Handle a scheduled pin command
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the command
+   * @param doc The received message
+   * @param receivedAt Local network time at which the frame arrived
+   * @return true if the command was queued or applied
+   */
+  bool handlePinScheduleMessage(const char* sender, const JsonObject& doc,
+                                uint32_t receivedAt);
+
+  /**
+   * Handle a scheduled pin command outcome report
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that ran the command
+   * @param doc The received message
+   * @return true if the report was delivered to a callback
+   */
+  bool handlePinScheduleResult(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a clock offset probe or its reply
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the frame
+   * @param body The frame body
+   * @param length Length of the body
+   * @param receivedAt Local network time at which the frame arrived
+   * @return true if the frame was handled
+   */
+  bool handleClockSync(const char* sender, const uint8_t* body, size_t length,
+                       uint32_t receivedAt);
+
+  /**
+   * Handle a pin sequence upload or stop request
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the request
+   * @param doc The received message
+   * @return true if the request was accepted
+   */
+  bool handlePinSequenceMessage(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a pin sequence status report
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board running the sequence
+   * @param doc The received message
+   * @return true if the report was delivered to a callback
+   */
+  bool handlePinSequenceStatus(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a group pin command or membership update
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the controller
+   * @param doc The received message
+   * @return true if the message concerned one of our groups
+   */
+  bool handlePinGroupMessage(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a group member's acknowledgement
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the member
+   * @param doc The received message
+   * @return true if the acknowledgement matched a pending command
+   */
+  bool handlePinGroupAck(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a bus transaction batch
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the batch
+   * @param doc The received message
+   * @return true if the batch was queued
+   */
+  bool handleBusTransactionMessage(const char* sender, const JsonObject& doc);
+
+  /**
+   * Handle a bus transaction response
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that ran the batch
+   * @param body The binary frame body
+   * @param length Length of the body
+   * @return true if the response was delivered to a callback
+   */
+  bool handleBusResponse(const char* sender, const uint8_t* body,
+                         size_t length);
+
+  /**
+   * Check if pin control from other boards is accepted
+   * Called internally by NetworkDiscovery for the capability record
+   *
+   * @return true if handlePinControl() or acceptPinControlFrom() is in effect
+   */
+  bool acceptsPinControl();
+
+  /**
+   * Check if bus transaction batches are served
+   * Called internally by NetworkDiscovery for the capability record
+   *
+   * @return true between enableBusProxy() and disableBusProxy()
+   */
+  bool isBusProxyEnabled();
+
  private:
   // Reference to the core network instance
   NetworkCore& _core;
 
   // Global pin change callback
-  PinChangeCallback _globalPinChangeCallback;
+  CallbackSlot _globalPinChangeCallback;
 
   // Legacy pin control confirm callback (for backward compatibility)
   PinControlConfirmCallback _pinControlConfirmCallback;
 
+  // Scheduled pin command outcome callback
+  PinScheduleCallback _pinScheduleCallback;
+
+  // Pin sequence status callback
+  PinSequenceCallback _pinSequenceCallback;
+
   // Subscription management for pin control
   struct PinSubscription {
     char targetBoard[32];
     uint8_t pin;
     uint8_t type;  // MSG_TYPE_PIN_SUBSCRIBE or MSG_TYPE_PIN_PUBLISH
-    PinChangeCallback callback;
+    CallbackSlot callback;
+    bool announced;  // Subscription request sent to the controller
     bool active;
   };
 
   PinSubscription _pinSubscriptions[MAX_PIN_SUBSCRIPTIONS];
   int _pinSubscriptionCount;
 
+  // Subscription requests and group memberships are sent once the target
+  // can be reached, so they may be registered before ESP-NOW is up
+  bool _announcePending;
+  uint32_t _lastAnnounce;
+  void announceRegistrations();
+
+  // Scheduled pin commands, kept sorted by fire time (earliest first)
+  struct ScheduledPinCommand {
+    char sender[32];
+    uint32_t fireTime;  // Local network time at which to apply
+    uint32_t target;    // Target time on the sender's clock
+    uint32_t appliedAt;
+    int32_t skew;       // Achieved lateness in microseconds
+    uint16_t sequence;
+    uint8_t pin;
+    uint8_t value;
+    uint8_t status;
+  };
+
+  ScheduledPinCommand _schedule[MAX_SCHEDULED_PIN_COMMANDS];
+  int _scheduleCount;
+
+  // Outcomes waiting to be reported from update()
+  ScheduledPinCommand _scheduleResults[MAX_SCHEDULED_PIN_COMMANDS];
+  int _scheduleResultHead;
+  int _scheduleResultCount;
+
+  esp_timer_handle_t _scheduleTimer;
+  portMUX_TYPE _scheduleLock;
+  uint16_t _scheduleSequence;
+
+  // Clock offsets of scheduled boards. Queueing only ever delays a probe, so
+  // the shortest trip each way is the closest to the bare delivery latency,
+  // which is assumed equal both ways. Guarded by _scheduleLock since replies
+  // arrive in the receive task.
+  struct ClockOffset {
+    char boardId[32];
+    int32_t offset;         // Their clock minus ours (us)
+    bool valid;
+    uint32_t syncedAt;      // millis() of the last completed round
+    uint32_t usedAt;        // millis() of the last scheduled command
+    uint8_t probes;         // Probes sent in the current round, 0 if idle
+    uint32_t probeTime;     // Network time stamped in the last probe
+    uint32_t probeSentAt;   // millis() of the last probe
+    int32_t bestOutbound;   // Shortest trips of the current round, including
+    int32_t bestInbound;    // the offset (us)
+  };
+  ClockOffset _clockOffsets[MAX_CLOCK_OFFSETS];
+
+  // Groups this board controls, with their outstanding command
+  struct BoardGroup {
+    char name[16];
+    char members[MAX_GROUP_MEMBERS][32];
+    PinGroupConfirmCallback callback;
+    uint32_t ackedMask;
+    uint32_t announcedMask;  // Members told their index
+    uint32_t sentTime;
+    uint16_t id;
+    uint16_t sequence;
+    uint8_t memberCount;
+    uint8_t pin;
+    uint8_t value;
+    uint8_t retries;
+    bool pending;
+    bool active;
+  };
+
+  // Groups this board is a member of. Group IDs are name hashes, so a
+  // membership only answers to the controller that enrolled it.
+  struct GroupMembership {
+    char controller[32];
+    uint16_t id;
+    uint16_t lastSequence;
+    uint8_t memberIndex;
+    bool sequenceSeen;
+    bool active;
+  };
+
+  BoardGroup _boardGroups[MAX_BOARD_GROUPS];
+  GroupMembership _groupMemberships[MAX_JOINED_GROUPS];
+
+  // Group helpers
+  BoardGroup* findBoardGroup(const char* groupName);
+  bool sendGroupCommand(BoardGroup& group, uint8_t memberIndex);
+  void finishGroupCommand(BoardGroup& group);
+
+  // Pin sequence runners, stepped from their own one-shot timer
+  struct PinSequenceRunner {
+    NetworkPinControl* owner;
+    esp_timer_handle_t timer;
+    char sender[32];
+    uint8_t program[MAX_PIN_SEQUENCE_BYTES];
+    uint8_t length;
+    uint8_t pc;
+    uint8_t id;
+    uint8_t loopDepth;
+    uint8_t loopStart[MAX_PIN_SEQUENCE_LOOP_DEPTH];
+    uint16_t loopRemaining[MAX_PIN_SEQUENCE_LOOP_DEPTH];
+    uint32_t waitStarted;  // millis() when the current input wait began
+    bool waiting;
+    bool active;
+  };
+
+  struct PinSequenceEvent {
+    char sender[32];
+    uint8_t id;
+    uint8_t status;
+    uint8_t tag;
+  };
+
+  PinSequenceRunner _sequenceRunners[MAX_PIN_SEQUENCES];
+  PinSequenceEvent _sequenceEvents[MAX_PIN_SEQUENCE_EVENTS];
+  int _sequenceEventHead;
+  int _sequenceEventCount;
+  portMUX_TYPE _sequenceLock;
+
+  // Pin writes decoded by a runner, applied once the lock is released
+  struct PinSequenceWrite {
+    uint8_t pin;
+    uint8_t value;
+  };
+
+  // Pin sequence helpers
+  static void onSequenceTimer(void* arg);
+  int stepSequence(PinSequenceRunner& runner, PinSequenceWrite* writes);
+  void armSequenceTimer(PinSequenceRunner& runner, uint32_t delayUs);
+  void stopSequence(PinSequenceRunner& runner, uint8_t status);
+  void queueSequenceEvent(const char* sender, uint8_t id, uint8_t status,
+                          uint8_t tag);
+  static bool validateSequence(const uint8_t* program, size_t length);
+
+  // Bus proxy state; batches are queued by the receive path and run from
+  // update()
+  struct PendingBusBatch {
+    char sender[32];
+    uint8_t batch[MAX_BUS_BATCH_BYTES];
+    uint8_t length;
+    uint8_t id;
+  };
+
+  TwoWire* _busWire;
+  SPIClass* _busSpi;
+  uint32_t _busSpiFrequency;
+  char _busClients[MAX_BUS_PROXY_CLIENTS][32];
+  uint8_t _busClientCount;
+  uint8_t _busCsPins[MAX_BUS_PROXY_CS_PINS];
+  uint8_t _busCsPinCount;
+  BusResponseCallback _busResponseCallback;
+  PendingBusBatch _busRequests[MAX_BUS_REQUESTS];
+  int _busRequestHead;
+  int _busRequestCount;
+  portMUX_TYPE _busLock;
+
+  // Bus proxy helpers
+  void runBusBatch(const PendingBusBatch& request);
+  bool runI2cTransaction(uint8_t op, uint8_t address, const uint8_t* data,
+                         uint8_t writeLength, uint8_t* rx,
+                         uint8_t readLength);
+  bool runSpiTransaction(uint8_t csPin, const uint8_t* data,
+                         uint8_t writeLength, uint8_t* rx,
+                         uint8_t readLength);
+  bool sendBusResponse(const char* target, uint8_t id, uint8_t status,
+                       uint8_t failedIndex, const uint8_t* data,
+                       size_t length);
+  static bool validateBusBatch(const uint8_t* batch, size_t length);
+  bool isBusBatchAllowed(const char* sender, const uint8_t* batch,
+                         size_t length);
+
+  // Scheduling helpers
+  static void onScheduleTimer(void* arg);
+  void fireDueCommands();
+  void armScheduleTimer();
+  void queueScheduleResult(const ScheduledPinCommand& command);
+
+  // Clock offset helpers
+  ClockOffset* findClockOffset(const char* boardId, bool create);
+  bool lookupClockOffset(const char* boardId, int32_t* offset);
+  void startClockSync(ClockOffset& entry);
+  bool sendClockProbe(ClockOffset& entry);
+  void finishClockSync(ClockOffset& entry);
+  void updateClockSync(uint32_t currentTime);
+
   // Helper methods
+  bool applyPinControl(const char* sender, uint8_t pin, uint8_t value);
+  bool drivesPinDirectly(const char* sender, uint8_t pin);
   int findFreePinSubscriptionSlot();
   bool findMatchingPinSubscription(const char* boardId, uint8_t pin,
                                    uint8_t type, int& index);
+  bool addPinSubscription(const char* boardId, uint8_t pin, uint8_t type,
+                          void (*function)(), void* context, uint8_t kind);
+  bool removePinSubscriptions(const char* boardId, uint8_t pin, uint8_t type);
+  bool notifyPinSubscriptions(const char* boardId, uint8_t pin, uint8_t value,
+                              uint8_t type);
+  static bool callPinChangeCallback(const CallbackSlot& callback,
+                                    const char* sender, uint8_t pin,
+                                    uint8_t value);
 };
 
 #endif
\ No newline at end of file
@@ -8,13 +8,65 @@
 #ifndef NetworkSerial_h
 #define NetworkSerial_h
 
+#include <esp_timer.h>
+
 #include "NetworkCore.h"
 
 // Maximum serial data buffer size
 #define MAX_SERIAL_DATA_SIZE 200
 
+// Default auto-forwarding flush policy
+#define SERIAL_FLUSH_IDLE_US 500000     // Flush after the line is idle (us)
+#define SERIAL_FLUSH_DELIMITERS "\r\n"  // Flush after any of these bytes
+#define SERIAL_FLUSH_RETRY_US 1000      // Idle flush retry while input is sent
+#define MAX_SERIAL_DELIMITERS 8
+
 // Callback function types
 typedef void (*SerialDataCallback)(const char* sender, const char* data);
+typedef void (*BinarySerialDataCallback)(const char* sender,
+                                         const uint8_t* data, size_t length);
+typedef void (*SerialDataContextCallback)(void* context, const char* sender,
+                                          const char* data);
+typedef void (*BinarySerialDataContextCallback)(void* context,
+                                                const char* sender,
+                                                const uint8_t* data,
+                                                size_t length);
+
+// Callbacks received serial data is delivered to
+#define MAX_SERIAL_DATA_CALLBACKS 4
+
+// Reliable stream ring buffers, must be powers of two. The receive buffer
+// is the window the peer may have in flight.
+#ifndef STREAM_TX_BUFFER_SIZE
+#define STREAM_TX_BUFFER_SIZE 2048
+#endif
+#ifndef STREAM_RX_BUFFER_SIZE
+#define STREAM_RX_BUFFER_SIZE 2048
+#endif
+
+// Virtual serial channels
+#define MAX_SERIAL_CHANNELS 4
+#define MAX_SERIAL_CHANNEL_TARGETS 4
+#ifndef SERIAL_CHANNEL_BUFFER_SIZE
+#define SERIAL_CHANNEL_BUFFER_SIZE 256  // Received bytes held per channel
+#endif
+
+// Byte counters of a virtual serial channel
+struct SerialChannelStats {
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+  uint32_t framesSent;
+  uint32_t framesReceived;
+  uint32_t bytesDropped;  // Received while the channel buffer was full
+};
+
+#define STREAM_HEADER_SIZE 5          // Session and 32-bit byte offset
+#define STREAM_ACK_SIZE 7             // Session, offset and 16-bit window
+#define STREAM_ACK_RESET 0x01         // Optional flags byte: restart session
+#define STREAM_RETRANSMIT_MIN 30      // First retransmit timeout (ms)
+#define STREAM_RETRANSMIT_MAX 1000    // Longest retransmit timeout (ms)
+#define STREAM_DUPLICATE_ACKS 2       // Duplicate acks that trigger a resend
+#define STREAM_SEGMENTS_PER_UPDATE 8  // Frames sent per update()
 
 class NetworkSerial {
  public:
@@ -40,21 +92,332 @@ class NetworkSerial {
    */
   bool forwardSerialData(const char* data);
 
+  /**
+   * Forward raw serial bytes to all boards on the network
+   *
+   * The bytes are sent as they are, without JSON escaping, so they may
+   * contain NUL bytes. Boards running firmware without binary frames drop
+   * them.
+   *
+   * @param data The bytes to forward
+   * @param length Number of bytes
+   * @return true if the data was sent successfully
+   */
+  bool forwardSerialData(const uint8_t* data, size_t length);
+
   /**
    * Receive serial data from other boards
    *
+   * Up to MAX_SERIAL_DATA_CALLBACKS callbacks, of any kind, receive all
+   * serial data.
+   * Each call adds a callback rather than replacing the last one. A NULL
+   * callback removes them all; a plain NULL matches both this and the
+   * binary overload, so call stopReceivingSerialData() instead.
+   *
    * @param callback Function to call when serial data is received
-   * @return true if the callback was set successfully
+   * @return true if the callback was added successfully
    */
   bool receiveSerialData(SerialDataCallback callback);
 
+  /**
+   * Receive serial data from other boards as raw bytes
+   *
+   * The data pointer refers to the receive buffer and is only valid during
+   * the callback.
+   *
+   * @param callback Function to call when serial data is received
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(BinarySerialDataCallback callback);
+
+  /**
+   * Receive serial data with a callback that receives a user context
+   *
+   * @param callback Function to call when serial data is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(SerialDataContextCallback callback, void* context);
+
+  /**
+   * Receive serial data as raw bytes with a callback that receives a user
+   * context
+   *
+   * @param callback Function to call when serial data is received
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was added successfully
+   */
+  bool receiveSerialData(BinarySerialDataContextCallback callback,
+                         void* context);
+
   /**
    * Stop receiving serial data
    *
-   * @return true if the callback was cleared successfully
+   * @return true if the callbacks were cleared successfully
    */
   bool stopReceivingSerialData();
 
+  /**
+   * Remove the serial data callbacks registered with a context
+   *
+   * @param context The context passed to receiveSerialData()
+   * @return true if a callback was removed
+   */
+  bool stopReceivingSerialData(void* context);
+
+  /**
+   * Remove a serial data callback registered without a context
+   *
+   * @param callback The callback passed to receiveSerialData()
+   * @return true if the callback was removed
+   */
+  bool removeSerialDataCallback(SerialDataCallback callback);
+
+  /**
+   * Remove a raw byte callback registered without a context
+   *
+   * @param callback The callback passed to receiveSerialData()
+   * @return true if the callback was removed
+   */
+  bool removeSerialDataCallback(BinarySerialDataCallback callback);
+
+  /**
+   * Open a numbered virtual serial channel
+   *
+   * Data written to the channel goes only to its targets, or to all boards
+   * when it has none. Received data is accepted only from the targets and
+   * only by boards that opened the same channel number, so several bridges
+   * can share the air without seeing each other's bytes.
+   *
+   * @param channel Channel number, 1 to 255
+   * @param targets Boards at the other end, or NULL for all boards
+   * @param targetCount Number of targets, at most MAX_SERIAL_CHANNEL_TARGETS
+   * @return true if the channel was opened successfully
+   */
+  bool openSerialChannel(uint8_t channel, const char* const* targets,
+                         uint8_t targetCount);
+
+  /**
+   * Open a numbered virtual serial channel to a single board
+   *
+   * @param channel Channel number, 1 to 255
+   * @param target The board at the other end, or NULL for all boards
+   * @return true if the channel was opened successfully
+   */
+  bool openSerialChannel(uint8_t channel, const char* target);
+
+  /**
+   * Close a virtual serial channel, dropping its buffered data
+   *
+   * @param channel Channel number
+   * @return true if the channel was closed
+   */
+  bool closeSerialChannel(uint8_t channel);
+
+  /**
+   * Send bytes on a virtual serial channel
+   *
+   * @param channel Channel number
+   * @param data The bytes to send, may contain any value
+   * @param length Number of bytes
+   * @return true if the data was sent to every target
+   */
+  bool writeSerialChannel(uint8_t channel, const uint8_t* data, size_t length);
+
+  /**
+   * Read bytes buffered on a virtual serial channel
+   *
+   * Data is buffered only while the channel has no receive callback.
+   *
+   * @param channel Channel number
+   * @param buffer Buffer for the bytes
+   * @param length Size of the buffer
+   * @return The number of bytes read
+   */
+  size_t readSerialChannel(uint8_t channel, uint8_t* buffer, size_t length);
+
+  /**
+   * Get the number of bytes buffered on a virtual serial channel
+   *
+   * @param channel Channel number
+   * @return The number of bytes available
+   */
+  int serialChannelAvailable(uint8_t channel);
+
+  /**
+   * Receive the data of a virtual serial channel with a callback
+   *
+   * @param channel Channel number
+   * @param callback Function to call with received data, or NULL to buffer
+   * it for readSerialChannel() instead
+   * @return true if the callback was set successfully
+   */
+  bool receiveSerialChannel(uint8_t channel,
+                            BinarySerialDataCallback callback);
+
+  /**
+   * Receive the data of a virtual serial channel with a callback that
+   * receives a user context
+   *
+   * @param channel Channel number
+   * @param callback Function to call with received data
+   * @param context Passed to the callback as its first argument
+   * @return true if the callback was set successfully
+   */
+  bool receiveSerialChannel(uint8_t channel,
+                            BinarySerialDataContextCallback callback,
+                            void* context);
+
+  /**
+   * Bridge a virtual serial channel to a UART
+   *
+   * update() sends bytes received on the UART over the channel, and writes
+   * bytes received on the channel to the UART without blocking.
+   *
+   * @param channel Channel number
+   * @param port The UART, or NULL to stop bridging
+   * @return true if the setting was applied successfully
+   */
+  bool bridgeSerialChannel(uint8_t channel, HardwareSerial* port);
+
+  /**
+   * Get the counters of a virtual serial channel
+   *
+   * @param channel Channel number
+   * @param stats Filled with the counters
+   * @return true if the channel is open
+   */
+  bool getSerialChannelStats(uint8_t channel, SerialChannelStats& stats);
+
+  /**
+   * Handle a virtual serial channel frame
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the data
+   * @param data The frame body, starting with the channel number
+   * @param length Number of bytes
+   * @return true if the data was handled successfully
+   */
+  bool handleSerialChannelData(const char* sender, const uint8_t* data,
+                               size_t length);
+
+  /**
+   * Open a reliable byte stream to another board
+   *
+   * Both boards open the stream to each other. Bytes written on one side
+   * are read on the other in order, without loss or duplication, and may
+   * contain any value. The sender never has more in flight than the
+   * receiver has buffer space for. Only one stream is open at a time;
+   * opening a new one closes the previous stream.
+   *
+   * @param boardId The board at the other end
+   * @return true if the stream was opened successfully
+   */
+  bool openSerialStream(const char* boardId);
+
+  /**
+   * Close the stream, dropping any buffered data
+   *
+   * @return true if a stream was closed
+   */
+  bool closeSerialStream();
+
+  /**
+   * Check if a stream is open
+   *
+   * @return true if a stream is open, false otherwise
+   */
+  bool isSerialStreamOpen();
+
+  /**
+   * Queue bytes for the stream
+   *
+   * Full frames are sent straight away; the remainder is sent from update()
+   * or flushSerialStream(), so many small writes share a frame. Only as many
+   * bytes as fit in the transmit buffer are taken.
+   *
+   * @param data The bytes to send
+   * @param length Number of bytes
+   * @return The number of bytes queued
+   */
+  size_t writeSerialStream(const uint8_t* data, size_t length);
+
+  /**
+   * Read bytes received on the stream
+   *
+   * @param buffer Buffer for the bytes
+   * @param length Size of the buffer
+   * @return The number of bytes read
+   */
+  size_t readSerialStream(uint8_t* buffer, size_t length);
+
+  /**
+   * Get the next received byte without consuming it
+   *
+   * @return The byte, or -1 if none is available
+   */
+  int peekSerialStream();
+
+  /**
+   * Send queued bytes now instead of from the next update()
+   *
+   * Does not wait for the peer to acknowledge them.
+   *
+   * @return true if a stream is open
+   */
+  bool flushSerialStream();
+
+  /**
+   * Get the number of received bytes waiting to be read
+   *
+   * @return The number of bytes available
+   */
+  int serialStreamAvailable();
+
+  /**
+   * Get the free space in the transmit buffer
+   *
+   * @return The number of bytes writeSerialStream() would take
+   */
+  int serialStreamWritable();
+
+  /**
+   * Bridge the stream to a UART
+   *
+   * update() moves bytes received on the UART into the stream, and bytes
+   * received on the stream out of the UART, without blocking. Give the UART
+   * a receive buffer of at least STREAM_TX_BUFFER_SIZE bytes at high baud
+   * rates.
+   *
+   * @param port The UART, or NULL to stop bridging
+   * @return true if the setting was applied successfully
+   */
+  bool bridgeSerialStream(HardwareSerial* port);
+
+  /**
+   * Handle a stream data frame
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the frame
+   * @param data The frame body
+   * @param length Number of bytes
+   * @return true if the frame was handled successfully
+   */
+  bool handleStreamData(const char* sender, const uint8_t* data,
+                        size_t length);
+
+  /**
+   * Handle a stream acknowledgement
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the acknowledgement
+   * @param data The frame body
+   * @param length Number of bytes
+   * @return true if the acknowledgement was handled successfully
+   */
+  bool handleStreamAck(const char* sender, const uint8_t* data,
+                       size_t length);
+
   /**
    * Handle serial data message
    * Called internally by NetworkCore
@@ -66,8 +429,25 @@ class NetworkSerial {
   bool handleSerialDataMessage(const char* sender, const char* data);
 
   /**
-   * Enable automatic forwarding of local Serial input
-   * This will read from Serial and forward to all boards
+   * Handle a binary serial data frame
+   * Called internally by NetworkCore
+   *
+   * @param sender The ID of the board that sent the data
+   * @param data The serial data
+   * @param length Number of bytes
+   * @return true if the data was handled successfully
+   */
+  bool handleBinarySerialData(const char* sender, const uint8_t* data,
+                              size_t length);
+
+  /**
+   * Enable automatic forwarding of local serial input
+   *
+   * Input from the forwarding port, Serial by default, is read in bulk from
+   * the UART driver's receive event and broadcast to all boards, so it does
+   * not depend on how often update() runs. Data is sent after a delimiter,
+   * once the size threshold is reached, or when the line has been idle for
+   * the idle gap; see setAutoForwardingFlush().
    *
    * @param enable true to enable, false to disable
    * @return true if the setting was applied successfully
@@ -75,23 +455,123 @@ class NetworkSerial {
   bool enableAutoForwarding(bool enable);
 
   /**
-   * Update function that must be called regularly if auto-forwarding is enabled
-   * This handles reading from Serial and forwarding
+   * Set the UART whose input is forwarded
+   *
+   * @param port The UART, e.g. &Serial2
+   * @return true if the port was set successfully
+   */
+  bool setAutoForwardingPort(HardwareSerial* port);
+
+  /**
+   * Set when buffered serial input is forwarded
+   *
+   * @param idleGapUs Forward once no byte has arrived for this long, 0 to
+   * forward whatever each receive event delivers
+   * @param sizeThreshold Forward once this many bytes are buffered, at most
+   * MAX_SERIAL_DATA_SIZE
+   * @param delimiters Forward after any of these bytes, up to
+   * MAX_SERIAL_DELIMITERS of them, or NULL or "" for none
+   * @return true if the policy was applied successfully
+   */
+  bool setAutoForwardingFlush(uint32_t idleGapUs, size_t sizeThreshold,
+                              const char* delimiters);
+
+  /**
+   * Update function that must be called regularly
+   * This services an open serial stream
    */
   void update();
 
+  /**
+   * Check if serial data from other boards is received
+   * Called internally by NetworkDiscovery for the capability record
+   *
+   * @return true if a serial data callback, channel or stream is open
+   */
+  bool hasOpenChannels();
+
  private:
   // Reference to the core network instance
   NetworkCore& _core;
 
-  // Serial data callback
-  SerialDataCallback _serialDataCallback;
+  // Serial data callbacks
+  CallbackSlot _serialCallbacks[MAX_SERIAL_DATA_CALLBACKS];
+
+  static void callSerialCallback(const CallbackSlot& callback,
+                                 const char* sender, const char*& text,
+                                 const uint8_t* data, size_t length,
+                                 char* copy);
 
-  // Auto-forwarding state
+  // Auto-forwarding state, shared by the UART event task and the idle timer
   bool _autoForwardingEnabled;
-  char _serialBuffer[MAX_SERIAL_DATA_SIZE];
-  int _serialBufferIndex;
-  unsigned long _lastSerialRead;
+  HardwareSerial* _forwardPort;
+  uint8_t _serialBuffer[MAX_SERIAL_DATA_SIZE];
+  size_t _serialBufferIndex;
+  uint32_t _flushIdleUs;
+  size_t _flushSize;
+  char _flushDelimiters[MAX_SERIAL_DELIMITERS + 1];
+  esp_timer_handle_t _flushTimer;
+  SemaphoreHandle_t _forwardMutex;
+
+  void ingestSerial();
+  void flushSerialBuffer();
+  static void onFlushTimer(void* arg);
+
+  // Virtual serial channels
+  struct SerialChannel {
+    uint8_t number;
+    bool active;
+    char targets[MAX_SERIAL_CHANNEL_TARGETS][32];
+    uint8_t targetCount;  // 0 for all boards
+    CallbackSlot callback;
+    HardwareSerial* bridge;
+    uint8_t buffer[SERIAL_CHANNEL_BUFFER_SIZE];
+    uint16_t head;
+    uint16_t count;
+    SerialChannelStats stats;
+  };
+
+  SerialChannel _channels[MAX_SERIAL_CHANNELS];
+  portMUX_TYPE _channelLock;
+
+  SerialChannel* findSerialChannel(uint8_t channel);
+  void updateChannelBridges();
+
+  // Reliable stream state. Byte offsets serve as sequence numbers; each
+  // direction has its own session so a restarted peer is detected.
+  bool _streamOpen;
+  char _streamPeer[32];
+  HardwareSerial* _streamBridge;
+  portMUX_TYPE _streamLock;
+
+  uint8_t _txBuffer[STREAM_TX_BUFFER_SIZE];
+  uint8_t _txSession;
+  uint32_t _txAcked;    // Offset the peer has confirmed
+  uint32_t _txSent;     // Next offset to send
+  uint32_t _txWritten;  // Offset after the last queued byte
+  uint32_t _txCredit;   // Offset the peer has buffer space up to
+  uint32_t _txLastProgress;
+  uint32_t _txTimeout;
+  uint8_t _txDuplicateAcks;
+  bool _txRecovering;  // Resending after a loss, ignore duplicate acks
+
+  uint8_t _rxBuffer[STREAM_RX_BUFFER_SIZE];
+  uint8_t _rxSession;
+  bool _rxSynced;
+  uint32_t _rxNext;        // Next offset expected from the peer
+  uint32_t _rxRead;        // Offset the application has read up to
+  uint32_t _rxAdvertised;  // Credit last advertised to the peer
+
+  // Stream helpers
+  void resetStream();
+  void pumpStream(bool partial);
+  void checkStreamTimeout();
+  void updateStreamBridge();
+  size_t streamSegmentSize();
+  void restartTxSession();
+  bool sendStreamAck(uint8_t session, uint32_t offset, uint32_t window,
+                     bool reset = false);
+  bool sendStreamData(uint32_t offset, const uint8_t* data, size_t length);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,112 @@
+/**
+ * NetworkStream.h - Arduino Stream over a reliable serial stream
+ * Created as part of the NetworkComm library refactoring
+ *
+ * This class lets Stream and Print based code, such as command parsers and
+ * loggers, run over the reliable byte stream of NetworkSerial.
+ */
+
+#ifndef NetworkStream_h
+#define NetworkStream_h
+
+#include <Arduino.h>
+
+#include "NetworkSerial.h"
+
+class NetworkStream : public Stream {
+ public:
+  /**
+   * Constructor for NetworkStream
+   *
+   * @param serial Reference to the NetworkSerial instance carrying the stream
+   */
+  NetworkStream(NetworkSerial& serial);
+
+  /**
+   * Open the stream to another board
+   *
+   * Both boards open the stream to each other. Opening the stream through
+   * NetworkSerial works the same; the adapter always uses the one stream
+   * NetworkSerial holds.
+   *
+   * @param boardId The board at the other end
+   * @return true if the stream was opened successfully
+   */
+  bool begin(const char* boardId);
+
+  /**
+   * Close the stream, dropping any buffered data
+   */
+  void end();
+
+  /**
+   * Check if the stream is open
+   *
+   * @return true if the stream is open, false otherwise
+   */
+  operator bool();
+
+  /**
+   * Get the number of received bytes waiting to be read
+   *
+   * @return The number of bytes available
+   */
+  int available() override;
+
+  /**
+   * Read one received byte
+   *
+   * @return The byte, or -1 if none is available
+   */
+  int read() override;
+
+  /**
+   * Get the next received byte without consuming it
+   *
+   * @return The byte, or -1 if none is available
+   */
+  int peek() override;
+
+  /**
+   * Queue one byte for sending
+   *
+   * Bytes are coalesced into full frames. A partial frame is sent from the
+   * next update() or by flush().
+   *
+   * @param value The byte to send
+   * @return 1 if the byte was queued, 0 if the stream is closed or stayed
+   * full for the stream timeout
+   */
+  size_t write(uint8_t value) override;
+
+  /**
+   * Queue bytes for sending
+   *
+   * While the transmit buffer is full, keeps sending for up to the stream
+   * timeout (setTimeout(), one second by default) for the peer to make room.
+   *
+   * @param buffer The bytes to send
+   * @param size Number of bytes
+   * @return The number of bytes queued
+   */
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  /**
+   * Get the free space in the transmit buffer
+   *
+   * @return The number of bytes write() takes without waiting
+   */
+  int availableForWrite() override;
+
+  /**
+   * Send queued bytes now, without waiting for the acknowledgement
+   */
+  void flush() override;
+
+ private:
+  // Reference to the serial instance holding the stream
+  NetworkSerial& _serial;
+};
+
+#endif
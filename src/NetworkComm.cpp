@@ -7,6 +7,8 @@
 
 #include "NetworkComm.h"
 
+#include <new>
+
 // Constructor
 NetworkComm::NetworkComm()
     : _core(),
@@ -14,10 +16,14 @@ NetworkComm::NetworkComm()
       _pinControl(_core),
       _messaging(_core),
       _serial(_core),
-      _diagnostics(_core) {
+      _stream(_serial),
+      _diagnostics(_core),
+      _gateway(NULL) {
   // All initialization is done in begin()
 }
 
+NetworkComm::~NetworkComm() { delete _gateway; }
+
 // Initialize with WiFi
 bool NetworkComm::begin(const char* ssid, const char* password,
                         const char* boardId) {
@@ -26,9 +32,35 @@ bool NetworkComm::begin(const char* ssid, const char* password,
     return false;
   }
 
+  startModules();
+  return true;
+}
+
+bool NetworkComm::beginEspNowOnly(const char* boardId, uint8_t channel) {
+  if (!_core.beginEspNowOnly(boardId, channel)) {
+    return false;
+  }
+
+  startModules();
+  return true;
+}
+
+void NetworkComm::enableWifiRetry(uint32_t intervalMs) {
+  _core.enableWifiRetry(intervalMs);
+}
+
+bool NetworkComm::setEspNowRate(wifi_phy_rate_t rate) {
+  return _core.setEspNowRate(rate);
+}
+
+// Helper method to register and initialize the modules after the core
+void NetworkComm::startModules() {
   // Register discovery handler
   _core.registerDiscoveryHandler(&_discovery);
   Serial.println("[NetworkComm] Registered discovery handler");
+  _core.registerPinControlHandler(&_pinControl);
+  _core.registerMessagingHandler(&_messaging);
+  _core.registerSerialHandler(&_serial);
 
   // Initialize all modules
   _discovery.begin();
@@ -36,8 +68,6 @@ bool NetworkComm::begin(const char* ssid, const char* password,
   _messaging.begin();
   _serial.begin();
   _diagnostics.begin();
-
-  return true;
 }
 
 // Main loop function - must be called in loop()
@@ -45,14 +75,23 @@ void NetworkComm::update() {
   // Update core and all modules
   _core.update();
   _discovery.update();
+  _messaging.update();
+  _pinControl.update();
   _diagnostics.update();
-  _serial.update();  // Only does work if auto-forwarding is enabled
+  _serial.update();  // Only does work with auto-forwarding or a stream
+  if (_gateway != NULL) _gateway->update();
 }
 
 // ==================== Network Status ====================
 
 bool NetworkComm::isConnected() { return _core.isConnected(); }
 
+uint8_t NetworkComm::getStartupState() { return _core.getStartupState(); }
+
+int32_t NetworkComm::getTimeToFirstFrame() {
+  return _core.getTimeToFirstFrame();
+}
+
 // ==================== Board Discovery ====================
 
 bool NetworkComm::isBoardAvailable(const char* boardId) {
@@ -71,6 +110,194 @@ bool NetworkComm::onBoardDiscovered(DiscoveryCallback callback) {
   return _discovery.onBoardDiscovered(callback);
 }
 
+bool NetworkComm::onBoardDiscovered(DiscoveryContextCallback callback,
+                                    void* context) {
+  return _discovery.onBoardDiscovered(callback, context);
+}
+
+bool NetworkComm::removeDiscoveryCallbacks(void* context) {
+  return _discovery.removeDiscoveryCallbacks(context);
+}
+
+bool NetworkComm::onBoardLost(DiscoveryCallback callback) {
+  return _discovery.onBoardLost(callback);
+}
+
+bool NetworkComm::onBoardLost(DiscoveryContextCallback callback,
+                              void* context) {
+  return _discovery.onBoardLost(callback, context);
+}
+
+bool NetworkComm::setPeerTimeout(uint32_t timeoutMs) {
+  return _discovery.setPeerTimeout(timeoutMs);
+}
+
+bool NetworkComm::isBoardSuspect(const char* boardId) {
+  return _discovery.isBoardSuspect(boardId);
+}
+
+bool NetworkComm::advertiseService(const char* service) {
+  return _discovery.advertiseService(service);
+}
+
+bool NetworkComm::withdrawService(const char* service) {
+  return _discovery.withdrawService(service);
+}
+
+bool NetworkComm::setFirmwareVersion(const char* version) {
+  return _discovery.setFirmwareVersion(version);
+}
+
+uint8_t NetworkComm::getBoardFeatures(const char* boardId) {
+  return _discovery.getBoardFeatures(boardId);
+}
+
+uint8_t NetworkComm::getBoardProtocolVersion(const char* boardId) {
+  return _discovery.getBoardProtocolVersion(boardId);
+}
+
+String NetworkComm::getBoardFirmwareVersion(const char* boardId) {
+  return _discovery.getBoardFirmwareVersion(boardId);
+}
+
+bool NetworkComm::boardOffersService(const char* boardId,
+                                     const char* service) {
+  return _discovery.boardOffersService(boardId, service);
+}
+
+int NetworkComm::getBoardsWithServiceCount(const char* service) {
+  return _discovery.getBoardsWithServiceCount(service);
+}
+
+String NetworkComm::getBoardWithService(const char* service, int index) {
+  return _discovery.getBoardWithService(service, index);
+}
+
+bool NetworkComm::boardMaySubscribe(const char* boardId,
+                                    const char* topicFilter) {
+  return _discovery.boardMaySubscribe(boardId, topicFilter);
+}
+
+// ==================== Mesh Relay ====================
+
+bool NetworkComm::enableMeshRelay(bool enable, uint8_t ttl) {
+  return _core.enableMeshRelay(enable, ttl);
+}
+
+bool NetworkComm::isMeshRelayEnabled() { return _core.isMeshRelayEnabled(); }
+
+int NetworkComm::getHopCount(const char* boardId) {
+  return _core.getHopCount(boardId);
+}
+
+// ==================== Store and Forward ====================
+
+bool NetworkComm::setStoredMessageLifetime(uint32_t lifetimeMs) {
+  return _core.setStoredMessageLifetime(lifetimeMs);
+}
+
+int NetworkComm::getStoredMessageCount(const char* boardId) {
+  return _core.getStoredMessageCount(boardId);
+}
+
+bool NetworkComm::clearStoredMessages(const char* boardId) {
+  return _core.clearStoredMessages(boardId);
+}
+
+// ==================== Peer Cache ====================
+
+bool NetworkComm::enablePeerCache(bool enable) {
+  return _core.enablePeerCache(enable);
+}
+
+bool NetworkComm::savePeerCache() { return _core.savePeerCache(); }
+
+bool NetworkComm::clearPeerCache() { return _core.clearPeerCache(); }
+
+// ==================== Compression ====================
+
+bool NetworkComm::enableCompression(bool enable) {
+  return _core.enableCompression(enable);
+}
+
+bool NetworkComm::setCompression(uint8_t messageType, bool enable) {
+  return _core.setCompression(messageType, enable);
+}
+
+bool NetworkComm::setBroadcastCompression(bool enable) {
+  return _core.setBroadcastCompression(enable);
+}
+
+bool NetworkComm::isCompressionEnabled(uint8_t messageType) {
+  return _core.isCompressionEnabled(messageType);
+}
+
+bool NetworkComm::getCompressionStats(uint32_t& payloadBytes,
+                                      uint32_t& sentBytes) {
+  return _core.getCompressionStats(payloadBytes, sentBytes);
+}
+
+// ==================== MQTT Gateway ====================
+
+bool NetworkComm::setMqttClient(Client& client) {
+  NetworkGateway* gateway = this->gateway();
+  return gateway != NULL && gateway->setMqttClient(client);
+}
+
+bool NetworkComm::startMqttGateway(const char* host, uint16_t port,
+                                   const char* clientId, const char* username,
+                                   const char* password) {
+  NetworkGateway* gateway = this->gateway();
+  return gateway != NULL && gateway->startMqttGateway(host, port, clientId,
+                                                      username, password);
+}
+
+bool NetworkComm::stopMqttGateway() {
+  return _gateway != NULL && _gateway->stopMqttGateway();
+}
+
+bool NetworkComm::isMqttConnected() {
+  return _gateway != NULL && _gateway->isMqttConnected();
+}
+
+bool NetworkComm::bridgeTopicToMqtt(const char* topicFilter,
+                                    const char* mqttPrefix) {
+  NetworkGateway* gateway = this->gateway();
+  return gateway != NULL && gateway->bridgeTopicToMqtt(topicFilter, mqttPrefix);
+}
+
+bool NetworkComm::bridgeTopicFromMqtt(const char* mqttPrefix,
+                                      const char* topicPrefix) {
+  NetworkGateway* gateway = this->gateway();
+  return gateway != NULL &&
+         gateway->bridgeTopicFromMqtt(mqttPrefix, topicPrefix);
+}
+
+bool NetworkComm::clearGatewayRoutes() {
+  return _gateway == NULL || _gateway->clearGatewayRoutes();
+}
+
+int NetworkComm::getGatewayBacklog() {
+  return _gateway != NULL ? _gateway->getGatewayBacklog() : 0;
+}
+
+uint32_t NetworkComm::getGatewayDropped() {
+  return _gateway != NULL ? _gateway->getGatewayDropped() : 0;
+}
+
+// Helper method to create the gateway the first time it is configured
+NetworkGateway* NetworkComm::gateway() {
+  if (_gateway == NULL) {
+    _gateway = new (std::nothrow) NetworkGateway(_core, _messaging);
+    if (_gateway == NULL) {
+      Serial.println("[NetworkComm] Error: No memory for the MQTT gateway");
+      return NULL;
+    }
+    _gateway->begin();
+  }
+  return _gateway;
+}
+
 // ==================== Debug & Diagnostic Features ====================
 
 bool NetworkComm::enableMessageAcknowledgements(bool enable) {
@@ -129,12 +356,94 @@ uint8_t NetworkComm::readRemotePin(const char* targetBoardId, uint8_t pin) {
   return _pinControl.readRemotePin(targetBoardId, pin);
 }
 
+// ==================== Scheduled Pin Control ====================
+
+uint32_t NetworkComm::getNetworkTime() { return _core.getNetworkTime(); }
+
+bool NetworkComm::controlRemotePinAt(const char* targetBoardId, uint8_t pin,
+                                     uint8_t value, uint32_t networkTime) {
+  return _pinControl.controlRemotePinAt(targetBoardId, pin, value,
+                                        networkTime);
+}
+
+bool NetworkComm::controlRemotePinsAt(const char* const* targetBoardIds,
+                                      uint8_t boardCount, uint8_t pin,
+                                      uint8_t value, uint32_t networkTime) {
+  return _pinControl.controlRemotePinsAt(targetBoardIds, boardCount, pin,
+                                         value, networkTime);
+}
+
+bool NetworkComm::syncClockWith(const char* targetBoardId) {
+  return _pinControl.syncClockWith(targetBoardId);
+}
+
+bool NetworkComm::onScheduledPinResult(PinScheduleCallback callback) {
+  return _pinControl.onScheduledPinResult(callback);
+}
+
+// ==================== Group Pin Control ====================
+
+bool NetworkComm::defineBoardGroup(const char* groupName,
+                                   const char* const* boardIds,
+                                   uint8_t memberCount) {
+  return _pinControl.defineBoardGroup(groupName, boardIds, memberCount);
+}
+
+bool NetworkComm::removeBoardGroup(const char* groupName) {
+  return _pinControl.removeBoardGroup(groupName);
+}
+
+const char* NetworkComm::getBoardGroupMember(const char* groupName,
+                                             uint8_t index) {
+  return _pinControl.getBoardGroupMember(groupName, index);
+}
+
+bool NetworkComm::controlGroupPin(const char* groupName, uint8_t pin,
+                                  uint8_t value,
+                                  PinGroupConfirmCallback callback) {
+  return _pinControl.controlGroupPin(groupName, pin, value, callback);
+}
+
+// ==================== Remote Pin Sequences ====================
+
+bool NetworkComm::runRemotePinSequence(const char* targetBoardId,
+                                       uint8_t sequenceId,
+                                       const PinSequence& sequence) {
+  return _pinControl.runRemotePinSequence(targetBoardId, sequenceId, sequence);
+}
+
+bool NetworkComm::stopRemotePinSequence(const char* targetBoardId,
+                                        uint8_t sequenceId) {
+  return _pinControl.stopRemotePinSequence(targetBoardId, sequenceId);
+}
+
+bool NetworkComm::onPinSequenceStatus(PinSequenceCallback callback) {
+  return _pinControl.onPinSequenceStatus(callback);
+}
+
+// ==================== Remote Bus Transactions ====================
+
+bool NetworkComm::submitBusTransactions(const char* targetBoardId,
+                                        uint8_t batchId,
+                                        const BusTransactionBatch& batch) {
+  return _pinControl.submitBusTransactions(targetBoardId, batchId, batch);
+}
+
+bool NetworkComm::onBusResponse(BusResponseCallback callback) {
+  return _pinControl.onBusResponse(callback);
+}
+
 // ==================== Remote Pin Control (Responder Side) ====================
 
 bool NetworkComm::handlePinControl(PinChangeCallback callback) {
   return _pinControl.handlePinControl(callback);
 }
 
+bool NetworkComm::handlePinControl(PinChangeContextCallback callback,
+                                   void* context) {
+  return _pinControl.handlePinControl(callback, context);
+}
+
 bool NetworkComm::stopHandlingPinControl() {
   return _pinControl.stopHandlingPinControl();
 }
@@ -145,11 +454,29 @@ bool NetworkComm::acceptPinControlFrom(const char* controllerBoardId,
   return _pinControl.acceptPinControlFrom(controllerBoardId, pin, callback);
 }
 
+bool NetworkComm::acceptPinControlFrom(const char* controllerBoardId,
+                                       uint8_t pin,
+                                       PinChangeContextCallback callback,
+                                       void* context) {
+  return _pinControl.acceptPinControlFrom(controllerBoardId, pin, callback,
+                                          context);
+}
+
 bool NetworkComm::stopAcceptingPinControlFrom(const char* controllerBoardId,
                                               uint8_t pin) {
   return _pinControl.stopAcceptingPinControlFrom(controllerBoardId, pin);
 }
 
+bool NetworkComm::enableBusProxy(const char* const* allowedBoardIds,
+                                 uint8_t allowedCount, TwoWire* wire,
+                                 SPIClass* spi, const uint8_t* csPins,
+                                 uint8_t csPinCount, uint32_t spiFrequency) {
+  return _pinControl.enableBusProxy(allowedBoardIds, allowedCount, wire, spi,
+                                    csPins, csPinCount, spiFrequency);
+}
+
+bool NetworkComm::disableBusProxy() { return _pinControl.disableBusProxy(); }
+
 // ==================== Pin State Broadcasting ====================
 
 bool NetworkComm::broadcastPinState(uint8_t pin, uint8_t value) {
@@ -162,6 +489,14 @@ bool NetworkComm::listenForPinStateFrom(const char* broadcasterBoardId,
   return _pinControl.listenForPinStateFrom(broadcasterBoardId, pin, callback);
 }
 
+bool NetworkComm::listenForPinStateFrom(const char* broadcasterBoardId,
+                                        uint8_t pin,
+                                        PinChangeContextCallback callback,
+                                        void* context) {
+  return _pinControl.listenForPinStateFrom(broadcasterBoardId, pin, callback,
+                                           context);
+}
+
 bool NetworkComm::stopListeningForPinStateFrom(const char* broadcasterBoardId,
                                                uint8_t pin) {
   return _pinControl.stopListeningForPinStateFrom(broadcasterBoardId, pin);
@@ -169,39 +504,232 @@ bool NetworkComm::stopListeningForPinStateFrom(const char* broadcasterBoardId,
 
 // ==================== Topic-based Messaging ====================
 
-bool NetworkComm::publishTopic(const char* topic, const char* message) {
-  return _messaging.publishTopic(topic, message);
+bool NetworkComm::publishTopic(const char* topic, const char* message,
+                               uint8_t flags) {
+  return _messaging.publishTopic(topic, message, flags);
+}
+
+bool NetworkComm::publishTopic(const char* topic, const uint8_t* data,
+                               size_t length, uint8_t flags) {
+  return _messaging.publishTopic(topic, data, length, flags);
+}
+
+uint16_t NetworkComm::getTopicId(const char* topic) {
+  return _messaging.getTopicId(topic);
+}
+
+bool NetworkComm::setTopicUnicastThreshold(uint8_t maxPeers) {
+  return _messaging.setTopicUnicastThreshold(maxPeers);
 }
 
 bool NetworkComm::subscribeTopic(const char* topic, MessageCallback callback) {
   return _messaging.subscribeTopic(topic, callback);
 }
 
+bool NetworkComm::subscribeTopic(const char* topic,
+                                 BinaryMessageCallback callback) {
+  return _messaging.subscribeTopic(topic, callback);
+}
+
+bool NetworkComm::subscribeTopic(const char* topic,
+                                 MessageContextCallback callback,
+                                 void* context) {
+  return _messaging.subscribeTopic(topic, callback, context);
+}
+
+bool NetworkComm::subscribeTopic(const char* topic,
+                                 BinaryMessageContextCallback callback,
+                                 void* context) {
+  return _messaging.subscribeTopic(topic, callback, context);
+}
+
 bool NetworkComm::unsubscribeTopic(const char* topic) {
   return _messaging.unsubscribeTopic(topic);
 }
 
+bool NetworkComm::unsubscribeTopic(const char* topic, void* context) {
+  return _messaging.unsubscribeTopic(topic, context);
+}
+
 // ==================== Serial Data Forwarding ====================
 
 bool NetworkComm::forwardSerialData(const char* data) {
   return _serial.forwardSerialData(data);
 }
 
+bool NetworkComm::forwardSerialData(const uint8_t* data, size_t length) {
+  return _serial.forwardSerialData(data, length);
+}
+
 bool NetworkComm::receiveSerialData(SerialDataCallback callback) {
   return _serial.receiveSerialData(callback);
 }
 
+bool NetworkComm::receiveSerialData(BinarySerialDataCallback callback) {
+  return _serial.receiveSerialData(callback);
+}
+
+bool NetworkComm::receiveSerialData(SerialDataContextCallback callback,
+                                    void* context) {
+  return _serial.receiveSerialData(callback, context);
+}
+
+bool NetworkComm::receiveSerialData(BinarySerialDataContextCallback callback,
+                                    void* context) {
+  return _serial.receiveSerialData(callback, context);
+}
+
 bool NetworkComm::stopReceivingSerialData() {
   return _serial.stopReceivingSerialData();
 }
 
+bool NetworkComm::stopReceivingSerialData(void* context) {
+  return _serial.stopReceivingSerialData(context);
+}
+
+bool NetworkComm::removeSerialDataCallback(SerialDataCallback callback) {
+  return _serial.removeSerialDataCallback(callback);
+}
+
+bool NetworkComm::removeSerialDataCallback(BinarySerialDataCallback callback) {
+  return _serial.removeSerialDataCallback(callback);
+}
+
+bool NetworkComm::enableAutoForwarding(bool enable) {
+  return _serial.enableAutoForwarding(enable);
+}
+
+bool NetworkComm::setAutoForwardingPort(HardwareSerial* port) {
+  return _serial.setAutoForwardingPort(port);
+}
+
+bool NetworkComm::setAutoForwardingFlush(uint32_t idleGapUs,
+                                         size_t sizeThreshold,
+                                         const char* delimiters) {
+  return _serial.setAutoForwardingFlush(idleGapUs, sizeThreshold, delimiters);
+}
+
+bool NetworkComm::openSerialChannel(uint8_t channel, const char* const* targets,
+                                    uint8_t targetCount) {
+  return _serial.openSerialChannel(channel, targets, targetCount);
+}
+
+bool NetworkComm::openSerialChannel(uint8_t channel, const char* target) {
+  return _serial.openSerialChannel(channel, target);
+}
+
+bool NetworkComm::closeSerialChannel(uint8_t channel) {
+  return _serial.closeSerialChannel(channel);
+}
+
+bool NetworkComm::writeSerialChannel(uint8_t channel, const uint8_t* data,
+                                     size_t length) {
+  return _serial.writeSerialChannel(channel, data, length);
+}
+
+size_t NetworkComm::readSerialChannel(uint8_t channel, uint8_t* buffer,
+                                      size_t length) {
+  return _serial.readSerialChannel(channel, buffer, length);
+}
+
+int NetworkComm::serialChannelAvailable(uint8_t channel) {
+  return _serial.serialChannelAvailable(channel);
+}
+
+bool NetworkComm::receiveSerialChannel(uint8_t channel,
+                                       BinarySerialDataCallback callback) {
+  return _serial.receiveSerialChannel(channel, callback);
+}
+
+bool NetworkComm::receiveSerialChannel(
+    uint8_t channel, BinarySerialDataContextCallback callback, void* context) {
+  return _serial.receiveSerialChannel(channel, callback, context);
+}
+
+bool NetworkComm::bridgeSerialChannel(uint8_t channel, HardwareSerial* port) {
+  return _serial.bridgeSerialChannel(channel, port);
+}
+
+bool NetworkComm::getSerialChannelStats(uint8_t channel,
+                                        SerialChannelStats& stats) {
+  return _serial.getSerialChannelStats(channel, stats);
+}
+
+bool NetworkComm::openSerialStream(const char* boardId) {
+  return _serial.openSerialStream(boardId);
+}
+
+bool NetworkComm::closeSerialStream() { return _serial.closeSerialStream(); }
+
+bool NetworkComm::isSerialStreamOpen() { return _serial.isSerialStreamOpen(); }
+
+size_t NetworkComm::writeSerialStream(const uint8_t* data, size_t length) {
+  return _serial.writeSerialStream(data, length);
+}
+
+size_t NetworkComm::readSerialStream(uint8_t* buffer, size_t length) {
+  return _serial.readSerialStream(buffer, length);
+}
+
+int NetworkComm::serialStreamAvailable() {
+  return _serial.serialStreamAvailable();
+}
+
+int NetworkComm::serialStreamWritable() {
+  return _serial.serialStreamWritable();
+}
+
+bool NetworkComm::flushSerialStream() { return _serial.flushSerialStream(); }
+
+NetworkStream& NetworkComm::getSerialStream() { return _stream; }
+
+bool NetworkComm::bridgeSerialStream(HardwareSerial* port) {
+  return _serial.bridgeSerialStream(port);
+}
+
 // ==================== Direct Messaging ====================
 
 bool NetworkComm::sendMessageToBoardId(const char* targetBoardId,
-                                       const char* message) {
-  return _messaging.sendMessageToBoardId(targetBoardId, message);
+                                       const char* message, uint8_t flags) {
+  return _messaging.sendMessageToBoardId(targetBoardId, message, flags);
+}
+
+bool NetworkComm::sendMessageToBoardId(const char* targetBoardId,
+                                       const uint8_t* data, size_t length,
+                                       uint8_t flags) {
+  return _messaging.sendMessageToBoardId(targetBoardId, data, length, flags);
 }
 
 bool NetworkComm::receiveMessagesFromBoards(MessageCallback callback) {
   return _messaging.receiveMessagesFromBoards(callback);
 }
+
+bool NetworkComm::receiveMessagesFromBoards(BinaryMessageCallback callback) {
+  return _messaging.receiveMessagesFromBoards(callback);
+}
+
+bool NetworkComm::receiveMessagesFromBoards(MessageContextCallback callback,
+                                            void* context) {
+  return _messaging.receiveMessagesFromBoards(callback, context);
+}
+
+bool NetworkComm::receiveMessagesFromBoards(
+    BinaryMessageContextCallback callback, void* context) {
+  return _messaging.receiveMessagesFromBoards(callback, context);
+}
+
+bool NetworkComm::stopReceivingMessages() {
+  return _messaging.stopReceivingMessages();
+}
+
+bool NetworkComm::stopReceivingMessages(void* context) {
+  return _messaging.stopReceivingMessages(context);
+}
+
+bool NetworkComm::removeMessageCallback(MessageCallback callback) {
+  return _messaging.removeMessageCallback(callback);
+}
+
+bool NetworkComm::removeMessageCallback(BinaryMessageCallback callback) {
+  return _messaging.removeMessageCallback(callback);
+}
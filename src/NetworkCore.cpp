@@ -6,7 +6,47 @@
 #include "NetworkCore.h"
 
 #include "NetworkDiscovery.h"
+#include "NetworkMessaging.h"
 #include "NetworkPinControl.h"
+#include "NetworkSerial.h"
+
+// Compressed bodies are a sequence of tokens. A token below 0x80 is followed
+// by token + 1 literal bytes; otherwise it copies (token & 0x7F) + 3 bytes
+// from the distance given by the next byte plus one.
+#define COMPRESSION_MAX_LITERALS 128
+#define COMPRESSION_MIN_MATCH 3
+#define COMPRESSION_MAX_MATCH (0x7F + COMPRESSION_MIN_MATCH)
+#define COMPRESSION_MAX_DISTANCE 256
+
+// Match finder hash of the three bytes at p
+static inline uint8_t hashTriple(const uint8_t* p) {
+  uint32_t value = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (uint8_t)((value * 2654435761UL) >> (32 - COMPRESSION_HASH_BITS));
+}
+
+// Append literal runs for length bytes, returning false if they do not fit
+static bool writeLiterals(const uint8_t* data, size_t length, uint8_t* output,
+                          size_t capacity, size_t* written) {
+  while (length > 0) {
+    size_t run = length < COMPRESSION_MAX_LITERALS ? length
+                                                   : COMPRESSION_MAX_LITERALS;
+    if (*written + 1 + run > capacity) return false;
+    output[(*written)++] = run - 1;
+    memcpy(output + *written, data, run);
+    *written += run;
+    data += run;
+    length -= run;
+  }
+  return true;
+}
+
+// Value of a hex digit, or -1
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
 
 // Static instance pointer for callbacks
 NetworkCore* NetworkCore::_instance = nullptr;
@@ -14,6 +54,19 @@ NetworkCore* NetworkCore::_instance = nullptr;
 // Constructor
 NetworkCore::NetworkCore() {
   _isConnected = false;
+  _startupState = STARTUP_IDLE;
+  _espNowOnly = false;
+  _beginTime = 0;
+  _espNowRate = ESPNOW_PHY_RATE;
+  _ssid[0] = '\0';
+  _password[0] = '\0';
+  _wifiRetryInterval = 0;
+  _wifiRetrying = false;
+  _wifiRetryTime = 0;
+  _wifiRetryChannel = ESPNOW_DEFAULT_CHANNEL;
+  _firstFrameTime = 0;
+  _firstFrameSent = false;
+  _firstFrameReported = false;
   _peerCount = 0;
   _acknowledgementsEnabled = true;  // Enable acknowledgements by default
   _debugLoggingEnabled = false;     // Debug logging off by default
@@ -22,10 +75,14 @@ NetworkCore::NetworkCore() {
   _sendStatusCallback = NULL;
   _sendFailureCallback = NULL;
   _discoveryHandler = NULL;  // Initialize discovery handler to NULL
+  _pinControlHandler = NULL;
+  _messagingHandler = NULL;
+  _serialHandler = NULL;
 
   // Initialize peers
   for (int i = 0; i < MAX_PEERS; i++) {
     _peers[i].active = false;
+    _peers[i].cacheDirty = false;
   }
 
   // Initialize tracked messages
@@ -36,6 +93,44 @@ NetworkCore::NetworkCore() {
     _trackedMessages[i].value = 0;
   }
 
+  // Initialize the outbox
+  _outboxLock = portMUX_INITIALIZER_UNLOCKED;
+  for (int i = 0; i < MAX_OUTBOX_MESSAGES; i++) {
+    _outbox[i].active = false;
+  }
+
+  // Store-and-forward messages are loaded from flash in begin()
+  _storedSequence = 0;
+  _storedAgesSaved = 0;
+  _storedLifetime = STORED_MESSAGE_LIFETIME;
+  _storedCount = 0;
+  _storedPreferencesOpen = false;
+  _storedLock = portMUX_INITIALIZER_UNLOCKED;
+  _peerCacheEnabled = true;
+  _peerCacheOpen = false;
+  _peerCacheDirty = false;
+  _peerCacheDirtySince = 0;
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    _stored[i].used = false;
+  }
+
+  // Mesh relaying is off until enabled
+  _meshEnabled = false;
+  _meshTtl = MESH_DEFAULT_TTL;
+  _meshSequence = 0;
+  _meshSeenCount = 0;
+  _meshSeenNext = 0;
+  _meshLock = portMUX_INITIALIZER_UNLOCKED;
+  for (int i = 0; i < MAX_MESH_ROUTES; i++) {
+    _meshRoutes[i].active = false;
+  }
+
+  // Compression is off until enabled
+  _compressedTypes = 0;
+  _compressBroadcasts = false;
+  _compressionPayloadBytes = 0;
+  _compressionSentBytes = 0;
+
   // Store global instance pointer for callbacks
   _instance = this;
 }
@@ -64,29 +159,142 @@ bool NetworkCore::begin(const char* ssid, const char* password,
   sprintf(debugMsg, "board ID: %s, SSID: %s", boardId, ssid);
   debugLog("Initializing NetworkCore", debugMsg);
 
-  // Connect to WiFi - ESP-NOW needs WiFi in station mode
+  // Connect to WiFi - ESP-NOW needs WiFi in station mode. The connection is
+  // completed from update(), so begin() does not block.
+  _beginTime = millis();
+  _espNowOnly = false;
+  strncpy(_ssid, ssid, sizeof(_ssid) - 1);
+  _ssid[sizeof(_ssid) - 1] = '\0';
+  strncpy(_password, password ? password : "", sizeof(_password) - 1);
+  _password[sizeof(_password) - 1] = '\0';
   WiFi.mode(WIFI_STA);
   WiFi.begin(ssid, password);
 
-  // Wait for connection (with timeout)
-  unsigned long startTime = millis();
-  Serial.print("[NetworkCore] Connecting to WiFi...");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-    if (millis() - startTime > 10000) {
-      Serial.println();
-      Serial.println("[NetworkCore] WiFi connection timeout");
-      debugLog("WiFi connection timeout");
-      return false;  // Connection timeout
-    }
+  _startupState = STARTUP_CONNECTING;
+  Serial.println("[NetworkCore] Connecting to WiFi...");
+  return true;
+}
+
+bool NetworkCore::beginEspNowOnly(const char* boardId, uint8_t channel) {
+  if (!boardId || channel < 1 || channel > 14) return false;
+
+  strncpy(_boardId, boardId, sizeof(_boardId) - 1);
+  _boardId[sizeof(_boardId) - 1] = '\0';
+
+  Serial.print("[NetworkCore] Initializing board: ");
+  Serial.print(boardId);
+  Serial.print(", ESP-NOW only on channel ");
+  Serial.println(channel);
+
+  // Station mode without association; the radio stays on our channel
+  _beginTime = millis();
+  _espNowOnly = true;
+  _ssid[0] = '\0';
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  if (esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) != ESP_OK) {
+    Serial.println("[NetworkCore] Failed to set WiFi channel");
+    _startupState = STARTUP_FAILED;
+    return false;
+  }
+
+  return startEspNow();
+}
+
+void NetworkCore::enableWifiRetry(uint32_t intervalMs) {
+  _wifiRetryInterval = intervalMs;
+  if (intervalMs == 0 && _wifiRetrying) {
+    WiFi.disconnect();
+    _wifiRetrying = false;
+  }
+}
+
+bool NetworkCore::setEspNowRate(wifi_phy_rate_t rate) {
+  _espNowRate = rate;
+  if (!_isConnected) return true;  // Set by startEspNow()
+  return applyEspNowRate();
+}
+
+bool NetworkCore::applyEspNowRate() {
+  if (esp_wifi_config_espnow_rate(WIFI_IF_STA, _espNowRate) != ESP_OK) {
+    Serial.println("[NetworkCore] Failed to set the ESP-NOW rate");
+    return false;
+  }
+  return true;
+}
+
+// Advance the startup state machine while joining the access point
+void NetworkCore::updateStartup() {
+  if (WiFi.status() == WL_CONNECTED) {
+    Serial.print("[NetworkCore] Connected to WiFi, IP: ");
+    Serial.println(WiFi.localIP());
+    debugLog("WiFi connected successfully");
+
+    startEspNow();
+    return;
+  }
+
+  if (millis() - _beginTime < WIFI_CONNECT_TIMEOUT) return;
+
+  // ESP-NOW does not need the access point, so carry on without it
+  Serial.println("[NetworkCore] WiFi connection timeout, using ESP-NOW only");
+  debugLog("WiFi connection timeout");
+  WiFi.disconnect();
+  _espNowOnly = true;
+  _wifiRetryTime = millis();
+  if (esp_wifi_set_channel(ESPNOW_DEFAULT_CHANNEL, WIFI_SECOND_CHAN_NONE) !=
+      ESP_OK) {
+    Serial.println("[NetworkCore] Failed to set WiFi channel");
+  }
+  startEspNow();
+}
+
+// Try the access point again after falling back to ESP-NOW only. Only the
+// channel ESP-NOW is on is searched, so joining never moves the board away
+// from its peers.
+void NetworkCore::updateWifiRetry() {
+  uint32_t now = millis();
+  if (!_wifiRetrying) {
+    if (now - _wifiRetryTime < _wifiRetryInterval) return;
+
+    uint8_t channel = ESPNOW_DEFAULT_CHANNEL;
+    wifi_second_chan_t second;
+    esp_wifi_get_channel(&channel, &second);
+
+    Serial.print("[NetworkCore] Retrying WiFi connection on channel ");
+    Serial.println(channel);
+    _wifiRetrying = true;
+    _wifiRetryChannel = channel;
+    _wifiRetryTime = now;
+    WiFi.begin(_ssid, _password, channel);
+    return;
+  }
+
+  if (WiFi.status() == WL_CONNECTED) {
+    Serial.print("[NetworkCore] Connected to WiFi, IP: ");
+    Serial.print(WiFi.localIP());
+    Serial.print(", channel ");
+    Serial.println(WiFi.channel());
+    _wifiRetrying = false;
+    _espNowOnly = false;
+    return;
   }
-  Serial.println();
-  Serial.print("[NetworkCore] Connected to WiFi, IP: ");
-  Serial.println(WiFi.localIP());
 
-  debugLog("WiFi connected successfully");
+  if (now - _wifiRetryTime < WIFI_CONNECT_TIMEOUT) return;
 
+  // Still out of reach; make sure the radio is back on the channel the
+  // attempt started from until next time
+  WiFi.disconnect();
+  _wifiRetrying = false;
+  _wifiRetryTime = now;
+  if (esp_wifi_set_channel(_wifiRetryChannel, WIFI_SECOND_CHAN_NONE) !=
+      ESP_OK) {
+    Serial.println("[NetworkCore] Failed to set WiFi channel");
+  }
+}
+
+// Start ESP-NOW on the current channel and restore the state kept in flash
+bool NetworkCore::startEspNow() {
   // Get the MAC address
   WiFi.macAddress(_macAddress);
   char macStr[18];
@@ -102,11 +310,13 @@ bool NetworkCore::begin(const char* ssid, const char* password,
   if (esp_now_init() != ESP_OK) {
     Serial.println("[NetworkCore] ESP-NOW initialization failed");
     debugLog("ESP-NOW initialization failed");
+    _startupState = STARTUP_FAILED;
     return false;
   }
 
   Serial.println("[NetworkCore] ESP-NOW initialized successfully");
   debugLog("ESP-NOW initialized successfully");
+  applyEspNowRate();
 
   // Register callback for receiving data
   esp_err_t recv_result = esp_now_register_recv_cb(onDataReceived);
@@ -129,19 +339,53 @@ bool NetworkCore::begin(const char* ssid, const char* password,
     Serial.println("[NetworkCore] ESP-NOW send callback registered");
   }
 
+  // Start mesh sequence numbers at a random point so boards that restart
+  // are not mistaken for duplicates of their previous frames
+  _meshSequence = random(0, 65536);
+
+  // Pick up store-and-forward messages left from before a reboot
+  loadStoredMessages();
+
+  // Restore the boards known before the reboot, so messages to them need
+  // not wait for discovery
+  loadPeerCache();
+
   _isConnected = true;
+  _startupState = STARTUP_READY;
 
+  Serial.print("[NetworkCore] Ready ");
+  Serial.print(millis() - _beginTime);
+  Serial.println(" ms after begin()");
   debugLog("NetworkCore initialization complete");
 
   return true;
 }
 
+uint8_t NetworkCore::getStartupState() { return _startupState; }
+
+int32_t NetworkCore::getTimeToFirstFrame() {
+  return _firstFrameSent ? (int32_t)(_firstFrameTime - _beginTime) : -1;
+}
+
 // Main loop function - must be called regularly
 void NetworkCore::update() {
+  if (_startupState == STARTUP_CONNECTING) updateStartup();
   if (!_isConnected) return;
+  if (_espNowOnly && _ssid[0] != '\0' && _wifiRetryInterval != 0) {
+    updateWifiRetry();
+  }
 
   uint32_t currentTime = millis();
 
+  if (_firstFrameSent && !_firstFrameReported) {
+    _firstFrameReported = true;
+    Serial.print("[NetworkCore] First frame sent ");
+    Serial.print(getTimeToFirstFrame());
+    Serial.print(" ms after begin(), ");
+    Serial.print(_firstFrameTime);
+    Serial.println(" ms after boot");
+  }
+
   // Process message acknowledgements if enabled
   if (_acknowledgementsEnabled) {
     // Check for message timeouts
@@ -179,12 +423,21 @@ void NetworkCore::update() {
       }
     }
   }
-}
 
-bool NetworkCore::isConnected() {
-  return _isConnected && (WiFi.status() == WL_CONNECTED);
+  // Retry QoS 1 messages
+  updateOutbox();
+
+  // Deliver store-and-forward messages to boards that are back
+  updateStoredMessages();
+
+  // Write peer changes to flash once they have settled
+  updatePeerCache(false);
 }
 
+bool NetworkCore::isConnected() { return _isConnected; }
+
+uint32_t NetworkCore::getNetworkTime() { return micros(); }
+
 bool NetworkCore::enableMessageAcknowledgements(bool enable) {
   _acknowledgementsEnabled = enable;
   char debugMsg[50];
@@ -229,6 +482,12 @@ void IRAM_ATTR NetworkCore::onDataReceived(const uint8_t* mac,
 // Process ESP-NOW send status callback
 void NetworkCore::handleSendStatus(const uint8_t* mac_addr,
                                    esp_now_send_status_t status) {
+  // Time to first frame, reported from update()
+  if (!_firstFrameSent) {
+    _firstFrameTime = millis();
+    _firstFrameSent = true;
+  }
+
   // Find the board ID for this MAC address
   char targetBoardId[32] = {0};
   uint8_t messageType = 0;
@@ -293,6 +552,10 @@ void NetworkCore::handleSendStatus(const uint8_t* mac_addr,
 // Process incoming ESP-NOW messages
 void NetworkCore::processIncomingMessage(const uint8_t* mac,
                                          const uint8_t* data, int len) {
+  // Capture arrival time before parsing so scheduled commands see the
+  // smallest possible receive latency
+  uint32_t receivedAt = getNetworkTime();
+
   // Ensure the data is valid
   if (len <= 0 || len > MAX_ESP_NOW_DATA_SIZE || !data || !mac) return;
 
@@ -302,6 +565,18 @@ void NetworkCore::processIncomingMessage(const uint8_t* mac,
     Serial.println(len);
   }
 
+  // Binary frames are dispatched straight from the receive buffer
+  if (data[0] == BINARY_FRAME_MAGIC) {
+    processBinaryMessage(data, len, receivedAt);
+    return;
+  }
+
+  // Mesh frames are relayed and unwrapped
+  if (data[0] == MESH_FRAME_MAGIC) {
+    processMeshFrame(mac, data, len);
+    return;
+  }
+
   // Create a copy of the data with null-termination
   char* message = new char[len + 1];
   if (!message) {
@@ -327,10 +602,73 @@ void NetworkCore::processIncomingMessage(const uint8_t* mac,
     return;
   }
 
+  dispatchMessage(mac, doc.as<JsonObject>(), receivedAt);
+}
+
+// Parse a binary frame in place. The body handed to the modules points into
+// the receive buffer, so payloads are neither copied nor unescaped.
+void NetworkCore::processBinaryMessage(const uint8_t* data, size_t len,
+                                       uint32_t receivedAt) {
+  if (len < BINARY_FRAME_HEADER_SIZE) return;
+
+  uint8_t msgType = data[1];
+  uint8_t flags = data[2];
+  size_t senderLength = data[3];
+  size_t offset = BINARY_FRAME_HEADER_SIZE + senderLength;
+
+  char sender[32];
+  if (senderLength == 0 || senderLength >= sizeof(sender) || offset > len) {
+    return;
+  }
+  memcpy(sender, data + BINARY_FRAME_HEADER_SIZE, senderLength);
+  sender[senderLength] = '\0';
+
+  char messageId[37];
+  bool hasMessageId = (flags & BINARY_FRAME_HAS_MESSAGE_ID) != 0;
+  if (hasMessageId) {
+    if (offset + sizeof(messageId) - 1 > len) return;
+    memcpy(messageId, data + offset, sizeof(messageId) - 1);
+    messageId[sizeof(messageId) - 1] = '\0';
+    offset += sizeof(messageId) - 1;
+  }
+
+  const uint8_t* body = data + offset;
+  size_t bodyLength = len - offset;
+
+  // Compressed bodies are unpacked here, the modules never see them
+  uint8_t unpacked[MAX_ESP_NOW_DATA_SIZE];
+  if (flags & BINARY_FRAME_COMPRESSED) {
+    bodyLength = decompress(body, bodyLength, unpacked, sizeof(unpacked));
+    if (bodyLength == 0) {
+      Serial.print("[NetworkCore] Malformed compressed frame from: ");
+      Serial.println(sender);
+      return;
+    }
+    body = unpacked;
+  }
+
+  if (_verboseLoggingEnabled) {
+    Serial.print("[NetworkCore] From: ");
+    Serial.print(sender);
+    Serial.print(", binary type: ");
+    Serial.println(msgType);
+  }
+
+  noteBoardSeen(sender);
+  dispatchBinaryMessage(sender, msgType, hasMessageId ? messageId : NULL, body,
+                        bodyLength, receivedAt);
+}
+
+// Route a message to the module that handles its type. Used for frames
+// received over ESP-NOW and for messages addressed to this board.
+void NetworkCore::dispatchMessage(const uint8_t* mac, const JsonObject& doc,
+                                  uint32_t receivedAt) {
   // Get the sender ID and message type
   const char* sender = doc["sender"];
   uint8_t msgType = doc["type"];
 
+  noteBoardSeen(sender);
+
   // Minimal sender info logging
   if (_verboseLoggingEnabled && sender) {
     Serial.print("[NetworkCore] From: ");
@@ -349,7 +687,11 @@ void NetworkCore::processIncomingMessage(const uint8_t* mac,
       // Forward to NetworkDiscovery class if handler is registered
       if (_discoveryHandler != NULL) {
         Serial.println("[NETWORK] Forwarding to discovery handler");
-        _discoveryHandler->handleDiscovery(sender, mac);
+        _discoveryHandler->handleDiscovery(sender, mac,
+                                           doc["known"].as<const char*>(),
+                                           doc["full"] | false);
+        setPeerFeatures(sender, doc["features"] | 0);
+        _discoveryHandler->handleRecord(sender, doc);
       } else {
         Serial.println("[NETWORK] ERROR: No discovery handler registered");
       }
@@ -369,6 +711,10 @@ void NetworkCore::processIncomingMessage(const uint8_t* mac,
         Serial.println(macStr);
 
         bool added = addPeer(sender, mac);
+        setPeerFeatures(sender, doc["features"] | 0);
+        if (_discoveryHandler != NULL) {
+          _discoveryHandler->handleRecord(sender, doc);
+        }
         Serial.print("[NETWORK] Peer added from response: ");
         Serial.println(added ? "YES" : "NO");
       }
@@ -386,22 +732,183 @@ void NetworkCore::processIncomingMessage(const uint8_t* mac,
 
     case MSG_TYPE_PIN_CONTROL:
       // Pin control messages are handled by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinControlMessage(
+            sender, doc["pin"], doc["value"], doc["messageId"]);
+      }
       break;
 
     case MSG_TYPE_PIN_PUBLISH:
       // Pin publish messages are handled by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinStateMessage(sender, doc["pin"],
+                                                  doc["value"]);
+      }
+      break;
+
+    case MSG_TYPE_PIN_SCHEDULE:
+      // Scheduled pin commands are queued by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinScheduleMessage(sender, doc, receivedAt);
+      }
+      break;
+
+    case MSG_TYPE_PIN_SCHEDULE_RESULT:
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinScheduleResult(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_PIN_SEQUENCE:
+      // Sequence programs are run by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinSequenceMessage(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_PIN_SEQUENCE_STATUS:
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinSequenceStatus(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_PIN_GROUP:
+      // Group pin commands are handled by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinGroupMessage(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_PIN_GROUP_ACK:
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handlePinGroupAck(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_BUS_TRANSACTION:
+      // Bus proxy batches are handled by the NetworkPinControl class
+      if (_pinControlHandler != NULL && sender) {
+        _pinControlHandler->handleBusTransactionMessage(sender, doc);
+      }
       break;
 
     case MSG_TYPE_MESSAGE:
       // Topic messages are handled by the NetworkMessaging class
+      // Frames from boards without topic interning carry only the name
+      if (_messagingHandler != NULL && sender) {
+        bool delivered;
+        if (doc.containsKey("t")) {
+          delivered = _messagingHandler->handleTopicIdMessage(
+              sender, doc["t"], doc["topic"], doc["message"]);
+        } else {
+          delivered = _messagingHandler->handleTopicMessage(
+              sender, doc["topic"], doc["message"]);
+        }
+
+        // QoS 1 publishes are acknowledged by the boards that deliver them
+        if (delivered && doc.containsKey("messageId")) {
+          sendAcknowledgement(sender, doc["messageId"]);
+        }
+      }
+      break;
+
+    case MSG_TYPE_TOPIC_ANNOUNCE:
+      if (_messagingHandler != NULL && sender) {
+        _messagingHandler->handleTopicAnnounce(sender, doc);
+      }
+      break;
+
+    case MSG_TYPE_TOPIC_INTEREST:
+      if (_messagingHandler != NULL && sender) {
+        _messagingHandler->handleTopicInterest(sender, doc);
+      }
       break;
 
     case MSG_TYPE_SERIAL_DATA:
       // Serial data messages are handled by the NetworkSerial class
+      if (_serialHandler != NULL && sender) {
+        _serialHandler->handleSerialDataMessage(sender, doc["data"]);
+      }
+      break;
+
+    case MSG_TYPE_DIRECT_MESSAGE:
+      // Direct messages are handled by the NetworkMessaging class. A message
+      // ID means the sender waits for an acknowledgement.
+      if (sender && doc.containsKey("messageId")) {
+        sendAcknowledgement(sender, doc["messageId"]);
+      }
+      if (_messagingHandler != NULL && sender) {
+        _messagingHandler->handleDirectMessage(sender, doc["message"]);
+      }
+      break;
+  }
+}
+
+// Route a binary frame to the module that handles its type
+void NetworkCore::dispatchBinaryMessage(const char* sender,
+                                        uint8_t messageType,
+                                        const char* messageId,
+                                        const uint8_t* body, size_t length,
+                                        uint32_t receivedAt) {
+  switch (messageType) {
+    case MSG_TYPE_MESSAGE:
+      if (_messagingHandler != NULL &&
+          _messagingHandler->handleBinaryTopicMessage(sender, body, length) &&
+          messageId != NULL) {
+        sendAcknowledgement(sender, messageId);
+      }
+      break;
+
+    case MSG_TYPE_TOPIC_RETAINED:
+      if (_messagingHandler != NULL) {
+        _messagingHandler->handleTopicRetained(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_SERIAL_DATA:
+      if (_serialHandler != NULL) {
+        _serialHandler->handleBinarySerialData(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_SERIAL_CHANNEL:
+      if (_serialHandler != NULL) {
+        _serialHandler->handleSerialChannelData(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_STREAM_DATA:
+      if (_serialHandler != NULL) {
+        _serialHandler->handleStreamData(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_STREAM_ACK:
+      if (_serialHandler != NULL) {
+        _serialHandler->handleStreamAck(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_BUS_RESPONSE:
+      if (_pinControlHandler != NULL) {
+        _pinControlHandler->handleBusResponse(sender, body, length);
+      }
+      break;
+
+    case MSG_TYPE_CLOCK_SYNC:
+      // Clock offsets are estimated for scheduled pin control
+      if (_pinControlHandler != NULL) {
+        _pinControlHandler->handleClockSync(sender, body, length, receivedAt);
+      }
       break;
 
     case MSG_TYPE_DIRECT_MESSAGE:
-      // Direct messages are handled by the NetworkMessaging class
+      if (messageId != NULL) {
+        sendAcknowledgement(sender, messageId);
+      }
+      if (_messagingHandler != NULL) {
+        _messagingHandler->handleBinaryDirectMessage(sender, body, length);
+      }
       break;
   }
 }
@@ -412,9 +919,21 @@ bool NetworkCore::sendMessage(const char* targetBoard, uint8_t messageType,
   if (!_isConnected) return false;
   if (!targetBoard) return false;
 
-  // Get MAC address for target board
-  uint8_t targetMac[6];
-  if (!getMacForBoardId(targetBoard, targetMac)) {
+  // Messages to ourselves skip the radio, serialization and acknowledgements
+  if (isLocalBoard(targetBoard)) {
+    StaticJsonDocument<384> localDoc;
+    localDoc.set(doc);
+    localDoc["sender"] = _boardId;
+    localDoc["type"] = messageType;
+    dispatchMessage(_macAddress, localDoc.as<JsonObject>(), getNetworkTime());
+
+    if (_sendStatusCallback != NULL) {
+      _sendStatusCallback(targetBoard, messageType, true);
+    }
+    return true;
+  }
+
+  if (!canSendTo(targetBoard)) {
     Serial.print("[NetworkCore] Unknown board: ");
     Serial.println(targetBoard);
     return false;  // Target board not found
@@ -430,32 +949,11 @@ bool NetworkCore::sendMessage(const char* targetBoard, uint8_t messageType,
 
   // Add message ID for tracking if acknowledgements are enabled
   char messageId[37] = {0};  // UUID string
-  if (_acknowledgementsEnabled && messageType != MSG_TYPE_ACKNOWLEDGEMENT) {
+  if (_acknowledgementsEnabled && requiresAcknowledgement(messageType)) {
     generateMessageId(messageId);
     outDoc["messageId"] = messageId;
 
-    // Track this message for acknowledgement
-    for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
-      if (!_trackedMessages[i].active) {
-        strncpy(_trackedMessages[i].messageId, messageId,
-                sizeof(_trackedMessages[i].messageId) - 1);
-        _trackedMessages[i]
-            .messageId[sizeof(_trackedMessages[i].messageId) - 1] = '\0';
-
-        strncpy(_trackedMessages[i].targetBoard, targetBoard,
-                sizeof(_trackedMessages[i].targetBoard) - 1);
-        _trackedMessages[i]
-            .targetBoard[sizeof(_trackedMessages[i].targetBoard) - 1] = '\0';
-
-        _trackedMessages[i].acknowledged = false;
-        _trackedMessages[i].sentTime = millis();
-        _trackedMessages[i].active = true;
-        _trackedMessages[i].messageType = messageType;
-
-        _trackedMessageCount++;
-        break;
-      }
-    }
+    trackMessage(messageId, targetBoard, messageType);
   }
 
   // Serialize to JSON
@@ -469,9 +967,8 @@ bool NetworkCore::sendMessage(const char* targetBoard, uint8_t messageType,
   }
 
   // Send the message
-  esp_err_t result =
-      esp_now_send(targetMac, (uint8_t*)jsonStr.c_str(), jsonStr.length() + 1);
-  return (result == ESP_OK);
+  return sendFrame(targetBoard, (const uint8_t*)jsonStr.c_str(),
+                   jsonStr.length() + 1);
 }
 
 // Helper method to broadcast a message to all boards
@@ -499,29 +996,6 @@ bool NetworkCore::broadcastMessage(uint8_t messageType, const JsonObject& doc) {
     return false;
   }
 
-  // Use the broadcast address
-  uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-
-  // Register broadcast address if not already registered
-  if (esp_now_is_peer_exist(broadcastMac) == false) {
-    Serial.println("[NetworkCore] Registering broadcast address as peer");
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, broadcastMac, 6);
-    peerInfo.channel = 0;
-    peerInfo.encrypt = false;
-
-    esp_err_t add_result = esp_now_add_peer(&peerInfo);
-    if (add_result != ESP_OK) {
-      Serial.print("[NetworkCore] Failed to add broadcast peer, error: ");
-      Serial.println(add_result);
-      return false;
-    } else {
-      Serial.println("[NetworkCore] Successfully registered broadcast address");
-    }
-  } else {
-    Serial.println("[NetworkCore] Broadcast address already registered");
-  }
-
   // Send to broadcast address
   Serial.print("[NetworkCore] Broadcasting message type ");
   Serial.print(messageType);
@@ -534,11 +1008,12 @@ bool NetworkCore::broadcastMessage(uint8_t messageType, const JsonObject& doc) {
     Serial.println(jsonStr);
   }
 
-  esp_err_t result = esp_now_send(broadcastMac, (uint8_t*)jsonStr.c_str(),
-                                  jsonStr.length() + 1);
-  if (result != ESP_OK) {
-    Serial.print("[NetworkCore] Broadcast failed with error: ");
-    Serial.println(result);
+  // Discovery stays within radio range so the peer list only holds boards
+  // that can be reached directly
+  bool relay = messageType != MSG_TYPE_DISCOVERY &&
+               messageType != MSG_TYPE_DISCOVERY_RESPONSE;
+  if (!sendFrame(NULL, (const uint8_t*)jsonStr.c_str(), jsonStr.length() + 1,
+                 relay)) {
     return false;
   }
 
@@ -546,69 +1021,1353 @@ bool NetworkCore::broadcastMessage(uint8_t messageType, const JsonObject& doc) {
   return true;
 }
 
-// Helper method to get MAC address for a board ID
-bool NetworkCore::getMacForBoardId(const char* boardId, uint8_t* macAddress) {
-  for (int i = 0; i < MAX_PEERS; i++) {
-    if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
-      memcpy(macAddress, _peers[i].macAddress, 6);
-      return true;
-    }
-  }
-  return false;
-}
+// Helper method to send a binary frame to a specific board
+bool NetworkCore::sendBinaryMessage(const char* targetBoard,
+                                    uint8_t messageType, const uint8_t* header,
+                                    size_t headerLength, const uint8_t* data,
+                                    size_t length) {
+  if (!_isConnected) return false;
+  if (!targetBoard) return false;
 
-// Helper method to get board ID for a MAC address
-bool NetworkCore::getBoardIdForMac(const uint8_t* macAddress, char* boardId) {
-  if (!macAddress || !boardId) return false;
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
 
-  // Check if it's broadcast address
-  bool isBroadcast = true;
-  for (int i = 0; i < 6; i++) {
-    if (macAddress[i] != 0xFF) {
-      isBroadcast = false;
-      break;
+  // Messages to ourselves skip the radio and acknowledgements
+  if (isLocalBoard(targetBoard)) {
+    size_t frameLength = buildBinaryFrame(frame, messageType, NULL, header,
+                                          headerLength, data, length);
+    if (frameLength == 0) return false;
+    processBinaryMessage(frame, frameLength, getNetworkTime());
+
+    if (_sendStatusCallback != NULL) {
+      _sendStatusCallback(targetBoard, messageType, true);
     }
+    return true;
   }
 
-  if (isBroadcast) {
-    strcpy(boardId, "broadcast");
-    return true;
+  if (!canSendTo(targetBoard)) {
+    Serial.print("[NetworkCore] Unknown board: ");
+    Serial.println(targetBoard);
+    return false;  // Target board not found
   }
 
-  // Check known peers
-  for (int i = 0; i < MAX_PEERS; i++) {
-    if (_peers[i].active) {
-      bool macMatch = true;
-      for (int j = 0; j < 6; j++) {
-        if (_peers[i].macAddress[j] != macAddress[j]) {
-          macMatch = false;
-          break;
-        }
-      }
+  char messageId[37] = {0};  // UUID string
+  bool track = _acknowledgementsEnabled && requiresAcknowledgement(messageType);
+  if (track) generateMessageId(messageId);
 
-      if (macMatch) {
-        strcpy(boardId, _peers[i].boardId);
-        return true;
-      }
-    }
+  size_t frameLength = buildBinaryFrame(
+      frame, messageType, track ? messageId : NULL, header, headerLength, data,
+      length, shouldCompress(targetBoard, messageType));
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
   }
 
-  return false;  // MAC address not found
+  if (track) trackMessage(messageId, targetBoard, messageType);
+
+  return sendFrame(targetBoard, frame, frameLength);
 }
 
-// Add a peer to our list
-bool NetworkCore::addPeer(const char* boardId, const uint8_t* macAddress) {
-  // Basic validation
-  if (!boardId || !macAddress) {
+// Helper method to broadcast a binary frame to all boards
+bool NetworkCore::broadcastBinaryMessage(uint8_t messageType,
+                                         const uint8_t* header,
+                                         size_t headerLength,
+                                         const uint8_t* data, size_t length) {
+  if (!_isConnected) {
+    Serial.println("[NetworkCore] Cannot broadcast: not connected");
+    return false;
+  }
+
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  size_t frameLength =
+      buildBinaryFrame(frame, messageType, NULL, header, headerLength, data,
+                       length, shouldCompress(NULL, messageType));
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
+  }
+
+  return sendFrame(NULL, frame, frameLength);
+}
+
+// Helper method to send a message with QoS 1
+bool NetworkCore::sendReliableMessage(const char (*targets)[32],
+                                      int targetCount, bool broadcast,
+                                      uint8_t messageType,
+                                      const JsonObject& doc) {
+  if (!_isConnected) return false;
+
+  char messageId[37];
+  generateMessageId(messageId);
+
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  size_t frameLength = buildJsonFrame(frame, messageType, doc, messageId);
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
+  }
+
+  return queueOutboxFrame(frame, frameLength, messageType, messageId, targets,
+                          targetCount, broadcast);
+}
+
+// Helper method to send a binary frame with QoS 1
+bool NetworkCore::sendReliableBinaryMessage(const char (*targets)[32],
+                                            int targetCount, bool broadcast,
+                                            uint8_t messageType,
+                                            const uint8_t* header,
+                                            size_t headerLength,
+                                            const uint8_t* data,
+                                            size_t length) {
+  if (!_isConnected) return false;
+
+  char messageId[37];
+  generateMessageId(messageId);
+
+  // Every recipient has to be able to decompress the frame
+  bool compress = !broadcast || shouldCompress(NULL, messageType);
+  for (int i = 0; i < targetCount && compress; i++) {
+    compress = shouldCompress(targets[i], messageType);
+  }
+
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  size_t frameLength = buildBinaryFrame(frame, messageType, messageId, header,
+                                        headerLength, data, length, compress);
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
+  }
+
+  return queueOutboxFrame(frame, frameLength, messageType, messageId, targets,
+                          targetCount, broadcast);
+}
+
+// Serialize a JSON message, returning its length including the terminating
+// NUL or 0 if it does not fit
+size_t NetworkCore::buildJsonFrame(uint8_t* frame, uint8_t messageType,
+                                   const JsonObject& doc,
+                                   const char* messageId) {
+  StaticJsonDocument<384> outDoc;
+  outDoc.set(doc);
+  outDoc["sender"] = _boardId;
+  outDoc["type"] = messageType;
+  if (messageId != NULL) outDoc["messageId"] = messageId;
+
+  size_t length = measureJson(outDoc);
+  if (length + 1 > MAX_ESP_NOW_DATA_SIZE) return 0;
+
+  serializeJson(outDoc, (char*)frame, length + 1);
+  return length + 1;
+}
+
+// Size of a serialized JSON message including the terminating NUL
+size_t NetworkCore::measureJsonFrame(uint8_t messageType,
+                                     const JsonObject& doc,
+                                     bool withMessageId) {
+  StaticJsonDocument<384> outDoc;
+  outDoc.set(doc);
+  outDoc["sender"] = _boardId;
+  outDoc["type"] = messageType;
+  if (withMessageId) {
+    // Message IDs are fixed-length UUID strings
+    outDoc["messageId"] = "00000000-0000-0000-0000-000000000000";
+  }
+
+  return measureJson(outDoc) + 1;
+}
+
+// Send an encoded frame to a board, or broadcast it if targetBoard is NULL
+bool NetworkCore::sendFrame(const char* targetBoard, const uint8_t* frame,
+                            size_t length, bool relay) {
+  uint8_t mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  if (targetBoard == NULL) {
+    if (!registerBroadcastPeer()) return false;
+
+    // Flood broadcasts across the mesh; a frame too large for the mesh
+    // header still reaches the boards in range
+    if (_meshEnabled && relay && sendMeshFrame(mac, NULL, frame, length)) {
+      return true;
+    }
+  } else if (!getMacForBoardId(targetBoard, mac)) {
+    if (!_meshEnabled) return false;
+
+    // Send boards out of range to the learned next hop, or flood the frame
+    // until a reply teaches us a route. The frame is flooded as well when
+    // the next hop does not fit the ESP-NOW peer table.
+    if (!findMeshRoute(targetBoard, mac) || !registerEspNowPeer(mac)) {
+      memset(mac, 0xFF, sizeof(mac));
+      if (!registerBroadcastPeer()) return false;
+    }
+    return sendMeshFrame(mac, targetBoard, frame, length);
+  }
+
+  esp_err_t result = esp_now_send(mac, frame, length);
+  if (result != ESP_OK) {
+    Serial.print("[NetworkCore] Send failed with error: ");
+    Serial.println(result);
+    return false;
+  }
+  return true;
+}
+
+// ==================== Outbox ====================
+
+// Store a QoS 1 frame and send it for the first time. The frame stays
+// queued, and is retried, even if the first transmission fails.
+bool NetworkCore::queueOutboxFrame(const uint8_t* frame, size_t length,
+                                   uint8_t messageType, const char* messageId,
+                                   const char (*targets)[32], int targetCount,
+                                   bool broadcast) {
+  if (targetCount <= 0 || targetCount > MAX_OUTBOX_RECIPIENTS) return false;
+
+  portENTER_CRITICAL(&_outboxLock);
+  OutboxEntry* entry = NULL;
+  for (int i = 0; i < MAX_OUTBOX_MESSAGES && entry == NULL; i++) {
+    if (!_outbox[i].active) entry = &_outbox[i];
+  }
+  if (entry != NULL) {
+    memcpy(entry->frame, frame, length);
+    entry->length = length;
+    entry->messageType = messageType;
+    strcpy(entry->messageId, messageId);
+    for (int t = 0; t < targetCount; t++) {
+      strncpy(entry->recipients[t], targets[t], sizeof(entry->recipients[t]));
+      entry->recipients[t][sizeof(entry->recipients[t]) - 1] = '\0';
+    }
+    entry->recipientCount = targetCount;
+    entry->ackedMask = 0;
+    entry->retries = 0;
+    entry->sentTime = millis();
+    entry->active = true;
+  }
+  portEXIT_CRITICAL(&_outboxLock);
+
+  if (entry == NULL) {
+    Serial.println("[NetworkCore] Error: Outbox full");
+    return false;
+  }
+
+  if (broadcast) {
+    sendFrame(NULL, frame, length);
+  } else {
+    for (int t = 0; t < targetCount; t++) {
+      sendFrame(targets[t], frame, length);
+    }
+  }
+  return true;
+}
+
+// Resend QoS 1 messages to the recipients that have not acknowledged them,
+// doubling the interval each time, and drop them once the retries run out
+void NetworkCore::updateOutbox() {
+  uint32_t currentTime = millis();
+
+  for (int i = 0; i < MAX_OUTBOX_MESSAGES; i++) {
+    uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+    char pending[MAX_OUTBOX_RECIPIENTS][32];
+    int pendingCount = 0;
+    size_t length = 0;
+    uint8_t messageType = 0;
+    bool expired = false;
+
+    // Copy what has to be sent, then send outside the lock
+    portENTER_CRITICAL(&_outboxLock);
+    OutboxEntry& entry = _outbox[i];
+    if (entry.active && currentTime - entry.sentTime >=
+                            (uint32_t)OUTBOX_RETRY_INTERVAL << entry.retries) {
+      for (int r = 0; r < entry.recipientCount; r++) {
+        if (!(entry.ackedMask & (1UL << r))) {
+          memcpy(pending[pendingCount++], entry.recipients[r], 32);
+        }
+      }
+      messageType = entry.messageType;
+      expired = entry.retries >= OUTBOX_MAX_RETRIES;
+      if (expired) {
+        entry.active = false;
+      } else {
+        memcpy(frame, entry.frame, entry.length);
+        length = entry.length;
+        entry.retries++;
+        entry.sentTime = currentTime;
+      }
+    }
+    portEXIT_CRITICAL(&_outboxLock);
+
+    if (pendingCount == 0) continue;
+
+    if (expired) {
+      for (int p = 0; p < pendingCount; p++) {
+        char debugMsg[100];
+        sprintf(debugMsg, "QoS 1 message to %s dropped after %d retries",
+                pending[p], OUTBOX_MAX_RETRIES);
+        debugLog(debugMsg);
+
+        if (_sendFailureCallback != NULL) {
+          _sendFailureCallback(pending[p], messageType, 0, 0);
+        }
+      }
+      continue;
+    }
+
+    // Retry by unicast, or by one broadcast if a recipient has no known
+    // address
+    uint8_t mac[6];
+    bool broadcast = false;
+    for (int p = 0; p < pendingCount && !broadcast; p++) {
+      broadcast = !getMacForBoardId(pending[p], mac);
+    }
+
+    if (broadcast) {
+      sendFrame(NULL, frame, length);
+    } else {
+      for (int p = 0; p < pendingCount; p++) {
+        sendFrame(pending[p], frame, length);
+      }
+    }
+  }
+}
+
+// Record a recipient's acknowledgement of a QoS 1 message, removing the
+// message once every recipient has acknowledged it
+bool NetworkCore::acknowledgeOutbox(const char* sender,
+                                    const char* messageId) {
+  bool found = false;
+
+  portENTER_CRITICAL(&_outboxLock);
+  for (int i = 0; i < MAX_OUTBOX_MESSAGES && !found; i++) {
+    OutboxEntry& entry = _outbox[i];
+    if (!entry.active || strcmp(entry.messageId, messageId) != 0) continue;
+
+    for (int r = 0; r < entry.recipientCount; r++) {
+      if (strcmp(entry.recipients[r], sender) == 0) {
+        entry.ackedMask |= 1UL << r;
+      }
+    }
+    uint32_t allAcked = entry.recipientCount >= 32
+                            ? 0xFFFFFFFFUL
+                            : (1UL << entry.recipientCount) - 1;
+    if (entry.ackedMask == allAcked) {
+      entry.active = false;
+    }
+    found = true;
+  }
+  portEXIT_CRITICAL(&_outboxLock);
+
+  return found;
+}
+
+// ==================== Store and Forward ====================
+
+bool NetworkCore::setStoredMessageLifetime(uint32_t lifetimeMs) {
+  if (lifetimeMs == 0) return false;
+
+  _storedLifetime = lifetimeMs;
+  return true;
+}
+
+int NetworkCore::getStoredMessageCount(const char* boardId) {
+  int count = 0;
+
+  portENTER_CRITICAL(&_storedLock);
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    if (_stored[i].used && !_stored[i].acknowledged &&
+        (boardId == NULL || strcmp(_stored[i].target, boardId) == 0)) {
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&_storedLock);
+
+  return count;
+}
+
+bool NetworkCore::clearStoredMessages(const char* boardId) {
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    if (_stored[i].used &&
+        (boardId == NULL || strcmp(_stored[i].target, boardId) == 0)) {
+      removeStoredMessage(i);
+    }
+  }
+  return true;
+}
+
+// Helper method to store a message until the target acknowledges it
+bool NetworkCore::storeMessage(const char* targetBoard, uint8_t messageType,
+                               const JsonObject& doc) {
+  if (!_isConnected) return false;
+  if (!targetBoard) return false;
+
+  char messageId[37];
+  generateMessageId(messageId);
+
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  size_t frameLength = buildJsonFrame(frame, messageType, doc, messageId);
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
+  }
+
+  return storeFrame(targetBoard, messageType, messageId, frame, frameLength);
+}
+
+// Helper method to store a binary frame until the target acknowledges it
+bool NetworkCore::storeBinaryMessage(const char* targetBoard,
+                                     uint8_t messageType,
+                                     const uint8_t* header,
+                                     size_t headerLength,
+                                     const uint8_t* data, size_t length) {
+  if (!_isConnected) return false;
+  if (!targetBoard) return false;
+
+  char messageId[37];
+  generateMessageId(messageId);
+
+  uint8_t frame[MAX_ESP_NOW_DATA_SIZE];
+  size_t frameLength =
+      buildBinaryFrame(frame, messageType, messageId, header, headerLength,
+                       data, length, shouldCompress(targetBoard, messageType));
+  if (frameLength == 0) {
+    Serial.println("[NetworkCore] Error: Message too large");
+    return false;
+  }
+
+  return storeFrame(targetBoard, messageType, messageId, frame, frameLength);
+}
+
+// Write a frame to a free flash slot, then send it straight away if the
+// target is reachable and nothing older is waiting for it
+bool NetworkCore::storeFrame(const char* targetBoard, uint8_t messageType,
+                             const char* messageId, const uint8_t* frame,
+                             size_t length) {
+  if (!_storedPreferencesOpen || strlen(targetBoard) >= 32) return false;
+
+  // Find a free slot, keeping within the per-board cap
+  int slot = -1;
+  int boardCount = 0;
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    if (!_stored[i].used) {
+      if (slot == -1) slot = i;
+    } else if (strcmp(_stored[i].target, targetBoard) == 0) {
+      boardCount++;
+    }
+  }
+  if (slot == -1 || boardCount >= MAX_STORED_PER_BOARD) {
+    Serial.println("[NetworkCore] Store-and-forward outbox full");
+    return false;
+  }
+
+  StoredRecord record;
+  record.sequence = _storedSequence++;
+  record.lifetime = _storedLifetime;
+  strcpy(record.target, targetBoard);
+  strcpy(record.messageId, messageId);
+  record.messageType = messageType;
+  record.length = length;
+  memcpy(record.frame, frame, length);
+
+  char key[8];
+  sprintf(key, "m%d", slot);
+  size_t recordLength = offsetof(StoredRecord, frame) + length;
+  if (_storedPreferences.putBytes(key, &record, recordLength) !=
+      recordLength) {
+    Serial.println("[NetworkCore] Failed to write stored message");
+    return false;
+  }
+
+  StoredEntry& entry = _stored[slot];
+  strcpy(entry.target, targetBoard);
+  strcpy(entry.messageId, messageId);
+  entry.messageType = messageType;
+  entry.sequence = record.sequence;
+  entry.storedAt = millis();
+  entry.lifetime = record.lifetime;
+  entry.lastAttempt = entry.storedAt - STORED_RETRY_INTERVAL;  // Due now
+  entry.acknowledged = false;
+  entry.flooded = false;
+
+  portENTER_CRITICAL(&_storedLock);
+  entry.used = true;
+  _storedCount++;
+  portEXIT_CRITICAL(&_storedLock);
+
+  updateStoredMessages();
+  return true;
+}
+
+// Rebuild the index of stored messages from flash
+void NetworkCore::loadStoredMessages() {
+  if (!_storedPreferencesOpen) {
+    _storedPreferencesOpen =
+        _storedPreferences.begin(STORED_MESSAGE_NAMESPACE, false);
+    if (!_storedPreferencesOpen) {
+      Serial.println("[NetworkCore] Failed to open store-and-forward storage");
+      return;
+    }
+  }
+
+  // Time since the ages were last saved is unknown, so charge a full
+  // interval rather than let reboots extend the lifetime
+  StoredAge ages[MAX_STORED_MESSAGES];
+  if (_storedPreferences.getBytes("ages", ages, sizeof(ages)) !=
+      sizeof(ages)) {
+    memset(ages, 0, sizeof(ages));
+  }
+
+  uint32_t now = millis();
+  StoredRecord record;
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    if (_stored[i].used) continue;
+
+    char key[8];
+    sprintf(key, "m%d", i);
+    if (!_storedPreferences.isKey(key)) continue;
+
+    // Drop records that are truncated or were written by another layout
+    size_t length = _storedPreferences.getBytes(key, &record, sizeof(record));
+    if (length < offsetof(StoredRecord, frame) ||
+        offsetof(StoredRecord, frame) + record.length != length) {
+      _storedPreferences.remove(key);
+      continue;
+    }
+
+    StoredEntry& entry = _stored[i];
+    memcpy(entry.target, record.target, sizeof(entry.target));
+    entry.target[sizeof(entry.target) - 1] = '\0';
+    memcpy(entry.messageId, record.messageId, sizeof(entry.messageId));
+    entry.messageId[sizeof(entry.messageId) - 1] = '\0';
+    entry.messageType = record.messageType;
+    entry.sequence = record.sequence;
+    uint32_t age = STORED_AGE_SAVE_INTERVAL;
+    if (ages[i].sequence == record.sequence) age += ages[i].age;
+    if (age > record.lifetime) age = record.lifetime + 1;  // Expired
+    entry.storedAt = now - age;
+    entry.lifetime = record.lifetime;
+    entry.lastAttempt = now - STORED_RETRY_INTERVAL;
+    entry.acknowledged = false;
+    entry.flooded = false;
+    entry.used = true;
+    _storedCount++;
+
+    if (record.sequence >= _storedSequence) {
+      _storedSequence = record.sequence + 1;
+    }
+  }
+
+  if (_storedCount > 0) {
+    Serial.print("[NetworkCore] Loaded stored messages: ");
+    Serial.println(_storedCount);
+
+    // Keep the charge even if the board reboots again before the next save
+    saveStoredAges();
+  }
+}
+
+// Write the age of every stored message to flash
+void NetworkCore::saveStoredAges() {
+  uint32_t now = millis();
+  StoredAge ages[MAX_STORED_MESSAGES];
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    ages[i].sequence = _stored[i].used ? _stored[i].sequence : 0;
+    ages[i].age = _stored[i].used ? now - _stored[i].storedAt : 0;
+  }
+
+  if (_storedPreferences.putBytes("ages", ages, sizeof(ages)) !=
+      sizeof(ages)) {
+    Serial.println("[NetworkCore] Failed to write stored message ages");
+  }
+  _storedAgesSaved = now;
+}
+
+// Drop acknowledged and expired messages, then send the oldest message for
+// each reachable board. Keeping one message per board in flight delivers
+// them in order.
+void NetworkCore::updateStoredMessages() {
+  if (_storedCount == 0) return;
+
+  uint32_t now = millis();
+
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    StoredEntry& entry = _stored[i];
+    if (!entry.used) continue;
+
+    if (entry.acknowledged) {
+      removeStoredMessage(i);
+    } else if (now - entry.storedAt > entry.lifetime) {
+      char debugMsg[100];
+      sprintf(debugMsg, "Stored message %s to %s expired", entry.messageId,
+              entry.target);
+      debugLog(debugMsg);
+
+      if (_sendFailureCallback != NULL) {
+        _sendFailureCallback(entry.target, entry.messageType, 0, 0);
+      }
+      removeStoredMessage(i);
+    }
+  }
+
+  if (_storedCount > 0 &&
+      now - _storedAgesSaved >= STORED_AGE_SAVE_INTERVAL) {
+    saveStoredAges();
+  }
+
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    StoredEntry& entry = _stored[i];
+    if (!entry.used || entry.acknowledged) continue;
+    if (now - entry.lastAttempt < STORED_RETRY_INTERVAL) continue;
+
+    bool oldest = true;
+    for (int j = 0; j < MAX_STORED_MESSAGES && oldest; j++) {
+      oldest = !(_stored[j].used && _stored[j].sequence < entry.sequence &&
+                 strcmp(_stored[j].target, entry.target) == 0);
+    }
+    // A board without a route is flooded once, so that its reply teaches
+    // the route; after that the message waits until the board is heard from
+    bool reachable = isReachable(entry.target);
+    if (!oldest || (!reachable && (!_meshEnabled || entry.flooded))) continue;
+    if (!reachable) entry.flooded = true;
+
+    char key[8];
+    sprintf(key, "m%d", i);
+    StoredRecord record;
+    size_t length = _storedPreferences.getBytes(key, &record, sizeof(record));
+    if (length < offsetof(StoredRecord, frame) ||
+        offsetof(StoredRecord, frame) + record.length != length) {
+      removeStoredMessage(i);
+      continue;
+    }
+
+    entry.lastAttempt = now;
+    sendFrame(entry.target, record.frame, record.length);
+  }
+}
+
+// Free a slot and erase its record from flash
+void NetworkCore::removeStoredMessage(int slot) {
+  char key[8];
+  sprintf(key, "m%d", slot);
+  _storedPreferences.remove(key);
+
+  portENTER_CRITICAL(&_storedLock);
+  if (_stored[slot].used) {
+    _stored[slot].used = false;
+    _storedCount--;
+  }
+  portEXIT_CRITICAL(&_storedLock);
+}
+
+// Mark a stored message as delivered. The flash record is erased from
+// update(), outside the receive callback.
+bool NetworkCore::acknowledgeStored(const char* sender, const char* messageId) {
+  bool found = false;
+
+  portENTER_CRITICAL(&_storedLock);
+  for (int i = 0; i < MAX_STORED_MESSAGES && !found; i++) {
+    StoredEntry& entry = _stored[i];
+    if (entry.used && !entry.acknowledged &&
+        strcmp(entry.messageId, messageId) == 0 &&
+        strcmp(entry.target, sender) == 0) {
+      entry.acknowledged = true;
+      found = true;
+    }
+  }
+  portEXIT_CRITICAL(&_storedLock);
+
+  return found;
+}
+
+// Make stored messages for a board due again when it is heard from, unless
+// one was sent to it moments ago
+void NetworkCore::noteBoardSeen(const char* boardId) {
+  if (boardId == NULL) return;
+
+  uint32_t now = millis();
+
+  // Any valid frame shows the board is alive, not only discovery
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
+      _peers[i].lastSeen = now;
+      _peers[i].state = PEER_STATE_ALIVE;
+      _peers[i].probes = 0;
+      break;
+    }
+  }
+
+  if (_storedCount == 0) return;
+  portENTER_CRITICAL(&_storedLock);
+  for (int i = 0; i < MAX_STORED_MESSAGES; i++) {
+    StoredEntry& entry = _stored[i];
+    if (entry.used && now - entry.lastAttempt >= STORED_SEEN_RETRY_DELAY &&
+        strcmp(entry.target, boardId) == 0) {
+      entry.lastAttempt = now - STORED_RETRY_INTERVAL;
+    }
+  }
+  portEXIT_CRITICAL(&_storedLock);
+}
+
+// ==================== Peer Cache ====================
+
+bool NetworkCore::enablePeerCache(bool enable) {
+  _peerCacheEnabled = enable;
+  return true;
+}
+
+bool NetworkCore::savePeerCache() {
+  if (!_peerCacheOpen) return false;
+
+  updatePeerCache(true);
+  return true;
+}
+
+bool NetworkCore::clearPeerCache() {
+  if (!_peerCacheOpen) return false;
+
+  _peerCacheDirty = false;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    _peers[i].cacheDirty = false;
+  }
+  return _peerCachePreferences.clear();
+}
+
+// Restore the cached boards into their peer slots and register them with
+// ESP-NOW. They count as available at once and are verified lazily: any
+// frame from them confirms them, and they are probed if they stay silent.
+void NetworkCore::loadPeerCache() {
+  if (!_peerCacheEnabled) return;
+  if (!_peerCacheOpen) {
+    _peerCacheOpen = _peerCachePreferences.begin(PEER_CACHE_NAMESPACE, false);
+    if (!_peerCacheOpen) {
+      Serial.println("[NetworkCore] Failed to open peer cache");
+      return;
+    }
+  }
+
+  uint32_t now = millis();
+  int restored = 0;
+  PeerCacheRecord record;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active) continue;
+
+    char key[8];
+    sprintf(key, "p%d", i);
+    if (!_peerCachePreferences.isKey(key)) continue;
+
+    // Drop records written by another layout. Boards cached on another
+    // channel are kept: they may have moved as well, e.g. after falling back
+    // to ESP-NOW only, and are dropped like any restored board if silent.
+    size_t length =
+        _peerCachePreferences.getBytes(key, &record, sizeof(record));
+    if (length != sizeof(record)) {
+      _peerCachePreferences.remove(key);
+      continue;
+    }
+
+    PeerInfo& peer = _peers[i];
+    memcpy(peer.boardId, record.boardId, sizeof(peer.boardId));
+    peer.boardId[sizeof(peer.boardId) - 1] = '\0';
+    memcpy(peer.macAddress, record.macAddress, 6);
+    peer.channel = record.channel;
+    peer.features = record.features;
+    peer.record = record.record;
+    peer.version = record.version;
+    memcpy(peer.firmware, record.firmware, sizeof(peer.firmware));
+    peer.firmware[sizeof(peer.firmware) - 1] = '\0';
+    memcpy(peer.topics, record.topics, sizeof(peer.topics));
+    memcpy(peer.services, record.services, sizeof(peer.services));
+    peer.serviceCount = record.serviceCount < MAX_BOARD_SERVICES
+                            ? record.serviceCount
+                            : MAX_BOARD_SERVICES;
+    peer.lastSeen = now;
+    peer.state = PEER_STATE_RESTORED;
+    peer.probes = 0;
+    peer.cacheDirty = false;
+    peer.active = true;
+    _peerCount++;
+
+    registerEspNowPeer(peer.macAddress);
+    restored++;
+  }
+
+  if (restored > 0) {
+    Serial.print("[NetworkCore] Restored cached peers: ");
+    Serial.println(restored);
+  }
+}
+
+// Write the changed peer slots to flash, PEER_CACHE_WRITE_DELAY ms after
+// the first change unless forced
+void NetworkCore::updatePeerCache(bool force) {
+  if (!_peerCacheDirty || !_peerCacheOpen || !_peerCacheEnabled) return;
+  if (!force && millis() - _peerCacheDirtySince < PEER_CACHE_WRITE_DELAY) {
+    return;
+  }
+
+  _peerCacheDirty = false;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    PeerInfo& peer = _peers[i];
+    if (!peer.cacheDirty) continue;
+    peer.cacheDirty = false;
+
+    char key[8];
+    sprintf(key, "p%d", i);
+    if (!peer.active) {
+      _peerCachePreferences.remove(key);
+      continue;
+    }
+
+    PeerCacheRecord record;
+    memset(&record, 0, sizeof(record));
+    strcpy(record.boardId, peer.boardId);
+    memcpy(record.macAddress, peer.macAddress, 6);
+    record.channel = peer.channel;
+    record.features = peer.features;
+    record.record = peer.record;
+    record.version = peer.version;
+    strcpy(record.firmware, peer.firmware);
+    memcpy(record.topics, peer.topics, sizeof(record.topics));
+    memcpy(record.services, peer.services, sizeof(record.services));
+    record.serviceCount = peer.serviceCount;
+
+    if (_peerCachePreferences.putBytes(key, &record, sizeof(record)) !=
+        sizeof(record)) {
+      Serial.println("[NetworkCore] Failed to write peer cache");
+    }
+  }
+}
+
+// Note that a peer slot changed; the write waits for more changes to settle
+void NetworkCore::markPeerDirty(int slot) {
+  _peers[slot].cacheDirty = true;
+  if (!_peerCacheDirty) {
+    _peerCacheDirtySince = millis();
+    _peerCacheDirty = true;
+  }
+}
+
+// ==================== Mesh Relay ====================
+
+bool NetworkCore::enableMeshRelay(bool enable, uint8_t ttl) {
+  if (ttl == 0 || ttl > 15) return false;
+
+  _meshEnabled = enable;
+  _meshTtl = ttl;
+
+  char debugMsg[50];
+  sprintf(debugMsg, "Mesh relay %s, TTL %d", enable ? "enabled" : "disabled",
+          ttl);
+  debugLog(debugMsg);
+  return true;
+}
+
+bool NetworkCore::isMeshRelayEnabled() { return _meshEnabled; }
+
+int NetworkCore::getHopCount(const char* boardId) {
+  if (!boardId) return -1;
+
+  uint8_t mac[6];
+  if (getMacForBoardId(boardId, mac)) return 1;
+
+  uint8_t hops = 0;
+  if (findMeshRoute(boardId, mac, &hops)) return hops;
+  return -1;
+}
+
+bool NetworkCore::enableCompression(bool enable) {
+  _compressedTypes = enable ? COMPRESSION_DEFAULT_TYPES : 0;
+  debugLog("Compression", enable ? "enabled" : "disabled");
+  return true;
+}
+
+bool NetworkCore::setCompression(uint8_t messageType, bool enable) {
+  if (messageType == 0 || messageType >= 32) return false;
+
+  if (enable) {
+    _compressedTypes |= 1UL << messageType;
+  } else {
+    _compressedTypes &= ~(1UL << messageType);
+  }
+  return true;
+}
+
+bool NetworkCore::setBroadcastCompression(bool enable) {
+  _compressBroadcasts = enable;
+  return true;
+}
+
+bool NetworkCore::isCompressionEnabled(uint8_t messageType) {
+  if (messageType == 0) return _compressedTypes != 0;
+  if (messageType >= 32) return false;
+  return (_compressedTypes & (1UL << messageType)) != 0;
+}
+
+bool NetworkCore::getCompressionStats(uint32_t& payloadBytes,
+                                      uint32_t& sentBytes) {
+  payloadBytes = _compressionPayloadBytes;
+  sentBytes = _compressionSentBytes;
+  return true;
+}
+
+size_t NetworkCore::compress(const uint8_t* data, size_t length,
+                             uint8_t* output, size_t capacity) {
+  if (length < COMPRESSION_MIN_MATCH + 1 || length > COMPRESSION_MAX_INPUT) {
+    return 0;
+  }
+
+  // Last position + 1 of each hashed triple, 0 when unused
+  uint8_t table[1 << COMPRESSION_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  size_t written = 0;
+  size_t literalStart = 0;
+  size_t i = 0;
+  while (i + COMPRESSION_MIN_MATCH <= length) {
+    uint8_t hash = hashTriple(data + i);
+    size_t candidate = table[hash];
+    table[hash] = i + 1;
+
+    if (candidate == 0 || i - (candidate - 1) > COMPRESSION_MAX_DISTANCE ||
+        memcmp(data + candidate - 1, data + i, COMPRESSION_MIN_MATCH) != 0) {
+      i++;
+      continue;
+    }
+    candidate--;
+
+    size_t matchLength = COMPRESSION_MIN_MATCH;
+    while (i + matchLength < length && matchLength < COMPRESSION_MAX_MATCH &&
+           data[candidate + matchLength] == data[i + matchLength]) {
+      matchLength++;
+    }
+
+    if (!writeLiterals(data + literalStart, i - literalStart, output, capacity,
+                       &written) ||
+        written + 2 > capacity) {
+      return 0;
+    }
+    output[written++] = 0x80 | (matchLength - COMPRESSION_MIN_MATCH);
+    output[written++] = i - candidate - 1;
+
+    // Index the positions inside the match so later repeats find them
+    for (size_t j = i + 1;
+         j < i + matchLength && j + COMPRESSION_MIN_MATCH <= length; j++) {
+      table[hashTriple(data + j)] = j + 1;
+    }
+    i += matchLength;
+    literalStart = i;
+  }
+
+  if (!writeLiterals(data + literalStart, length - literalStart, output,
+                     capacity, &written)) {
+    return 0;
+  }
+  return written < length ? written : 0;
+}
+
+size_t NetworkCore::decompress(const uint8_t* data, size_t length,
+                               uint8_t* output, size_t capacity) {
+  size_t written = 0;
+  size_t i = 0;
+  while (i < length) {
+    uint8_t token = data[i++];
+
+    if (token < 0x80) {
+      size_t run = token + 1;
+      if (i + run > length || written + run > capacity) return 0;
+      memcpy(output + written, data + i, run);
+      i += run;
+      written += run;
+      continue;
+    }
+
+    if (i >= length) return 0;
+    size_t matchLength = (token & 0x7F) + COMPRESSION_MIN_MATCH;
+    size_t distance = data[i++] + 1;
+    if (distance > written || written + matchLength > capacity) return 0;
+
+    // Byte by byte, a match may overlap the bytes it produces
+    for (size_t j = 0; j < matchLength; j++, written++) {
+      output[written] = output[written - distance];
+    }
+  }
+  return written;
+}
+
+// Compress a frame type for a board, or for every peer if targetBoard is NULL.
+// Boards we have not discovered may hear a broadcast too, so broadcasts are
+// only compressed when the sketch opted in.
+bool NetworkCore::shouldCompress(const char* targetBoard, uint8_t messageType) {
+  if (messageType >= 32 || !(_compressedTypes & (1UL << messageType))) {
+    return false;
+  }
+  if (targetBoard == NULL && !_compressBroadcasts) return false;
+
+  bool capable = false;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (!_peers[i].active) continue;
+    if (targetBoard != NULL && strcmp(_peers[i].boardId, targetBoard) != 0) {
+      continue;
+    }
+    if (!(_peers[i].features & PEER_FEATURE_COMPRESSION)) return false;
+    capable = true;
+  }
+  return capable;
+}
+
+// Wrap a frame in a mesh header and send it to a MAC address. A NULL
+// destination floods the frame to every board.
+bool NetworkCore::sendMeshFrame(const uint8_t* mac, const char* destination,
+                                const uint8_t* frame, size_t length) {
+  size_t originLength = strlen(_boardId);
+  size_t destinationLength = destination != NULL ? strlen(destination) : 0;
+  size_t meshLength =
+      MESH_FRAME_HEADER_SIZE + originLength + destinationLength + length;
+  if (destinationLength >= 32 || meshLength > MAX_ESP_NOW_DATA_SIZE) {
+    Serial.println("[NetworkCore] Error: Message too large for mesh relay");
+    return false;
+  }
+
+  uint8_t meshFrame[MAX_ESP_NOW_DATA_SIZE];
+  uint16_t sequence = _meshSequence++;
+  meshFrame[0] = MESH_FRAME_MAGIC;
+  meshFrame[1] = _meshTtl;
+  meshFrame[2] = 0;  // Hops so far
+  meshFrame[3] = sequence & 0xFF;
+  meshFrame[4] = sequence >> 8;
+  meshFrame[5] = originLength;
+
+  uint8_t* p = meshFrame + 6;
+  memcpy(p, _boardId, originLength);
+  p += originLength;
+  *p++ = destinationLength;
+  if (destinationLength > 0) memcpy(p, destination, destinationLength);
+  p += destinationLength;
+  memcpy(p, frame, length);
+
+  esp_err_t result = esp_now_send(mac, meshFrame, meshLength);
+  if (result != ESP_OK) {
+    Serial.print("[NetworkCore] Mesh send failed with error: ");
+    Serial.println(result);
+    return false;
+  }
+  return true;
+}
+
+// Relay a mesh frame onwards if needed, then handle the wrapped frame if it
+// is for this board. Relaying first keeps the added latency per hop low.
+void NetworkCore::processMeshFrame(const uint8_t* mac, const uint8_t* data,
+                                   size_t len) {
+  if (len < MESH_FRAME_HEADER_SIZE) return;
+
+  uint8_t ttl = data[1];
+  uint8_t hops = data[2];
+  uint16_t sequence = data[3] | (data[4] << 8);
+  size_t originLength = data[5];
+  size_t offset = 6;
+
+  char origin[32];
+  if (originLength == 0 || originLength >= sizeof(origin) ||
+      offset + originLength >= len) {
+    return;
+  }
+  memcpy(origin, data + offset, originLength);
+  origin[originLength] = '\0';
+  offset += originLength;
+
+  char destination[32];
+  size_t destinationLength = data[offset++];
+  if (destinationLength >= sizeof(destination) ||
+      offset + destinationLength >= len) {
+    return;
+  }
+  memcpy(destination, data + offset, destinationLength);
+  destination[destinationLength] = '\0';
+  offset += destinationLength;
+
+  // Mesh frames are never nested, and our own floods come back to us
+  if (data[offset] == MESH_FRAME_MAGIC || isLocalBoard(origin)) return;
+  if (!acceptMeshFrame(origin, sequence, mac, hops)) return;
+
+  bool forUs = destinationLength == 0 || isLocalBoard(destination);
+
+  if (_meshEnabled && !isLocalBoard(destination) && ttl > 1) {
+    uint8_t relayed[MAX_ESP_NOW_DATA_SIZE];
+    memcpy(relayed, data, len);
+    relayed[1] = ttl - 1;
+    relayed[2] = hops + 1;
+
+    uint8_t nextHop[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    bool unicast = destinationLength > 0 &&
+                   (getMacForBoardId(destination, nextHop) ||
+                    findMeshRoute(destination, nextHop));
+
+    // Flood the frame onwards when the next hop cannot be registered
+    if (unicast && !registerEspNowPeer(nextHop)) {
+      memset(nextHop, 0xFF, sizeof(nextHop));
+      unicast = false;
+    }
+    if (unicast || registerBroadcastPeer()) {
+      esp_now_send(nextHop, relayed, len);
+    }
+
+    if (_verboseLoggingEnabled) {
+      Serial.print("[NetworkCore] Relayed mesh frame from ");
+      Serial.print(origin);
+      Serial.print(unicast ? " to next hop, TTL " : " by broadcast, TTL ");
+      Serial.println(ttl - 1);
+    }
+  }
+
+  if (forUs) processIncomingMessage(mac, data + offset, len - offset);
+}
+
+// Record a mesh frame and learn the route back to its origin. Returns false
+// for frames that were already handled.
+bool NetworkCore::acceptMeshFrame(const char* origin, uint16_t sequence,
+                                  const uint8_t* mac, uint8_t hops) {
+  uint16_t originHash = hash16(origin);
+
+  portENTER_CRITICAL(&_meshLock);
+  for (int i = 0; i < _meshSeenCount; i++) {
+    // Board IDs can share a hash, so a match is confirmed on the full ID
+    if (_meshSeen[i].originHash == originHash &&
+        _meshSeen[i].sequence == sequence &&
+        strcmp(_meshSeen[i].origin, origin) == 0) {
+      portEXIT_CRITICAL(&_meshLock);
+      return false;
+    }
+  }
+
+  MeshSeenFrame& seen = _meshSeen[_meshSeenNext];
+  strncpy(seen.origin, origin, sizeof(seen.origin) - 1);
+  seen.origin[sizeof(seen.origin) - 1] = '\0';
+  seen.originHash = originHash;
+  seen.sequence = sequence;
+  _meshSeenNext = (_meshSeenNext + 1) % MESH_DEDUPE_SIZE;
+  if (_meshSeenCount < MESH_DEDUPE_SIZE) _meshSeenCount++;
+
+  learnMeshRoute(origin, mac, hops + 1);
+  portEXIT_CRITICAL(&_meshLock);
+  return true;
+}
+
+// Remember the neighbour a board was heard through. A route is replaced by
+// a shorter one, by a newer one through the same neighbour, or once it
+// expires. Called with _meshLock held.
+void NetworkCore::learnMeshRoute(const char* boardId, const uint8_t* mac,
+                                 uint8_t hops) {
+  uint32_t now = millis();
+  int slot = -1;
+  int oldest = 0;
+
+  for (int i = 0; i < MAX_MESH_ROUTES; i++) {
+    MeshRoute& route = _meshRoutes[i];
+    if (route.active && strcmp(route.boardId, boardId) == 0) {
+      bool expired = now - route.lastSeen > MESH_ROUTE_TIMEOUT;
+      bool sameHop = memcmp(route.nextHop, mac, 6) == 0;
+      if (!expired && !sameHop && hops > route.hops) return;
+      slot = i;
+      break;
+    }
+    if (!route.active && slot == -1) slot = i;
+    if ((int32_t)(route.lastSeen - _meshRoutes[oldest].lastSeen) < 0) {
+      oldest = i;
+    }
+  }
+
+  // Reuse the least recently refreshed route when the table is full
+  if (slot == -1) slot = oldest;
+
+  MeshRoute& route = _meshRoutes[slot];
+  strncpy(route.boardId, boardId, sizeof(route.boardId) - 1);
+  route.boardId[sizeof(route.boardId) - 1] = '\0';
+  memcpy(route.nextHop, mac, 6);
+  route.hops = hops;
+  route.lastSeen = now;
+  route.active = true;
+}
+
+// Look up the next hop towards a board
+bool NetworkCore::findMeshRoute(const char* boardId, uint8_t* mac,
+                                uint8_t* hops) {
+  bool found = false;
+  uint32_t now = millis();
+
+  portENTER_CRITICAL(&_meshLock);
+  for (int i = 0; i < MAX_MESH_ROUTES && !found; i++) {
+    MeshRoute& route = _meshRoutes[i];
+    if (route.active && now - route.lastSeen <= MESH_ROUTE_TIMEOUT &&
+        strcmp(route.boardId, boardId) == 0) {
+      memcpy(mac, route.nextHop, 6);
+      if (hops != NULL) *hops = route.hops;
+      found = true;
+    }
+  }
+  portEXIT_CRITICAL(&_meshLock);
+
+  return found;
+}
+
+// Lay out a binary frame, returning its length or 0 if it does not fit
+size_t NetworkCore::buildBinaryFrame(uint8_t* frame, uint8_t messageType,
+                                     const char* messageId,
+                                     const uint8_t* header,
+                                     size_t headerLength, const uint8_t* data,
+                                     size_t length, bool compressBody) {
+  size_t senderLength = strlen(_boardId);
+  size_t idLength = messageId != NULL ? strlen(messageId) : 0;
+  size_t prefixLength = BINARY_FRAME_HEADER_SIZE + senderLength + idLength;
+  size_t bodyLength = headerLength + length;
+  if (prefixLength + bodyLength > MAX_ESP_NOW_DATA_SIZE) return 0;
+
+  frame[0] = BINARY_FRAME_MAGIC;
+  frame[1] = messageType;
+  frame[2] = messageId != NULL ? BINARY_FRAME_HAS_MESSAGE_ID : 0;
+  frame[3] = senderLength;
+
+  uint8_t* p = frame + BINARY_FRAME_HEADER_SIZE;
+  memcpy(p, _boardId, senderLength);
+  p += senderLength;
+  if (idLength > 0) memcpy(p, messageId, idLength);
+  p += idLength;
+  if (headerLength > 0) memcpy(p, header, headerLength);
+  if (length > 0) memcpy(p + headerLength, data, length);
+
+  if (!compressBody || bodyLength < COMPRESSION_MIN_SIZE) {
+    return prefixLength + bodyLength;
+  }
+
+  // Keep the raw body unless compressing saves at least a byte
+  uint8_t packed[MAX_ESP_NOW_DATA_SIZE];
+  size_t packedLength = compress(p, bodyLength, packed, bodyLength - 1);
+  _compressionPayloadBytes += bodyLength;
+  if (packedLength == 0) {
+    _compressionSentBytes += bodyLength;
+    return prefixLength + bodyLength;
+  }
+
+  memcpy(p, packed, packedLength);
+  frame[2] |= BINARY_FRAME_COMPRESSED;
+  _compressionSentBytes += packedLength;
+  return prefixLength + packedLength;
+}
+
+// Register the broadcast address as a peer if it is not registered yet
+bool NetworkCore::registerBroadcastPeer() {
+  uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+  if (esp_now_is_peer_exist(broadcastMac) == false) {
+    Serial.println("[NetworkCore] Registering broadcast address as peer");
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, broadcastMac, 6);
+    peerInfo.channel = 0;
+    peerInfo.encrypt = false;
+
+    esp_err_t add_result = esp_now_add_peer(&peerInfo);
+    if (add_result != ESP_OK) {
+      Serial.print("[NetworkCore] Failed to add broadcast peer, error: ");
+      Serial.println(add_result);
+      return false;
+    }
+    Serial.println("[NetworkCore] Successfully registered broadcast address");
+  } else {
+    Serial.println("[NetworkCore] Broadcast address already registered");
+  }
+  return true;
+}
+
+// Helper method to get MAC address for a board ID
+bool NetworkCore::getMacForBoardId(const char* boardId, uint8_t* macAddress) {
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
+      memcpy(macAddress, _peers[i].macAddress, 6);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Check whether a board ID refers to this board
+bool NetworkCore::isLocalBoard(const char* boardId) {
+  return boardId != NULL && strcmp(boardId, _boardId) == 0;
+}
+
+// Check whether a board is in range or has a learned mesh route
+bool NetworkCore::isReachable(const char* boardId) {
+  uint8_t mac[6];
+  return getMacForBoardId(boardId, mac) ||
+         (_meshEnabled && findMeshRoute(boardId, mac));
+}
+
+// Check whether a frame can be sent to a board. With mesh relaying, a board
+// without a route is reached by flooding.
+bool NetworkCore::canSendTo(const char* boardId) {
+  return _meshEnabled || isReachable(boardId);
+}
+
+// Helper method to get board ID for a MAC address
+bool NetworkCore::getBoardIdForMac(const uint8_t* macAddress, char* boardId) {
+  if (!macAddress || !boardId) return false;
+
+  // Check if it's broadcast address
+  bool isBroadcast = true;
+  for (int i = 0; i < 6; i++) {
+    if (macAddress[i] != 0xFF) {
+      isBroadcast = false;
+      break;
+    }
+  }
+
+  if (isBroadcast) {
+    strcpy(boardId, "broadcast");
+    return true;
+  }
+
+  // Check known peers
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active) {
+      bool macMatch = true;
+      for (int j = 0; j < 6; j++) {
+        if (_peers[i].macAddress[j] != macAddress[j]) {
+          macMatch = false;
+          break;
+        }
+      }
+
+      if (macMatch) {
+        strcpy(boardId, _peers[i].boardId);
+        return true;
+      }
+    }
+  }
+
+  return false;  // MAC address not found
+}
+
+// Add a peer to our list
+bool NetworkCore::addPeer(const char* boardId, const uint8_t* macAddress) {
+  // Basic validation
+  if (!boardId || !macAddress) {
     Serial.println("[NetworkCore] Error: Invalid peer data");
     return false;
   }
 
+  // Stored messages for the board can go out now
+  noteBoardSeen(boardId);
+
   // Check if peer already exists
   for (int i = 0; i < MAX_PEERS; i++) {
     if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
       // Update existing peer's last seen time
       _peers[i].lastSeen = millis();
+      _peers[i].state = PEER_STATE_ALIVE;
+      _peers[i].probes = 0;
+
+      // A cached board may come back with other hardware or on another
+      // channel
+      uint8_t channel = WiFi.channel();
+      if (memcmp(_peers[i].macAddress, macAddress, 6) != 0 ||
+          _peers[i].channel != channel) {
+        memcpy(_peers[i].macAddress, macAddress, 6);
+        _peers[i].channel = channel;
+        registerEspNowPeer(macAddress);
+        markPeerDirty(i);
+      }
       return true;  // Peer already exists
     }
   }
@@ -628,15 +2387,29 @@ bool NetworkCore::addPeer(const char* boardId, const uint8_t* macAddress) {
     }
   }
 
-  // If no free slot, find oldest peer
+  // If no free slot, replace the oldest board restored from the peer cache
+  // and not heard since. Evicting live peers would keep a crowded table
+  // churning, and a silent board would be evicted before it is reported
+  // lost; it frees its slot once its probes go unanswered.
   if (slot == -1) {
     uint32_t oldestTime = UINT32_MAX;
     for (int i = 0; i < MAX_PEERS; i++) {
-      if (_peers[i].lastSeen < oldestTime) {
+      if (_peers[i].state == PEER_STATE_RESTORED &&
+          _peers[i].lastSeen < oldestTime) {
         oldestTime = _peers[i].lastSeen;
         slot = i;
       }
     }
+    if (slot == -1) {
+      if (_debugLoggingEnabled) {
+        Serial.print("[NetworkCore] Peer table full, not adding: ");
+        Serial.println(boardId);
+      }
+      return false;
+    }
+
+    // Its ESP-NOW registration would otherwise fill the peer table
+    esp_now_del_peer(_peers[slot].macAddress);
   }
 
   // Add the peer
@@ -645,24 +2418,110 @@ bool NetworkCore::addPeer(const char* boardId, const uint8_t* macAddress) {
   memcpy(_peers[slot].macAddress, macAddress, 6);
   _peers[slot].active = true;
   _peers[slot].lastSeen = millis();
+  _peers[slot].channel = WiFi.channel();
+  _peers[slot].features = 0;
+  _peers[slot].state = PEER_STATE_ALIVE;
+  _peers[slot].probes = 0;
+  _peers[slot].record = 0;
+  _peers[slot].version = 0;
+  _peers[slot].firmware[0] = '\0';
+  memset(_peers[slot].topics, 0, sizeof(_peers[slot].topics));
+  _peers[slot].serviceCount = 0;
   if (_peerCount < MAX_PEERS) _peerCount++;
+  markPeerDirty(slot);
 
   // Register with ESP-NOW
-  if (esp_now_is_peer_exist(macAddress) == false) {
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, macAddress, 6);
-    peerInfo.channel = 0;
-    peerInfo.encrypt = false;
+  registerEspNowPeer(macAddress);
+
+  return true;
+}
+
+// Drop a peer from our list and from ESP-NOW
+bool NetworkCore::removePeer(const char* boardId) {
+  if (!boardId) return false;
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
+      _peers[i].active = false;
+      if (_peerCount > 0) _peerCount--;
+      esp_now_del_peer(_peers[i].macAddress);
+      markPeerDirty(i);
+
+      debugLog("Removed peer", boardId);
+      return true;
+    }
+  }
+  return false;
+}
 
-    esp_err_t result = esp_now_add_peer(&peerInfo);
-    if (result != ESP_OK) {
-      Serial.println("[NetworkCore] Failed to add ESP-NOW peer");
+// Record the features a peer advertised in its discovery messages
+void NetworkCore::setPeerFeatures(const char* boardId, uint8_t features) {
+  if (!boardId) return;
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_peers[i].active && strcmp(_peers[i].boardId, boardId) == 0) {
+      if (_peers[i].features != features) {
+        _peers[i].features = features;
+        markPeerDirty(i);
+      }
+      return;
     }
   }
+}
+
+// Register a MAC address with ESP-NOW if it is not registered yet. When the
+// ESP-NOW peer table is full, a mesh next hop that is not a known peer is
+// unregistered to make room.
+bool NetworkCore::registerEspNowPeer(const uint8_t* macAddress) {
+  if (esp_now_is_peer_exist(macAddress)) return true;
 
+  esp_now_peer_info_t peerInfo = {};
+  memcpy(peerInfo.peer_addr, macAddress, 6);
+  peerInfo.channel = 0;
+  peerInfo.encrypt = false;
+
+  esp_err_t result = esp_now_add_peer(&peerInfo);
+  if (result == ESP_ERR_ESPNOW_FULL && releaseEspNowPeer()) {
+    result = esp_now_add_peer(&peerInfo);
+  }
+  if (result != ESP_OK) {
+    Serial.println("[NetworkCore] Failed to add ESP-NOW peer");
+    return false;
+  }
   return true;
 }
 
+// Unregister the least recently used mesh next hop that is not in our peer
+// list. Returns false if there is none to unregister.
+bool NetworkCore::releaseEspNowPeer() {
+  uint8_t hops[MAX_MESH_ROUTES][6];
+  uint32_t lastSeen[MAX_MESH_ROUTES];
+  int count = 0;
+
+  portENTER_CRITICAL(&_meshLock);
+  for (int i = 0; i < MAX_MESH_ROUTES; i++) {
+    if (!_meshRoutes[i].active) continue;
+    memcpy(hops[count], _meshRoutes[i].nextHop, 6);
+    lastSeen[count++] = _meshRoutes[i].lastSeen;
+  }
+  portEXIT_CRITICAL(&_meshLock);
+
+  int oldest = -1;
+  for (int i = 0; i < count; i++) {
+    if (!esp_now_is_peer_exist(hops[i])) continue;
+    bool known = false;
+    for (int j = 0; j < MAX_PEERS && !known; j++) {
+      known = _peers[j].active &&
+              memcmp(_peers[j].macAddress, hops[i], 6) == 0;
+    }
+    if (!known && (oldest == -1 ||
+                   (int32_t)(lastSeen[i] - lastSeen[oldest]) < 0)) {
+      oldest = i;
+    }
+  }
+  return oldest != -1 && esp_now_del_peer(hops[oldest]) == ESP_OK;
+}
+
 // Send an acknowledgement for a received message
 void NetworkCore::sendAcknowledgement(const char* sender,
                                       const char* messageId) {
@@ -686,6 +2545,9 @@ void NetworkCore::handleAcknowledgement(const char* sender,
           sender);
   debugLog(debugMsg);
 
+  if (acknowledgeOutbox(sender, messageId)) return;
+  if (acknowledgeStored(sender, messageId)) return;
+
   // Find and update the tracked message
   for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
     if (_trackedMessages[i].active &&
@@ -696,6 +2558,110 @@ void NetworkCore::handleAcknowledgement(const char* sender,
   }
 }
 
+// Track a sent message until it is acknowledged or times out
+void NetworkCore::trackMessage(const char* messageId, const char* targetBoard,
+                               uint8_t messageType) {
+  for (int i = 0; i < MAX_TRACKED_MESSAGES; i++) {
+    if (!_trackedMessages[i].active) {
+      strncpy(_trackedMessages[i].messageId, messageId,
+              sizeof(_trackedMessages[i].messageId) - 1);
+      _trackedMessages[i]
+          .messageId[sizeof(_trackedMessages[i].messageId) - 1] = '\0';
+
+      strncpy(_trackedMessages[i].targetBoard, targetBoard,
+              sizeof(_trackedMessages[i].targetBoard) - 1);
+      _trackedMessages[i]
+          .targetBoard[sizeof(_trackedMessages[i].targetBoard) - 1] = '\0';
+
+      _trackedMessages[i].acknowledged = false;
+      _trackedMessages[i].sentTime = millis();
+      _trackedMessages[i].active = true;
+      _trackedMessages[i].messageType = messageType;
+
+      _trackedMessageCount++;
+      break;
+    }
+  }
+}
+
+// Replies, reports and requests answered by their own reply are never
+// acknowledged themselves. Topic and direct messages choose their QoS per
+// message and are tracked by the outbox instead.
+bool NetworkCore::requiresAcknowledgement(uint8_t messageType) {
+  switch (messageType) {
+    case MSG_TYPE_ACKNOWLEDGEMENT:
+    case MSG_TYPE_DISCOVERY:
+    case MSG_TYPE_DISCOVERY_RESPONSE:
+    case MSG_TYPE_MESSAGE:
+    case MSG_TYPE_DIRECT_MESSAGE:
+    case MSG_TYPE_PIN_SCHEDULE_RESULT:
+    case MSG_TYPE_PIN_SEQUENCE_STATUS:
+    case MSG_TYPE_PIN_GROUP:
+    case MSG_TYPE_PIN_GROUP_ACK:
+    case MSG_TYPE_BUS_TRANSACTION:
+    case MSG_TYPE_BUS_RESPONSE:
+    case MSG_TYPE_TOPIC_ANNOUNCE:
+    case MSG_TYPE_TOPIC_INTEREST:
+    case MSG_TYPE_TOPIC_RETAINED:
+    case MSG_TYPE_STREAM_DATA:
+    case MSG_TYPE_STREAM_ACK:
+    case MSG_TYPE_SERIAL_CHANNEL:
+    case MSG_TYPE_CLOCK_SYNC:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Add a callback to a fixed-capacity list
+bool NetworkCore::addCallback(CallbackSlot* slots, int capacity,
+                              void (*function)(), void* context,
+                              uint8_t kind) {
+  if (function == NULL) return false;
+
+  CallbackSlot* freeSlot = NULL;
+  for (int i = 0; i < capacity; i++) {
+    if (slots[i].kind == CALLBACK_NONE) {
+      if (freeSlot == NULL) freeSlot = &slots[i];
+    } else if (slots[i].function == function && slots[i].context == context &&
+               slots[i].kind == kind) {
+      return true;  // Already registered
+    }
+  }
+  if (freeSlot == NULL) return false;  // List full
+
+  freeSlot->function = function;
+  freeSlot->context = context;
+  freeSlot->kind = kind;
+  return true;
+}
+
+// Remove every callback registered with a context
+bool NetworkCore::removeCallbacks(CallbackSlot* slots, int capacity,
+                                  void* context) {
+  bool removed = false;
+  for (int i = 0; i < capacity; i++) {
+    if (slots[i].kind != CALLBACK_NONE && slots[i].context == context) {
+      slots[i].kind = CALLBACK_NONE;
+      removed = true;
+    }
+  }
+  return removed;
+}
+
+// Remove a callback registered without a context
+bool NetworkCore::removeCallback(CallbackSlot* slots, int capacity,
+                                 void (*function)()) {
+  bool removed = false;
+  for (int i = 0; i < capacity; i++) {
+    if ((slots[i].kind & CALLBACK_PLAIN) && slots[i].function == function) {
+      slots[i].kind = CALLBACK_NONE;
+      removed = true;
+    }
+  }
+  return removed;
+}
+
 // Generate a simple UUID-like message ID
 void NetworkCore::generateMessageId(char* buffer) {
   const char* chars = "0123456789abcdef";
@@ -712,6 +2678,65 @@ void NetworkCore::generateMessageId(char* buffer) {
   buffer[36] = '\0';
 }
 
+// Compact 16-bit identifier for a name (FNV-1a folded to 16 bits)
+uint16_t NetworkCore::hash16(const char* text) {
+  return hash16(text, strlen(text));
+}
+
+uint16_t NetworkCore::hash16(const char* data, size_t length) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619UL;
+  }
+  return (uint16_t)((hash >> 16) ^ (hash & 0xFFFF));
+}
+
+// Each entry sets two bits, chosen by the two bytes of its 16-bit hash
+void NetworkCore::addToDigest(uint8_t* digest, size_t size, const char* text) {
+  uint16_t hash = hash16(text);
+  uint16_t first = (hash & 0xFF) % (size * 8);
+  uint16_t second = (hash >> 8) % (size * 8);
+  digest[first / 8] |= 1 << (first % 8);
+  digest[second / 8] |= 1 << (second % 8);
+}
+
+// False positives are possible, false negatives are not
+bool NetworkCore::digestContains(const uint8_t* digest, size_t size,
+                                 const char* text) {
+  uint16_t hash = hash16(text);
+  uint16_t first = (hash & 0xFF) % (size * 8);
+  uint16_t second = (hash >> 8) % (size * 8);
+  return (digest[first / 8] & (1 << (first % 8))) &&
+         (digest[second / 8] & (1 << (second % 8)));
+}
+
+// Hex-encode bytes so they travel inside a JSON frame; out must hold
+// length * 2 + 1 characters
+void NetworkCore::hexEncode(const uint8_t* data, size_t length, char* out) {
+  static const char hexChars[] = "0123456789abcdef";
+  for (size_t i = 0; i < length; i++) {
+    out[i * 2] = hexChars[data[i] >> 4];
+    out[i * 2 + 1] = hexChars[data[i] & 0x0F];
+  }
+  out[length * 2] = '\0';
+}
+
+// Decode a hex string, returning the number of bytes or -1 if it is
+// malformed or longer than maxLength
+int NetworkCore::hexDecode(const char* hex, uint8_t* out, size_t maxLength) {
+  size_t hexLength = hex ? strlen(hex) : 0;
+  if (hexLength % 2 != 0 || hexLength / 2 > maxLength) return -1;
+
+  for (size_t i = 0; i < hexLength; i += 2) {
+    int high = hexNibble(hex[i]);
+    int low = hexNibble(hex[i + 1]);
+    if (high < 0 || low < 0) return -1;
+    out[i / 2] = (uint8_t)((high << 4) | low);
+  }
+  return hexLength / 2;
+}
+
 // Debug logging helper
 void NetworkCore::debugLog(const char* event, const char* details) {
   if (_debugLoggingEnabled) {
@@ -743,4 +2768,19 @@ bool NetworkCore::registerDiscoveryHandler(NetworkDiscovery* discovery) {
   _discoveryHandler = discovery;
   Serial.println("[NetworkCore] Discovery handler registered");
   return true;
+}
+
+bool NetworkCore::registerPinControlHandler(NetworkPinControl* pinControl) {
+  _pinControlHandler = pinControl;
+  return true;
+}
+
+bool NetworkCore::registerMessagingHandler(NetworkMessaging* messaging) {
+  _messagingHandler = messaging;
+  return true;
+}
+
+bool NetworkCore::registerSerialHandler(NetworkSerial* serial) {
+  _serialHandler = serial;
+  return true;
 }
\ No newline at end of file
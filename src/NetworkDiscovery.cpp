@@ -5,21 +5,38 @@
 
 #include "NetworkDiscovery.h"
 
+#include "NetworkMessaging.h"
+#include "NetworkPinControl.h"
+#include "NetworkSerial.h"
+
 // Constructor
 NetworkDiscovery::NetworkDiscovery(NetworkCore& core) : _core(core) {
-  _discoveryCallback = NULL;
-  _lastDiscoveryBroadcast = 0;
-  _firstMinuteDiscovery = true;
-  _firstFiveMinutesDiscovery = true;
-  _discoveryStartTime = 0;
+  memset(_discoveryCallbacks, 0, sizeof(_discoveryCallbacks));
+  memset(_lostCallbacks, 0, sizeof(_lostCallbacks));
+  _discoveryInterval = DISCOVERY_INTERVAL_MIN;
+  _nextDiscoveryBroadcast = 0;
+  _advertisedRecord = 0;
+  _peerTimeout = PEER_SUSPECT_TIMEOUT;
+  _lastPeerCheck = 0;
+
+  _serviceCount = 0;
+  _firmwareVersion[0] = '\0';
+
+  _responseLock = portMUX_INITIALIZER_UNLOCKED;
+  for (int i = 0; i < MAX_PENDING_RESPONSES; i++) {
+    _pendingResponses[i].active = false;
+  }
 }
 
 bool NetworkDiscovery::begin() {
-  _discoveryStartTime = millis();
-
-  // Broadcast presence immediately to discover other boards
-  broadcastPresence();
-
+  // Broadcast presence immediately to discover other boards, or from the
+  // first update() after the core has started
+  _discoveryInterval = DISCOVERY_INTERVAL_MIN;
+  if (broadcastPresence()) {
+    scheduleDiscovery(millis());
+  } else {
+    _nextDiscoveryBroadcast = millis();
+  }
   return true;
 }
 
@@ -28,27 +45,27 @@ void NetworkDiscovery::update() {
 
   uint32_t currentTime = millis();
 
-  // Determine the appropriate discovery interval based on uptime
-  uint32_t discoveryInterval =
-      INITIAL_DISCOVERY_INTERVAL;  // 5 seconds initially
-
-  // After the first minute, slow down to 20 seconds
-  if (_firstMinuteDiscovery && (currentTime - _discoveryStartTime > 60000)) {
-    _firstMinuteDiscovery = false;
-    discoveryInterval = ACTIVE_DISCOVERY_INTERVAL;  // 20 seconds
+  // Broadcast presence, then back off until the network changes
+  if ((int32_t)(currentTime - _nextDiscoveryBroadcast) >= 0) {
+    broadcastPresence();
+    _discoveryInterval = _discoveryInterval * 2 < DISCOVERY_INTERVAL_MAX
+                             ? _discoveryInterval * 2
+                             : DISCOVERY_INTERVAL_MAX;
+    scheduleDiscovery(currentTime);
   }
 
-  // After five minutes, slow down further to 60 seconds
-  if (_firstFiveMinutesDiscovery &&
-      (currentTime - _discoveryStartTime > 300000)) {
-    _firstFiveMinutesDiscovery = false;
-    discoveryInterval = STABLE_DISCOVERY_INTERVAL;  // 60 seconds
-  }
+  sendPendingResponses(currentTime);
 
-  // Check if it's time to broadcast presence
-  if (currentTime - _lastDiscoveryBroadcast > discoveryInterval) {
-    broadcastPresence();
-    _lastDiscoveryBroadcast = currentTime;
+  if (currentTime - _lastPeerCheck >= PEER_CHECK_INTERVAL) {
+    _lastPeerCheck = currentTime;
+    checkPeers(currentTime);
+
+    // A subscription, pin control or channel changed our record; broadcast
+    // the new hash soon, so peers fetch it
+    uint8_t topics[TOPIC_DIGEST_SIZE];
+    if (_advertisedRecord != 0 && localRecord(topics) != _advertisedRecord) {
+      speedUpDiscovery();
+    }
   }
 }
 
@@ -58,7 +75,14 @@ bool NetworkDiscovery::broadcastPresence() {
   // Create a minimal discovery message
   StaticJsonDocument<128> doc;
 
-  // No additional data needed for discovery broadcast
+  // Advertise what this board can do and which boards it knows, so those
+  // need not respond
+  addRecord(doc.to<JsonObject>(), false);
+  _advertisedRecord = doc["rec"];
+  char digest[DISCOVERY_DIGEST_SIZE * 2 + 1];
+  buildKnownDigest(digest);
+  doc["known"] = (const char*)digest;
+  if (isPeerTableFull()) doc["full"] = true;
 
   // Add debug output before broadcasting
   Serial.print("[DISCOVERY] Broadcasting presence from board: ");
@@ -79,10 +103,64 @@ bool NetworkDiscovery::broadcastPresence() {
 }
 
 bool NetworkDiscovery::onBoardDiscovered(DiscoveryCallback callback) {
-  _discoveryCallback = callback;
+  if (callback == NULL) {
+    memset(_discoveryCallbacks, 0, sizeof(_discoveryCallbacks));
+    return true;
+  }
+  return NetworkCore::addCallback(_discoveryCallbacks, MAX_DISCOVERY_CALLBACKS,
+                                  (void (*)())callback, NULL, CALLBACK_PLAIN);
+}
+
+bool NetworkDiscovery::onBoardDiscovered(DiscoveryContextCallback callback,
+                                         void* context) {
+  return NetworkCore::addCallback(_discoveryCallbacks, MAX_DISCOVERY_CALLBACKS,
+                                  (void (*)())callback, context,
+                                  CALLBACK_CONTEXT);
+}
+
+bool NetworkDiscovery::removeDiscoveryCallbacks(void* context) {
+  bool removed = NetworkCore::removeCallbacks(_discoveryCallbacks,
+                                              MAX_DISCOVERY_CALLBACKS, context);
+  removed |= NetworkCore::removeCallbacks(_lostCallbacks, MAX_LOST_CALLBACKS,
+                                          context);
+  return removed;
+}
+
+bool NetworkDiscovery::onBoardLost(DiscoveryCallback callback) {
+  if (callback == NULL) {
+    memset(_lostCallbacks, 0, sizeof(_lostCallbacks));
+    return true;
+  }
+  return NetworkCore::addCallback(_lostCallbacks, MAX_LOST_CALLBACKS,
+                                  (void (*)())callback, NULL, CALLBACK_PLAIN);
+}
+
+bool NetworkDiscovery::onBoardLost(DiscoveryContextCallback callback,
+                                   void* context) {
+  return NetworkCore::addCallback(_lostCallbacks, MAX_LOST_CALLBACKS,
+                                  (void (*)())callback, context,
+                                  CALLBACK_CONTEXT);
+}
+
+bool NetworkDiscovery::setPeerTimeout(uint32_t timeoutMs) {
+  if (timeoutMs == 0) return false;
+
+  _peerTimeout = timeoutMs;
   return true;
 }
 
+bool NetworkDiscovery::isBoardSuspect(const char* boardId) {
+  if (!boardId) return false;
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_core._peers[i].active &&
+        strcmp(_core._peers[i].boardId, boardId) == 0) {
+      return _core._peers[i].state == PEER_STATE_SUSPECT;
+    }
+  }
+  return false;
+}
+
 bool NetworkDiscovery::isBoardAvailable(const char* boardId) {
   if (!_core.isConnected()) return false;
 
@@ -125,7 +203,9 @@ String NetworkDiscovery::getAvailableBoardName(int index) {
 }
 
 void NetworkDiscovery::handleDiscovery(const char* senderId,
-                                       const uint8_t* senderMac) {
+                                       const uint8_t* senderMac,
+                                       const char* knownDigest,
+                                       bool senderFull) {
   // Don't process discovery messages from ourselves
   if (strcmp(senderId, _core._boardId) == 0) {
     Serial.println("[DISCOVERY] Ignoring discovery from self");
@@ -142,33 +222,468 @@ void NetworkDiscovery::handleDiscovery(const char* senderId,
   Serial.print("[DISCOVERY] Sender MAC: ");
   Serial.println(macStr);
 
-  // Add the sender to our peer list
+  // Add the sender to our peer list. A board we did not know changes the
+  // network, so discovery speeds up again; with a full peer table it only
+  // replaces a cached board, which must not keep discovery at full rate.
+  bool joined = !isBoardAvailable(senderId) && _core._peerCount < MAX_PEERS;
   bool added = addPeer(senderId, senderMac);
+  if (added && joined) speedUpDiscovery();
   Serial.print("[DISCOVERY] Peer added: ");
   Serial.println(added ? "YES" : "NO");
 
-  // Notify through callback if registered
-  if (_discoveryCallback != NULL) {
-    _discoveryCallback(senderId);
+  // Notify through the callbacks if registered
+  int notified = 0;
+  for (int i = 0; i < MAX_DISCOVERY_CALLBACKS; i++) {
+    const CallbackSlot& callback = _discoveryCallbacks[i];
+    if (callback.kind == CALLBACK_PLAIN) {
+      ((DiscoveryCallback)callback.function)(senderId);
+    } else if (callback.kind == CALLBACK_CONTEXT) {
+      ((DiscoveryContextCallback)callback.function)(callback.context,
+                                                    senderId);
+    } else {
+      continue;
+    }
+    notified++;
+  }
+  if (notified > 0) {
     Serial.println("[DISCOVERY] Discovery callback executed");
   } else {
     Serial.println("[DISCOVERY] No discovery callback registered");
   }
 
-  // Send a discovery response to let the sender know we exist
+  // A sender that already knows us needs no response
+  if (knownDigest != NULL &&
+      knownDigestContains(knownDigest, _core._boardId)) {
+    Serial.println("[DISCOVERY] Response suppressed, sender knows us");
+    return;
+  }
+
+  // Neither does a sender with no room to add us. Probes carry no digest
+  // and are always answered.
+  if (knownDigest != NULL && senderFull) {
+    Serial.println("[DISCOVERY] Response suppressed, sender's table is full");
+    return;
+  }
+
+  // Answer after a random delay, so the boards hearing one broadcast do
+  // not all transmit at once
+  uint32_t dueTime = millis() + random(0, DISCOVERY_RESPONSE_DELAY_MAX + 1);
+
+  // With every slot taken, answer straight away rather than not at all
+  if (!queuePending(senderId, dueTime, false)) sendDiscoveryResponse(senderId);
+}
+
+bool NetworkDiscovery::addPeer(const char* boardId, const uint8_t* macAddress) {
+  // Use the core's addPeer method
+  return _core.addPeer(boardId, macAddress);
+}
+
+// Pick the next broadcast time at random in the second half of the interval
+void NetworkDiscovery::scheduleDiscovery(uint32_t currentTime) {
+  _nextDiscoveryBroadcast = currentTime + _discoveryInterval / 2 +
+                            random(0, _discoveryInterval / 2 + 1);
+}
+
+// Restart discovery at the shortest interval after a board joined or left
+void NetworkDiscovery::speedUpDiscovery() {
+  if (_discoveryInterval == DISCOVERY_INTERVAL_MIN) return;
+
+  _discoveryInterval = DISCOVERY_INTERVAL_MIN;
+  scheduleDiscovery(millis());
+}
+
+// Probe peers that have gone silent and drop those that stay silent
+void NetworkDiscovery::checkPeers(uint32_t currentTime) {
+  for (int i = 0; i < MAX_PEERS; i++) {
+    NetworkCore::PeerInfo& peer = _core._peers[i];
+    if (!peer.active) continue;
+
+    // lastSeen is written from the receive path and may be ahead of us.
+    // Boards restored from the peer cache get less time to show up.
+    int32_t silence = currentTime - peer.lastSeen;
+    uint32_t timeout = peer.state == PEER_STATE_RESTORED
+                           ? PEER_RESTORED_TIMEOUT
+                           : _peerTimeout;
+    if (silence < (int32_t)timeout) continue;
+
+    if (peer.state != PEER_STATE_SUSPECT) {
+      // A restored board continues on the normal probe schedule
+      if (peer.state == PEER_STATE_RESTORED) {
+        peer.lastSeen = currentTime - _peerTimeout;
+        silence = timeout = _peerTimeout;
+      }
+      peer.state = PEER_STATE_SUSPECT;
+      peer.probes = 0;
+      Serial.print("[DISCOVERY] Board suspect: ");
+      Serial.println(peer.boardId);
+    }
+
+    if (silence < (int32_t)(timeout + peer.probes * PEER_PROBE_INTERVAL)) {
+      continue;
+    }
+
+    if (peer.probes < PEER_PROBE_COUNT) {
+      peer.probes++;
+      probePeer(peer.boardId);
+      continue;
+    }
+
+    char boardId[32];
+    strcpy(boardId, peer.boardId);
+    Serial.print("[DISCOVERY] Board lost: ");
+    Serial.println(boardId);
+
+    _core.removePeer(boardId);
+    notifyBoardLost(boardId);
+    speedUpDiscovery();
+  }
+}
+
+// Ask a peer to answer with a discovery response, which also carries its
+// capability record. Used to probe silent peers and to fetch records.
+bool NetworkDiscovery::probePeer(const char* boardId) {
   StaticJsonDocument<128> doc;
+  addRecord(doc.to<JsonObject>(), false);
+  return _core.sendMessage(boardId, MSG_TYPE_DISCOVERY, doc.as<JsonObject>());
+}
+
+void NetworkDiscovery::notifyBoardLost(const char* boardId) {
+  for (int i = 0; i < MAX_LOST_CALLBACKS; i++) {
+    const CallbackSlot& callback = _lostCallbacks[i];
+    if (callback.kind == CALLBACK_PLAIN) {
+      ((DiscoveryCallback)callback.function)(boardId);
+    } else if (callback.kind == CALLBACK_CONTEXT) {
+      ((DiscoveryContextCallback)callback.function)(callback.context, boardId);
+    }
+  }
+}
+
+// Queue a discovery response or record request, once per board and kind.
+// Returns false if the queue is full.
+bool NetworkDiscovery::queuePending(const char* boardId, uint32_t dueTime,
+                                    bool recordRequest) {
+  if (strlen(boardId) >= sizeof(_pendingResponses[0].boardId)) return false;
+
+  bool queued = false;
+  portENTER_CRITICAL(&_responseLock);
+  for (int i = 0; i < MAX_PENDING_RESPONSES && !queued; i++) {
+    const PendingResponse& response = _pendingResponses[i];
+    if (response.active && response.recordRequest == recordRequest &&
+        strcmp(response.boardId, boardId) == 0) {
+      queued = true;  // Already pending for this board
+    }
+  }
+  for (int i = 0; i < MAX_PENDING_RESPONSES && !queued; i++) {
+    PendingResponse& response = _pendingResponses[i];
+    if (!response.active) {
+      strcpy(response.boardId, boardId);
+      response.dueTime = dueTime;
+      response.recordRequest = recordRequest;
+      response.active = true;
+      queued = true;
+    }
+  }
+  portEXIT_CRITICAL(&_responseLock);
+  return queued;
+}
+
+// Send the discovery responses whose delay has passed, and record requests
+void NetworkDiscovery::sendPendingResponses(uint32_t currentTime) {
+  for (int i = 0; i < MAX_PENDING_RESPONSES; i++) {
+    char boardId[32];
+    bool due = false;
+    bool recordRequest = false;
+
+    portENTER_CRITICAL(&_responseLock);
+    PendingResponse& response = _pendingResponses[i];
+    if (response.active && (int32_t)(currentTime - response.dueTime) >= 0) {
+      strcpy(boardId, response.boardId);
+      recordRequest = response.recordRequest;
+      response.active = false;
+      due = true;
+    }
+    portEXIT_CRITICAL(&_responseLock);
+
+    if (!due) continue;
+    if (recordRequest) {
+      probePeer(boardId);
+    } else {
+      sendDiscoveryResponse(boardId);
+    }
+  }
+}
+
+// Send a discovery response to let a board know we exist
+bool NetworkDiscovery::sendDiscoveryResponse(const char* boardId) {
+  StaticJsonDocument<256> doc;
+  addRecord(doc.to<JsonObject>(), true);
 
   Serial.print("[DISCOVERY] Sending discovery response to: ");
-  Serial.println(senderId);
+  Serial.println(boardId);
 
-  bool sent = _core.sendMessage(senderId, MSG_TYPE_DISCOVERY_RESPONSE,
+  bool sent = _core.sendMessage(boardId, MSG_TYPE_DISCOVERY_RESPONSE,
                                 doc.as<JsonObject>());
 
   Serial.print("[DISCOVERY] Response sent: ");
   Serial.println(sent ? "YES" : "NO");
+  return sent;
 }
 
-bool NetworkDiscovery::addPeer(const char* boardId, const uint8_t* macAddress) {
-  // Use the core's addPeer method
-  return _core.addPeer(boardId, macAddress);
-}
\ No newline at end of file
+// Write the digest of the active peers as a hex string
+void NetworkDiscovery::buildKnownDigest(char* hex) {
+  uint8_t digest[DISCOVERY_DIGEST_SIZE];
+  memset(digest, 0, sizeof(digest));
+
+  // Boards restored from the peer cache are left out until they are heard
+  // from, so they answer and confirm they are still there
+  for (int i = 0; i < MAX_PEERS; i++) {
+    const NetworkCore::PeerInfo& peer = _core._peers[i];
+    if (peer.active && peer.state != PEER_STATE_RESTORED) {
+      NetworkCore::addToDigest(digest, sizeof(digest), peer.boardId);
+    }
+  }
+  NetworkCore::hexEncode(digest, sizeof(digest), hex);
+}
+
+// Check if the peer table has no slot for a new board. A full table still
+// takes a board in place of one restored from the cache.
+bool NetworkDiscovery::isPeerTableFull() {
+  for (int i = 0; i < MAX_PEERS; i++) {
+    const NetworkCore::PeerInfo& peer = _core._peers[i];
+    if (!peer.active || peer.state == PEER_STATE_RESTORED) return false;
+  }
+  return true;
+}
+
+// Check a received digest for a board ID. False positives are possible;
+// the board then answers the sender's next broadcast that misses it.
+bool NetworkDiscovery::knownDigestContains(const char* hex,
+                                           const char* boardId) {
+  uint8_t digest[DISCOVERY_DIGEST_SIZE];
+  if (NetworkCore::hexDecode(hex, digest, sizeof(digest)) != sizeof(digest)) {
+    return false;
+  }
+  return NetworkCore::digestContains(digest, sizeof(digest), boardId);
+}
+
+// ==================== Capability Records ====================
+
+bool NetworkDiscovery::advertiseService(const char* service) {
+  if (!service || service[0] == '\0') return false;
+
+  uint16_t hash = NetworkCore::hash16(service);
+  for (int i = 0; i < _serviceCount; i++) {
+    if (_services[i] == hash) return true;
+  }
+  if (_serviceCount >= MAX_BOARD_SERVICES) {
+    Serial.println("[DISCOVERY] Maximum services reached");
+    return false;
+  }
+
+  _services[_serviceCount++] = hash;
+
+  // Broadcast the new record hash soon, so peers fetch the record
+  speedUpDiscovery();
+  return true;
+}
+
+bool NetworkDiscovery::withdrawService(const char* service) {
+  if (!service) return false;
+
+  uint16_t hash = NetworkCore::hash16(service);
+  for (int i = 0; i < _serviceCount; i++) {
+    if (_services[i] != hash) continue;
+
+    _serviceCount--;
+    memmove(&_services[i], &_services[i + 1],
+            (_serviceCount - i) * sizeof(_services[0]));
+    speedUpDiscovery();
+    return true;
+  }
+  return false;
+}
+
+bool NetworkDiscovery::setFirmwareVersion(const char* version) {
+  if (!version || strlen(version) >= sizeof(_firmwareVersion)) return false;
+  if (strcmp(version, _firmwareVersion) == 0) return true;
+
+  strcpy(_firmwareVersion, version);
+  speedUpDiscovery();
+  return true;
+}
+
+uint8_t NetworkDiscovery::getBoardFeatures(const char* boardId) {
+  NetworkCore::PeerInfo* peer = findPeer(boardId);
+  return peer ? peer->features : 0;
+}
+
+uint8_t NetworkDiscovery::getBoardProtocolVersion(const char* boardId) {
+  NetworkCore::PeerInfo* peer = findPeer(boardId);
+  return peer ? peer->version : 0;
+}
+
+String NetworkDiscovery::getBoardFirmwareVersion(const char* boardId) {
+  NetworkCore::PeerInfo* peer = findPeer(boardId);
+  return String(peer ? peer->firmware : "");
+}
+
+bool NetworkDiscovery::boardOffersService(const char* boardId,
+                                          const char* service) {
+  NetworkCore::PeerInfo* peer = findPeer(boardId);
+  if (!peer || !service) return false;
+
+  uint16_t hash = NetworkCore::hash16(service);
+  for (int i = 0; i < peer->serviceCount; i++) {
+    if (peer->services[i] == hash) return true;
+  }
+  return false;
+}
+
+int NetworkDiscovery::getBoardsWithServiceCount(const char* service) {
+  int count = 0;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_core._peers[i].active &&
+        boardOffersService(_core._peers[i].boardId, service)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+String NetworkDiscovery::getBoardWithService(const char* service, int index) {
+  int count = 0;
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (!_core._peers[i].active ||
+        !boardOffersService(_core._peers[i].boardId, service)) {
+      continue;
+    }
+    if (count == index) return String(_core._peers[i].boardId);
+    count++;
+  }
+  return String("");  // Not found
+}
+
+bool NetworkDiscovery::boardMaySubscribe(const char* boardId,
+                                         const char* topicFilter) {
+  NetworkCore::PeerInfo* peer = findPeer(boardId);
+  if (!peer || !topicFilter || peer->record == 0) return false;
+
+  return NetworkCore::digestContains(peer->topics, sizeof(peer->topics),
+                                     topicFilter);
+}
+
+void NetworkDiscovery::handleRecord(const char* senderId,
+                                    const JsonObject& doc) {
+  // Boards with older firmware send no record
+  uint16_t record = doc["rec"] | 0;
+  if (record == 0) return;
+
+  NetworkCore::PeerInfo* peer = findPeer(senderId);
+  if (!peer) return;
+
+  if (!doc.containsKey("ver")) {
+    // Only the hash; fetch the record if our copy is missing or stale
+    if (peer->record != record) queuePending(senderId, millis(), true);
+    return;
+  }
+
+  peer->version = doc["ver"] | 0;
+  strncpy(peer->firmware, doc["fw"] | "", sizeof(peer->firmware) - 1);
+  peer->firmware[sizeof(peer->firmware) - 1] = '\0';
+  if (NetworkCore::hexDecode(doc["topics"], peer->topics,
+                             sizeof(peer->topics)) != sizeof(peer->topics)) {
+    memset(peer->topics, 0, sizeof(peer->topics));
+  }
+
+  peer->serviceCount = 0;
+  JsonArray services = doc["svc"];
+  for (JsonVariant service : services) {
+    if (peer->serviceCount == MAX_BOARD_SERVICES) break;
+    peer->services[peer->serviceCount++] = service.as<uint16_t>();
+  }
+  peer->record = record;
+  _core.markPeerDirty(peer - _core._peers);
+
+  Serial.print("[DISCOVERY] Capability record from: ");
+  Serial.println(senderId);
+}
+
+// Features of this board, from the modules registered with the core
+uint8_t NetworkDiscovery::localFeatures() {
+  uint8_t features = LOCAL_PEER_FEATURES;
+  NetworkPinControl* pinControl = _core._pinControlHandler;
+  if (pinControl != NULL && pinControl->acceptsPinControl()) {
+    features |= PEER_FEATURE_PIN_CONTROL;
+  }
+  if (pinControl != NULL && pinControl->isBusProxyEnabled()) {
+    features |= PEER_FEATURE_BUS_PROXY;
+  }
+  if (_core._messagingHandler != NULL &&
+      _core._messagingHandler->hasSubscriptions()) {
+    features |= PEER_FEATURE_MESSAGING;
+  }
+  if (_core._serialHandler != NULL && _core._serialHandler->hasOpenChannels()) {
+    features |= PEER_FEATURE_SERIAL;
+  }
+  if (_core._meshEnabled) features |= PEER_FEATURE_MESH_RELAY;
+  return features;
+}
+
+// Fill in the subscription digest and return the hash of our record, never 0
+uint16_t NetworkDiscovery::localRecord(uint8_t* topics) {
+  memset(topics, 0, TOPIC_DIGEST_SIZE);
+  if (_core._messagingHandler != NULL) {
+    _core._messagingHandler->addSubscriptionsToDigest(topics,
+                                                      TOPIC_DIGEST_SIZE);
+  }
+
+  uint8_t data[2 + FIRMWARE_VERSION_SIZE + TOPIC_DIGEST_SIZE +
+               MAX_BOARD_SERVICES * 2];
+  size_t length = 0;
+  data[length++] = localFeatures();
+  data[length++] = NETWORK_PROTOCOL_VERSION;
+  memset(data + length, 0, FIRMWARE_VERSION_SIZE);
+  strcpy((char*)data + length, _firmwareVersion);
+  length += FIRMWARE_VERSION_SIZE;
+  memcpy(data + length, topics, TOPIC_DIGEST_SIZE);
+  length += TOPIC_DIGEST_SIZE;
+  for (int i = 0; i < _serviceCount; i++) {
+    data[length++] = _services[i] >> 8;
+    data[length++] = _services[i] & 0xFF;
+  }
+
+  uint16_t hash = NetworkCore::hash16((const char*)data, length);
+  return hash != 0 ? hash : 1;
+}
+
+// Add our features and record hash to a discovery message, and with full
+// set the record itself
+void NetworkDiscovery::addRecord(JsonObject doc, bool full) {
+  uint8_t topics[TOPIC_DIGEST_SIZE];
+  doc["features"] = localFeatures();
+  doc["rec"] = localRecord(topics);
+  if (!full) return;
+
+  char topicsHex[TOPIC_DIGEST_SIZE * 2 + 1];
+  NetworkCore::hexEncode(topics, sizeof(topics), topicsHex);
+
+  doc["ver"] = NETWORK_PROTOCOL_VERSION;
+  doc["fw"] = (const char*)_firmwareVersion;
+  doc["topics"] = topicsHex;  // Copied into the document
+  JsonArray services = doc.createNestedArray("svc");
+  for (int i = 0; i < _serviceCount; i++) {
+    services.add(_services[i]);
+  }
+}
+
+NetworkCore::PeerInfo* NetworkDiscovery::findPeer(const char* boardId) {
+  if (!boardId) return NULL;
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (_core._peers[i].active &&
+        strcmp(_core._peers[i].boardId, boardId) == 0) {
+      return &_core._peers[i];
+    }
+  }
+  return NULL;
+}
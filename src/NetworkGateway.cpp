@@ -0,0 +1,352 @@
+/**
+ * NetworkGateway.cpp - MQTT gateway for ESP32 network communication
+ * Created as part of the NetworkComm library refactoring
+ */
+
+#include "NetworkGateway.h"
+
+// Constructor
+NetworkGateway::NetworkGateway(NetworkCore& core, NetworkMessaging& messaging)
+    : _core(core), _messaging(messaging), _mqtt(_wifiClient) {
+  _host[0] = '\0';
+  _port = 0;
+  _clientId[0] = '\0';
+  _username[0] = '\0';
+  _password[0] = '\0';
+  _started = false;
+  _subscribed = false;
+  _lastConnectAttempt = 0;
+  _reconnectDelay = 0;
+
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    _outboundRoutes[i].gateway = this;
+    _outboundRoutes[i].active = false;
+    _inboundRoutes[i].gateway = this;
+    _inboundRoutes[i].active = false;
+  }
+
+  _backlogHead = 0;
+  _backlogCount = 0;
+  _backlogSince = 0;
+  _dropped = 0;
+  _backlogLock = portMUX_INITIALIZER_UNLOCKED;
+  _bridgingInbound = false;
+
+  _mqtt.setCallback([this](char* topic, uint8_t* payload,
+                           unsigned int length) {
+    handleMqttMessage(topic, payload, length);
+  });
+}
+
+bool NetworkGateway::begin() {
+  // Room for the longest topic and payload we bridge, plus the MQTT header
+  _mqtt.setBufferSize(MQTT_GATEWAY_TOPIC_SIZE + MQTT_GATEWAY_PAYLOAD_SIZE + 16);
+  _mqtt.setSocketTimeout(MQTT_GATEWAY_SOCKET_TIMEOUT);
+  return true;
+}
+
+void NetworkGateway::update() {
+  // The broker is reached through the access point, unlike the boards
+  if (!_started || !_core.isConnected() || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  if (!_mqtt.connected()) {
+    _subscribed = false;
+
+    uint32_t currentTime = millis();
+    if (currentTime - _lastConnectAttempt < _reconnectDelay) return;
+    _lastConnectAttempt = currentTime;
+
+    // Back off with a doubling delay while the broker is unreachable
+    if (!connectToBroker()) {
+      _reconnectDelay = _reconnectDelay == 0 ? MQTT_GATEWAY_RECONNECT_MIN
+                                             : _reconnectDelay * 2;
+      if (_reconnectDelay > MQTT_GATEWAY_RECONNECT_MAX) {
+        _reconnectDelay = MQTT_GATEWAY_RECONNECT_MAX;
+      }
+      return;
+    }
+    _reconnectDelay = 0;
+  }
+
+  if (!_subscribed) subscribeInboundRoutes();
+
+  flushBacklog();
+  _mqtt.loop();
+}
+
+bool NetworkGateway::setMqttClient(Client& client) {
+  if (_started) return false;
+
+  _mqtt.setClient(client);
+  return true;
+}
+
+bool NetworkGateway::startMqttGateway(const char* host, uint16_t port,
+                                      const char* clientId,
+                                      const char* username,
+                                      const char* password) {
+  if (!host || strlen(host) >= sizeof(_host)) return false;
+  if (clientId && strlen(clientId) >= sizeof(_clientId)) return false;
+  if (username && strlen(username) >= sizeof(_username)) return false;
+  if (password && strlen(password) >= sizeof(_password)) return false;
+
+  if (_started) stopMqttGateway();
+
+  strcpy(_host, host);
+  _port = port;
+  strcpy(_clientId, clientId ? clientId : _core._boardId);
+  strcpy(_username, username ? username : "");
+  strcpy(_password, password ? password : "");
+
+  // PubSubClient keeps the host pointer, so it must point at our copy
+  _mqtt.setServer(_host, _port);
+
+  // Connect on the next update()
+  _reconnectDelay = 0;
+  _subscribed = false;
+  _started = true;
+  return true;
+}
+
+bool NetworkGateway::stopMqttGateway() {
+  if (!_started) return false;
+
+  _started = false;
+  _mqtt.disconnect();
+
+  portENTER_CRITICAL(&_backlogLock);
+  _backlogCount = 0;
+  portEXIT_CRITICAL(&_backlogLock);
+
+  return true;
+}
+
+bool NetworkGateway::isMqttConnected() { return _started && _mqtt.connected(); }
+
+bool NetworkGateway::bridgeTopicToMqtt(const char* topicFilter,
+                                       const char* mqttPrefix) {
+  if (!topicFilter || !mqttPrefix) return false;
+  if (strlen(topicFilter) >= sizeof(_outboundRoutes[0].filter)) return false;
+  if (strlen(mqttPrefix) >= sizeof(_outboundRoutes[0].prefix)) return false;
+
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    GatewayRoute& route = _outboundRoutes[i];
+    if (route.active) continue;
+
+    strcpy(route.filter, topicFilter);
+    strcpy(route.prefix, mqttPrefix);
+
+    // The route itself is the context, so the callback knows its prefix
+    if (!_messaging.subscribeTopic(route.filter, onBridgedTopic, &route)) {
+      return false;
+    }
+    route.active = true;
+    return true;
+  }
+
+  Serial.println("[NetworkGateway] Maximum routes reached");
+  return false;
+}
+
+bool NetworkGateway::bridgeTopicFromMqtt(const char* mqttPrefix,
+                                         const char* topicPrefix) {
+  if (!mqttPrefix || !topicPrefix) return false;
+
+  // The prefix is subscribed with a trailing # wildcard
+  size_t prefixLength = strlen(mqttPrefix);
+  if (prefixLength >= sizeof(_inboundRoutes[0].filter)) return false;
+  if (prefixLength > 0 && mqttPrefix[prefixLength - 1] != '/') return false;
+  if (strlen(topicPrefix) >= sizeof(_inboundRoutes[0].prefix)) return false;
+
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    GatewayRoute& route = _inboundRoutes[i];
+    if (route.active) continue;
+
+    strcpy(route.filter, mqttPrefix);
+    strcpy(route.prefix, topicPrefix);
+    route.active = true;
+
+    // Subscribe now if connected, otherwise on the next connection
+    _subscribed = false;
+    return true;
+  }
+
+  Serial.println("[NetworkGateway] Maximum routes reached");
+  return false;
+}
+
+bool NetworkGateway::clearGatewayRoutes() {
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    GatewayRoute& outbound = _outboundRoutes[i];
+    if (outbound.active) {
+      _messaging.unsubscribeTopic(outbound.filter, &outbound);
+      outbound.active = false;
+    }
+
+    GatewayRoute& inbound = _inboundRoutes[i];
+    if (inbound.active) {
+      if (_started && _mqtt.connected()) {
+        char filter[sizeof(inbound.filter) + 1];
+        sprintf(filter, "%s#", inbound.filter);
+        _mqtt.unsubscribe(filter);
+      }
+      inbound.active = false;
+    }
+  }
+  return true;
+}
+
+int NetworkGateway::getGatewayBacklog() { return _backlogCount; }
+
+uint32_t NetworkGateway::getGatewayDropped() { return _dropped; }
+
+// Helper method to open the broker connection
+bool NetworkGateway::connectToBroker() {
+  if (WiFi.status() != WL_CONNECTED) return false;
+
+  bool connected = _username[0] != '\0'
+                       ? _mqtt.connect(_clientId, _username, _password)
+                       : _mqtt.connect(_clientId);
+  if (!connected) {
+    Serial.print("[NetworkGateway] MQTT connect failed, state ");
+    Serial.println(_mqtt.state());
+    return false;
+  }
+
+  Serial.print("[NetworkGateway] Connected to MQTT broker ");
+  Serial.println(_host);
+  return true;
+}
+
+// Helper method to subscribe the inbound routes on a new connection
+void NetworkGateway::subscribeInboundRoutes() {
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    GatewayRoute& route = _inboundRoutes[i];
+    if (!route.active) continue;
+
+    char filter[sizeof(route.filter) + 1];
+    sprintf(filter, "%s#", route.filter);
+    if (!_mqtt.subscribe(filter)) return;  // Retried on the next update
+  }
+  _subscribed = true;
+}
+
+// Publish queued messages, a batch at a time. A partial batch waits up to
+// MQTT_GATEWAY_FLUSH_INTERVAL so bursts go out together.
+void NetworkGateway::flushBacklog() {
+  portENTER_CRITICAL(&_backlogLock);
+  uint8_t count = _backlogCount;
+  uint32_t since = _backlogSince;
+  portEXIT_CRITICAL(&_backlogLock);
+
+  if (count == 0) return;
+  if (count < MQTT_GATEWAY_BATCH_SIZE &&
+      millis() - since < MQTT_GATEWAY_FLUSH_INTERVAL) {
+    return;
+  }
+
+  QueuedPublish publish;
+  for (int sent = 0; sent < MQTT_GATEWAY_BATCH_SIZE; sent++) {
+    portENTER_CRITICAL(&_backlogLock);
+    if (_backlogCount == 0) {
+      portEXIT_CRITICAL(&_backlogLock);
+      break;
+    }
+    memcpy(&publish, &_backlog[_backlogHead], sizeof(publish));
+    _backlogHead = (_backlogHead + 1) % MQTT_GATEWAY_BACKLOG;
+    _backlogCount--;
+    portEXIT_CRITICAL(&_backlogLock);
+
+    // A failed publish means the connection dropped. Put the message back
+    // at the head and stop until reconnected, unless newer messages have
+    // filled the backlog meanwhile and made it the one to drop.
+    if (!_mqtt.publish(publish.topic, publish.payload, publish.length)) {
+      portENTER_CRITICAL(&_backlogLock);
+      if (_backlogCount < MQTT_GATEWAY_BACKLOG) {
+        _backlogHead =
+            (_backlogHead + MQTT_GATEWAY_BACKLOG - 1) % MQTT_GATEWAY_BACKLOG;
+        memcpy(&_backlog[_backlogHead], &publish, sizeof(publish));
+        _backlogCount++;
+      } else {
+        _dropped++;
+      }
+      portEXIT_CRITICAL(&_backlogLock);
+      break;
+    }
+  }
+}
+
+// Copy a message into the backlog. Called from the ESP-NOW receive path, so
+// it never touches the broker connection.
+void NetworkGateway::enqueuePublish(const GatewayRoute& route,
+                                    const char* topic, const uint8_t* data,
+                                    size_t length) {
+  char mqttTopic[MQTT_GATEWAY_TOPIC_SIZE];
+  if (length > MQTT_GATEWAY_PAYLOAD_SIZE ||
+      snprintf(mqttTopic, sizeof(mqttTopic), "%s%s", route.prefix, topic) >=
+          (int)sizeof(mqttTopic)) {
+    portENTER_CRITICAL(&_backlogLock);
+    _dropped++;
+    portEXIT_CRITICAL(&_backlogLock);
+    return;
+  }
+
+  portENTER_CRITICAL(&_backlogLock);
+  if (_backlogCount == MQTT_GATEWAY_BACKLOG) {
+    // Drop the oldest, the newest value is the one worth keeping
+    _backlogHead = (_backlogHead + 1) % MQTT_GATEWAY_BACKLOG;
+    _backlogCount--;
+    _dropped++;
+  }
+  if (_backlogCount == 0) _backlogSince = millis();
+
+  QueuedPublish& publish =
+      _backlog[(_backlogHead + _backlogCount) % MQTT_GATEWAY_BACKLOG];
+  strcpy(publish.topic, mqttTopic);
+  memcpy(publish.payload, data, length);
+  publish.length = length;
+  _backlogCount++;
+  portEXIT_CRITICAL(&_backlogLock);
+}
+
+// Publish a message from the broker on ESP-NOW for each matching route
+void NetworkGateway::handleMqttMessage(const char* topic,
+                                       const uint8_t* payload,
+                                       unsigned int length) {
+  for (int i = 0; i < MAX_GATEWAY_ROUTES; i++) {
+    GatewayRoute& route = _inboundRoutes[i];
+    if (!route.active) continue;
+
+    size_t prefixLength = strlen(route.filter);
+    if (strncmp(topic, route.filter, prefixLength) != 0) continue;
+
+    char localTopic[32];
+    if (snprintf(localTopic, sizeof(localTopic), "%s%s", route.prefix,
+                 topic + prefixLength) >= (int)sizeof(localTopic)) {
+      Serial.print("[NetworkGateway] Topic too long: ");
+      Serial.println(topic);
+      continue;
+    }
+
+    // Our own outbound routes see the local delivery; keep it off the broker
+    _bridgingInbound = true;
+    _messaging.publishTopic(localTopic, payload, length);
+    _bridgingInbound = false;
+  }
+}
+
+void NetworkGateway::onBridgedTopic(void* context, const char* sender,
+                                    const char* topic, const uint8_t* data,
+                                    size_t length) {
+  GatewayRoute* route = (GatewayRoute*)context;
+  NetworkGateway* gateway = route->gateway;
+  if (!gateway->_started) return;
+  if (gateway->_bridgingInbound &&
+      strcmp(sender, gateway->_core._boardId) == 0) {
+    return;
+  }
+
+  gateway->enqueuePublish(*route, topic, data, length);
+}
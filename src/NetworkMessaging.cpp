@@ -5,15 +5,62 @@
 
 #include "NetworkMessaging.h"
 
+// Empty trie link
+#define TOPIC_TRIE_NONE 0xFFFF
+
+// Append a length-prefixed name to a binary header
+static uint8_t* writeName(uint8_t* p, const char* name) {
+  size_t length = strlen(name);
+  *p++ = length;
+  memcpy(p, name, length);
+  return p + length;
+}
+
+// Read a length-prefixed name, returning NULL if it is malformed
+static const uint8_t* readName(const uint8_t* p, const uint8_t* end,
+                               char* name) {
+  if (p >= end) return NULL;
+  size_t length = *p++;
+  if (length >= 32 || length > (size_t)(end - p)) return NULL;
+  memcpy(name, p, length);
+  name[length] = '\0';
+  return p + length;
+}
+
 // Constructor
 NetworkMessaging::NetworkMessaging(NetworkCore& core) : _core(core) {
-  _directMessageCallback = NULL;
+  memset(_directCallbacks, 0, sizeof(_directCallbacks));
   _topicSubscriptionCount = 0;
+  _topicCount = 0;
+  _lastTopicQuery = 0;
+  _topicLock = portMUX_INITIALIZER_UNLOCKED;
+  _topicUnicastThreshold = TOPIC_UNICAST_THRESHOLD;
+  _lastInterestAdvert = 0;
+  _interestAdvertDue = false;
+  _interestQuerySent = false;
+  _interestRoundStart = 0;
 
   // Initialize subscriptions
   for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
     _topicSubscriptions[i].active = false;
   }
+
+  // Initialize the topic table
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    _topics[i].used = false;
+  }
+
+  // Initialize peer interests
+  for (int i = 0; i < MAX_TOPIC_INTERESTS; i++) {
+    _topicInterests[i].active = false;
+  }
+
+  // Initialize the retained values
+  for (int i = 0; i < MAX_RETAINED_TOPICS; i++) {
+    _retained[i].used = false;
+  }
+
+  compileTopicTrie();
 }
 
 bool NetworkMessaging::begin() {
@@ -21,25 +68,133 @@ bool NetworkMessaging::begin() {
   return true;
 }
 
+void NetworkMessaging::update() {
+  if (!_core.isConnected()) return;
+
+  uint32_t currentTime = millis();
+
+  // Ask the other boards for their subscriptions once we are up, and tell
+  // them ours
+  if (!_interestQuerySent) {
+    StaticJsonDocument<16> doc;
+    doc["q"] = 1;
+    _interestQuerySent =
+        _core.broadcastMessage(MSG_TYPE_TOPIC_INTEREST, doc.as<JsonObject>());
+    portENTER_CRITICAL(&_topicLock);
+    _interestRoundStart = currentTime;
+    portEXIT_CRITICAL(&_topicLock);
+    _interestAdvertDue = true;
+  }
+
+  if (_interestAdvertDue ||
+      currentTime - _lastInterestAdvert >= TOPIC_INTEREST_REFRESH) {
+    advertiseTopicInterests();
+    _interestAdvertDue = false;
+    _lastInterestAdvert = currentTime;
+  }
+
+  // Forget interests that have not been refreshed
+  portENTER_CRITICAL(&_topicLock);
+  for (int i = 0; i < MAX_TOPIC_INTERESTS; i++) {
+    if (_topicInterests[i].active &&
+        currentTime - _topicInterests[i].lastSeen > TOPIC_INTEREST_TIMEOUT) {
+      _topicInterests[i].active = false;
+    }
+  }
+  portEXIT_CRITICAL(&_topicLock);
+
+  announcePendingTopics(currentTime);
+}
+
 // ==================== Topic-based Messaging ====================
 
-bool NetworkMessaging::publishTopic(const char* topic, const char* message) {
+bool NetworkMessaging::publishTopic(const char* topic, const char* message,
+                                    uint8_t flags) {
   if (!_core.isConnected()) return false;
   if (!topic || !message) return false;
 
-  // Prepare the message
-  StaticJsonDocument<256> doc;
-  doc["topic"] = topic;
-  doc["message"] = message;
+  // Longer names would be truncated when the topic is interned, and
+  // receivers would resolve its ID to the wrong name
+  if (strlen(topic) >= sizeof(_topics[0].name)) return false;
+
+  if ((flags & PUBLISH_RETAINED) &&
+      !retainTopic(topic, (const uint8_t*)message, strlen(message))) {
+    return false;
+  }
+
+  return publishTopicFrame(topic, message, NULL, 0, flags & MESSAGE_QOS1);
+}
+
+bool NetworkMessaging::publishTopic(const char* topic, const uint8_t* data,
+                                    size_t length, uint8_t flags) {
+  if (!_core.isConnected()) return false;
+  if (!topic || (!data && length > 0)) return false;
+
+  // Binary frames carry the name with a one-byte length
+  if (strlen(topic) >= sizeof(_topics[0].name)) return false;
+  if (length > MAX_ESP_NOW_DATA_SIZE) return false;
+
+  if ((flags & PUBLISH_RETAINED) && !retainTopic(topic, data, length)) {
+    return false;
+  }
+
+  return publishTopicFrame(topic, NULL, data, length, flags & MESSAGE_QOS1);
+}
 
-  // Broadcast the message
-  return _core.broadcastMessage(MSG_TYPE_MESSAGE, doc.as<JsonObject>());
+uint16_t NetworkMessaging::getTopicId(const char* topic) {
+  if (!topic) return 0;
+
+  portENTER_CRITICAL(&_topicLock);
+  TopicEntry* entry = internTopic(topic);
+  uint16_t topicId = entry != NULL ? entry->id : 0;
+  portEXIT_CRITICAL(&_topicLock);
+
+  return topicId;
+}
+
+bool NetworkMessaging::setTopicUnicastThreshold(uint8_t maxPeers) {
+  if (maxPeers > MAX_TOPIC_UNICAST_PEERS) return false;
+
+  _topicUnicastThreshold = maxPeers;
+  return true;
 }
 
 bool NetworkMessaging::subscribeTopic(const char* topic,
                                       MessageCallback callback) {
-  if (!_core.isConnected()) return false;
-  if (!topic || !callback) return false;
+  if (!callback) return false;
+  return addTopicSubscription(topic, (void (*)())callback, NULL,
+                              CALLBACK_PLAIN);
+}
+
+bool NetworkMessaging::subscribeTopic(const char* topic,
+                                      BinaryMessageCallback callback) {
+  if (!callback) return false;
+  return addTopicSubscription(topic, (void (*)())callback, NULL,
+                              CALLBACK_PLAIN | CALLBACK_BINARY);
+}
+
+bool NetworkMessaging::subscribeTopic(const char* topic,
+                                      MessageContextCallback callback,
+                                      void* context) {
+  if (!callback) return false;
+  return addTopicSubscription(topic, (void (*)())callback, context,
+                              CALLBACK_CONTEXT);
+}
+
+bool NetworkMessaging::subscribeTopic(const char* topic,
+                                      BinaryMessageContextCallback callback,
+                                      void* context) {
+  if (!callback) return false;
+  return addTopicSubscription(topic, (void (*)())callback, context,
+                              CALLBACK_CONTEXT | CALLBACK_BINARY);
+}
+
+bool NetworkMessaging::addTopicSubscription(const char* topic,
+                                            void (*function)(), void* context,
+                                            uint8_t kind) {
+  if (!topic) return false;
+  if (strlen(topic) >= sizeof(_topicSubscriptions[0].topic)) return false;
+  if (!isValidTopicFilter(topic)) return false;
 
   // Find a free subscription slot
   int slot = findFreeTopicSubscriptionSlot();
@@ -50,90 +205,1218 @@ bool NetworkMessaging::subscribeTopic(const char* topic,
           sizeof(_topicSubscriptions[slot].topic) - 1);
   _topicSubscriptions[slot].topic[sizeof(_topicSubscriptions[slot].topic) - 1] =
       '\0';
-  _topicSubscriptions[slot].callback = callback;
+  _topicSubscriptions[slot].callback.function = function;
+  _topicSubscriptions[slot].callback.context = context;
+  _topicSubscriptions[slot].callback.kind = kind;
+
+  // Add it to the trie, recompiling to reclaim nodes left behind by earlier
+  // unsubscriptions if the trie is full
+  portENTER_CRITICAL(&_topicLock);
   _topicSubscriptions[slot].active = true;
+  bool added = insertTopicSubscription(slot) || compileTopicTrie();
+  if (!added) {
+    _topicSubscriptions[slot].active = false;
+    compileTopicTrie();
+  }
+  portEXIT_CRITICAL(&_topicLock);
+
+  if (!added) return false;
 
   if (_topicSubscriptionCount < MAX_TOPIC_SUBSCRIPTIONS)
     _topicSubscriptionCount++;
 
+  // Let publishers know straight away rather than at the next refresh, and
+  // deliver our own retained values, which never come back by radio. Before
+  // ESP-NOW is up, update() advertises every subscription once it is.
+  if (_core.isConnected()) sendTopicInterest(topic, false);
+  sendRetainedValues(_core._boardId, topic);
+
   return true;
 }
 
 bool NetworkMessaging::unsubscribeTopic(const char* topic) {
-  if (!_core.isConnected()) return false;
   if (!topic) return false;
 
   // Find and remove the matching subscriptions
   int index = -1;
   if (findMatchingTopicSubscription(topic, index)) {
-    _topicSubscriptions[index].active = false;
+    removeTopicSubscription(index);
+
+    // Withdraw the interest unless another subscription uses the same filter
+    if (_core.isConnected() && !findMatchingTopicSubscription(topic, index)) {
+      sendTopicInterest(topic, true);
+    }
     return true;
   }
 
   return false;  // Subscription not found
 }
 
+bool NetworkMessaging::unsubscribeTopic(const char* topic, void* context) {
+  if (!topic) return false;
+
+  bool removed = false;
+  for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    TopicSubscription& subscription = _topicSubscriptions[i];
+    if (subscription.active && subscription.callback.context == context &&
+        strcmp(subscription.topic, topic) == 0) {
+      removeTopicSubscription(i);
+      removed = true;
+    }
+  }
+
+  // Withdraw the interest unless another subscription uses the same filter
+  int index = -1;
+  if (removed && _core.isConnected() &&
+      !findMatchingTopicSubscription(topic, index)) {
+    sendTopicInterest(topic, true);
+  }
+  return removed;
+}
+
+// Deactivate a subscription and unlink it from its trie node; the node itself
+// is reclaimed by the next recompilation
+void NetworkMessaging::removeTopicSubscription(int index) {
+  portENTER_CRITICAL(&_topicLock);
+  _topicSubscriptions[index].active = false;
+
+  uint16_t* link =
+      &_trieNodes[_topicSubscriptions[index].node].firstSubscription;
+  while (*link != TOPIC_TRIE_NONE && *link != index) {
+    link = &_topicSubscriptions[*link].next;
+  }
+  if (*link == index) *link = _topicSubscriptions[index].next;
+  portEXIT_CRITICAL(&_topicLock);
+}
+
 // ==================== Direct Messaging ====================
 
 bool NetworkMessaging::sendMessageToBoardId(const char* targetBoardId,
-                                            const char* message) {
+                                            const char* message,
+                                            uint8_t flags) {
   if (!_core.isConnected()) return false;
   if (!targetBoardId || !message) return false;
 
+  // A board that decompresses frames gets the text in a binary frame, which
+  // can be compressed. Stored messages stay JSON in flash.
+  if (!(flags & MESSAGE_STORE_AND_FORWARD) &&
+      _core.shouldCompress(targetBoardId, MSG_TYPE_DIRECT_MESSAGE)) {
+    return sendMessageToBoardId(targetBoardId, (const uint8_t*)message,
+                                strlen(message), flags);
+  }
+
   // Prepare the message
   StaticJsonDocument<256> doc;
   doc["message"] = message;
 
-  // Send the message
+  // Stored messages wait in flash until the board acknowledges them
+  if ((flags & MESSAGE_STORE_AND_FORWARD) &&
+      !_core.isLocalBoard(targetBoardId)) {
+    return _core.storeMessage(targetBoardId, MSG_TYPE_DIRECT_MESSAGE,
+                              doc.as<JsonObject>());
+  }
+
+  // Send the message, through the outbox for QoS 1 unless it stays local
+  if ((flags & MESSAGE_QOS1) && !_core.isLocalBoard(targetBoardId)) {
+    char targets[1][32];
+    if (!copyTarget(targetBoardId, targets[0])) return false;
+    return _core.sendReliableMessage(targets, 1, false,
+                                     MSG_TYPE_DIRECT_MESSAGE,
+                                     doc.as<JsonObject>());
+  }
   return _core.sendMessage(targetBoardId, MSG_TYPE_DIRECT_MESSAGE,
                            doc.as<JsonObject>());
 }
 
+bool NetworkMessaging::sendMessageToBoardId(const char* targetBoardId,
+                                            const uint8_t* data, size_t length,
+                                            uint8_t flags) {
+  if (!_core.isConnected()) return false;
+  if (!targetBoardId || (!data && length > 0)) return false;
+
+  if ((flags & MESSAGE_STORE_AND_FORWARD) &&
+      !_core.isLocalBoard(targetBoardId)) {
+    return _core.storeBinaryMessage(targetBoardId, MSG_TYPE_DIRECT_MESSAGE,
+                                    NULL, 0, data, length);
+  }
+  if ((flags & MESSAGE_QOS1) && !_core.isLocalBoard(targetBoardId)) {
+    char targets[1][32];
+    if (!copyTarget(targetBoardId, targets[0])) return false;
+    return _core.sendReliableBinaryMessage(targets, 1, false,
+                                           MSG_TYPE_DIRECT_MESSAGE, NULL, 0,
+                                           data, length);
+  }
+  return _core.sendBinaryMessage(targetBoardId, MSG_TYPE_DIRECT_MESSAGE, NULL,
+                                 0, data, length);
+}
+
 bool NetworkMessaging::receiveMessagesFromBoards(MessageCallback callback) {
-  _directMessageCallback = callback;
-  return true;
+  if (callback == NULL) return stopReceivingMessages();
+  return NetworkCore::addCallback(_directCallbacks,
+                                  MAX_DIRECT_MESSAGE_CALLBACKS,
+                                  (void (*)())callback, NULL, CALLBACK_PLAIN);
+}
+
+bool NetworkMessaging::receiveMessagesFromBoards(
+    BinaryMessageCallback callback) {
+  if (callback == NULL) return stopReceivingMessages();
+  return NetworkCore::addCallback(
+      _directCallbacks, MAX_DIRECT_MESSAGE_CALLBACKS, (void (*)())callback,
+      NULL, CALLBACK_PLAIN | CALLBACK_BINARY);
+}
+
+bool NetworkMessaging::receiveMessagesFromBoards(
+    MessageContextCallback callback, void* context) {
+  return NetworkCore::addCallback(_directCallbacks,
+                                  MAX_DIRECT_MESSAGE_CALLBACKS,
+                                  (void (*)())callback, context,
+                                  CALLBACK_CONTEXT);
+}
+
+bool NetworkMessaging::receiveMessagesFromBoards(
+    BinaryMessageContextCallback callback, void* context) {
+  return NetworkCore::addCallback(
+      _directCallbacks, MAX_DIRECT_MESSAGE_CALLBACKS, (void (*)())callback,
+      context, CALLBACK_CONTEXT | CALLBACK_BINARY);
 }
 
 bool NetworkMessaging::stopReceivingMessages() {
-  _directMessageCallback = NULL;
+  memset(_directCallbacks, 0, sizeof(_directCallbacks));
   return true;
 }
 
+bool NetworkMessaging::removeMessageCallback(MessageCallback callback) {
+  return NetworkCore::removeCallback(_directCallbacks,
+                                     MAX_DIRECT_MESSAGE_CALLBACKS,
+                                     (void (*)())callback);
+}
+
+bool NetworkMessaging::removeMessageCallback(BinaryMessageCallback callback) {
+  return NetworkCore::removeCallback(_directCallbacks,
+                                     MAX_DIRECT_MESSAGE_CALLBACKS,
+                                     (void (*)())callback);
+}
+
+bool NetworkMessaging::stopReceivingMessages(void* context) {
+  return NetworkCore::removeCallbacks(_directCallbacks,
+                                      MAX_DIRECT_MESSAGE_CALLBACKS, context);
+}
+
 // ==================== Message Handlers ====================
 
 bool NetworkMessaging::handleTopicMessage(const char* sender, const char* topic,
                                           const char* message) {
   if (!sender || !topic || !message) return false;
 
-  bool handled = false;
+  return deliverTopicMessage(sender, topic, message, NULL, 0);
+}
+
+bool NetworkMessaging::handleTopicIdMessage(const char* sender,
+                                            uint16_t topicId,
+                                            const char* topic,
+                                            const char* message) {
+  if (!sender || !message || topicId == 0) return false;
+
+  char name[32];
+  const char* resolved = resolveTopicId(sender, topicId, topic, name);
+  if (resolved == NULL) return false;
+
+  return deliverTopicMessage(sender, resolved, message, NULL, 0);
+}
 
-  // Find and call matching topic subscriptions
+bool NetworkMessaging::handleBinaryTopicMessage(const char* sender,
+                                                const uint8_t* body,
+                                                size_t length) {
+  // Body layout: topic ID (little-endian), name length, name, payload
+  if (!sender || !body || length < 3) return false;
+
+  uint16_t topicId = body[0] | (body[1] << 8);
+  size_t nameLength = body[2];
+
+  char topic[32];
+  if (nameLength >= sizeof(topic) || 3 + nameLength > length) return false;
+  memcpy(topic, body + 3, nameLength);
+  topic[nameLength] = '\0';
+
+  const uint8_t* data = body + 3 + nameLength;
+  size_t dataLength = length - 3 - nameLength;
+
+  const char* resolved = topic;
+  char name[32];
+  if (topicId != 0) {
+    resolved =
+        resolveTopicId(sender, topicId, nameLength > 0 ? topic : NULL, name);
+  } else if (nameLength == 0) {
+    return false;
+  }
+  if (resolved == NULL) return false;
+
+  return deliverTopicMessage(sender, resolved, NULL, data, dataLength);
+}
+
+bool NetworkMessaging::handleTopicAnnounce(const char* sender,
+                                           const JsonObject& doc) {
+  uint16_t topicId = doc["t"];
+  const char* topic = doc["topic"];
+  if (!sender || topicId == 0) return false;
+
+  bool collided = false;
+
+  portENTER_CRITICAL(&_topicLock);
+  TopicEntry* entry = NULL;
+  if (topic == NULL) {
+    // A query, answered by whoever publishes under the ID. Queries from
+    // several boards are answered with one announcement, and the next
+    // frames carry the name as well.
+    entry = findTopicById(topicId);
+    if (entry != NULL && entry->published) {
+      entry->announcePending = true;
+      entry->nameSends = TOPIC_NAME_REPEATS;
+    }
+  } else {
+    // Announcements carry the name that holds the ID, so a collision
+    // settles once every board has seen the winning name
+    entry = learnTopic(topicId, topic, collided);
+    if (collided && entry != NULL && strcmp(entry->name, topic) != 0) {
+      entry->announcePending = true;
+    }
+  }
+  portEXIT_CRITICAL(&_topicLock);
+
+  return true;
+}
+
+bool NetworkMessaging::handleTopicInterest(const char* sender,
+                                           const JsonObject& doc) {
+  if (!sender) return false;
+
+  // A board that just started asks everyone to advertise. It knows none of
+  // our topic IDs yet, so send the names again.
+  if (doc["q"] | false) {
+    _interestAdvertDue = true;
+    portENTER_CRITICAL(&_topicLock);
+    resendTopicNames(NULL);
+    portEXIT_CRITICAL(&_topicLock);
+    return true;
+  }
+
+  bool remove = doc["rm"] | false;
+  bool retained = doc["r"] | false;
+  JsonArray filters = doc["f"];
+  if (filters.isNull()) return false;
+
+  for (JsonVariant filter : filters) {
+    const char* text = filter.as<const char*>();
+    if (!text) continue;
+
+    recordTopicInterest(sender, text, remove);
+    if (retained && !remove) sendRetainedValues(sender, text);
+  }
+  return true;
+}
+
+void NetworkMessaging::addSubscriptionsToDigest(uint8_t* digest, size_t size) {
   for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    if (_topicSubscriptions[i].active) {
+      NetworkCore::addToDigest(digest, size, _topicSubscriptions[i].topic);
+    }
+  }
+}
+
+bool NetworkMessaging::hasSubscriptions() {
+  if (hasTopicSubscriptions()) return true;
+  for (int i = 0; i < MAX_DIRECT_MESSAGE_CALLBACKS; i++) {
+    if (_directCallbacks[i].kind != CALLBACK_NONE) return true;
+  }
+  return false;
+}
+
+bool NetworkMessaging::handleTopicRetained(const char* sender,
+                                           const uint8_t* body,
+                                           size_t length) {
+  if (!sender || !body) return false;
+
+  char requester[32];
+  char filter[32];
+  char topic[32];
+  const uint8_t* end = body + length;
+  const uint8_t* p = readName(body, end, requester);
+  if (p != NULL) p = readName(p, end, filter);
+  if (p != NULL) p = readName(p, end, topic);
+  if (p == NULL) return false;
+
+  // Values for boards we have no address for are broadcast
+  if (!_core.isLocalBoard(requester)) return false;
+
+  // Only the subscriptions that asked get the value, so older subscribers
+  // to the same topic do not see it twice
+  uint16_t matches[MAX_TOPIC_DELIVERIES];
+  int matchCount = 0;
+  portENTER_CRITICAL(&_topicLock);
+  for (int i = 0;
+       i < MAX_TOPIC_SUBSCRIPTIONS && matchCount < MAX_TOPIC_DELIVERIES; i++) {
     if (_topicSubscriptions[i].active &&
-        strcmp(_topicSubscriptions[i].topic, topic) == 0) {
-      _topicSubscriptions[i].callback(sender, topic, message);
-      handled = true;
+        strcmp(_topicSubscriptions[i].topic, filter) == 0) {
+      matches[matchCount++] = i;
     }
   }
+  portEXIT_CRITICAL(&_topicLock);
 
-  return handled;
+  return deliverToSubscriptions(matches, matchCount, sender, topic, NULL, p,
+                                end - p);
 }
 
 bool NetworkMessaging::handleDirectMessage(const char* sender,
                                            const char* message) {
   if (!sender || !message) return false;
 
-  // Call the direct message callback if registered
-  if (_directMessageCallback) {
-    _directMessageCallback(sender, NULL, message);
-    return true;
+  // Call the direct message callbacks if registered
+  size_t length = strlen(message);
+  bool handled = false;
+  for (int i = 0; i < MAX_DIRECT_MESSAGE_CALLBACKS; i++) {
+    if (_directCallbacks[i].kind == CALLBACK_NONE) continue;
+    callMessageCallback(_directCallbacks[i], sender, NULL, message,
+                        (const uint8_t*)message, length, NULL);
+    handled = true;
+  }
+
+  return handled;
+}
+
+bool NetworkMessaging::handleBinaryDirectMessage(const char* sender,
+                                                 const uint8_t* data,
+                                                 size_t length) {
+  if (!sender || !data) return false;
+
+  // Text callbacks need a terminated copy and stop at the first NUL byte
+  const char* text = NULL;
+  char copy[MAX_ESP_NOW_DATA_SIZE + 1];
+  bool handled = false;
+  for (int i = 0; i < MAX_DIRECT_MESSAGE_CALLBACKS; i++) {
+    if (_directCallbacks[i].kind == CALLBACK_NONE) continue;
+    callMessageCallback(_directCallbacks[i], sender, NULL, text, data, length,
+                        copy);
+    handled = true;
+  }
+
+  return handled;
+}
+
+// ==================== Topic Delivery ====================
+
+bool NetworkMessaging::publishTopicFrame(const char* topic, const char* text,
+                                         const uint8_t* data, size_t length,
+                                         bool reliable) {
+  uint16_t topicId = 0;
+  bool announce = false;
+
+  portENTER_CRITICAL(&_topicLock);
+  TopicEntry* entry = internTopic(topic);
+  if (entry != NULL) {
+    topicId = entry->id;
+    announce = entry->nameSends > 0;
+    entry->published = true;
+  }
+  portEXIT_CRITICAL(&_topicLock);
+
+  // Frames carry the topic ID, plus the name for the first few frames after
+  // a board may have missed it, so receivers can learn it. With a full topic
+  // table the name is sent on its own.
+  const char* name = topicId == 0 || announce ? topic : NULL;
+
+  // Unicast to the interested boards when there are few enough of them and
+  // we know all their addresses, otherwise broadcast. QoS 1 messages are
+  // tracked until every interested board acknowledges them.
+  char targets[MAX_TOPIC_TARGETS][32];
+  int maxTargets = reliable ? MAX_OUTBOX_RECIPIENTS : _topicUnicastThreshold;
+  int targetCount = -1;
+  if (maxTargets > 0) {
+    portENTER_CRITICAL(&_topicLock);
+    targetCount = findInterestedBoards(topic, targets, maxTargets);
+    portEXIT_CRITICAL(&_topicLock);
+  }
+
+  // The outbox cannot track every subscriber, so refuse rather than send
+  // without the acknowledgements the caller asked for
+  if (reliable && targetCount < 0) {
+    Serial.println("[NetworkMessaging] Error: Too many subscribers for QoS 1");
+    return false;
+  }
+
+  // Local subscribers never see our own broadcast, so deliver to them directly
+  deliverTopicMessage(_core._boardId, topic, text, data, length);
+
+  // Boards we have not heard from yet may subscribe too, so broadcast until
+  // the interest table is complete
+  bool interestsKnown = areInterestsKnown();
+  if (targetCount == 0) {
+    if (interestsKnown) return true;  // Nobody else is interested
+    reliable = false;                 // Nobody to track acknowledgements of
+  }
+
+  bool broadcast = !interestsKnown || targetCount < 0 ||
+                   targetCount > _topicUnicastThreshold;
+  for (int i = 0; i < targetCount && !broadcast; i++) {
+    broadcast = !_core.isReachable(targets[i]);
+  }
+
+  bool sent = sendTopicFrame(targets, targetCount, broadcast, reliable,
+                             topicId, name, text, data, length);
+
+  if (sent && announce) {
+    portENTER_CRITICAL(&_topicLock);
+    entry = findTopicById(topicId);
+    if (entry != NULL && entry->nameSends > 0) entry->nameSends--;
+    portEXIT_CRITICAL(&_topicLock);
+  }
+
+  return sent;
+}
+
+// Send one topic frame to the given boards, or broadcast it
+bool NetworkMessaging::sendTopicFrame(const char (*targets)[32],
+                                      int targetCount, bool broadcast,
+                                      bool reliable, uint16_t topicId,
+                                      const char* name, const char* text,
+                                      const uint8_t* data, size_t length) {
+  // Boards that decompress frames also read binary ones, so text for them
+  // goes out as a binary frame, which can be compressed
+  if (text != NULL) {
+    bool compressed = broadcast
+                          ? _core.shouldCompress(NULL, MSG_TYPE_MESSAGE)
+                          : targetCount > 0;
+    for (int i = 0; i < targetCount && !broadcast && compressed; i++) {
+      compressed = _core.shouldCompress(targets[i], MSG_TYPE_MESSAGE);
+    }
+    if (compressed) {
+      data = (const uint8_t*)text;
+      length = strlen(text);
+      text = NULL;
+    }
+  }
+
+  if (text != NULL) {
+    StaticJsonDocument<256> doc;
+    if (topicId != 0) doc["t"] = topicId;
+    if (name != NULL) doc["topic"] = name;
+    doc["message"] = text;
+
+    if (reliable) {
+      return _core.sendReliableMessage(targets, targetCount, broadcast,
+                                       MSG_TYPE_MESSAGE, doc.as<JsonObject>());
+    }
+    if (broadcast) {
+      return _core.broadcastMessage(MSG_TYPE_MESSAGE, doc.as<JsonObject>());
+    }
+
+    bool sent = true;
+    for (int i = 0; i < targetCount; i++) {
+      sent &= _core.sendMessage(targets[i], MSG_TYPE_MESSAGE,
+                                doc.as<JsonObject>());
+    }
+    return sent;
   }
 
+  // Binary frames put the ID and optional name ahead of the raw payload
+  uint8_t header[3 + sizeof(_topics[0].name)];
+  size_t nameLength = name != NULL ? strlen(name) : 0;
+  header[0] = topicId & 0xFF;
+  header[1] = topicId >> 8;
+  header[2] = nameLength;
+  memcpy(header + 3, name, nameLength);
+  size_t headerLength = 3 + nameLength;
+
+  if (reliable) {
+    return _core.sendReliableBinaryMessage(targets, targetCount, broadcast,
+                                           MSG_TYPE_MESSAGE, header,
+                                           headerLength, data, length);
+  }
+  if (broadcast) {
+    return _core.broadcastBinaryMessage(MSG_TYPE_MESSAGE, header, headerLength,
+                                        data, length);
+  }
+
+  bool sent = true;
+  for (int i = 0; i < targetCount; i++) {
+    sent &= _core.sendBinaryMessage(targets[i], MSG_TYPE_MESSAGE, header,
+                                    headerLength, data, length);
+  }
+  return sent;
+}
+
+// Find the name a frame carrying a topic ID is delivered under, or NULL if
+// it cannot be delivered. The name is copied to the given buffer when it
+// comes from our table.
+const char* NetworkMessaging::resolveTopicId(const char* sender,
+                                             uint16_t topicId,
+                                             const char* topic, char* name) {
+  bool collided = false;
+
+  portENTER_CRITICAL(&_topicLock);
+  TopicEntry* entry = topic != NULL ? learnTopic(topicId, topic, collided)
+                                    : findTopicById(topicId);
+  bool known = entry != NULL;
+  if (known) memcpy(name, entry->name, sizeof(entry->name));
+
+  // Our mapping kept the ID, so tell the publisher to move; the message
+  // itself can still be delivered by name
+  bool ours = topic != NULL && known && strcmp(name, topic) != 0;
+  if (collided && ours) entry->announcePending = true;
+  portEXIT_CRITICAL(&_topicLock);
+
+  if (topic != NULL) {
+    if (!known || ours) return topic;
+  } else if (!known) {
+    // Ask the publisher for the name; this message cannot be delivered. A
+    // board with no subscriptions would drop it anyway, so it stays quiet.
+    uint32_t now = millis();
+    if (hasTopicSubscriptions() &&
+        now - _lastTopicQuery >= TOPIC_ANNOUNCE_INTERVAL) {
+      _lastTopicQuery = now;
+      StaticJsonDocument<32> doc;
+      doc["t"] = topicId;
+      _core.sendMessage(sender, MSG_TYPE_TOPIC_ANNOUNCE,
+                        doc.as<JsonObject>());
+    }
+    return NULL;
+  }
+
+  return name;
+}
+
+// Call the subscriptions matching a topic
+bool NetworkMessaging::deliverTopicMessage(const char* sender,
+                                           const char* topic,
+                                           const char* text,
+                                           const uint8_t* data,
+                                           size_t length) {
+  // Match against the trie, then call the callbacks outside the lock
+  uint16_t matches[MAX_TOPIC_DELIVERIES];
+  portENTER_CRITICAL(&_topicLock);
+  int matchCount = matchTopicSubscriptions(topic, matches);
+  portEXIT_CRITICAL(&_topicLock);
+
+  return deliverToSubscriptions(matches, matchCount, sender, topic, text, data,
+                                length);
+}
+
+// Text payloads reach binary callbacks as they are; binary payloads reach
+// text callbacks through a terminated copy, made once per message
+bool NetworkMessaging::deliverToSubscriptions(const uint16_t* matches,
+                                              int matchCount,
+                                              const char* sender,
+                                              const char* topic,
+                                              const char* text,
+                                              const uint8_t* data,
+                                              size_t length) {
+  if (text != NULL) {
+    data = (const uint8_t*)text;
+    length = strlen(text);
+  }
+
+  char copy[MAX_ESP_NOW_DATA_SIZE + 1];
+  bool handled = false;
+  for (int i = 0; i < matchCount; i++) {
+    TopicSubscription& subscription = _topicSubscriptions[matches[i]];
+    if (!subscription.active) continue;
+
+    callMessageCallback(subscription.callback, sender, topic, text, data,
+                        length, copy);
+    handled = true;
+  }
+
+  return handled;
+}
+
+// Call one message callback. A NULL text is replaced by a terminated copy of
+// the data, which later callbacks for the same message reuse.
+void NetworkMessaging::callMessageCallback(const CallbackSlot& callback,
+                                           const char* sender,
+                                           const char* topic,
+                                           const char*& text,
+                                           const uint8_t* data, size_t length,
+                                           char* copy) {
+  if (!(callback.kind & CALLBACK_BINARY) && text == NULL) {
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    text = copy;
+  }
+
+  switch (callback.kind) {
+    case CALLBACK_PLAIN:
+      ((MessageCallback)callback.function)(sender, topic, text);
+      break;
+    case CALLBACK_CONTEXT:
+      ((MessageContextCallback)callback.function)(callback.context, sender,
+                                                  topic, text);
+      break;
+    case CALLBACK_PLAIN | CALLBACK_BINARY:
+      ((BinaryMessageCallback)callback.function)(sender, topic, data, length);
+      break;
+    case CALLBACK_CONTEXT | CALLBACK_BINARY:
+      ((BinaryMessageContextCallback)callback.function)(
+          callback.context, sender, topic, data, length);
+      break;
+  }
+}
+
+// ==================== Topic Interests ====================
+
+int NetworkMessaging::findInterestedBoards(const char* topic,
+                                           char (*boards)[32], int maxBoards) {
+  int count = 0;
+
+  for (int i = 0; i < MAX_TOPIC_INTERESTS; i++) {
+    TopicInterest& interest = _topicInterests[i];
+    if (!interest.active || !topicMatchesFilter(interest.filter, topic)) {
+      continue;
+    }
+
+    bool known = false;
+    for (int b = 0; b < count && !known; b++) {
+      known = strcmp(boards[b], interest.board) == 0;
+    }
+    if (known) continue;
+
+    if (count == maxBoards) return -1;  // Too many, broadcast instead
+    memcpy(boards[count++], interest.board, sizeof(interest.board));
+  }
+
+  return count;
+}
+
+void NetworkMessaging::recordTopicInterest(const char* board,
+                                           const char* filter, bool remove) {
+  uint32_t currentTime = millis();
+
+  portENTER_CRITICAL(&_topicLock);
+  TopicInterest* slot = NULL;
+  for (int i = 0; i < MAX_TOPIC_INTERESTS; i++) {
+    TopicInterest& interest = _topicInterests[i];
+    if (interest.active && strcmp(interest.board, board) == 0 &&
+        strcmp(interest.filter, filter) == 0) {
+      slot = &interest;
+      break;
+    }
+  }
+
+  if (remove) {
+    if (slot != NULL) slot->active = false;
+  } else {
+    // Reuse a free slot, or the least recently refreshed one
+    for (int i = 0; slot == NULL && i < MAX_TOPIC_INTERESTS; i++) {
+      if (!_topicInterests[i].active) slot = &_topicInterests[i];
+    }
+    if (slot == NULL) {
+      slot = &_topicInterests[0];
+      for (int i = 1; i < MAX_TOPIC_INTERESTS; i++) {
+        if (currentTime - _topicInterests[i].lastSeen >
+            currentTime - slot->lastSeen) {
+          slot = &_topicInterests[i];
+        }
+      }
+      // The evicted board may still subscribe, so stop trusting the table
+      // until it has had a full round to advertise again
+      _interestRoundStart = currentTime;
+    }
+
+    // A new subscriber has not seen the names of the topics it matches
+    bool isNew = !slot->active || strcmp(slot->board, board) != 0 ||
+                 strcmp(slot->filter, filter) != 0;
+    if (isNew) resendTopicNames(filter);
+
+    strncpy(slot->board, board, sizeof(slot->board) - 1);
+    slot->board[sizeof(slot->board) - 1] = '\0';
+    strncpy(slot->filter, filter, sizeof(slot->filter) - 1);
+    slot->filter[sizeof(slot->filter) - 1] = '\0';
+    slot->lastSeen = currentTime;
+    slot->active = true;
+  }
+  portEXIT_CRITICAL(&_topicLock);
+}
+
+// The interest table is complete once every board has had a full refresh
+// period to advertise since we asked at startup, and since the last time an
+// interest was evicted for lack of room
+bool NetworkMessaging::areInterestsKnown() {
+  if (!_interestQuerySent) return false;
+  portENTER_CRITICAL(&_topicLock);
+  uint32_t roundStart = _interestRoundStart;
+  portEXIT_CRITICAL(&_topicLock);
+  return millis() - roundStart >= TOPIC_INTEREST_REFRESH;
+}
+
+bool NetworkMessaging::advertiseTopicInterests() {
+  StaticJsonDocument<256> doc;
+  JsonArray filters = doc.createNestedArray("f");
+  size_t payload = 0;
+  bool sent = true;
+
+  // Pack as many filters per frame as fit
+  for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    if (!_topicSubscriptions[i].active) continue;
+
+    size_t length = strlen(_topicSubscriptions[i].topic) + 3;
+    if (payload + length > TOPIC_INTEREST_PAYLOAD) {
+      sent &= _core.broadcastMessage(MSG_TYPE_TOPIC_INTEREST,
+                                     doc.as<JsonObject>());
+      doc.clear();
+      filters = doc.createNestedArray("f");
+      payload = 0;
+    }
+
+    filters.add(_topicSubscriptions[i].topic);
+    payload += length;
+  }
+
+  if (payload > 0) {
+    sent &= _core.broadcastMessage(MSG_TYPE_TOPIC_INTEREST,
+                                   doc.as<JsonObject>());
+  }
+  return sent;
+}
+
+bool NetworkMessaging::sendTopicInterest(const char* filter, bool remove) {
+  StaticJsonDocument<64> doc;
+  JsonArray filters = doc.createNestedArray("f");
+  filters.add(filter);
+
+  // A new subscription also asks for the retained values it matches
+  if (remove) {
+    doc["rm"] = 1;
+  } else {
+    doc["r"] = 1;
+  }
+
+  return _core.broadcastMessage(MSG_TYPE_TOPIC_INTEREST, doc.as<JsonObject>());
+}
+
+// ==================== Retained Values ====================
+
+// Keep a topic's last value, or forget it when the value is empty
+bool NetworkMessaging::retainTopic(const char* topic, const uint8_t* data,
+                                   size_t length) {
+  if (strlen(topic) >= sizeof(_retained[0].topic)) return false;
+  if (length > MAX_RETAINED_SIZE) return false;
+
+  uint32_t currentTime = millis();
+
+  portENTER_CRITICAL(&_topicLock);
+  RetainedValue* slot = NULL;
+  for (int i = 0; i < MAX_RETAINED_TOPICS && slot == NULL; i++) {
+    if (_retained[i].used && strcmp(_retained[i].topic, topic) == 0) {
+      slot = &_retained[i];
+    }
+  }
+
+  if (length == 0) {
+    if (slot != NULL) slot->used = false;
+  } else {
+    // Reuse a free slot, or the least recently used one
+    for (int i = 0; slot == NULL && i < MAX_RETAINED_TOPICS; i++) {
+      if (!_retained[i].used) slot = &_retained[i];
+    }
+    if (slot == NULL) {
+      slot = &_retained[0];
+      for (int i = 1; i < MAX_RETAINED_TOPICS; i++) {
+        if (currentTime - _retained[i].lastUsed >
+            currentTime - slot->lastUsed) {
+          slot = &_retained[i];
+        }
+      }
+    }
+
+    strcpy(slot->topic, topic);
+    memcpy(slot->data, data, length);
+    slot->length = length;
+    slot->lastUsed = currentTime;
+    slot->used = true;
+  }
+  portEXIT_CRITICAL(&_topicLock);
+
+  return true;
+}
+
+// Send the retained values matching a new subscription to the board that
+// made it
+void NetworkMessaging::sendRetainedValues(const char* requester,
+                                          const char* filter) {
+  if (strlen(requester) >= 32 || strlen(filter) >= 32) return;
+
+  // Fall back to broadcast for boards not discovered yet; the requester in
+  // the header keeps other boards from delivering the value
+  bool unicast = _core.isLocalBoard(requester) || _core.isReachable(requester);
+  bool wildcard = filter[0] == '+' || filter[0] == '#';
+
+  for (int i = 0; i < MAX_RETAINED_TOPICS; i++) {
+    RetainedValue value;
+    portENTER_CRITICAL(&_topicLock);
+    bool match = _retained[i].used &&
+                 !(wildcard && _retained[i].topic[0] == '$') &&
+                 topicMatchesFilter(filter, _retained[i].topic);
+    if (match) {
+      _retained[i].lastUsed = millis();
+      value = _retained[i];
+    }
+    portEXIT_CRITICAL(&_topicLock);
+    if (!match) continue;
+
+    uint8_t header[3 * 32];
+    uint8_t* p = writeName(header, requester);
+    p = writeName(p, filter);
+    p = writeName(p, value.topic);
+
+    if (unicast) {
+      _core.sendBinaryMessage(requester, MSG_TYPE_TOPIC_RETAINED, header,
+                              p - header, value.data, value.length);
+    } else {
+      _core.broadcastBinaryMessage(MSG_TYPE_TOPIC_RETAINED, header,
+                                   p - header, value.data, value.length);
+    }
+  }
+}
+
+// ==================== Topic Interning ====================
+
+NetworkMessaging::TopicEntry* NetworkMessaging::findTopicById(uint16_t id) {
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    TopicEntry& entry = _topics[(id + i) & (MAX_TOPIC_IDS - 1)];
+    if (!entry.used) return NULL;  // End of the probe chain
+    if (entry.id == id) return &entry;
+  }
+  return NULL;
+}
+
+NetworkMessaging::TopicEntry* NetworkMessaging::insertTopic(uint16_t id,
+                                                            const char* name) {
+  if (_topicCount >= MAX_TOPIC_IDS) return NULL;
+
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    TopicEntry& entry = _topics[(id + i) & (MAX_TOPIC_IDS - 1)];
+    if (entry.used) continue;
+
+    strncpy(entry.name, name, sizeof(entry.name) - 1);
+    entry.name[sizeof(entry.name) - 1] = '\0';
+    entry.id = id;
+    entry.published = false;
+    entry.announcePending = false;
+    entry.nameSends = TOPIC_NAME_REPEATS;
+    entry.lastAnnounce = 0;
+    entry.used = true;
+    _topicCount++;
+    return &entry;
+  }
+  return NULL;
+}
+
+NetworkMessaging::TopicEntry* NetworkMessaging::internTopic(const char* name) {
+  // Start from the hash of the name and probe past IDs taken by other names,
+  // so every board interns the same name to the same ID
+  uint16_t id = NetworkCore::hash16(name);
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    if (id == 0) id = 1;  // 0 means no ID
+
+    TopicEntry* entry = findTopicById(id);
+    if (entry == NULL) return insertTopic(id, name);
+    if (strncmp(entry->name, name, sizeof(entry->name) - 1) == 0) {
+      return entry;
+    }
+    id++;
+  }
+  return NULL;
+}
+
+NetworkMessaging::TopicEntry* NetworkMessaging::learnTopic(uint16_t id,
+                                                           const char* name,
+                                                           bool& collided) {
+  collided = false;
+
+  TopicEntry* entry = findTopicById(id);
+  if (entry == NULL) return insertTopic(id, name);
+  if (strncmp(entry->name, name, sizeof(entry->name) - 1) == 0) return entry;
+
+  // Two names claim the ID; the lexicographically smaller one keeps it
+  collided = true;
+  if (strncmp(name, entry->name, sizeof(entry->name) - 1) > 0) return entry;
+
+  char loser[32];
+  memcpy(loser, entry->name, sizeof(loser));
+  bool published = entry->published;
+
+  strncpy(entry->name, name, sizeof(entry->name) - 1);
+  entry->name[sizeof(entry->name) - 1] = '\0';
+  entry->published = false;
+  entry->announcePending = false;
+  entry->nameSends = TOPIC_NAME_REPEATS;
+
+  // Move our own topic to its next free ID and announce it on next publish
+  if (published) {
+    TopicEntry* moved = internTopic(loser);
+    if (moved != NULL) moved->published = true;
+  }
+
+  return entry;
+}
+
+bool NetworkMessaging::announceTopic(uint16_t id, const char* name) {
+  StaticJsonDocument<64> doc;
+  doc["t"] = id;
+  doc["topic"] = name;
+
+  return _core.broadcastMessage(MSG_TYPE_TOPIC_ANNOUNCE, doc.as<JsonObject>());
+}
+
+// Broadcast the topics that were queried or contested, each at most once
+// per TOPIC_ANNOUNCE_INTERVAL however many boards asked
+void NetworkMessaging::announcePendingTopics(uint32_t currentTime) {
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    char name[32];
+    uint16_t id = 0;
+
+    portENTER_CRITICAL(&_topicLock);
+    TopicEntry& entry = _topics[i];
+    if (entry.used && entry.announcePending &&
+        currentTime - entry.lastAnnounce >= TOPIC_ANNOUNCE_INTERVAL) {
+      entry.announcePending = false;
+      entry.lastAnnounce = currentTime;
+      id = entry.id;
+      memcpy(name, entry.name, sizeof(name));
+    }
+    portEXIT_CRITICAL(&_topicLock);
+
+    if (id != 0) announceTopic(id, name);
+  }
+}
+
+// Send the names of the topics we publish that match a filter, or of all
+// of them, with the next few frames. Called with _topicLock held.
+void NetworkMessaging::resendTopicNames(const char* filter) {
+  for (int i = 0; i < MAX_TOPIC_IDS; i++) {
+    TopicEntry& entry = _topics[i];
+    if (!entry.used || !entry.published) continue;
+    if (filter == NULL || topicMatchesFilter(filter, entry.name)) {
+      entry.nameSends = TOPIC_NAME_REPEATS;
+    }
+  }
+}
+
+bool NetworkMessaging::hasTopicSubscriptions() {
+  for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    if (_topicSubscriptions[i].active) return true;
+  }
   return false;
 }
 
+// ==================== Subscription Trie ====================
+
+bool NetworkMessaging::insertTopicSubscription(int index) {
+  TopicSubscription& subscription = _topicSubscriptions[index];
+  const char* level = subscription.topic;
+  uint16_t node = 0;
+
+  // Walk or extend the trie one level at a time
+  while (true) {
+    const char* end = strchr(level, '/');
+    size_t length = end != NULL ? end - level : strlen(level);
+
+    uint16_t child;
+    if (length == 1 && (level[0] == '+' || level[0] == '#')) {
+      uint16_t& link = level[0] == '+' ? _trieNodes[node].plusChild
+                                       : _trieNodes[node].hashChild;
+      if (link == TOPIC_TRIE_NONE) link = addTrieNode();
+      child = link;
+    } else {
+      uint16_t levelHash = NetworkCore::hash16(level, length);
+      child = findTrieEdge(node, levelHash);
+      if (child == TOPIC_TRIE_NONE) {
+        child = addTrieNode();
+        if (child != TOPIC_TRIE_NONE) addTrieEdge(node, levelHash, child);
+      }
+    }
+
+    if (child == TOPIC_TRIE_NONE) return false;  // Out of nodes
+    node = child;
+
+    if (end == NULL) break;
+    level = end + 1;
+  }
+
+  subscription.node = node;
+  subscription.next = _trieNodes[node].firstSubscription;
+  _trieNodes[node].firstSubscription = index;
+  return true;
+}
+
+bool NetworkMessaging::compileTopicTrie() {
+  _trieNodeCount = 0;
+  for (int i = 0; i < MAX_TOPIC_TRIE_NODES * 2; i++) {
+    _trieEdges[i].child = TOPIC_TRIE_NONE;
+  }
+  addTrieNode();  // Root
+
+  for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    if (_topicSubscriptions[i].active && !insertTopicSubscription(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint16_t NetworkMessaging::addTrieNode() {
+  if (_trieNodeCount >= MAX_TOPIC_TRIE_NODES) return TOPIC_TRIE_NONE;
+
+  TopicNode& node = _trieNodes[_trieNodeCount];
+  node.firstSubscription = TOPIC_TRIE_NONE;
+  node.plusChild = TOPIC_TRIE_NONE;
+  node.hashChild = TOPIC_TRIE_NONE;
+  return _trieNodeCount++;
+}
+
+uint16_t NetworkMessaging::findTrieEdge(uint16_t parent, uint16_t levelHash) {
+  const int mask = MAX_TOPIC_TRIE_NODES * 2 - 1;
+  int slot = (levelHash ^ (parent * 40503U)) & mask;
+
+  // The table is at most half full, so probing always reaches an empty slot
+  while (_trieEdges[slot].child != TOPIC_TRIE_NONE) {
+    if (_trieEdges[slot].parent == parent &&
+        _trieEdges[slot].levelHash == levelHash) {
+      return _trieEdges[slot].child;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return TOPIC_TRIE_NONE;
+}
+
+void NetworkMessaging::addTrieEdge(uint16_t parent, uint16_t levelHash,
+                                   uint16_t child) {
+  const int mask = MAX_TOPIC_TRIE_NODES * 2 - 1;
+  int slot = (levelHash ^ (parent * 40503U)) & mask;
+
+  while (_trieEdges[slot].child != TOPIC_TRIE_NONE) {
+    slot = (slot + 1) & mask;
+  }
+  _trieEdges[slot].parent = parent;
+  _trieEdges[slot].levelHash = levelHash;
+  _trieEdges[slot].child = child;
+}
+
+int NetworkMessaging::matchTopicSubscriptions(const char* topic,
+                                              uint16_t* matches) {
+  // Hash every level of the topic once
+  uint16_t levelHashes[MAX_TOPIC_LEVELS];
+  int levelCount = 0;
+  const char* level = topic;
+  while (true) {
+    if (levelCount == MAX_TOPIC_LEVELS) return 0;
+
+    const char* end = strchr(level, '/');
+    size_t length = end != NULL ? end - level : strlen(level);
+    levelHashes[levelCount++] = NetworkCore::hash16(level, length);
+
+    if (end == NULL) break;
+    level = end + 1;
+  }
+
+  // Depth-first walk following the exact, "+" and "#" branches
+  struct {
+    uint16_t node;
+    uint8_t depth;
+  } stack[MAX_TOPIC_LEVELS + 2];
+  int stackSize = 0;
+  int matchCount = 0;
+  bool systemTopic = topic[0] == '$';
+
+  stack[stackSize].node = 0;
+  stack[stackSize++].depth = 0;
+
+  while (stackSize > 0) {
+    uint16_t node = stack[--stackSize].node;
+    uint8_t depth = stack[stackSize].depth;
+    bool wildcards = !(systemTopic && depth == 0);
+
+    // "#" matches the rest of the topic, including no levels at all, and
+    // the end of the topic matches the node itself
+    uint16_t candidates[2] = {TOPIC_TRIE_NONE, TOPIC_TRIE_NONE};
+    if (wildcards) candidates[0] = _trieNodes[node].hashChild;
+    if (depth == levelCount) candidates[1] = node;
+
+    for (int c = 0; c < 2; c++) {
+      if (candidates[c] == TOPIC_TRIE_NONE) continue;
+      for (uint16_t s = _trieNodes[candidates[c]].firstSubscription;
+           s != TOPIC_TRIE_NONE; s = _topicSubscriptions[s].next) {
+        // Level hashes can collide, so confirm the filter really matches
+        if (matchCount < MAX_TOPIC_DELIVERIES &&
+            topicMatchesFilter(_topicSubscriptions[s].topic, topic)) {
+          matches[matchCount++] = s;
+        }
+      }
+    }
+    if (depth == levelCount) continue;
+
+    uint16_t exact = findTrieEdge(node, levelHashes[depth]);
+    if (exact != TOPIC_TRIE_NONE) {
+      stack[stackSize].node = exact;
+      stack[stackSize++].depth = depth + 1;
+    }
+    if (wildcards && _trieNodes[node].plusChild != TOPIC_TRIE_NONE) {
+      stack[stackSize].node = _trieNodes[node].plusChild;
+      stack[stackSize++].depth = depth + 1;
+    }
+  }
+
+  return matchCount;
+}
+
+// "+" and "#" must each fill a whole level, and "#" must be the last level
+bool NetworkMessaging::isValidTopicFilter(const char* filter) {
+  for (const char* p = filter; *p; p++) {
+    if (*p != '+' && *p != '#') continue;
+
+    bool levelStart = p == filter || p[-1] == '/';
+    bool levelEnd = p[1] == '\0' || p[1] == '/';
+    if (!levelStart || !levelEnd) return false;
+    if (*p == '#' && p[1] != '\0') return false;
+  }
+  return true;
+}
+
+bool NetworkMessaging::topicMatchesFilter(const char* filter,
+                                          const char* topic) {
+  while (true) {
+    if (*filter == '#') return true;
+
+    if (*filter == '+') {
+      filter++;
+      while (*topic && *topic != '/') topic++;
+    } else {
+      while (*filter && *filter != '/') {
+        if (*filter++ != *topic++) return false;
+      }
+      if (*topic && *topic != '/') return false;
+    }
+
+    // Both are now at a level separator or the end
+    if (*filter == '\0') return *topic == '\0';
+    if (*topic == '\0') return strcmp(filter, "/#") == 0;
+    filter++;
+    topic++;
+  }
+}
+
 // ==================== Helper Methods ====================
 
+// Copy a known board ID into an outbox recipient slot
+bool NetworkMessaging::copyTarget(const char* boardId, char* target) {
+  if (strlen(boardId) >= 32 || !_core.canSendTo(boardId)) {
+    Serial.print("[NetworkMessaging] Unknown board: ");
+    Serial.println(boardId);
+    return false;
+  }
+
+  strcpy(target, boardId);
+  return true;
+}
+
 int NetworkMessaging::findFreeTopicSubscriptionSlot() {
   for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
     if (!_topicSubscriptions[i].active) {
@@ -5,23 +5,340 @@
 
 #include "NetworkPinControl.h"
 
+#include <SPI.h>
+#include <Wire.h>
+
+// Little-endian fields of clock sync bodies
+static void writeUint32(uint8_t* p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static uint32_t readUint32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Encoded length of each pin sequence step, 0 for unknown opcodes
+static uint8_t pinSequenceStepLength(uint8_t op) {
+  switch (op) {
+    case PIN_SEQ_OP_SET:
+      return 3;
+    case PIN_SEQ_OP_DELAY:
+      return 5;
+    case PIN_SEQ_OP_LOOP:
+      return 3;
+    case PIN_SEQ_OP_END_LOOP:
+      return 1;
+    case PIN_SEQ_OP_WAIT:
+      return 5;
+    case PIN_SEQ_OP_REPORT:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// Acked mask with a bit set for every member of a group
+static uint32_t allGroupMembers(uint8_t memberCount) {
+  return memberCount >= 32 ? 0xFFFFFFFFUL : ((1UL << memberCount) - 1);
+}
+
+// ==================== PinSequence Builder ====================
+
+PinSequence::PinSequence() { clear(); }
+
+void PinSequence::clear() { _length = 0; }
+
+bool PinSequence::append(const uint8_t* bytes, size_t len) {
+  if (_length + len > MAX_PIN_SEQUENCE_BYTES) return false;
+  memcpy(&_program[_length], bytes, len);
+  _length += len;
+  return true;
+}
+
+bool PinSequence::set(uint8_t pin, uint8_t value) {
+  uint8_t step[] = {PIN_SEQ_OP_SET, pin, value};
+  return append(step, sizeof(step));
+}
+
+bool PinSequence::delayMs(uint32_t ms) { return delayMicros(ms * 1000UL); }
+
+bool PinSequence::delayMicros(uint32_t us) {
+  uint8_t step[] = {PIN_SEQ_OP_DELAY, (uint8_t)us, (uint8_t)(us >> 8),
+                    (uint8_t)(us >> 16), (uint8_t)(us >> 24)};
+  return append(step, sizeof(step));
+}
+
+bool PinSequence::loop(uint16_t iterations) {
+  uint8_t step[] = {PIN_SEQ_OP_LOOP, (uint8_t)iterations,
+                    (uint8_t)(iterations >> 8)};
+  return append(step, sizeof(step));
+}
+
+bool PinSequence::endLoop() {
+  uint8_t step[] = {PIN_SEQ_OP_END_LOOP};
+  return append(step, sizeof(step));
+}
+
+bool PinSequence::waitInput(uint8_t pin, uint8_t value, uint16_t timeoutMs) {
+  uint8_t step[] = {PIN_SEQ_OP_WAIT, pin, value, (uint8_t)timeoutMs,
+                    (uint8_t)(timeoutMs >> 8)};
+  return append(step, sizeof(step));
+}
+
+bool PinSequence::report(uint8_t tag) {
+  uint8_t step[] = {PIN_SEQ_OP_REPORT, tag};
+  return append(step, sizeof(step));
+}
+
+// ==================== BusTransactionBatch Builder ====================
+
+BusTransactionBatch::BusTransactionBatch() { clear(); }
+
+void BusTransactionBatch::clear() {
+  _length = 0;
+  _readLength = 0;
+  _count = 0;
+}
+
+bool BusTransactionBatch::append(uint8_t op, uint8_t target,
+                                 const uint8_t* data, uint8_t writeLength,
+                                 uint8_t readLength) {
+  if (_count >= MAX_BUS_TRANSACTIONS ||
+      _length + 4 + writeLength > MAX_BUS_BATCH_BYTES ||
+      _readLength + readLength > MAX_BUS_READ_BYTES)
+    return false;
+
+  _batch[_length++] = op;
+  _batch[_length++] = target;
+  _batch[_length++] = writeLength;
+  _batch[_length++] = readLength;
+  if (writeLength > 0) memcpy(&_batch[_length], data, writeLength);
+  _length += writeLength;
+  _readLength += readLength;
+  _count++;
+  return true;
+}
+
+bool BusTransactionBatch::i2cWrite(uint8_t address, const uint8_t* data,
+                                   uint8_t length) {
+  if (length == 0) return false;
+  return append(BUS_OP_I2C_WRITE, address, data, length, 0);
+}
+
+bool BusTransactionBatch::i2cRead(uint8_t address, uint8_t length) {
+  if (length == 0) return false;
+  return append(BUS_OP_I2C_READ, address, NULL, 0, length);
+}
+
+bool BusTransactionBatch::i2cWriteRead(uint8_t address, const uint8_t* data,
+                                       uint8_t writeLength,
+                                       uint8_t readLength) {
+  if (writeLength == 0 || readLength == 0) return false;
+  return append(BUS_OP_I2C_WRITE_READ, address, data, writeLength,
+                readLength);
+}
+
+bool BusTransactionBatch::spiTransfer(uint8_t csPin, const uint8_t* data,
+                                      uint8_t writeLength,
+                                      uint8_t readLength) {
+  if (writeLength == 0 && readLength == 0) return false;
+  return append(BUS_OP_SPI_TRANSFER, csPin, data, writeLength, readLength);
+}
+
+// ==================== NetworkPinControl ====================
+
 // Constructor
 NetworkPinControl::NetworkPinControl(NetworkCore& core) : _core(core) {
-  _globalPinChangeCallback = NULL;
+  memset(&_globalPinChangeCallback, 0, sizeof(_globalPinChangeCallback));
   _pinControlConfirmCallback = NULL;
+  _pinScheduleCallback = NULL;
+  _pinSequenceCallback = NULL;
   _pinSubscriptionCount = 0;
+  _announcePending = false;
+  _lastAnnounce = 0;
+  _scheduleCount = 0;
+  _scheduleResultHead = 0;
+  _scheduleResultCount = 0;
+  _scheduleTimer = NULL;
+  _scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+  _scheduleSequence = 0;
+  memset(_clockOffsets, 0, sizeof(_clockOffsets));
+  _sequenceEventHead = 0;
+  _sequenceEventCount = 0;
+  _sequenceLock = portMUX_INITIALIZER_UNLOCKED;
+  _busWire = NULL;
+  _busSpi = NULL;
+  _busSpiFrequency = BUS_PROXY_SPI_FREQUENCY;
+  _busClientCount = 0;
+  _busCsPinCount = 0;
+  _busResponseCallback = NULL;
+  _busRequestHead = 0;
+  _busRequestCount = 0;
+  _busLock = portMUX_INITIALIZER_UNLOCKED;
 
   // Initialize subscriptions
   for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
     _pinSubscriptions[i].active = false;
   }
+
+  // Initialize groups
+  for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+    _boardGroups[i].active = false;
+    _boardGroups[i].pending = false;
+  }
+  for (int i = 0; i < MAX_JOINED_GROUPS; i++) {
+    _groupMemberships[i].active = false;
+  }
+
+  // Initialize sequence runners
+  for (int i = 0; i < MAX_PIN_SEQUENCES; i++) {
+    _sequenceRunners[i].owner = this;
+    _sequenceRunners[i].timer = NULL;
+    _sequenceRunners[i].active = false;
+  }
 }
 
 bool NetworkPinControl::begin() {
-  // No specific initialization needed
+  // Create the one-shot timer that fires scheduled pin commands
+  if (_scheduleTimer == NULL) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onScheduleTimer;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "pin_schedule";
+
+    if (esp_timer_create(&timerArgs, &_scheduleTimer) != ESP_OK) {
+      Serial.println("[NetworkPinControl] Failed to create schedule timer");
+      _scheduleTimer = NULL;
+      return false;
+    }
+  }
+
+  for (int i = 0; i < MAX_PIN_SEQUENCES; i++) {
+    if (_sequenceRunners[i].timer != NULL) continue;
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onSequenceTimer;
+    timerArgs.arg = &_sequenceRunners[i];
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "pin_sequence";
+
+    if (esp_timer_create(&timerArgs, &_sequenceRunners[i].timer) != ESP_OK) {
+      Serial.println("[NetworkPinControl] Failed to create sequence timer");
+      _sequenceRunners[i].timer = NULL;
+      return false;
+    }
+  }
+
   return true;
 }
 
+void NetworkPinControl::update() {
+  uint32_t currentTime = millis();
+  if (_announcePending &&
+      currentTime - _lastAnnounce >= PIN_ANNOUNCE_INTERVAL) {
+    _lastAnnounce = currentTime;
+    announceRegistrations();
+  }
+
+  // Retry group members that have not acknowledged, by unicast only
+  for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+    BoardGroup& group = _boardGroups[i];
+    if (!group.pending ||
+        currentTime - group.sentTime < PIN_GROUP_ACK_TIMEOUT)
+      continue;
+
+    if (group.retries >= PIN_GROUP_MAX_RETRIES) {
+      finishGroupCommand(group);
+      continue;
+    }
+
+    for (uint8_t m = 0; m < group.memberCount; m++) {
+      if (!(group.ackedMask & (1UL << m))) sendGroupCommand(group, m);
+    }
+    group.retries++;
+    group.sentTime = currentTime;
+  }
+
+  updateClockSync(currentTime);
+
+  // Report scheduled command outcomes outside of the timer context
+  while (true) {
+    ScheduledPinCommand result;
+
+    portENTER_CRITICAL(&_scheduleLock);
+    if (_scheduleResultCount == 0) {
+      portEXIT_CRITICAL(&_scheduleLock);
+      break;
+    }
+    result = _scheduleResults[_scheduleResultHead];
+    _scheduleResultHead =
+        (_scheduleResultHead + 1) % MAX_SCHEDULED_PIN_COMMANDS;
+    _scheduleResultCount--;
+    portEXIT_CRITICAL(&_scheduleLock);
+
+    // The target and the apply time let the sender measure the skew against
+    // its own clock
+    StaticJsonDocument<160> doc;
+    doc["seq"] = result.sequence;
+    doc["pin"] = result.pin;
+    doc["value"] = result.value;
+    doc["status"] = result.status;
+    doc["skew"] = result.skew;
+    if (result.status != PIN_SCHEDULE_REJECTED) {
+      doc["at"] = result.target;
+      doc["applied"] = result.appliedAt;
+    }
+
+    _core.sendMessage(result.sender, MSG_TYPE_PIN_SCHEDULE_RESULT,
+                      doc.as<JsonObject>());
+  }
+
+  // Run bus proxy batches here rather than in the receive callback, since
+  // bus transactions can block for milliseconds
+  while (true) {
+    PendingBusBatch request;
+
+    portENTER_CRITICAL(&_busLock);
+    if (_busRequestCount == 0) {
+      portEXIT_CRITICAL(&_busLock);
+      break;
+    }
+    request = _busRequests[_busRequestHead];
+    _busRequestHead = (_busRequestHead + 1) % MAX_BUS_REQUESTS;
+    _busRequestCount--;
+    portEXIT_CRITICAL(&_busLock);
+
+    runBusBatch(request);
+  }
+
+  // Report pin sequence progress and completion
+  while (true) {
+    PinSequenceEvent event;
+
+    portENTER_CRITICAL(&_sequenceLock);
+    if (_sequenceEventCount == 0) {
+      portEXIT_CRITICAL(&_sequenceLock);
+      break;
+    }
+    event = _sequenceEvents[_sequenceEventHead];
+    _sequenceEventHead = (_sequenceEventHead + 1) % MAX_PIN_SEQUENCE_EVENTS;
+    _sequenceEventCount--;
+    portEXIT_CRITICAL(&_sequenceLock);
+
+    StaticJsonDocument<64> doc;
+    doc["id"] = event.id;
+    doc["status"] = event.status;
+    doc["tag"] = event.tag;
+
+    _core.sendMessage(event.sender, MSG_TYPE_PIN_SEQUENCE_STATUS,
+                      doc.as<JsonObject>());
+  }
+}
+
 // ==================== Remote Pin Control (Controller Side)
 // ====================
 
@@ -35,6 +352,15 @@ bool NetworkPinControl::controlRemotePin(const char* targetBoardId, uint8_t pin,
   doc["pin"] = pin;
   doc["value"] = value;
 
+  // Commands to ourselves are applied through the loopback path and
+  // confirmed immediately
+  if (_core.isLocalBoard(targetBoardId)) {
+    bool handled = _core.sendMessage(targetBoardId, MSG_TYPE_PIN_CONTROL,
+                                     doc.as<JsonObject>());
+    if (callback != NULL) callback(targetBoardId, pin, value, handled);
+    return handled;
+  }
+
   // Store pin details for callbacks
   int freeSlot = -1;
   for (int i = 0; i < NetworkCore::MAX_TRACKED_MESSAGES; i++) {
@@ -76,204 +402,1545 @@ uint8_t NetworkPinControl::readRemotePin(const char* targetBoardId,
   return 0;
 }
 
-// ==================== Remote Pin Control (Responder Side) ====================
+// ==================== Scheduled Pin Control ====================
 
-bool NetworkPinControl::handlePinControl(PinChangeCallback callback) {
-  _globalPinChangeCallback = callback;
-  return true;
+bool NetworkPinControl::controlRemotePinAt(const char* targetBoardId,
+                                           uint8_t pin, uint8_t value,
+                                           uint32_t networkTime) {
+  if (!_core.isConnected()) return false;
+
+  // With a known clock offset the responder fires on its own clock, which
+  // stays right through queueing and retransmission
+  StaticJsonDocument<128> doc;
+  doc["pin"] = pin;
+  doc["value"] = value;
+  doc["seq"] = ++_scheduleSequence;
+  doc["at"] = networkTime;
+  int32_t offset;
+  if (lookupClockOffset(targetBoardId, &offset)) doc["ofs"] = offset;
+  doc["now"] = _core.getNetworkTime();  // Stamped as late as possible
+
+  return _core.sendMessage(targetBoardId, MSG_TYPE_PIN_SCHEDULE,
+                           doc.as<JsonObject>());
 }
 
-bool NetworkPinControl::stopHandlingPinControl() {
-  _globalPinChangeCallback = NULL;
+bool NetworkPinControl::controlRemotePinsAt(const char* const* targetBoardIds,
+                                            uint8_t boardCount, uint8_t pin,
+                                            uint8_t value,
+                                            uint32_t networkTime) {
+  if (!_core.isConnected()) return false;
+  if (!targetBoardIds || boardCount == 0 ||
+      boardCount > MAX_SCHEDULE_GROUP_SIZE)
+    return false;
 
-  // Also clear pin control subscriptions
-  for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
-    if (_pinSubscriptions[i].active &&
-        _pinSubscriptions[i].type == MSG_TYPE_PIN_CONTROL) {
-      _pinSubscriptions[i].active = false;
+  // Targets whose IDs do not fit one frame go out in further broadcasts with
+  // the same sequence and target time
+  uint16_t sequence = ++_scheduleSequence;
+  uint8_t next = 0;
+  while (next < boardCount) {
+    StaticJsonDocument<512> doc;
+    JsonArray targets = doc.createNestedArray("targets");
+    JsonArray offsets = doc.createNestedArray("ofs");
+    doc["pin"] = pin;
+    doc["value"] = value;
+    doc["seq"] = sequence;
+    doc["at"] = networkTime;
+    doc["now"] = UINT32_MAX;  // Widest timestamp while measuring
+
+    uint8_t first = next;
+    while (next < boardCount) {
+      // Targets without a clock offset yet convert with the lead time
+      int32_t offset;
+      targets.add(targetBoardIds[next]);
+      if (lookupClockOffset(targetBoardIds[next], &offset)) {
+        offsets.add(offset);
+      } else {
+        offsets.add(nullptr);
+      }
+      if (_core.measureJsonFrame(MSG_TYPE_PIN_SCHEDULE, doc.as<JsonObject>(),
+                                 false) > MAX_ESP_NOW_DATA_SIZE) {
+        targets.remove(targets.size() - 1);
+        offsets.remove(offsets.size() - 1);
+        break;
+      }
+      next++;
+    }
+    if (next == first) return false;  // A single board ID does not fit
+
+    doc["now"] = _core.getNetworkTime();
+    if (!_core.broadcastMessage(MSG_TYPE_PIN_SCHEDULE, doc.as<JsonObject>())) {
+      return false;
     }
   }
 
   return true;
 }
 
-bool NetworkPinControl::acceptPinControlFrom(const char* controllerBoardId,
-                                             uint8_t pin,
-                                             PinChangeCallback callback) {
-  if (!_core.isConnected()) return false;
+bool NetworkPinControl::syncClockWith(const char* targetBoardId) {
+  if (!_core.isConnected() || !targetBoardId) return false;
 
-  // Find a free subscription slot
-  int slot = findFreePinSubscriptionSlot();
-  if (slot == -1) return false;  // No free slots
+  // The round starts from update(), one probe at a time across boards
+  portENTER_CRITICAL(&_scheduleLock);
+  ClockOffset* entry = findClockOffset(targetBoardId, true);
+  entry->usedAt = millis();
+  if (entry->probes == 0) entry->syncedAt = entry->usedAt - CLOCK_SYNC_INTERVAL;
+  portEXIT_CRITICAL(&_scheduleLock);
+  return true;
+}
 
-  // Store the subscription
-  strncpy(_pinSubscriptions[slot].targetBoard, controllerBoardId,
-          sizeof(_pinSubscriptions[slot].targetBoard) - 1);
-  _pinSubscriptions[slot]
-      .targetBoard[sizeof(_pinSubscriptions[slot].targetBoard) - 1] = '\0';
-  _pinSubscriptions[slot].pin = pin;
-  _pinSubscriptions[slot].type = MSG_TYPE_PIN_CONTROL;
-  _pinSubscriptions[slot].callback = callback;
-  _pinSubscriptions[slot].active = true;
+bool NetworkPinControl::onScheduledPinResult(PinScheduleCallback callback) {
+  _pinScheduleCallback = callback;
+  return true;
+}
 
-  if (_pinSubscriptionCount < MAX_PIN_SUBSCRIPTIONS) _pinSubscriptionCount++;
+// ==================== Group Pin Control ====================
 
-  // Send subscription request to the controller
-  StaticJsonDocument<64> doc;
-  doc["pin"] = pin;
+bool NetworkPinControl::defineBoardGroup(const char* groupName,
+                                         const char* const* boardIds,
+                                         uint8_t memberCount) {
+  if (!groupName || !boardIds || memberCount == 0 ||
+      memberCount > MAX_GROUP_MEMBERS)
+    return false;
 
-  return _core.sendMessage(controllerBoardId, MSG_TYPE_PIN_SUBSCRIBE,
-                           doc.as<JsonObject>());
-}
+  BoardGroup* group = findBoardGroup(groupName);
+  if (group == NULL) {
+    for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+      if (!_boardGroups[i].active) {
+        group = &_boardGroups[i];
+        break;
+      }
+    }
+    if (group == NULL) return false;  // No free slots
 
-bool NetworkPinControl::stopAcceptingPinControlFrom(
-    const char* controllerBoardId, uint8_t pin) {
-  if (!_core.isConnected()) return false;
+    strncpy(group->name, groupName, sizeof(group->name) - 1);
+    group->name[sizeof(group->name) - 1] = '\0';
+    group->id = NetworkCore::hash16(group->name);
+    group->sequence = 0;
+    group->memberCount = 0;
+    group->pending = false;
+    group->announcedMask = 0;
+    group->active = true;
+  } else {
+    // Members dropped from the group must stop answering to it
+    for (uint8_t m = 0; m < group->memberCount; m++) {
+      bool kept = false;
+      for (uint8_t n = 0; n < memberCount && !kept; n++) {
+        kept = strcmp(group->members[m], boardIds[n]) == 0;
+      }
+      if (kept || !(group->announcedMask & (1UL << m))) continue;
 
-  // Find and remove the matching subscription
-  int index = -1;
-  if (findMatchingPinSubscription(controllerBoardId, pin, MSG_TYPE_PIN_CONTROL,
-                                  index)) {
-    _pinSubscriptions[index].active = false;
-    return true;
+      StaticJsonDocument<64> doc;
+      doc["g"] = group->id;
+      doc["leave"] = 1;
+      _core.sendMessage(group->members[m], MSG_TYPE_PIN_GROUP,
+                        doc.as<JsonObject>());
+    }
+    if (group->pending) finishGroupCommand(*group);
+  }
+
+  // Store members and tell each one its index, now or once it can be
+  // reached
+  group->memberCount = memberCount;
+  group->announcedMask = 0;
+  for (uint8_t m = 0; m < memberCount; m++) {
+    strncpy(group->members[m], boardIds[m], sizeof(group->members[m]) - 1);
+    group->members[m][sizeof(group->members[m]) - 1] = '\0';
   }
+  _announcePending = true;
+  announceRegistrations();
 
-  return false;  // Subscription not found
+  return true;
 }
 
-// ==================== Pin State Broadcasting ====================
+bool NetworkPinControl::removeBoardGroup(const char* groupName) {
+  BoardGroup* group = findBoardGroup(groupName);
+  if (group == NULL) return false;
 
-bool NetworkPinControl::broadcastPinState(uint8_t pin, uint8_t value) {
+  if (group->pending) finishGroupCommand(*group);
+  group->active = false;
+  return true;
+}
+
+const char* NetworkPinControl::getBoardGroupMember(const char* groupName,
+                                                   uint8_t index) {
+  BoardGroup* group = findBoardGroup(groupName);
+  if (group == NULL || index >= group->memberCount) return NULL;
+  return group->members[index];
+}
+
+bool NetworkPinControl::controlGroupPin(const char* groupName, uint8_t pin,
+                                        uint8_t value,
+                                        PinGroupConfirmCallback callback) {
   if (!_core.isConnected()) return false;
 
-  // Prepare the message
-  StaticJsonDocument<64> doc;
-  doc["pin"] = pin;
-  doc["value"] = value;
+  BoardGroup* group = findBoardGroup(groupName);
+  if (group == NULL) return false;
 
-  // Broadcast the pin state
-  return _core.broadcastMessage(MSG_TYPE_PIN_PUBLISH, doc.as<JsonObject>());
+  // A new command supersedes the outstanding one
+  if (group->pending) finishGroupCommand(*group);
+
+  group->sequence++;
+  group->pin = pin;
+  group->value = value;
+  group->callback = callback;
+  group->ackedMask = 0;
+  group->retries = 0;
+  group->sentTime = millis();
+  group->pending = true;
+
+  // A member of our own group is served through the loopback path
+  for (uint8_t m = 0; m < group->memberCount; m++) {
+    if (_core.isLocalBoard(group->members[m])) {
+      applyPinControl(_core._boardId, pin, value);
+      group->ackedMask |= (1UL << m);
+    }
+  }
+
+  bool sent = sendGroupCommand(*group, 0xFF);
+  if (group->ackedMask == allGroupMembers(group->memberCount)) {
+    finishGroupCommand(*group);
+  }
+  return sent;
 }
 
-bool NetworkPinControl::listenForPinStateFrom(const char* broadcasterBoardId,
-                                              uint8_t pin,
-                                              PinChangeCallback callback) {
+// ==================== Remote Pin Sequences ====================
+
+bool NetworkPinControl::runRemotePinSequence(const char* targetBoardId,
+                                             uint8_t sequenceId,
+                                             const PinSequence& sequence) {
   if (!_core.isConnected()) return false;
+  if (sequence.length() == 0 ||
+      !validateSequence(sequence.data(), sequence.length()))
+    return false;
 
-  // Find a free subscription slot
-  int slot = findFreePinSubscriptionSlot();
-  if (slot == -1) return false;  // No free slots
+  char program[MAX_PIN_SEQUENCE_BYTES * 2 + 1];
+  NetworkCore::hexEncode(sequence.data(), sequence.length(), program);
 
-  // Store the subscription
-  strncpy(_pinSubscriptions[slot].targetBoard, broadcasterBoardId,
-          sizeof(_pinSubscriptions[slot].targetBoard) - 1);
-  _pinSubscriptions[slot]
-      .targetBoard[sizeof(_pinSubscriptions[slot].targetBoard) - 1] = '\0';
-  _pinSubscriptions[slot].pin = pin;
-  _pinSubscriptions[slot].type = MSG_TYPE_PIN_PUBLISH;
-  _pinSubscriptions[slot].callback = callback;
-  _pinSubscriptions[slot].active = true;
+  StaticJsonDocument<256> doc;
+  doc["id"] = sequenceId;
+  doc["prog"] = (const char*)program;
 
-  if (_pinSubscriptionCount < MAX_PIN_SUBSCRIPTIONS) _pinSubscriptionCount++;
+  // Measured with a message ID so the answer does not depend on whether
+  // acknowledgements are enabled
+  if (_core.measureJsonFrame(MSG_TYPE_PIN_SEQUENCE, doc.as<JsonObject>(),
+                             true) > MAX_ESP_NOW_DATA_SIZE) {
+    Serial.println("[NetworkPinControl] Pin sequence too large for a frame");
+    return false;
+  }
 
-  return true;
+  return _core.sendMessage(targetBoardId, MSG_TYPE_PIN_SEQUENCE,
+                           doc.as<JsonObject>());
 }
 
-bool NetworkPinControl::stopListeningForPinStateFrom(
-    const char* broadcasterBoardId, uint8_t pin) {
+bool NetworkPinControl::stopRemotePinSequence(const char* targetBoardId,
+                                              uint8_t sequenceId) {
   if (!_core.isConnected()) return false;
 
-  // Find and remove the matching subscription
-  int index = -1;
-  if (findMatchingPinSubscription(broadcasterBoardId, pin, MSG_TYPE_PIN_PUBLISH,
-                                  index)) {
-    _pinSubscriptions[index].active = false;
-    return true;
-  }
+  StaticJsonDocument<64> doc;
+  doc["id"] = sequenceId;
+  doc["stop"] = 1;
 
-  return false;  // Subscription not found
+  return _core.sendMessage(targetBoardId, MSG_TYPE_PIN_SEQUENCE,
+                           doc.as<JsonObject>());
 }
 
-// ==================== Message Handlers ====================
+bool NetworkPinControl::onPinSequenceStatus(PinSequenceCallback callback) {
+  _pinSequenceCallback = callback;
+  return true;
+}
 
-bool NetworkPinControl::handlePinControlMessage(const char* sender, uint8_t pin,
-                                                uint8_t value,
-                                                const char* messageId) {
-  // Send acknowledgement if needed
-  if (messageId != NULL && _core.isAcknowledgementsEnabled()) {
-    _core.sendAcknowledgement(sender, messageId);
-  }
+// ==================== Remote Bus Transactions ====================
 
-  bool pinHandled = false;
+bool NetworkPinControl::submitBusTransactions(
+    const char* targetBoardId, uint8_t batchId,
+    const BusTransactionBatch& batch) {
+  if (!_core.isConnected()) return false;
+  if (batch.length() == 0) return false;
 
-  // First, check if there's a global callback
-  if (_globalPinChangeCallback != NULL) {
-    _globalPinChangeCallback(sender, pin, value);
-    pinHandled = true;
-  }
+  char encoded[MAX_BUS_BATCH_BYTES * 2 + 1];
+  NetworkCore::hexEncode(batch.data(), batch.length(), encoded);
 
-  // Next, check for specific subscriptions
-  int index = -1;
-  if (findMatchingPinSubscription(sender, pin, MSG_TYPE_PIN_CONTROL, index)) {
-    if (_pinSubscriptions[index].callback != NULL) {
-      _pinSubscriptions[index].callback(sender, pin, value);
-      pinHandled = true;
-    }
-  }
+  StaticJsonDocument<192> doc;
+  doc["id"] = batchId;
+  doc["tx"] = (const char*)encoded;
 
-  // If no callback handled it, set the pin directly (if it's valid)
-  if (!pinHandled && pin < NUM_DIGITAL_PINS) {
-    pinMode(pin, OUTPUT);
-    digitalWrite(pin, value);
-    pinHandled = true;
+  if (_core.measureJsonFrame(MSG_TYPE_BUS_TRANSACTION, doc.as<JsonObject>(),
+                             true) > MAX_ESP_NOW_DATA_SIZE) {
+    Serial.println("[NetworkPinControl] Bus batch too large for a frame");
+    return false;
   }
 
-  return pinHandled;
+  return _core.sendMessage(targetBoardId, MSG_TYPE_BUS_TRANSACTION,
+                           doc.as<JsonObject>());
 }
 
-bool NetworkPinControl::handlePinStateMessage(const char* sender, uint8_t pin,
-                                              uint8_t value) {
-  bool pinHandled = false;
+bool NetworkPinControl::onBusResponse(BusResponseCallback callback) {
+  _busResponseCallback = callback;
+  return true;
+}
 
-  // First, check if there's a global callback
-  if (_globalPinChangeCallback != NULL) {
-    _globalPinChangeCallback(sender, pin, value);
-    pinHandled = true;
-  }
+// ==================== Remote Pin Control (Responder Side) ====================
 
-  // Next, check for specific subscriptions
-  int index = -1;
-  if (findMatchingPinSubscription(sender, pin, MSG_TYPE_PIN_PUBLISH, index)) {
-    if (_pinSubscriptions[index].callback != NULL) {
-      _pinSubscriptions[index].callback(sender, pin, value);
-      pinHandled = true;
-    }
-  }
+bool NetworkPinControl::handlePinControl(PinChangeCallback callback) {
+  _globalPinChangeCallback.function = (void (*)())callback;
+  _globalPinChangeCallback.context = NULL;
+  _globalPinChangeCallback.kind = callback ? CALLBACK_PLAIN : CALLBACK_NONE;
+  return true;
+}
 
-  return pinHandled;
+bool NetworkPinControl::handlePinControl(PinChangeContextCallback callback,
+                                         void* context) {
+  _globalPinChangeCallback.function = (void (*)())callback;
+  _globalPinChangeCallback.context = context;
+  _globalPinChangeCallback.kind = callback ? CALLBACK_CONTEXT : CALLBACK_NONE;
+  return true;
 }
 
-// ==================== Helper Methods ====================
+bool NetworkPinControl::stopHandlingPinControl() {
+  _globalPinChangeCallback.kind = CALLBACK_NONE;
 
-int NetworkPinControl::findFreePinSubscriptionSlot() {
+  // Also clear pin control subscriptions
   for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
-    if (!_pinSubscriptions[i].active) {
-      return i;
+    if (_pinSubscriptions[i].active &&
+        _pinSubscriptions[i].type == MSG_TYPE_PIN_CONTROL) {
+      _pinSubscriptions[i].active = false;
     }
   }
-  return -1;  // No free slots
+
+  return true;
 }
 
-bool NetworkPinControl::findMatchingPinSubscription(const char* boardId,
-                                                    uint8_t pin, uint8_t type,
-                                                    int& index) {
+bool NetworkPinControl::acceptsPinControl() {
+  if (_globalPinChangeCallback.kind != CALLBACK_NONE) return true;
   for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
-    if (_pinSubscriptions[i].active && _pinSubscriptions[i].type == type &&
-        _pinSubscriptions[i].pin == pin &&
-        strcmp(_pinSubscriptions[i].targetBoard, boardId) == 0) {
-      index = i;
+    if (_pinSubscriptions[i].active &&
+        _pinSubscriptions[i].type == MSG_TYPE_PIN_CONTROL) {
       return true;
     }
   }
-  return false;  // No match found
-}
\ No newline at end of file
+  return false;
+}
+
+bool NetworkPinControl::acceptPinControlFrom(const char* controllerBoardId,
+                                             uint8_t pin,
+                                             PinChangeCallback callback) {
+  if (!addPinSubscription(controllerBoardId, pin, MSG_TYPE_PIN_CONTROL,
+                          (void (*)())callback, NULL, CALLBACK_PLAIN)) {
+    return false;
+  }
+
+  // Send the subscription request to the controller, now or once it can
+  // be reached
+  _announcePending = true;
+  announceRegistrations();
+  return true;
+}
+
+bool NetworkPinControl::acceptPinControlFrom(const char* controllerBoardId,
+                                             uint8_t pin,
+                                             PinChangeContextCallback callback,
+                                             void* context) {
+  if (!addPinSubscription(controllerBoardId, pin, MSG_TYPE_PIN_CONTROL,
+                          (void (*)())callback, context, CALLBACK_CONTEXT)) {
+    return false;
+  }
+
+  // Send the subscription request to the controller, now or once it can
+  // be reached
+  _announcePending = true;
+  announceRegistrations();
+  return true;
+}
+
+bool NetworkPinControl::stopAcceptingPinControlFrom(
+    const char* controllerBoardId, uint8_t pin) {
+  // Find and remove the matching subscriptions
+  return removePinSubscriptions(controllerBoardId, pin, MSG_TYPE_PIN_CONTROL);
+}
+
+bool NetworkPinControl::enableBusProxy(const char* const* allowedBoardIds,
+                                       uint8_t allowedCount, TwoWire* wire,
+                                       SPIClass* spi, const uint8_t* csPins,
+                                       uint8_t csPinCount,
+                                       uint32_t spiFrequency) {
+  if (wire == NULL && spi == NULL) return false;
+  if (!allowedBoardIds || allowedCount == 0 ||
+      allowedCount > MAX_BUS_PROXY_CLIENTS)
+    return false;
+  if (csPinCount > MAX_BUS_PROXY_CS_PINS || (csPinCount > 0 && !csPins))
+    return false;
+  if (spi != NULL && csPinCount == 0) return false;
+
+  for (uint8_t i = 0; i < csPinCount; i++) {
+    if (csPins[i] >= NUM_DIGITAL_PINS) return false;
+  }
+
+  // Stop serving while the allowlists change
+  disableBusProxy();
+
+  for (uint8_t i = 0; i < allowedCount; i++) {
+    strncpy(_busClients[i], allowedBoardIds[i], sizeof(_busClients[i]) - 1);
+    _busClients[i][sizeof(_busClients[i]) - 1] = '\0';
+  }
+  _busClientCount = allowedCount;
+  memcpy(_busCsPins, csPins, csPinCount);
+  _busCsPinCount = csPinCount;
+
+  _busWire = wire;
+  _busSpi = spi;
+  _busSpiFrequency = spiFrequency;
+  return true;
+}
+
+bool NetworkPinControl::isBusProxyEnabled() {
+  return _busWire != NULL || _busSpi != NULL;
+}
+
+bool NetworkPinControl::disableBusProxy() {
+  _busWire = NULL;
+  _busSpi = NULL;
+  _busClientCount = 0;
+  _busCsPinCount = 0;
+
+  portENTER_CRITICAL(&_busLock);
+  _busRequestCount = 0;
+  portEXIT_CRITICAL(&_busLock);
+  return true;
+}
+
+// ==================== Pin State Broadcasting ====================
+
+bool NetworkPinControl::broadcastPinState(uint8_t pin, uint8_t value) {
+  if (!_core.isConnected()) return false;
+
+  // Prepare the message
+  StaticJsonDocument<64> doc;
+  doc["pin"] = pin;
+  doc["value"] = value;
+
+  // Local listeners for our own pins are notified directly. The global pin
+  // callback is the pin control handler, so it is not run for our own state.
+  notifyPinSubscriptions(_core._boardId, pin, value, MSG_TYPE_PIN_PUBLISH);
+
+  // Broadcast the pin state
+  return _core.broadcastMessage(MSG_TYPE_PIN_PUBLISH, doc.as<JsonObject>());
+}
+
+bool NetworkPinControl::listenForPinStateFrom(const char* broadcasterBoardId,
+                                              uint8_t pin,
+                                              PinChangeCallback callback) {
+  return addPinSubscription(broadcasterBoardId, pin, MSG_TYPE_PIN_PUBLISH,
+                            (void (*)())callback, NULL, CALLBACK_PLAIN);
+}
+
+bool NetworkPinControl::listenForPinStateFrom(
+    const char* broadcasterBoardId, uint8_t pin,
+    PinChangeContextCallback callback, void* context) {
+  return addPinSubscription(broadcasterBoardId, pin, MSG_TYPE_PIN_PUBLISH,
+                            (void (*)())callback, context, CALLBACK_CONTEXT);
+}
+
+bool NetworkPinControl::stopListeningForPinStateFrom(
+    const char* broadcasterBoardId, uint8_t pin) {
+  // Find and remove the matching subscriptions
+  return removePinSubscriptions(broadcasterBoardId, pin, MSG_TYPE_PIN_PUBLISH);
+}
+
+// ==================== Message Handlers ====================
+
+bool NetworkPinControl::handlePinControlMessage(const char* sender, uint8_t pin,
+                                                uint8_t value,
+                                                const char* messageId) {
+  // Send acknowledgement if needed
+  if (messageId != NULL && _core.isAcknowledgementsEnabled()) {
+    _core.sendAcknowledgement(sender, messageId);
+  }
+
+  return applyPinControl(sender, pin, value);
+}
+
+bool NetworkPinControl::handlePinStateMessage(const char* sender, uint8_t pin,
+                                              uint8_t value) {
+  bool pinHandled = false;
+
+  // First, check if there's a global callback
+  if (callPinChangeCallback(_globalPinChangeCallback, sender, pin, value)) {
+    pinHandled = true;
+  }
+
+  // Next, check for specific subscriptions
+  if (notifyPinSubscriptions(sender, pin, value, MSG_TYPE_PIN_PUBLISH)) {
+    pinHandled = true;
+  }
+
+  return pinHandled;
+}
+
+bool NetworkPinControl::handlePinScheduleMessage(const char* sender,
+                                                 const JsonObject& doc,
+                                                 uint32_t receivedAt) {
+  // Unicast commands are acknowledged like plain pin control
+  const char* messageId = doc["messageId"];
+  if (messageId != NULL && _core.isAcknowledgementsEnabled()) {
+    _core.sendAcknowledgement(sender, messageId);
+  }
+
+  // Group commands list their targets, each with its clock offset; skip the
+  // ones not addressed to us
+  bool hasOffset = doc["ofs"].is<int32_t>();
+  int32_t offset = hasOffset ? doc["ofs"].as<int32_t>() : 0;
+  JsonArray targets = doc["targets"];
+  if (!targets.isNull()) {
+    bool addressed = false;
+    for (size_t i = 0; i < targets.size(); i++) {
+      const char* targetId = targets[i].as<const char*>();
+      if (targetId && strcmp(targetId, _core._boardId) == 0) {
+        addressed = true;
+        hasOffset = doc["ofs"][i].is<int32_t>();
+        offset = hasOffset ? doc["ofs"][i].as<int32_t>() : 0;
+        break;
+      }
+    }
+    if (!addressed) return false;
+  }
+
+  ScheduledPinCommand command;
+  strncpy(command.sender, sender, sizeof(command.sender) - 1);
+  command.sender[sizeof(command.sender) - 1] = '\0';
+  command.pin = doc["pin"];
+  command.value = doc["value"];
+  command.sequence = doc["seq"];
+  command.skew = 0;
+  command.appliedAt = 0;
+  command.target = doc["at"];
+
+  // Convert the sender's target time into our clock with the offset it
+  // estimated for us. Without one, use the lead time it had when the frame
+  // was built, which leaves the delivery latency in.
+  if (hasOffset) {
+    command.fireTime = command.target + offset;
+  } else {
+    uint32_t sentTime = doc["now"];
+    command.fireTime = receivedAt + (command.target - sentTime);
+  }
+
+  // Too late to schedule: apply immediately and report how late we were
+  if ((int32_t)(command.fireTime - _core.getNetworkTime()) <= 0) {
+    command.appliedAt = _core.getNetworkTime();
+    applyPinControl(command.sender, command.pin, command.value);
+    command.skew = (int32_t)(command.appliedAt - command.fireTime);
+    command.status = PIN_SCHEDULE_LATE;
+    queueScheduleResult(command);
+    return true;
+  }
+
+  // Insert in fire-time order
+  bool queued = false;
+  portENTER_CRITICAL(&_scheduleLock);
+  if (_scheduleCount < MAX_SCHEDULED_PIN_COMMANDS) {
+    int slot = _scheduleCount;
+    while (slot > 0 &&
+           (int32_t)(_schedule[slot - 1].fireTime - command.fireTime) > 0) {
+      _schedule[slot] = _schedule[slot - 1];
+      slot--;
+    }
+    command.status = PIN_SCHEDULE_ON_TIME;
+    _schedule[slot] = command;
+    _scheduleCount++;
+    queued = true;
+  }
+  portEXIT_CRITICAL(&_scheduleLock);
+
+  if (!queued) {
+    command.status = PIN_SCHEDULE_REJECTED;
+    queueScheduleResult(command);
+    return false;
+  }
+
+  armScheduleTimer();
+  return true;
+}
+
+bool NetworkPinControl::handlePinScheduleResult(const char* sender,
+                                                const JsonObject& doc) {
+  if (_pinScheduleCallback == NULL) return false;
+
+  // Measure the skew against our own target time when we know the
+  // responder's clock; its own figure only covers its timer
+  int32_t skew = doc["skew"];
+  int32_t offset;
+  if (doc.containsKey("applied") && lookupClockOffset(sender, &offset)) {
+    uint32_t applied = doc["applied"];
+    uint32_t target = doc["at"];
+    skew = (int32_t)(applied - offset - target);
+  }
+
+  _pinScheduleCallback(sender, doc["pin"], doc["value"], doc["status"], skew);
+  return true;
+}
+
+bool NetworkPinControl::handleClockSync(const char* sender,
+                                        const uint8_t* body, size_t length,
+                                        uint32_t receivedAt) {
+  if (length < CLOCK_SYNC_BODY_SIZE) return false;
+
+  // Probes are answered at once with our receive and send times
+  if (body[0] == CLOCK_SYNC_PROBE) {
+    uint8_t reply[CLOCK_SYNC_BODY_SIZE];
+    memcpy(reply, body, sizeof(reply));
+    reply[0] = CLOCK_SYNC_REPLY;
+    writeUint32(reply + 5, receivedAt);
+    writeUint32(reply + 9, _core.getNetworkTime());
+    return _core.sendBinaryMessage(sender, MSG_TYPE_CLOCK_SYNC, NULL, 0, reply,
+                                   sizeof(reply));
+  }
+  if (body[0] != CLOCK_SYNC_REPLY) return false;
+
+  uint32_t probeTime = readUint32(body + 1);
+  int32_t outbound = (int32_t)(readUint32(body + 5) - probeTime);
+  int32_t inbound = (int32_t)(receivedAt - readUint32(body + 9));
+  int64_t roundTrip = (int64_t)outbound + inbound;
+
+  portENTER_CRITICAL(&_scheduleLock);
+  ClockOffset* entry = findClockOffset(sender, false);
+  if (entry == NULL || entry->probes == 0 || entry->probeTime != probeTime ||
+      roundTrip < 0) {
+    portEXIT_CRITICAL(&_scheduleLock);
+    return false;
+  }
+  entry->probeTime = 0;  // Ignore duplicates of this reply
+  if (outbound < entry->bestOutbound) entry->bestOutbound = outbound;
+  if (inbound < entry->bestInbound) entry->bestInbound = inbound;
+  if (entry->probes >= CLOCK_SYNC_SAMPLES) finishClockSync(*entry);
+  portEXIT_CRITICAL(&_scheduleLock);
+  return true;
+}
+
+bool NetworkPinControl::handlePinSequenceMessage(const char* sender,
+                                                 const JsonObject& doc) {
+  const char* messageId = doc["messageId"];
+  if (messageId != NULL && _core.isAcknowledgementsEnabled()) {
+    _core.sendAcknowledgement(sender, messageId);
+  }
+
+  uint8_t id = doc["id"];
+  bool stopRequest = doc["stop"] | false;
+
+  // Decode the program before taking the lock. The lock is a spinlock held
+  // only for bookkeeping, since this runs in the WiFi receive task.
+  uint8_t program[MAX_PIN_SEQUENCE_BYTES];
+  int length = 0;
+  if (!stopRequest) {
+    length = NetworkCore::hexDecode(doc["prog"], program, sizeof(program));
+    if (length <= 0 || !validateSequence(program, length)) {
+      portENTER_CRITICAL(&_sequenceLock);
+      queueSequenceEvent(sender, id, PIN_SEQUENCE_REJECTED, 0);
+      portEXIT_CRITICAL(&_sequenceLock);
+      return false;
+    }
+
+    // Input waits read their pin as an input from the first step on. Pins
+    // the sketch handles with a pin control callback are its to configure.
+    for (int pc = 0; pc < length; pc += pinSequenceStepLength(program[pc])) {
+      if (program[pc] == PIN_SEQ_OP_WAIT &&
+          drivesPinDirectly(sender, program[pc + 1])) {
+        pinMode(program[pc + 1], INPUT);
+      }
+    }
+  }
+
+  portENTER_CRITICAL(&_sequenceLock);
+
+  // A program with the same ID from the same controller is stopped or
+  // replaced in place
+  PinSequenceRunner* runner = NULL;
+  for (int i = 0; i < MAX_PIN_SEQUENCES; i++) {
+    if (_sequenceRunners[i].active && _sequenceRunners[i].id == id &&
+        strcmp(_sequenceRunners[i].sender, sender) == 0) {
+      stopSequence(_sequenceRunners[i], PIN_SEQUENCE_STOPPED);
+      runner = &_sequenceRunners[i];
+      break;
+    }
+  }
+
+  if (stopRequest) {
+    portEXIT_CRITICAL(&_sequenceLock);
+    return runner != NULL;
+  }
+
+  for (int i = 0; runner == NULL && i < MAX_PIN_SEQUENCES; i++) {
+    if (!_sequenceRunners[i].active) runner = &_sequenceRunners[i];
+  }
+
+  if (runner == NULL || runner->timer == NULL) {
+    queueSequenceEvent(sender, id, PIN_SEQUENCE_REJECTED, 0);
+    portEXIT_CRITICAL(&_sequenceLock);
+    return false;
+  }
+
+  strncpy(runner->sender, sender, sizeof(runner->sender) - 1);
+  runner->sender[sizeof(runner->sender) - 1] = '\0';
+  memcpy(runner->program, program, length);
+  runner->length = length;
+  runner->pc = 0;
+  runner->id = id;
+  runner->loopDepth = 0;
+  runner->waiting = false;
+  runner->active = true;
+
+  // Execution always happens on the runner's timer
+  armSequenceTimer(*runner, 1);
+
+  portEXIT_CRITICAL(&_sequenceLock);
+  return true;
+}
+
+bool NetworkPinControl::handlePinSequenceStatus(const char* sender,
+                                                const JsonObject& doc) {
+  if (_pinSequenceCallback == NULL) return false;
+
+  _pinSequenceCallback(sender, doc["id"], doc["status"], doc["tag"]);
+  return true;
+}
+
+bool NetworkPinControl::handlePinGroupMessage(const char* sender,
+                                              const JsonObject& doc) {
+  if (!sender) return false;
+  uint16_t groupId = doc["g"];
+
+  // Other controllers may use the same group name, or one hashing alike
+  GroupMembership* membership = NULL;
+  for (int i = 0; i < MAX_JOINED_GROUPS; i++) {
+    if (_groupMemberships[i].active && _groupMemberships[i].id == groupId &&
+        strcmp(_groupMemberships[i].controller, sender) == 0) {
+      membership = &_groupMemberships[i];
+      break;
+    }
+  }
+
+  if (doc.containsKey("leave")) {
+    if (membership != NULL) membership->active = false;
+    return membership != NULL;
+  }
+
+  // Unicast frames carry our member index and enrol us in the group
+  if (doc.containsKey("m")) {
+    for (int i = 0; membership == NULL && i < MAX_JOINED_GROUPS; i++) {
+      if (!_groupMemberships[i].active) {
+        membership = &_groupMemberships[i];
+        strncpy(membership->controller, sender,
+                sizeof(membership->controller) - 1);
+        membership->controller[sizeof(membership->controller) - 1] = '\0';
+        membership->id = groupId;
+        membership->sequenceSeen = false;
+        membership->active = true;
+      }
+    }
+    if (membership == NULL) return false;  // No free slots
+    membership->memberIndex = doc["m"];
+  }
+
+  if (membership == NULL) return false;  // Not one of our groups
+  if (!doc.containsKey("pin")) return true;  // Membership update only
+
+  // Retransmissions of a command we already applied are only re-acked
+  uint16_t sequence = doc["q"];
+  if (!membership->sequenceSeen || membership->lastSequence != sequence) {
+    membership->lastSequence = sequence;
+    membership->sequenceSeen = true;
+    applyPinControl(sender, doc["pin"], doc["value"]);
+  }
+
+  StaticJsonDocument<64> ack;
+  ack["g"] = groupId;
+  ack["q"] = sequence;
+  ack["m"] = membership->memberIndex;
+  _core.sendMessage(sender, MSG_TYPE_PIN_GROUP_ACK, ack.as<JsonObject>());
+
+  return true;
+}
+
+bool NetworkPinControl::handlePinGroupAck(const char* sender,
+                                          const JsonObject& doc) {
+  uint16_t groupId = doc["g"];
+  uint16_t sequence = doc["q"];
+  uint8_t memberIndex = doc["m"];
+
+  for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+    BoardGroup& group = _boardGroups[i];
+    if (!group.pending || group.id != groupId || group.sequence != sequence)
+      continue;
+
+    // Ignore acks whose index does not belong to the sender
+    if (memberIndex >= group.memberCount ||
+        strcmp(group.members[memberIndex], sender) != 0)
+      return false;
+
+    group.ackedMask |= (1UL << memberIndex);
+    if (group.ackedMask == allGroupMembers(group.memberCount)) {
+      finishGroupCommand(group);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+bool NetworkPinControl::handleBusTransactionMessage(const char* sender,
+                                                    const JsonObject& doc) {
+  uint8_t id = doc["id"];
+
+  PendingBusBatch request;
+  int length =
+      NetworkCore::hexDecode(doc["tx"], request.batch, sizeof(request.batch));
+  if (length <= 0 || !validateBusBatch(request.batch, length)) {
+    sendBusResponse(sender, id, BUS_BATCH_INVALID, 0, NULL, 0);
+    return false;
+  }
+
+  if (_busWire == NULL && _busSpi == NULL) {
+    sendBusResponse(sender, id, BUS_BATCH_DISABLED, 0, NULL, 0);
+    return false;
+  }
+
+  if (!isBusBatchAllowed(sender, request.batch, length)) {
+    sendBusResponse(sender, id, BUS_BATCH_DENIED, 0, NULL, 0);
+    return false;
+  }
+
+  strncpy(request.sender, sender, sizeof(request.sender) - 1);
+  request.sender[sizeof(request.sender) - 1] = '\0';
+  request.length = length;
+  request.id = id;
+
+  portENTER_CRITICAL(&_busLock);
+  bool queued = _busRequestCount < MAX_BUS_REQUESTS;
+  if (queued) {
+    int tail = (_busRequestHead + _busRequestCount) % MAX_BUS_REQUESTS;
+    _busRequests[tail] = request;
+    _busRequestCount++;
+  }
+  portEXIT_CRITICAL(&_busLock);
+
+  if (!queued) sendBusResponse(sender, id, BUS_BATCH_BUSY, 0, NULL, 0);
+  return queued;
+}
+
+bool NetworkPinControl::handleBusResponse(const char* sender,
+                                          const uint8_t* body, size_t length) {
+  if (_busResponseCallback == NULL) return false;
+  if (length < BUS_RESPONSE_HEADER_SIZE ||
+      length > BUS_RESPONSE_HEADER_SIZE + MAX_BUS_READ_BYTES)
+    return false;
+
+  _busResponseCallback(sender, body[0], body[1], body[2],
+                       body + BUS_RESPONSE_HEADER_SIZE,
+                       length - BUS_RESPONSE_HEADER_SIZE);
+  return true;
+}
+
+// ==================== Group Helpers ====================
+
+NetworkPinControl::BoardGroup* NetworkPinControl::findBoardGroup(
+    const char* groupName) {
+  if (!groupName) return NULL;
+
+  for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+    if (_boardGroups[i].active &&
+        strncmp(_boardGroups[i].name, groupName,
+                sizeof(_boardGroups[i].name) - 1) == 0) {
+      return &_boardGroups[i];
+    }
+  }
+  return NULL;
+}
+
+bool NetworkPinControl::sendGroupCommand(BoardGroup& group,
+                                         uint8_t memberIndex) {
+  StaticJsonDocument<96> doc;
+  doc["g"] = group.id;
+  doc["q"] = group.sequence;
+  doc["pin"] = group.pin;
+  doc["value"] = group.value;
+
+  // 0xFF addresses every member with one broadcast frame
+  if (memberIndex == 0xFF) {
+    return _core.broadcastMessage(MSG_TYPE_PIN_GROUP, doc.as<JsonObject>());
+  }
+
+  doc["m"] = memberIndex;
+  return _core.sendMessage(group.members[memberIndex], MSG_TYPE_PIN_GROUP,
+                           doc.as<JsonObject>());
+}
+
+void NetworkPinControl::finishGroupCommand(BoardGroup& group) {
+  group.pending = false;
+  if (group.callback != NULL) {
+    group.callback(group.name, group.pin, group.value, group.ackedMask,
+                   group.memberCount);
+  }
+}
+
+// ==================== Pin Sequence Helpers ====================
+
+void NetworkPinControl::onSequenceTimer(void* arg) {
+  PinSequenceRunner* runner = static_cast<PinSequenceRunner*>(arg);
+  NetworkPinControl* owner = runner->owner;
+
+  // Steps are decoded under the lock, but pin callbacks run after it is
+  // released so a slow callback cannot hold up the receive path
+  PinSequenceWrite writes[PIN_SEQUENCE_STEPS_PER_TICK];
+  char sender[32];
+  int writeCount = 0;
+
+  portENTER_CRITICAL(&owner->_sequenceLock);
+  if (runner->active) {
+    writeCount = owner->stepSequence(*runner, writes);
+    memcpy(sender, runner->sender, sizeof(sender));
+  }
+  portEXIT_CRITICAL(&owner->_sequenceLock);
+
+  for (int i = 0; i < writeCount; i++) {
+    owner->applyPinControl(sender, writes[i].pin, writes[i].value);
+  }
+}
+
+// Run the runner up to its next delay, returning the pin writes it made
+int NetworkPinControl::stepSequence(PinSequenceRunner& runner,
+                                    PinSequenceWrite* writes) {
+  // Bound the work per tick so a loop without delays cannot starve the
+  // timer task
+  int budget = PIN_SEQUENCE_STEPS_PER_TICK;
+  int writeCount = 0;
+
+  while (runner.pc < runner.length) {
+    if (budget-- == 0) {
+      armSequenceTimer(runner, PIN_SEQUENCE_POLL_INTERVAL);
+      return writeCount;
+    }
+
+    const uint8_t* step = &runner.program[runner.pc];
+    switch (step[0]) {
+      case PIN_SEQ_OP_SET:
+        writes[writeCount].pin = step[1];
+        writes[writeCount].value = step[2];
+        writeCount++;
+        runner.pc += 3;
+        break;
+
+      case PIN_SEQ_OP_DELAY: {
+        uint32_t us = (uint32_t)step[1] | ((uint32_t)step[2] << 8) |
+                      ((uint32_t)step[3] << 16) | ((uint32_t)step[4] << 24);
+        runner.pc += 5;
+        if (us > 0) {
+          armSequenceTimer(runner, us);
+          return writeCount;
+        }
+        break;
+      }
+
+      case PIN_SEQ_OP_LOOP:
+        runner.loopStart[runner.loopDepth] = runner.pc + 3;
+        runner.loopRemaining[runner.loopDepth] =
+            (uint16_t)(step[1] | (step[2] << 8));
+        runner.loopDepth++;
+        runner.pc += 3;
+        break;
+
+      case PIN_SEQ_OP_END_LOOP: {
+        uint8_t top = runner.loopDepth - 1;
+        if (runner.loopRemaining[top] == 0 ||
+            --runner.loopRemaining[top] > 0) {
+          runner.pc = runner.loopStart[top];
+        } else {
+          runner.loopDepth--;
+          runner.pc += 1;
+        }
+        break;
+      }
+
+      case PIN_SEQ_OP_WAIT: {
+        // Apply earlier writes before sampling the input
+        if (writeCount > 0) {
+          armSequenceTimer(runner, 1);
+          return writeCount;
+        }
+
+        if (digitalRead(step[1]) == step[2]) {
+          runner.waiting = false;
+          runner.pc += 5;
+          break;
+        }
+
+        uint16_t timeoutMs = (uint16_t)(step[3] | (step[4] << 8));
+        if (!runner.waiting) {
+          runner.waiting = true;
+          runner.waitStarted = millis();
+        } else if (timeoutMs > 0 &&
+                   millis() - runner.waitStarted >= timeoutMs) {
+          stopSequence(runner, PIN_SEQUENCE_TIMEOUT);
+          return writeCount;
+        }
+
+        armSequenceTimer(runner, PIN_SEQUENCE_POLL_INTERVAL);
+        return writeCount;
+      }
+
+      case PIN_SEQ_OP_REPORT:
+        queueSequenceEvent(runner.sender, runner.id, PIN_SEQUENCE_PROGRESS,
+                           step[1]);
+        runner.pc += 2;
+        break;
+    }
+  }
+
+  stopSequence(runner, PIN_SEQUENCE_COMPLETE);
+  return writeCount;
+}
+
+void NetworkPinControl::armSequenceTimer(PinSequenceRunner& runner,
+                                         uint32_t delayUs) {
+  esp_timer_stop(runner.timer);
+  esp_timer_start_once(runner.timer, delayUs);
+}
+
+void NetworkPinControl::stopSequence(PinSequenceRunner& runner,
+                                     uint8_t status) {
+  esp_timer_stop(runner.timer);
+  runner.active = false;
+  queueSequenceEvent(runner.sender, runner.id, status, 0);
+}
+
+void NetworkPinControl::queueSequenceEvent(const char* sender, uint8_t id,
+                                           uint8_t status, uint8_t tag) {
+  if (_sequenceEventCount >= MAX_PIN_SEQUENCE_EVENTS) return;
+
+  int slot =
+      (_sequenceEventHead + _sequenceEventCount) % MAX_PIN_SEQUENCE_EVENTS;
+  strncpy(_sequenceEvents[slot].sender, sender,
+          sizeof(_sequenceEvents[slot].sender) - 1);
+  _sequenceEvents[slot].sender[sizeof(_sequenceEvents[slot].sender) - 1] =
+      '\0';
+  _sequenceEvents[slot].id = id;
+  _sequenceEvents[slot].status = status;
+  _sequenceEvents[slot].tag = tag;
+  _sequenceEventCount++;
+}
+
+bool NetworkPinControl::validateSequence(const uint8_t* program,
+                                         size_t length) {
+  // Every step must be complete and loops balanced within the depth limit
+  int depth = 0;
+  size_t pc = 0;
+  while (pc < length) {
+    uint8_t stepLength = pinSequenceStepLength(program[pc]);
+    if (stepLength == 0 || pc + stepLength > length) return false;
+
+    if (program[pc] == PIN_SEQ_OP_WAIT) {
+      if (program[pc + 1] >= NUM_DIGITAL_PINS) return false;
+    } else if (program[pc] == PIN_SEQ_OP_LOOP) {
+      if (++depth > MAX_PIN_SEQUENCE_LOOP_DEPTH) return false;
+    } else if (program[pc] == PIN_SEQ_OP_END_LOOP) {
+      if (--depth < 0) return false;
+    }
+    pc += stepLength;
+  }
+  return depth == 0;
+}
+
+// ==================== Bus Proxy Helpers ====================
+
+void NetworkPinControl::runBusBatch(const PendingBusBatch& request) {
+  uint8_t rx[MAX_BUS_READ_BYTES];
+  size_t rxLength = 0;
+  uint8_t status = BUS_BATCH_OK;
+  uint8_t index = 0;
+
+  // Transactions run in order; the first failure skips the rest
+  for (size_t offset = 0; offset < request.length; index++) {
+    uint8_t op = request.batch[offset];
+    uint8_t target = request.batch[offset + 1];
+    uint8_t writeLength = request.batch[offset + 2];
+    uint8_t readLength = request.batch[offset + 3];
+    const uint8_t* data = &request.batch[offset + 4];
+
+    bool success;
+    if (op == BUS_OP_SPI_TRANSFER) {
+      success = runSpiTransaction(target, data, writeLength, &rx[rxLength],
+                                  readLength);
+    } else {
+      success = runI2cTransaction(op, target, data, writeLength, &rx[rxLength],
+                                  readLength);
+    }
+
+    if (!success) {
+      status = BUS_BATCH_FAILED;
+      break;
+    }
+
+    rxLength += readLength;
+    offset += 4 + writeLength;
+  }
+
+  sendBusResponse(request.sender, request.id, status,
+                  status == BUS_BATCH_OK ? 0 : index, rx, rxLength);
+}
+
+bool NetworkPinControl::runI2cTransaction(uint8_t op, uint8_t address,
+                                          const uint8_t* data,
+                                          uint8_t writeLength, uint8_t* rx,
+                                          uint8_t readLength) {
+  if (_busWire == NULL) return false;
+
+  if (op != BUS_OP_I2C_READ) {
+    _busWire->beginTransmission(address);
+    _busWire->write(data, writeLength);
+
+    // Keep the bus for a repeated start when a read follows
+    if (_busWire->endTransmission(op == BUS_OP_I2C_WRITE) != 0) return false;
+  }
+
+  if (readLength == 0) return true;
+  if (_busWire->requestFrom(address, readLength) != readLength) return false;
+
+  for (uint8_t i = 0; i < readLength; i++) {
+    rx[i] = _busWire->read();
+  }
+  return true;
+}
+
+bool NetworkPinControl::runSpiTransaction(uint8_t csPin, const uint8_t* data,
+                                          uint8_t writeLength, uint8_t* rx,
+                                          uint8_t readLength) {
+  if (_busSpi == NULL) return false;
+
+  // Drive chip select high before making it an output to avoid a glitch
+  digitalWrite(csPin, HIGH);
+  pinMode(csPin, OUTPUT);
+
+  _busSpi->beginTransaction(SPISettings(_busSpiFrequency, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  for (uint8_t i = 0; i < writeLength; i++) {
+    _busSpi->transfer(data[i]);
+  }
+  for (uint8_t i = 0; i < readLength; i++) {
+    rx[i] = _busSpi->transfer(0x00);
+  }
+  digitalWrite(csPin, HIGH);
+  _busSpi->endTransaction();
+
+  return true;
+}
+
+// A batch is run only for allowed boards, and only if its SPI transfers use
+// allowed chip select pins. The batch must already be validated.
+bool NetworkPinControl::isBusBatchAllowed(const char* sender,
+                                          const uint8_t* batch,
+                                          size_t length) {
+  bool client = false;
+  for (uint8_t i = 0; i < _busClientCount && !client; i++) {
+    client = strcmp(_busClients[i], sender) == 0;
+  }
+  if (!client) return false;
+
+  for (size_t offset = 0; offset < length; offset += 4 + batch[offset + 2]) {
+    if (batch[offset] != BUS_OP_SPI_TRANSFER) continue;
+
+    bool allowed = false;
+    for (uint8_t i = 0; i < _busCsPinCount && !allowed; i++) {
+      allowed = _busCsPins[i] == batch[offset + 1];
+    }
+    if (!allowed) return false;
+  }
+  return true;
+}
+
+bool NetworkPinControl::sendBusResponse(const char* target, uint8_t id,
+                                        uint8_t status, uint8_t failedIndex,
+                                        const uint8_t* data, size_t length) {
+  // Raw read bytes, so a full response fits one frame even with the
+  // longest board IDs in a mesh header
+  uint8_t header[BUS_RESPONSE_HEADER_SIZE] = {
+      id, status, status == BUS_BATCH_FAILED ? failedIndex : (uint8_t)0};
+  return _core.sendBinaryMessage(target, MSG_TYPE_BUS_RESPONSE, header,
+                                 sizeof(header), data, length);
+}
+
+bool NetworkPinControl::validateBusBatch(const uint8_t* batch,
+                                         size_t length) {
+  size_t offset = 0;
+  size_t readTotal = 0;
+  uint8_t count = 0;
+
+  while (offset < length) {
+    if (offset + 4 > length || ++count > MAX_BUS_TRANSACTIONS) return false;
+
+    uint8_t op = batch[offset];
+    uint8_t writeLength = batch[offset + 2];
+    uint8_t readLength = batch[offset + 3];
+
+    switch (op) {
+      case BUS_OP_I2C_WRITE:
+        if (writeLength == 0 || readLength != 0) return false;
+        break;
+      case BUS_OP_I2C_READ:
+        if (writeLength != 0 || readLength == 0) return false;
+        break;
+      case BUS_OP_I2C_WRITE_READ:
+        if (writeLength == 0 || readLength == 0) return false;
+        break;
+      case BUS_OP_SPI_TRANSFER:
+        if (writeLength == 0 && readLength == 0) return false;
+        break;
+      default:
+        return false;
+    }
+
+    readTotal += readLength;
+    offset += 4 + writeLength;
+  }
+
+  return offset == length && readTotal <= MAX_BUS_READ_BYTES;
+}
+
+// ==================== Scheduling Helpers ====================
+
+void NetworkPinControl::onScheduleTimer(void* arg) {
+  static_cast<NetworkPinControl*>(arg)->fireDueCommands();
+}
+
+void NetworkPinControl::fireDueCommands() {
+  while (true) {
+    ScheduledPinCommand command;
+
+    // Pop the earliest command if it is due
+    portENTER_CRITICAL(&_scheduleLock);
+    if (_scheduleCount == 0 ||
+        (int32_t)(_schedule[0].fireTime - _core.getNetworkTime()) > 0) {
+      portEXIT_CRITICAL(&_scheduleLock);
+      break;
+    }
+    command = _schedule[0];
+    _scheduleCount--;
+    memmove(&_schedule[0], &_schedule[1],
+            _scheduleCount * sizeof(ScheduledPinCommand));
+    portEXIT_CRITICAL(&_scheduleLock);
+
+    command.appliedAt = _core.getNetworkTime();
+    applyPinControl(command.sender, command.pin, command.value);
+    command.skew = (int32_t)(command.appliedAt - command.fireTime);
+    queueScheduleResult(command);
+  }
+
+  armScheduleTimer();
+}
+
+void NetworkPinControl::armScheduleTimer() {
+  if (_scheduleTimer == NULL) return;
+
+  portENTER_CRITICAL(&_scheduleLock);
+  bool pending = _scheduleCount > 0;
+  uint32_t nextFireTime = pending ? _schedule[0].fireTime : 0;
+  portEXIT_CRITICAL(&_scheduleLock);
+
+  esp_timer_stop(_scheduleTimer);
+  if (!pending) return;
+
+  int32_t remaining = (int32_t)(nextFireTime - _core.getNetworkTime());
+  esp_timer_start_once(_scheduleTimer, remaining > 0 ? remaining : 1);
+}
+
+void NetworkPinControl::queueScheduleResult(
+    const ScheduledPinCommand& command) {
+  portENTER_CRITICAL(&_scheduleLock);
+  if (_scheduleResultCount < MAX_SCHEDULED_PIN_COMMANDS) {
+    int slot = (_scheduleResultHead + _scheduleResultCount) %
+               MAX_SCHEDULED_PIN_COMMANDS;
+    _scheduleResults[slot] = command;
+    _scheduleResultCount++;
+  }
+  portEXIT_CRITICAL(&_scheduleLock);
+}
+
+// ==================== Clock Offset Helpers ====================
+
+// Called with _scheduleLock held. New entries replace the least recently
+// used one and start a round from the next update().
+NetworkPinControl::ClockOffset* NetworkPinControl::findClockOffset(
+    const char* boardId, bool create) {
+  ClockOffset* oldest = &_clockOffsets[0];
+  for (int i = 0; i < MAX_CLOCK_OFFSETS; i++) {
+    ClockOffset& entry = _clockOffsets[i];
+    if (strcmp(entry.boardId, boardId) == 0) return &entry;
+    if (entry.boardId[0] == '\0') {
+      oldest = &entry;
+    } else if (oldest->boardId[0] != '\0' &&
+               (int32_t)(entry.usedAt - oldest->usedAt) < 0) {
+      oldest = &entry;
+    }
+  }
+  if (!create) return NULL;
+
+  memset(oldest, 0, sizeof(*oldest));
+  strncpy(oldest->boardId, boardId, sizeof(oldest->boardId) - 1);
+  oldest->usedAt = millis();
+  oldest->syncedAt = oldest->usedAt - CLOCK_SYNC_INTERVAL;
+  return oldest;
+}
+
+// Offset for a scheduled command, which also keeps the board's offset
+// refreshed
+bool NetworkPinControl::lookupClockOffset(const char* boardId,
+                                          int32_t* offset) {
+  portENTER_CRITICAL(&_scheduleLock);
+  ClockOffset* entry = findClockOffset(boardId, true);
+  entry->usedAt = millis();
+  bool valid = entry->valid;
+  if (valid) *offset = entry->offset;
+  portEXIT_CRITICAL(&_scheduleLock);
+  return valid;
+}
+
+// Called with _scheduleLock held
+void NetworkPinControl::startClockSync(ClockOffset& entry) {
+  entry.bestOutbound = INT32_MAX;
+  entry.bestInbound = INT32_MAX;
+}
+
+bool NetworkPinControl::sendClockProbe(ClockOffset& entry) {
+  uint8_t body[CLOCK_SYNC_BODY_SIZE] = {CLOCK_SYNC_PROBE};
+  char target[sizeof(entry.boardId)];
+
+  portENTER_CRITICAL(&_scheduleLock);
+  memcpy(target, entry.boardId, sizeof(target));
+  entry.probes++;
+  entry.probeSentAt = millis();
+  entry.probeTime = _core.getNetworkTime();
+  writeUint32(body + 1, entry.probeTime);
+  portEXIT_CRITICAL(&_scheduleLock);
+
+  return _core.sendBinaryMessage(target, MSG_TYPE_CLOCK_SYNC, NULL, 0, body,
+                                 sizeof(body));
+}
+
+// Called with _scheduleLock held. A round without replies keeps the last
+// offset and is retried after CLOCK_SYNC_INTERVAL.
+void NetworkPinControl::finishClockSync(ClockOffset& entry) {
+  if (entry.bestOutbound != INT32_MAX) {
+    entry.offset =
+        (int32_t)(((int64_t)entry.bestOutbound - entry.bestInbound) / 2);
+    entry.valid = true;
+  }
+  entry.syncedAt = millis();
+  entry.probes = 0;
+}
+
+// Send at most one probe at a time, across all boards, and space the probes
+// to each board, so probes neither queue behind each other nor keep meeting
+// the same traffic. Start rounds for boards still in use.
+void NetworkPinControl::updateClockSync(uint32_t currentTime) {
+  ClockOffset* next = NULL;
+  bool start = false;
+  bool inFlight = false;
+
+  portENTER_CRITICAL(&_scheduleLock);
+  for (int i = 0; i < MAX_CLOCK_OFFSETS; i++) {
+    ClockOffset& entry = _clockOffsets[i];
+    if (entry.boardId[0] == '\0') continue;
+
+    if (entry.probes > 0) {
+      if (currentTime - entry.probeSentAt < CLOCK_SYNC_PROBE_INTERVAL) {
+        if (entry.probeTime != 0) inFlight = true;  // Not answered yet
+      } else if (entry.probes >= CLOCK_SYNC_SAMPLES) {
+        finishClockSync(entry);
+      } else if (next == NULL) {
+        next = &entry;
+      }
+    } else if (next == NULL &&
+               currentTime - entry.usedAt < CLOCK_SYNC_IDLE_TIMEOUT &&
+               currentTime - entry.syncedAt >= CLOCK_SYNC_INTERVAL) {
+      next = &entry;
+      start = true;
+    }
+  }
+  if (inFlight) next = NULL;
+  if (next != NULL && start) startClockSync(*next);
+  portEXIT_CRITICAL(&_scheduleLock);
+
+  if (next != NULL) sendClockProbe(*next);
+}
+
+// ==================== Helper Methods ====================
+
+bool NetworkPinControl::applyPinControl(const char* sender, uint8_t pin,
+                                        uint8_t value) {
+  bool pinHandled = false;
+
+  // First, check if there's a global callback
+  if (callPinChangeCallback(_globalPinChangeCallback, sender, pin, value)) {
+    pinHandled = true;
+  }
+
+  // Next, check for specific subscriptions
+  if (notifyPinSubscriptions(sender, pin, value, MSG_TYPE_PIN_CONTROL)) {
+    pinHandled = true;
+  }
+
+  // If no callback handled it, set the pin directly (if it's valid)
+  if (!pinHandled && pin < NUM_DIGITAL_PINS) {
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, value);
+    pinHandled = true;
+  }
+
+  return pinHandled;
+}
+
+// Check if pin control of a pin from a sender is left to the library, with
+// no callback of the sketch to hand it to
+bool NetworkPinControl::drivesPinDirectly(const char* sender, uint8_t pin) {
+  if (_globalPinChangeCallback.kind != CALLBACK_NONE) return false;
+
+  int index;
+  return !findMatchingPinSubscription(sender, pin, MSG_TYPE_PIN_CONTROL,
+                                      index);
+}
+
+int NetworkPinControl::findFreePinSubscriptionSlot() {
+  for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
+    if (!_pinSubscriptions[i].active) {
+      return i;
+    }
+  }
+  return -1;  // No free slots
+}
+
+bool NetworkPinControl::findMatchingPinSubscription(const char* boardId,
+                                                    uint8_t pin, uint8_t type,
+                                                    int& index) {
+  for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
+    if (_pinSubscriptions[i].active && _pinSubscriptions[i].type == type &&
+        _pinSubscriptions[i].pin == pin &&
+        strcmp(_pinSubscriptions[i].targetBoard, boardId) == 0) {
+      index = i;
+      return true;
+    }
+  }
+  return false;  // No match found
+}
+
+// Send the subscription requests and group memberships still owed to
+// boards that can now be reached
+void NetworkPinControl::announceRegistrations() {
+  if (!_core.isConnected()) return;
+
+  bool pending = false;
+  for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
+    PinSubscription& subscription = _pinSubscriptions[i];
+    if (!subscription.active || subscription.announced ||
+        subscription.type != MSG_TYPE_PIN_CONTROL) {
+      continue;
+    }
+
+    if (_core.canSendTo(subscription.targetBoard)) {
+      StaticJsonDocument<64> doc;
+      doc["pin"] = subscription.pin;
+      subscription.announced =
+          _core.sendMessage(subscription.targetBoard, MSG_TYPE_PIN_SUBSCRIBE,
+                            doc.as<JsonObject>());
+    }
+    pending |= !subscription.announced;
+  }
+
+  for (int i = 0; i < MAX_BOARD_GROUPS; i++) {
+    BoardGroup& group = _boardGroups[i];
+    if (!group.active) continue;
+
+    for (uint8_t m = 0; m < group.memberCount; m++) {
+      uint32_t bit = 1UL << m;
+      if (group.announcedMask & bit) continue;
+
+      if (_core.canSendTo(group.members[m])) {
+        StaticJsonDocument<64> doc;
+        doc["g"] = group.id;
+        doc["m"] = m;
+        if (_core.sendMessage(group.members[m], MSG_TYPE_PIN_GROUP,
+                              doc.as<JsonObject>())) {
+          group.announcedMask |= bit;
+        }
+      }
+      pending |= !(group.announcedMask & bit);
+    }
+  }
+
+  _announcePending = pending;
+}
+
+bool NetworkPinControl::addPinSubscription(const char* boardId, uint8_t pin,
+                                           uint8_t type, void (*function)(),
+                                           void* context, uint8_t kind) {
+  // Find a free subscription slot
+  int slot = findFreePinSubscriptionSlot();
+  if (slot == -1) return false;  // No free slots
+
+  // Store the subscription
+  strncpy(_pinSubscriptions[slot].targetBoard, boardId,
+          sizeof(_pinSubscriptions[slot].targetBoard) - 1);
+  _pinSubscriptions[slot]
+      .targetBoard[sizeof(_pinSubscriptions[slot].targetBoard) - 1] = '\0';
+  _pinSubscriptions[slot].pin = pin;
+  _pinSubscriptions[slot].type = type;
+  _pinSubscriptions[slot].callback.function = function;
+  _pinSubscriptions[slot].callback.context = context;
+  _pinSubscriptions[slot].callback.kind = function ? kind : CALLBACK_NONE;
+  _pinSubscriptions[slot].announced = false;
+  _pinSubscriptions[slot].active = true;
+
+  if (_pinSubscriptionCount < MAX_PIN_SUBSCRIPTIONS) _pinSubscriptionCount++;
+
+  return true;
+}
+
+bool NetworkPinControl::removePinSubscriptions(const char* boardId,
+                                               uint8_t pin, uint8_t type) {
+  bool removed = false;
+  int index = -1;
+  while (findMatchingPinSubscription(boardId, pin, type, index)) {
+    _pinSubscriptions[index].active = false;
+    removed = true;
+  }
+  return removed;
+}
+
+// Call every subscription for a board and pin
+bool NetworkPinControl::notifyPinSubscriptions(const char* boardId,
+                                               uint8_t pin, uint8_t value,
+                                               uint8_t type) {
+  bool notified = false;
+  for (int i = 0; i < MAX_PIN_SUBSCRIPTIONS; i++) {
+    PinSubscription& subscription = _pinSubscriptions[i];
+    if (subscription.active && subscription.type == type &&
+        subscription.pin == pin &&
+        strcmp(subscription.targetBoard, boardId) == 0 &&
+        callPinChangeCallback(subscription.callback, boardId, pin, value)) {
+      notified = true;
+    }
+  }
+  return notified;
+}
+
+bool NetworkPinControl::callPinChangeCallback(const CallbackSlot& callback,
+                                              const char* sender, uint8_t pin,
+                                              uint8_t value) {
+  switch (callback.kind) {
+    case CALLBACK_PLAIN:
+      ((PinChangeCallback)callback.function)(sender, pin, value);
+      return true;
+    case CALLBACK_CONTEXT:
+      ((PinChangeContextCallback)callback.function)(callback.context, sender,
+                                                    pin, value);
+      return true;
+    default:
+      return false;
+  }
+}
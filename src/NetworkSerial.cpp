@@ -5,16 +5,90 @@
 
 #include "NetworkSerial.h"
 
+// Copy bytes into a ring buffer at a byte offset, wrapping at the end
+static void writeRing(uint8_t* ring, size_t size, uint32_t offset,
+                      const uint8_t* data, size_t length) {
+  size_t start = offset & (size - 1);
+  size_t first = length < size - start ? length : size - start;
+  memcpy(ring + start, data, first);
+  memcpy(ring, data + first, length - first);
+}
+
+// Copy bytes out of a ring buffer at a byte offset, wrapping at the end
+static void readRing(const uint8_t* ring, size_t size, uint32_t offset,
+                     uint8_t* data, size_t length) {
+  size_t start = offset & (size - 1);
+  size_t first = length < size - start ? length : size - start;
+  memcpy(data, ring + start, first);
+  memcpy(data + first, ring, length - first);
+}
+
+// Reverse bytes in place, a step of rotating a ring buffer
+static void reverseBytes(uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length / 2; i++) {
+    uint8_t byte = data[i];
+    data[i] = data[length - 1 - i];
+    data[length - 1 - i] = byte;
+  }
+}
+
+static void writeUint32(uint8_t* p, uint32_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = (value >> 16) & 0xFF;
+  p[3] = value >> 24;
+}
+
+static uint32_t readUint32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
 // Constructor
 NetworkSerial::NetworkSerial(NetworkCore& core) : _core(core) {
-  _serialDataCallback = NULL;
+  memset(_serialCallbacks, 0, sizeof(_serialCallbacks));
   _autoForwardingEnabled = false;
+  _forwardPort = &Serial;
   _serialBufferIndex = 0;
-  _lastSerialRead = 0;
+  _flushIdleUs = SERIAL_FLUSH_IDLE_US;
+  _flushSize = MAX_SERIAL_DATA_SIZE;
+  strcpy(_flushDelimiters, SERIAL_FLUSH_DELIMITERS);
+  _flushTimer = NULL;
+  _forwardMutex = NULL;
+
+  for (int i = 0; i < MAX_SERIAL_CHANNELS; i++) {
+    _channels[i].active = false;
+  }
+  _channelLock = portMUX_INITIALIZER_UNLOCKED;
+
+  _streamOpen = false;
+  _streamPeer[0] = '\0';
+  _streamBridge = NULL;
+  _streamLock = portMUX_INITIALIZER_UNLOCKED;
+  resetStream();
 }
 
 bool NetworkSerial::begin() {
-  // No specific initialization needed
+  // The UART event task and the idle timer both flush the forwarding buffer
+  if (_forwardMutex == NULL) {
+    _forwardMutex = xSemaphoreCreateMutex();
+    if (_forwardMutex == NULL) return false;
+  }
+
+  // One-shot timer that forwards buffered input once the line goes idle
+  if (_flushTimer == NULL) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onFlushTimer;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "serial_flush";
+
+    if (esp_timer_create(&timerArgs, &_flushTimer) != ESP_OK) {
+      Serial.println("[NetworkSerial] Failed to create flush timer");
+      _flushTimer = NULL;
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -30,66 +104,863 @@ bool NetworkSerial::forwardSerialData(const char* data) {
   return _core.broadcastMessage(MSG_TYPE_SERIAL_DATA, doc.as<JsonObject>());
 }
 
+bool NetworkSerial::forwardSerialData(const uint8_t* data, size_t length) {
+  if (!_core.isConnected()) return false;
+  if (!data && length > 0) return false;
+
+  return _core.broadcastBinaryMessage(MSG_TYPE_SERIAL_DATA, NULL, 0, data,
+                                      length);
+}
+
 bool NetworkSerial::receiveSerialData(SerialDataCallback callback) {
-  _serialDataCallback = callback;
-  return true;
+  if (callback == NULL) return stopReceivingSerialData();
+  return NetworkCore::addCallback(_serialCallbacks, MAX_SERIAL_DATA_CALLBACKS,
+                                  (void (*)())callback, NULL, CALLBACK_PLAIN);
+}
+
+bool NetworkSerial::receiveSerialData(BinarySerialDataCallback callback) {
+  if (callback == NULL) return stopReceivingSerialData();
+  return NetworkCore::addCallback(_serialCallbacks, MAX_SERIAL_DATA_CALLBACKS,
+                                  (void (*)())callback, NULL,
+                                  CALLBACK_PLAIN | CALLBACK_BINARY);
+}
+
+bool NetworkSerial::receiveSerialData(SerialDataContextCallback callback,
+                                      void* context) {
+  return NetworkCore::addCallback(_serialCallbacks, MAX_SERIAL_DATA_CALLBACKS,
+                                  (void (*)())callback, context,
+                                  CALLBACK_CONTEXT);
+}
+
+bool NetworkSerial::receiveSerialData(
+    BinarySerialDataContextCallback callback, void* context) {
+  return NetworkCore::addCallback(_serialCallbacks, MAX_SERIAL_DATA_CALLBACKS,
+                                  (void (*)())callback, context,
+                                  CALLBACK_CONTEXT | CALLBACK_BINARY);
 }
 
 bool NetworkSerial::stopReceivingSerialData() {
-  _serialDataCallback = NULL;
+  memset(_serialCallbacks, 0, sizeof(_serialCallbacks));
   return true;
 }
 
+bool NetworkSerial::stopReceivingSerialData(void* context) {
+  return NetworkCore::removeCallbacks(_serialCallbacks,
+                                      MAX_SERIAL_DATA_CALLBACKS, context);
+}
+
+bool NetworkSerial::removeSerialDataCallback(SerialDataCallback callback) {
+  return NetworkCore::removeCallback(_serialCallbacks,
+                                     MAX_SERIAL_DATA_CALLBACKS,
+                                     (void (*)())callback);
+}
+
+bool NetworkSerial::removeSerialDataCallback(
+    BinarySerialDataCallback callback) {
+  return NetworkCore::removeCallback(_serialCallbacks,
+                                     MAX_SERIAL_DATA_CALLBACKS,
+                                     (void (*)())callback);
+}
+
 bool NetworkSerial::handleSerialDataMessage(const char* sender,
                                             const char* data) {
   if (!sender || !data) return false;
 
-  // Call the callback if registered
-  if (_serialDataCallback) {
-    _serialDataCallback(sender, data);
-    return true;
+  // Call the callbacks if registered
+  size_t length = strlen(data);
+  bool handled = false;
+  for (int i = 0; i < MAX_SERIAL_DATA_CALLBACKS; i++) {
+    if (_serialCallbacks[i].kind == CALLBACK_NONE) continue;
+    callSerialCallback(_serialCallbacks[i], sender, data,
+                       (const uint8_t*)data, length, NULL);
+    handled = true;
   }
 
-  return false;
+  return handled;
+}
+
+bool NetworkSerial::handleBinarySerialData(const char* sender,
+                                           const uint8_t* data,
+                                           size_t length) {
+  if (!sender || !data) return false;
+
+  // Text callbacks need a terminated copy and stop at the first NUL byte
+  const char* text = NULL;
+  char copy[MAX_ESP_NOW_DATA_SIZE + 1];
+  bool handled = false;
+  for (int i = 0; i < MAX_SERIAL_DATA_CALLBACKS; i++) {
+    if (_serialCallbacks[i].kind == CALLBACK_NONE) continue;
+    callSerialCallback(_serialCallbacks[i], sender, text, data, length, copy);
+    handled = true;
+  }
+
+  return handled;
+}
+
+// Call one serial data callback. A NULL text is replaced by a terminated copy
+// of the data, which later callbacks for the same data reuse.
+void NetworkSerial::callSerialCallback(const CallbackSlot& callback,
+                                       const char* sender, const char*& text,
+                                       const uint8_t* data, size_t length,
+                                       char* copy) {
+  if (!(callback.kind & CALLBACK_BINARY) && text == NULL) {
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    text = copy;
+  }
+
+  switch (callback.kind) {
+    case CALLBACK_PLAIN:
+      ((SerialDataCallback)callback.function)(sender, text);
+      break;
+    case CALLBACK_CONTEXT:
+      ((SerialDataContextCallback)callback.function)(callback.context, sender,
+                                                     text);
+      break;
+    case CALLBACK_PLAIN | CALLBACK_BINARY:
+      ((BinarySerialDataCallback)callback.function)(sender, data, length);
+      break;
+    case CALLBACK_CONTEXT | CALLBACK_BINARY:
+      ((BinarySerialDataContextCallback)callback.function)(
+          callback.context, sender, data, length);
+      break;
+  }
 }
 
 bool NetworkSerial::enableAutoForwarding(bool enable) {
-  _autoForwardingEnabled = enable;
+  if (_forwardMutex == NULL || _forwardPort == NULL) return false;
 
-  // Reset buffer when enabling
-  if (enable) {
+  xSemaphoreTake(_forwardMutex, portMAX_DELAY);
+  if (enable && !_autoForwardingEnabled) {
     _serialBufferIndex = 0;
-    _lastSerialRead = millis();
+    _forwardPort->onReceive([this]() { ingestSerial(); });
+  } else if (!enable && _autoForwardingEnabled) {
+    _forwardPort->onReceive(NULL);
+    if (_flushTimer != NULL) esp_timer_stop(_flushTimer);
   }
+  _autoForwardingEnabled = enable;
+  xSemaphoreGive(_forwardMutex);
+
+  return true;
+}
+
+bool NetworkSerial::setAutoForwardingPort(HardwareSerial* port) {
+  if (port == NULL) return false;
+
+  // Move the receive event over to the new port
+  bool enabled = _autoForwardingEnabled;
+  if (enabled) enableAutoForwarding(false);
+  _forwardPort = port;
+  if (enabled) return enableAutoForwarding(true);
+
+  return true;
+}
+
+bool NetworkSerial::setAutoForwardingFlush(uint32_t idleGapUs,
+                                           size_t sizeThreshold,
+                                           const char* delimiters) {
+  if (sizeThreshold == 0 || sizeThreshold > MAX_SERIAL_DATA_SIZE) return false;
+  if (delimiters && strlen(delimiters) > MAX_SERIAL_DELIMITERS) return false;
+
+  if (_forwardMutex != NULL) xSemaphoreTake(_forwardMutex, portMAX_DELAY);
+  _flushIdleUs = idleGapUs;
+  _flushSize = sizeThreshold;
+  strcpy(_flushDelimiters, delimiters ? delimiters : "");
+  if (_serialBufferIndex >= _flushSize) flushSerialBuffer();
+  if (_forwardMutex != NULL) xSemaphoreGive(_forwardMutex);
 
   return true;
 }
 
+// Read everything the UART driver has buffered. Runs on the UART event task
+// whenever bytes arrive.
+void NetworkSerial::ingestSerial() {
+  xSemaphoreTake(_forwardMutex, portMAX_DELAY);
+
+  uint8_t chunk[64];
+  while (_autoForwardingEnabled) {
+    int available = _forwardPort->available();
+    if (available <= 0) break;
+
+    size_t count = _forwardPort->read(
+        chunk, available < (int)sizeof(chunk) ? available : sizeof(chunk));
+    if (count == 0) break;
+
+    for (size_t i = 0; i < count; i++) {
+      uint8_t c = chunk[i];
+      _serialBuffer[_serialBufferIndex++] = c;
+      if ((c != '\0' && strchr(_flushDelimiters, c) != NULL) ||
+          _serialBufferIndex >= _flushSize) {
+        flushSerialBuffer();
+      }
+    }
+  }
+
+  // Forward the rest once the line has been idle for the gap
+  if (_serialBufferIndex > 0) {
+    if (_flushIdleUs == 0 || _flushTimer == NULL) {
+      flushSerialBuffer();
+    } else {
+      esp_timer_stop(_flushTimer);
+      esp_timer_start_once(_flushTimer, _flushIdleUs);
+    }
+  }
+
+  xSemaphoreGive(_forwardMutex);
+}
+
+// Broadcast the buffered input. Called with the forwarding mutex held.
+void NetworkSerial::flushSerialBuffer() {
+  if (_serialBufferIndex == 0) return;
+
+  if (_core.isConnected()) {
+    forwardSerialData(_serialBuffer, _serialBufferIndex);
+  }
+  _serialBufferIndex = 0;
+}
+
+// Runs on the esp_timer task, which must not block: while the mutex is held,
+// e.g. by ingestSerial() waiting for the radio, try again shortly
+void NetworkSerial::onFlushTimer(void* arg) {
+  NetworkSerial* serial = static_cast<NetworkSerial*>(arg);
+
+  if (xSemaphoreTake(serial->_forwardMutex, 0) != pdTRUE) {
+    esp_timer_start_once(serial->_flushTimer, SERIAL_FLUSH_RETRY_US);
+    return;
+  }
+  serial->flushSerialBuffer();
+  xSemaphoreGive(serial->_forwardMutex);
+}
+
 void NetworkSerial::update() {
-  // Only process if auto-forwarding is enabled and we're connected
-  if (!_autoForwardingEnabled || !_core.isConnected()) return;
+  if (!_core.isConnected()) return;
 
-  uint32_t currentTime = millis();
+  // Auto-forwarding runs from the UART receive event, not from here
+  updateChannelBridges();
 
-  // Check for data on Serial
-  while (Serial.available() && _serialBufferIndex < MAX_SERIAL_DATA_SIZE - 1) {
-    char c = Serial.read();
-    _serialBuffer[_serialBufferIndex++] = c;
-    _lastSerialRead = currentTime;
-
-    // Send if newline or buffer nearly full
-    if (c == '\n' || c == '\r' ||
-        _serialBufferIndex >= MAX_SERIAL_DATA_SIZE - 2) {
-      _serialBuffer[_serialBufferIndex] = '\0';
-      forwardSerialData(_serialBuffer);
-      _serialBufferIndex = 0;
+  if (_streamOpen) {
+    updateStreamBridge();
+    checkStreamTimeout();
+    // A short segment waits until the frames in flight are acknowledged,
+    // so more bytes can join it meanwhile
+    pumpStream(_txSent == _txAcked);
+  }
+}
+
+// ==================== Virtual Serial Channels ====================
+
+bool NetworkSerial::openSerialChannel(uint8_t channel,
+                                      const char* const* targets,
+                                      uint8_t targetCount) {
+  if (channel == 0) return false;
+  if (targetCount > MAX_SERIAL_CHANNEL_TARGETS) return false;
+  if (targetCount > 0 && targets == NULL) return false;
+  for (uint8_t i = 0; i < targetCount; i++) {
+    if (!targets[i] || strlen(targets[i]) >= 32) return false;
+  }
+
+  // Reopening a channel replaces its targets and keeps its callback
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) {
+    for (int i = 0; i < MAX_SERIAL_CHANNELS && slot == NULL; i++) {
+      if (!_channels[i].active) slot = &_channels[i];
     }
+    if (slot == NULL) {
+      Serial.println("[NetworkSerial] Maximum serial channels reached");
+      return false;
+    }
+
+    portENTER_CRITICAL(&_channelLock);
+    memset(slot, 0, sizeof(SerialChannel));
+    slot->number = channel;
+    portEXIT_CRITICAL(&_channelLock);
   }
 
-  // Also send if we have data but haven't received anything for a while
-  if (_serialBufferIndex > 0 && (currentTime - _lastSerialRead > 500)) {
-    _serialBuffer[_serialBufferIndex] = '\0';
-    forwardSerialData(_serialBuffer);
-    _serialBufferIndex = 0;
+  portENTER_CRITICAL(&_channelLock);
+  for (uint8_t i = 0; i < targetCount; i++) {
+    strcpy(slot->targets[i], targets[i]);
+  }
+  slot->targetCount = targetCount;
+  slot->active = true;
+  portEXIT_CRITICAL(&_channelLock);
+
+  return true;
+}
+
+bool NetworkSerial::openSerialChannel(uint8_t channel, const char* target) {
+  return openSerialChannel(channel, target ? &target : NULL, target ? 1 : 0);
+}
+
+bool NetworkSerial::closeSerialChannel(uint8_t channel) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) return false;
+
+  portENTER_CRITICAL(&_channelLock);
+  slot->active = false;
+  portEXIT_CRITICAL(&_channelLock);
+  return true;
+}
+
+bool NetworkSerial::writeSerialChannel(uint8_t channel, const uint8_t* data,
+                                       size_t length) {
+  if (!_core.isConnected()) return false;
+  if (!data && length > 0) return false;
+
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) return false;
+
+  // Split into frames of at most MAX_SERIAL_DATA_SIZE bytes
+  bool sent = true;
+  size_t offset = 0;
+  do {
+    size_t chunk = length - offset < MAX_SERIAL_DATA_SIZE
+                       ? length - offset
+                       : MAX_SERIAL_DATA_SIZE;
+
+    if (slot->targetCount == 0) {
+      sent &= _core.broadcastBinaryMessage(MSG_TYPE_SERIAL_CHANNEL, &channel,
+                                           1, data + offset, chunk);
+    } else {
+      for (uint8_t i = 0; i < slot->targetCount; i++) {
+        sent &= _core.sendBinaryMessage(slot->targets[i],
+                                        MSG_TYPE_SERIAL_CHANNEL, &channel, 1,
+                                        data + offset, chunk);
+      }
+    }
+
+    slot->stats.bytesSent += chunk;
+    slot->stats.framesSent++;
+    offset += chunk;
+  } while (offset < length);
+
+  return sent;
+}
+
+size_t NetworkSerial::readSerialChannel(uint8_t channel, uint8_t* buffer,
+                                        size_t length) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL || !buffer) return 0;
+
+  portENTER_CRITICAL(&_channelLock);
+  if (length > slot->count) length = slot->count;
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = slot->buffer[slot->head];
+    slot->head = (slot->head + 1) % SERIAL_CHANNEL_BUFFER_SIZE;
+  }
+  slot->count -= length;
+  portEXIT_CRITICAL(&_channelLock);
+
+  return length;
+}
+
+int NetworkSerial::serialChannelAvailable(uint8_t channel) {
+  SerialChannel* slot = findSerialChannel(channel);
+  return slot != NULL ? slot->count : 0;
+}
+
+bool NetworkSerial::receiveSerialChannel(uint8_t channel,
+                                         BinarySerialDataCallback callback) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) return false;
+
+  portENTER_CRITICAL(&_channelLock);
+  slot->callback.function = (void (*)())callback;
+  slot->callback.context = NULL;
+  slot->callback.kind =
+      callback != NULL ? CALLBACK_PLAIN | CALLBACK_BINARY : CALLBACK_NONE;
+  portEXIT_CRITICAL(&_channelLock);
+  return true;
+}
+
+bool NetworkSerial::receiveSerialChannel(
+    uint8_t channel, BinarySerialDataContextCallback callback, void* context) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL || callback == NULL) return false;
+
+  portENTER_CRITICAL(&_channelLock);
+  slot->callback.function = (void (*)())callback;
+  slot->callback.context = context;
+  slot->callback.kind = CALLBACK_CONTEXT | CALLBACK_BINARY;
+  portEXIT_CRITICAL(&_channelLock);
+  return true;
+}
+
+bool NetworkSerial::bridgeSerialChannel(uint8_t channel,
+                                        HardwareSerial* port) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) return false;
+
+  slot->bridge = port;
+  return true;
+}
+
+bool NetworkSerial::getSerialChannelStats(uint8_t channel,
+                                          SerialChannelStats& stats) {
+  SerialChannel* slot = findSerialChannel(channel);
+  if (slot == NULL) return false;
+
+  portENTER_CRITICAL(&_channelLock);
+  stats = slot->stats;
+  portEXIT_CRITICAL(&_channelLock);
+  return true;
+}
+
+bool NetworkSerial::handleSerialChannelData(const char* sender,
+                                            const uint8_t* data,
+                                            size_t length) {
+  if (!sender || length < 1) return false;
+
+  SerialChannel* slot = findSerialChannel(data[0]);
+  if (slot == NULL) return false;
+
+  // A channel with targets only listens to them
+  bool accepted = slot->targetCount == 0;
+  for (uint8_t i = 0; i < slot->targetCount && !accepted; i++) {
+    accepted = strcmp(slot->targets[i], sender) == 0;
+  }
+  if (!accepted) return false;
+
+  const uint8_t* payload = data + 1;
+  size_t payloadLength = length - 1;
+
+  portENTER_CRITICAL(&_channelLock);
+  slot->stats.bytesReceived += payloadLength;
+  slot->stats.framesReceived++;
+  CallbackSlot callback = slot->callback;
+
+  // Without a callback the data waits in the channel buffer
+  if (callback.kind == CALLBACK_NONE) {
+    size_t space = SERIAL_CHANNEL_BUFFER_SIZE - slot->count;
+    size_t stored = payloadLength < space ? payloadLength : space;
+    for (size_t i = 0; i < stored; i++) {
+      slot->buffer[(slot->head + slot->count + i) %
+                   SERIAL_CHANNEL_BUFFER_SIZE] = payload[i];
+    }
+    slot->count += stored;
+    slot->stats.bytesDropped += payloadLength - stored;
+  }
+  portEXIT_CRITICAL(&_channelLock);
+
+  if (callback.kind != CALLBACK_NONE) {
+    const char* text = NULL;
+    callSerialCallback(callback, sender, text, payload, payloadLength, NULL);
+  }
+  return true;
+}
+
+NetworkSerial::SerialChannel* NetworkSerial::findSerialChannel(
+    uint8_t channel) {
+  for (int i = 0; i < MAX_SERIAL_CHANNELS; i++) {
+    if (_channels[i].active && _channels[i].number == channel) {
+      return &_channels[i];
+    }
+  }
+  return NULL;
+}
+
+// Move bytes between bridged UARTs and their channels without blocking
+void NetworkSerial::updateChannelBridges() {
+  uint8_t buffer[MAX_SERIAL_DATA_SIZE];
+
+  for (int i = 0; i < MAX_SERIAL_CHANNELS; i++) {
+    SerialChannel& channel = _channels[i];
+    if (!channel.active || channel.bridge == NULL) continue;
+
+    int available = channel.bridge->available();
+    if (available > 0) {
+      size_t count = channel.bridge->read(
+          buffer, available < (int)sizeof(buffer) ? available : sizeof(buffer));
+      if (count > 0) writeSerialChannel(channel.number, buffer, count);
+    }
+
+    int room = channel.bridge->availableForWrite();
+    if (room > (int)sizeof(buffer)) room = sizeof(buffer);
+    if (room > 0 && channel.count > 0) {
+      size_t count = readSerialChannel(channel.number, buffer, room);
+      channel.bridge->write(buffer, count);
+    }
+  }
+}
+
+// ==================== Reliable Stream ====================
+
+bool NetworkSerial::openSerialStream(const char* boardId) {
+  if (!_core.isConnected()) return false;
+  if (!boardId || strlen(boardId) >= sizeof(_streamPeer)) return false;
+  if (_core.isLocalBoard(boardId)) return false;
+
+  portENTER_CRITICAL(&_streamLock);
+  resetStream();
+  strcpy(_streamPeer, boardId);
+  _streamOpen = true;
+  portEXIT_CRITICAL(&_streamLock);
+
+  return true;
+}
+
+bool NetworkSerial::closeSerialStream() {
+  if (!_streamOpen) return false;
+
+  portENTER_CRITICAL(&_streamLock);
+  _streamOpen = false;
+  resetStream();
+  portEXIT_CRITICAL(&_streamLock);
+
+  return true;
+}
+
+bool NetworkSerial::isSerialStreamOpen() { return _streamOpen; }
+
+bool NetworkSerial::hasOpenChannels() {
+  if (_streamOpen) return true;
+  for (int i = 0; i < MAX_SERIAL_DATA_CALLBACKS; i++) {
+    if (_serialCallbacks[i].kind != CALLBACK_NONE) return true;
   }
-}
\ No newline at end of file
+  for (int i = 0; i < MAX_SERIAL_CHANNELS; i++) {
+    if (_channels[i].active) return true;
+  }
+  return false;
+}
+
+size_t NetworkSerial::writeSerialStream(const uint8_t* data, size_t length) {
+  if (!_streamOpen || !data) return 0;
+
+  portENTER_CRITICAL(&_streamLock);
+  size_t space = STREAM_TX_BUFFER_SIZE - (_txWritten - _txAcked);
+  if (length > space) length = space;
+  writeRing(_txBuffer, STREAM_TX_BUFFER_SIZE, _txWritten, data, length);
+  _txWritten += length;
+  portEXIT_CRITICAL(&_streamLock);
+
+  // Full segments go out straight away; a partial one waits for update()
+  // or flushSerialStream(), so small writes share a frame
+  if (length > 0) pumpStream(false);
+  return length;
+}
+
+size_t NetworkSerial::readSerialStream(uint8_t* buffer, size_t length) {
+  if (!_streamOpen || !buffer) return 0;
+
+  portENTER_CRITICAL(&_streamLock);
+  size_t available = _rxNext - _rxRead;
+  if (length > available) length = available;
+  readRing(_rxBuffer, STREAM_RX_BUFFER_SIZE, _rxRead, buffer, length);
+  _rxRead += length;
+
+  // Tell the peer once a useful amount of space has opened up, so a full
+  // window does not wait for the retransmit timer
+  uint8_t session = _rxSession;
+  uint32_t next = _rxNext;
+  uint32_t window = STREAM_RX_BUFFER_SIZE - (_rxNext - _rxRead);
+  bool update = _rxSynced && (int32_t)(next + window - _rxAdvertised) >=
+                                 STREAM_RX_BUFFER_SIZE / 4;
+  if (update) _rxAdvertised = next + window;
+  portEXIT_CRITICAL(&_streamLock);
+
+  if (update) sendStreamAck(session, next, window);
+  return length;
+}
+
+int NetworkSerial::peekSerialStream() {
+  if (!_streamOpen) return -1;
+
+  portENTER_CRITICAL(&_streamLock);
+  int value = -1;
+  if (_rxNext != _rxRead) {
+    value = _rxBuffer[_rxRead & (STREAM_RX_BUFFER_SIZE - 1)];
+  }
+  portEXIT_CRITICAL(&_streamLock);
+
+  return value;
+}
+
+bool NetworkSerial::flushSerialStream() {
+  if (!_streamOpen) return false;
+
+  checkStreamTimeout();
+  pumpStream(true);
+  return true;
+}
+
+int NetworkSerial::serialStreamAvailable() {
+  if (!_streamOpen) return 0;
+  return _rxNext - _rxRead;
+}
+
+int NetworkSerial::serialStreamWritable() {
+  if (!_streamOpen) return 0;
+  return STREAM_TX_BUFFER_SIZE - (_txWritten - _txAcked);
+}
+
+bool NetworkSerial::bridgeSerialStream(HardwareSerial* port) {
+  _streamBridge = port;
+  return true;
+}
+
+// Accept the next in-order segment and acknowledge what we hold. Segments
+// out of order are dropped; the sender resends from the first gap.
+bool NetworkSerial::handleStreamData(const char* sender, const uint8_t* data,
+                                     size_t length) {
+  if (!_streamOpen || !sender || length < STREAM_HEADER_SIZE) return false;
+  if (strcmp(sender, _streamPeer) != 0) return false;
+
+  uint8_t session = data[0];
+  uint32_t offset = readUint32(data + 1);
+  const uint8_t* payload = data + STREAM_HEADER_SIZE;
+  size_t payloadLength = length - STREAM_HEADER_SIZE;
+
+  portENTER_CRITICAL(&_streamLock);
+
+  // A new session means the peer (re)opened its stream; wait for its start.
+  // Data from the middle of a session we do not hold, e.g. after we reopened
+  // our side, would be resent forever, so ask the peer for a new session.
+  if (!_rxSynced || session != _rxSession) {
+    if (offset != 0) {
+      uint32_t window = STREAM_RX_BUFFER_SIZE;
+      if (_rxSynced) window -= _rxNext - _rxRead;
+      portEXIT_CRITICAL(&_streamLock);
+      sendStreamAck(session, 0, window, true);
+      return false;
+    }
+    _rxSession = session;
+    _rxSynced = true;
+    _rxNext = 0;
+    _rxRead = 0;
+  }
+
+  if (offset == _rxNext &&
+      payloadLength <= STREAM_RX_BUFFER_SIZE - (_rxNext - _rxRead)) {
+    writeRing(_rxBuffer, STREAM_RX_BUFFER_SIZE, _rxNext, payload,
+              payloadLength);
+    _rxNext += payloadLength;
+  }
+
+  uint32_t next = _rxNext;
+  uint32_t window = STREAM_RX_BUFFER_SIZE - (_rxNext - _rxRead);
+  _rxAdvertised = next + window;
+  portEXIT_CRITICAL(&_streamLock);
+
+  sendStreamAck(session, next, window);
+  return true;
+}
+
+// Advance the acknowledged offset and the credit. Repeated acks for the
+// same offset while data is in flight mean a segment was lost.
+bool NetworkSerial::handleStreamAck(const char* sender, const uint8_t* data,
+                                   size_t length) {
+  if (!_streamOpen || !sender || length < STREAM_ACK_SIZE) return false;
+  if (strcmp(sender, _streamPeer) != 0) return false;
+
+  uint32_t offset = readUint32(data + 1);
+  uint16_t window = data[5] | (data[6] << 8);
+
+  portENTER_CRITICAL(&_streamLock);
+  if (data[0] == _txSession && length > STREAM_ACK_SIZE &&
+      (data[STREAM_ACK_SIZE] & STREAM_ACK_RESET)) {
+    restartTxSession();
+    _txCredit = window;
+    portEXIT_CRITICAL(&_streamLock);
+    return true;
+  }
+
+  if (data[0] != _txSession || (int32_t)(offset - _txAcked) < 0 ||
+      (int32_t)(_txWritten - offset) < 0) {
+    portEXIT_CRITICAL(&_streamLock);
+    return false;  // Another session, or a stale acknowledgement
+  }
+
+  if (offset != _txAcked) {
+    // Data sent before a resend may be acknowledged past _txSent
+    if ((int32_t)(offset - _txSent) > 0) _txSent = offset;
+    _txAcked = offset;
+    _txLastProgress = millis();
+    _txTimeout = STREAM_RETRANSMIT_MIN;
+    _txDuplicateAcks = 0;
+    _txRecovering = false;
+  } else if (_txSent != _txAcked && !_txRecovering &&
+             ++_txDuplicateAcks >= STREAM_DUPLICATE_ACKS) {
+    _txSent = _txAcked;  // Go back to the first missing byte
+    _txDuplicateAcks = 0;
+    _txRecovering = true;
+  }
+  _txCredit = offset + window;
+  bool idle = _txSent == _txAcked;
+  portEXIT_CRITICAL(&_streamLock);
+
+  // Send into the window this ack opened rather than waiting for update()
+  pumpStream(idle);
+  return true;
+}
+
+// Clear both directions and start a new transmit session. Called with the
+// stream lock held or before the stream is used.
+void NetworkSerial::resetStream() {
+  _txSession = random(1, 256);
+  _txAcked = 0;
+  _txSent = 0;
+  _txWritten = 0;
+  _txCredit = STREAM_RX_BUFFER_SIZE;  // Assume the peer's default window
+  _txLastProgress = millis();
+  _txTimeout = STREAM_RETRANSMIT_MIN;
+  _txDuplicateAcks = 0;
+  _txRecovering = false;
+
+  _rxSession = 0;
+  _rxSynced = false;
+  _rxNext = 0;
+  _rxRead = 0;
+  _rxAdvertised = 0;
+}
+
+// Start a new transmit session after the peer lost its receive state. The
+// bytes it has not acknowledged become the start of the new session, so the
+// ring is rotated to put the first of them at offset 0. Called with the
+// stream lock held.
+void NetworkSerial::restartTxSession() {
+  size_t shift = _txAcked & (STREAM_TX_BUFFER_SIZE - 1);
+  reverseBytes(_txBuffer, shift);
+  reverseBytes(_txBuffer + shift, STREAM_TX_BUFFER_SIZE - shift);
+  reverseBytes(_txBuffer, STREAM_TX_BUFFER_SIZE);
+
+  uint8_t oldSession = _txSession;
+  do {
+    _txSession = random(1, 256);
+  } while (_txSession == oldSession);
+
+  _txWritten -= _txAcked;
+  _txAcked = 0;
+  _txSent = 0;
+  _txLastProgress = millis();
+  _txTimeout = STREAM_RETRANSMIT_MIN;
+  _txDuplicateAcks = 0;
+  _txRecovering = false;
+}
+
+// Send queued bytes the peer has room for, one segment per frame. Without
+// partial, a trailing segment shorter than a frame is held back. Runs from
+// both the loop and the receive callback, so each segment is claimed under
+// the lock before it is sent.
+void NetworkSerial::pumpStream(bool partial) {
+  if (!_core.canSendTo(_streamPeer)) return;
+
+  size_t segment = streamSegmentSize();
+  uint8_t payload[MAX_ESP_NOW_DATA_SIZE];
+
+  for (int i = 0; i < STREAM_SEGMENTS_PER_UPDATE; i++) {
+    portENTER_CRITICAL(&_streamLock);
+    uint32_t end = _txWritten;
+    if ((int32_t)(_txCredit - end) < 0) end = _txCredit;
+    uint32_t offset = _txSent;
+    size_t length = 0;
+    if ((int32_t)(end - offset) > 0) {
+      length = end - offset < segment ? end - offset : segment;
+    }
+    if (length == 0 || (length < segment && !partial)) {
+      portEXIT_CRITICAL(&_streamLock);
+      break;
+    }
+    readRing(_txBuffer, STREAM_TX_BUFFER_SIZE, offset, payload, length);
+    if (_txSent == _txAcked) _txLastProgress = millis();  // Timer starts
+    _txSent = offset + length;
+    portEXIT_CRITICAL(&_streamLock);
+
+    // A full radio queue is retried on the next update()
+    if (!sendStreamData(offset, payload, length)) {
+      portENTER_CRITICAL(&_streamLock);
+      if (_txSent == offset + length) _txSent = offset;
+      portEXIT_CRITICAL(&_streamLock);
+      break;
+    }
+  }
+}
+
+// Resend from the first unacknowledged byte when the peer has gone quiet,
+// doubling the timeout each time. With a closed window, probe it instead.
+void NetworkSerial::checkStreamTimeout() {
+  uint32_t currentTime = millis();
+
+  portENTER_CRITICAL(&_streamLock);
+  bool inFlight = _txSent != _txAcked;
+  bool blocked = !inFlight && _txWritten != _txSent &&
+                 (int32_t)(_txCredit - _txSent) <= 0;
+  bool expired = (inFlight || blocked) &&
+                 currentTime - _txLastProgress >= _txTimeout;
+  uint32_t offset = _txAcked;
+  if (expired) {
+    _txSent = _txAcked;
+    _txLastProgress = currentTime;
+    _txTimeout = _txTimeout * 2 < STREAM_RETRANSMIT_MAX
+                     ? _txTimeout * 2
+                     : STREAM_RETRANSMIT_MAX;
+    _txDuplicateAcks = 0;
+    _txRecovering = true;
+  }
+  portEXIT_CRITICAL(&_streamLock);
+
+  // An empty segment makes the peer report its window
+  if (expired && blocked) sendStreamData(offset, NULL, 0);
+}
+
+// Move bytes between the bridged UART and the stream without blocking
+void NetworkSerial::updateStreamBridge() {
+  if (_streamBridge == NULL) return;
+
+  uint8_t buffer[256];
+
+  // UART to stream, as much as the transmit buffer takes
+  int available = _streamBridge->available();
+  int writable = serialStreamWritable();
+  size_t count = available < writable ? available : writable;
+  if (count > sizeof(buffer)) count = sizeof(buffer);
+  if (count > 0) {
+    count = _streamBridge->read(buffer, count);
+    writeSerialStream(buffer, count);
+  }
+
+  // Stream to UART, as much as the UART transmit buffer takes
+  int room = _streamBridge->availableForWrite();
+  count = room < serialStreamAvailable() ? room : serialStreamAvailable();
+  if (count > sizeof(buffer)) count = sizeof(buffer);
+  if (count > 0) {
+    count = readSerialStream(buffer, count);
+    _streamBridge->write(buffer, count);
+  }
+}
+
+// Largest payload that fits one frame, with the mesh header when the peer
+// is reached through relays
+size_t NetworkSerial::streamSegmentSize() {
+  size_t overhead = BINARY_FRAME_HEADER_SIZE + strlen(_core._boardId) +
+                    STREAM_HEADER_SIZE;
+  uint8_t mac[6];
+  if (!_core.getMacForBoardId(_streamPeer, mac)) {
+    overhead +=
+        MESH_FRAME_HEADER_SIZE + strlen(_core._boardId) + strlen(_streamPeer);
+  }
+  return MAX_ESP_NOW_DATA_SIZE - overhead;
+}
+
+bool NetworkSerial::sendStreamAck(uint8_t session, uint32_t offset,
+                                  uint32_t window, bool reset) {
+  if (window > 0xFFFF) window = 0xFFFF;
+
+  // Acks are STREAM_ACK_SIZE bytes, plus an optional flags byte that is
+  // appended only to ask the sender to restart the session
+  uint8_t ack[STREAM_ACK_SIZE + 1];
+  ack[0] = session;
+  writeUint32(ack + 1, offset);
+  ack[5] = window & 0xFF;
+  ack[6] = window >> 8;
+  ack[STREAM_ACK_SIZE] = STREAM_ACK_RESET;
+  return _core.sendBinaryMessage(_streamPeer, MSG_TYPE_STREAM_ACK, NULL, 0, ack,
+                                 reset ? sizeof(ack) : STREAM_ACK_SIZE);
+}
+
+bool NetworkSerial::sendStreamData(uint32_t offset, const uint8_t* data,
+                                   size_t length) {
+  uint8_t header[STREAM_HEADER_SIZE];
+  header[0] = _txSession;
+  writeUint32(header + 1, offset);
+  return _core.sendBinaryMessage(_streamPeer, MSG_TYPE_STREAM_DATA, header,
+                                 sizeof(header), data, length);
+}
@@ -0,0 +1,52 @@
+/**
+ * NetworkStream.cpp - Arduino Stream over a reliable serial stream
+ * Created as part of the NetworkComm library refactoring
+ */
+
+#include "NetworkStream.h"
+
+// Constructor
+NetworkStream::NetworkStream(NetworkSerial& serial) : _serial(serial) {}
+
+bool NetworkStream::begin(const char* boardId) {
+  return _serial.openSerialStream(boardId);
+}
+
+void NetworkStream::end() { _serial.closeSerialStream(); }
+
+NetworkStream::operator bool() { return _serial.isSerialStreamOpen(); }
+
+int NetworkStream::available() { return _serial.serialStreamAvailable(); }
+
+int NetworkStream::read() {
+  uint8_t value;
+  if (_serial.readSerialStream(&value, 1) == 0) return -1;
+  return value;
+}
+
+int NetworkStream::peek() { return _serial.peekSerialStream(); }
+
+size_t NetworkStream::write(uint8_t value) { return write(&value, 1); }
+
+size_t NetworkStream::write(const uint8_t* buffer, size_t size) {
+  if (!_serial.isSerialStreamOpen() || !buffer) return 0;
+
+  size_t written = _serial.writeSerialStream(buffer, size);
+  if (written == size) return written;
+
+  // The buffer is full: push what is queued and wait for the peer to
+  // acknowledge it, as a UART write waits for its transmit buffer
+  uint32_t start = millis();
+  while (written < size && millis() - start < _timeout) {
+    if (!_serial.flushSerialStream()) break;  // Closed meanwhile
+    delay(1);
+    written += _serial.writeSerialStream(buffer + written, size - written);
+  }
+  return written;
+}
+
+int NetworkStream::availableForWrite() {
+  return _serial.serialStreamWritable();
+}
+
+void NetworkStream::flush() { _serial.flushSerialStream(); }
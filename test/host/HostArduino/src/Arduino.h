@@ -0,0 +1,313 @@
+/**
+ * Arduino.h - Arduino-ESP32 core shim for host builds
+ *
+ * Just enough of the Arduino core, and of the FreeRTOS calls the library
+ * makes, to build and run NetworkComm on Linux. Time comes from the
+ * simulated clock in HostHooks.h, or from the wall clock when no simulator
+ * drives it.
+ */
+
+#ifndef HostArduino_Arduino_h
+#define HostArduino_Arduino_h
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#define IRAM_ATTR
+#define PROGMEM
+#define PGM_P const char*
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_byte_near(address) pgm_read_byte(address)
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+#define NUM_DIGITAL_PINS 40
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+#define DEC 10
+#define HEX 16
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// As in the ESP32 core, min() and max() are the standard templates
+using std::max;
+using std::min;
+#define constrain(x, low, high) \
+  ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+class String {
+ public:
+  String() {}
+  String(const char* text) { if (text) _text = text; }
+  String(const String& other) = default;
+  explicit String(char c) : _text(1, c) {}
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(double value, unsigned int decimals = 2);
+
+  String& operator=(const String& other) = default;
+  String& operator=(const char* text) {
+    _text = text ? text : "";
+    return *this;
+  }
+
+  const char* c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+  bool isEmpty() const { return _text.empty(); }
+  bool reserve(unsigned int size) {
+    _text.reserve(size);
+    return true;
+  }
+
+  bool concat(const String& other) { return concat(other.c_str()); }
+  bool concat(const char* text) {
+    if (!text) return false;
+    _text += text;
+    return true;
+  }
+  bool concat(const char* text, unsigned int length) {
+    if (!text) return false;
+    _text.append(text, length);
+    return true;
+  }
+  bool concat(char c) {
+    _text += c;
+    return true;
+  }
+  String& operator+=(const String& other) {
+    concat(other);
+    return *this;
+  }
+  String& operator+=(const char* text) {
+    concat(text);
+    return *this;
+  }
+  String& operator+=(char c) {
+    concat(c);
+    return *this;
+  }
+
+  bool equals(const String& other) const { return _text == other._text; }
+  bool equals(const char* text) const { return _text == (text ? text : ""); }
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* text) const { return equals(text); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* text) const { return !equals(text); }
+  bool operator<(const String& other) const { return _text < other._text; }
+
+  char charAt(unsigned int index) const {
+    return index < _text.size() ? _text[index] : 0;
+  }
+  char operator[](unsigned int index) const { return charAt(index); }
+  bool startsWith(const String& prefix) const {
+    return _text.compare(0, prefix._text.size(), prefix._text) == 0;
+  }
+  bool endsWith(const String& suffix) const {
+    return _text.size() >= suffix._text.size() &&
+           _text.compare(_text.size() - suffix._text.size(),
+                         suffix._text.size(), suffix._text) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t found = _text.find(c, from);
+    return found == std::string::npos ? -1 : (int)found;
+  }
+  int indexOf(const String& text, unsigned int from = 0) const {
+    size_t found = _text.find(text._text, from);
+    return found == std::string::npos ? -1 : (int)found;
+  }
+  String substring(unsigned int from) const {
+    return from < _text.size() ? String(_text.substr(from).c_str()) : String();
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to || from >= _text.size()) return String();
+    return String(_text.substr(from, to - from).c_str());
+  }
+  long toInt() const { return strtol(_text.c_str(), NULL, 10); }
+  float toFloat() const { return strtof(_text.c_str(), NULL); }
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+
+ private:
+  std::string _text;
+};
+
+String operator+(const String& left, const String& right);
+String operator+(const String& left, const char* right);
+String operator+(const char* left, const String& right);
+
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& out) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* text) {
+    return text ? write((const uint8_t*)text, strlen(text)) : 0;
+  }
+  size_t write(const char* buffer, size_t size) {
+    return write((const uint8_t*)buffer, size);
+  }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char* text) { return write(text); }
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = DEC);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(long long value, int base = DEC);
+  size_t print(unsigned long long value, int base = DEC);
+  size_t print(double value, int decimals = 2);
+  size_t print(const Printable& printable) { return printable.printTo(*this); }
+
+  template <typename T>
+  size_t println(const T& value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T& value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char* format, ...);
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length) {
+    return readBytes((char*)buffer, length);
+  }
+
+ protected:
+  unsigned long _timeout = 1000;
+};
+
+#define SERIAL_8N1 0x800001c
+
+/**
+ * A UART. Bytes written to it go to stdout for Serial when HOST_VERBOSE is
+ * set, and are kept for the test otherwise; bytes the test feeds it with
+ * HostHooks are read back by the sketch.
+ */
+class HardwareSerial : public Stream {
+ public:
+  typedef std::function<void(void)> OnReceiveCb;
+
+  explicit HardwareSerial(int uartNumber);
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1,
+             int8_t rxPin = -1, int8_t txPin = -1) {}
+  void end() {}
+  void onReceive(OnReceiveCb function, bool onlyOnTimeout = false) {
+    _onReceive = function;
+  }
+  bool setRxTimeout(uint8_t symbols) { return true; }
+  size_t setRxBufferSize(size_t size) { return size; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override;
+  operator bool() const { return true; }
+
+  // Host side, see HostHooks.h
+  void hostFeed(const uint8_t* data, size_t length);
+  std::string hostTake();
+  void hostSetWriteRoom(int room) { _writeRoom = room; }
+
+ private:
+  int _uart;
+  std::string _rx;
+  std::string _tx;
+  int _writeRoom;
+  OnReceiveCb _onReceive;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+// FreeRTOS. Every node runs single-threaded, so locks have nothing to do.
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+#define portENTER_CRITICAL_ISR(mux) (void)(mux)
+#define portEXIT_CRITICAL_ISR(mux) (void)(mux)
+
+typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,508 @@
+/**
+ * HostArduino.cpp - Arduino core, FreeRTOS, timer and storage shims
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "HostHooks.h"
+
+namespace {
+
+bool simulatedClock = false;
+uint64_t simulatedMicros = 0;
+const std::chrono::steady_clock::time_point bootTime =
+    std::chrono::steady_clock::now();
+
+uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+
+std::string logLabel;
+bool logLineStart = true;
+
+uint8_t pinModes[NUM_DIGITAL_PINS];
+uint8_t pinOutputs[NUM_DIGITAL_PINS];
+uint8_t pinInputs[NUM_DIGITAL_PINS];
+
+std::map<std::string, std::vector<uint8_t>>& preferenceStore() {
+  static std::map<std::string, std::vector<uint8_t>> store;
+  return store;
+}
+
+bool verbose() {
+  static int enabled = -1;
+  if (enabled < 0) enabled = getenv("HOST_VERBOSE") != NULL;
+  return enabled;
+}
+
+uint64_t nextRandom() {
+  // xorshift64*
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 0x2545F4914F6CDD1DULL;
+}
+
+std::string formatNumber(unsigned long long value, int base) {
+  if (base < 2 || base > 16) base = 10;
+  char digits[65];
+  int length = 0;
+  do {
+    digits[length++] = "0123456789ABCDEF"[value % base];
+    value /= base;
+  } while (value);
+  std::string text;
+  while (length) text += digits[--length];
+  return text;
+}
+
+}  // namespace
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  bool active;
+  uint64_t due;
+  uint64_t period;  // 0 for a one-shot timer
+};
+
+namespace {
+
+std::vector<esp_timer*>& timers() {
+  static std::vector<esp_timer*> list;
+  return list;
+}
+
+}  // namespace
+
+// ---- String
+
+String::String(int value, unsigned char base)
+    : _text(value < 0 && base == 10
+                ? "-" + formatNumber(-(long long)value, base)
+                : formatNumber((unsigned int)value, base)) {}
+String::String(unsigned int value, unsigned char base)
+    : _text(formatNumber(value, base)) {}
+String::String(long value, unsigned char base)
+    : _text(value < 0 && base == 10
+                ? "-" + formatNumber(-(long long)value, base)
+                : formatNumber((unsigned long)value, base)) {}
+String::String(unsigned long value, unsigned char base)
+    : _text(formatNumber(value, base)) {}
+String::String(double value, unsigned int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+  _text = buffer;
+}
+
+void String::trim() {
+  size_t first = _text.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    _text.clear();
+    return;
+  }
+  size_t last = _text.find_last_not_of(" \t\r\n");
+  _text = _text.substr(first, last - first + 1);
+}
+
+void String::toLowerCase() {
+  for (char& c : _text) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char& c : _text) c = toupper((unsigned char)c);
+}
+
+String operator+(const String& left, const String& right) {
+  String result(left);
+  result += right;
+  return result;
+}
+
+String operator+(const String& left, const char* right) {
+  String result(left);
+  result += right;
+  return result;
+}
+
+String operator+(const char* left, const String& right) {
+  String result(left);
+  result += right;
+  return result;
+}
+
+// ---- Print and Stream
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (size--) written += write(*buffer++);
+  return written;
+}
+
+size_t Print::print(unsigned char value, int base) {
+  return print((unsigned long long)value, base);
+}
+size_t Print::print(int value, int base) {
+  return print((long long)value, base);
+}
+size_t Print::print(unsigned int value, int base) {
+  return print((unsigned long long)value, base);
+}
+size_t Print::print(long value, int base) {
+  return print((long long)value, base);
+}
+size_t Print::print(unsigned long value, int base) {
+  return print((unsigned long long)value, base);
+}
+size_t Print::print(long long value, int base) {
+  if (value < 0 && base == 10) {
+    return write("-") + print((unsigned long long)-value, base);
+  }
+  return print((unsigned long long)value, base);
+}
+size_t Print::print(unsigned long long value, int base) {
+  return write(formatNumber(value, base).c_str());
+}
+size_t Print::print(double value, int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  return write(buffer);
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0) return 0;
+  return write(buffer);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0) break;
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+// ---- HardwareSerial
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+
+HardwareSerial::HardwareSerial(int uartNumber)
+    : _uart(uartNumber), _writeRoom(128) {}
+
+int HardwareSerial::available() { return (int)_rx.size(); }
+
+int HardwareSerial::read() {
+  if (_rx.empty()) return -1;
+  uint8_t c = _rx[0];
+  _rx.erase(0, 1);
+  return c;
+}
+
+int HardwareSerial::peek() { return _rx.empty() ? -1 : (uint8_t)_rx[0]; }
+
+size_t HardwareSerial::read(uint8_t* buffer, size_t size) {
+  size_t count = size < _rx.size() ? size : _rx.size();
+  memcpy(buffer, _rx.data(), count);
+  _rx.erase(0, count);
+  return count;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (_uart != 0) {
+    _tx.append((const char*)buffer, size);
+    return size;
+  }
+  if (!verbose()) return size;
+  for (size_t i = 0; i < size; i++) {
+    if (logLineStart && !logLabel.empty()) {
+      fputs(logLabel.c_str(), stdout);
+      fputs(": ", stdout);
+    }
+    logLineStart = buffer[i] == '\n';
+    if (buffer[i] != '\r') fputc(buffer[i], stdout);
+  }
+  return size;
+}
+
+int HardwareSerial::availableForWrite() { return _writeRoom; }
+
+void HardwareSerial::hostFeed(const uint8_t* data, size_t length) {
+  _rx.append((const char*)data, length);
+  if (_onReceive) _onReceive();
+}
+
+std::string HardwareSerial::hostTake() {
+  std::string taken;
+  taken.swap(_tx);
+  return taken;
+}
+
+// ---- Time
+
+unsigned long millis() { return (uint32_t)(host::now() / 1000); }
+
+unsigned long micros() { return (uint32_t)host::now(); }
+
+void delay(unsigned long ms) {
+  if (simulatedClock) {
+    simulatedMicros += (uint64_t)ms * 1000;
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (simulatedClock) simulatedMicros += us;
+}
+
+void yield() {}
+
+// ---- Random numbers
+
+uint32_t esp_random() { return (uint32_t)(nextRandom() >> 32); }
+
+long random(long howBig) {
+  if (howBig <= 0) return 0;
+  return esp_random() % howBig;
+}
+
+long random(long howSmall, long howBig) {
+  if (howSmall >= howBig) return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) randomState = seed * 0x9E3779B97F4A7C15ULL | 1;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// ---- Pins
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS) pinModes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) pinOutputs[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return LOW;
+  return pinModes[pin] == OUTPUT ? pinOutputs[pin] : pinInputs[pin];
+}
+
+int analogRead(uint8_t pin) { return digitalRead(pin) ? 4095 : 0; }
+
+void analogWrite(uint8_t pin, int value) { digitalWrite(pin, value > 0); }
+
+// ---- FreeRTOS
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new int(0); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+  return semaphore ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  return semaphore ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete static_cast<int*>(semaphore);
+}
+
+// ---- esp_timer
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args,
+                           esp_timer_handle_t* handle) {
+  if (!args || !args->callback || !handle) return ESP_ERR_INVALID_ARG;
+  esp_timer* timer = new esp_timer{args->callback, args->arg, false, 0, 0};
+  timers().push_back(timer);
+  *handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  timer->active = true;
+  timer->due = host::now() + timeoutUs;
+  timer->period = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer,
+                                   uint64_t periodUs) {
+  if (!timer || periodUs == 0) return ESP_ERR_INVALID_ARG;
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  timer->active = true;
+  timer->due = host::now() + periodUs;
+  timer->period = periodUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  if (!timer->active) return ESP_ERR_INVALID_STATE;
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  std::vector<esp_timer*>& list = timers();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i] == timer) {
+      list.erase(list.begin() + i);
+      break;
+    }
+  }
+  delete timer;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time() { return (int64_t)host::now(); }
+
+// ---- Preferences
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  if (!name || strlen(name) > 15) return false;
+  _namespace = name;
+  _open = true;
+  _readOnly = readOnly;
+  return true;
+}
+
+bool Preferences::clear() {
+  if (!_open || _readOnly) return false;
+  std::map<std::string, std::vector<uint8_t>>& store = preferenceStore();
+  std::string prefix = _namespace + '\0';
+  for (auto it = store.begin(); it != store.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = store.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!_open || _readOnly || !key) return false;
+  return preferenceStore().erase(_namespace + '\0' + key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!_open || !key) return false;
+  return preferenceStore().count(_namespace + '\0' + key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value,
+                             size_t length) {
+  if (!_open || _readOnly || !key || strlen(key) > 15 || !value) return 0;
+  std::vector<uint8_t>& entry = preferenceStore()[_namespace + '\0' + key];
+  entry.assign((const uint8_t*)value, (const uint8_t*)value + length);
+  return length;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!_open || !key) return 0;
+  auto it = preferenceStore().find(_namespace + '\0' + key);
+  return it == preferenceStore().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer,
+                             size_t maxLength) {
+  size_t length = getBytesLength(key);
+  if (length == 0 || !buffer || length > maxLength) return 0;
+  memcpy(buffer, preferenceStore()[_namespace + '\0' + key].data(), length);
+  return length;
+}
+
+// ---- Buses
+
+TwoWire Wire(0);
+SPIClass SPI(0);
+
+// ---- Host controls
+
+namespace host {
+
+void useSimulatedClock(bool enable) { simulatedClock = enable; }
+
+void setTime(uint64_t micros) {
+  // delay() may have moved a node ahead of the simulator
+  if (micros > simulatedMicros) simulatedMicros = micros;
+}
+
+uint64_t now() {
+  if (simulatedClock) return simulatedMicros;
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+void setLogLabel(const char* label) { logLabel = label ? label : ""; }
+
+void runTimers() {
+  // A callback may start, stop or delete timers, so look again after each
+  for (int fired = 0; fired < 1000; fired++) {
+    esp_timer* next = NULL;
+    uint64_t currentTime = now();
+    for (esp_timer* timer : timers()) {
+      if (timer->active && timer->due <= currentTime &&
+          (next == NULL || timer->due < next->due)) {
+        next = timer;
+      }
+    }
+    if (next == NULL) return;
+    if (next->period) {
+      next->due += next->period;
+    } else {
+      next->active = false;
+    }
+    next->callback(next->arg);
+  }
+}
+
+void setPinInput(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) pinInputs[pin] = value ? HIGH : LOW;
+}
+
+uint8_t pinOutput(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? pinOutputs[pin] : LOW;
+}
+
+uint8_t pinModeOf(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? pinModes[pin] : 0;
+}
+
+void clearPreferences() { preferenceStore().clear(); }
+
+void seedRandom(const uint8_t* mac) {
+  uint64_t seed = 0;
+  for (int i = 0; i < 6; i++) seed = seed << 8 | mac[i];
+  randomSeed((unsigned long)(seed ^ 0xA5A5A5A5A5ULL));
+}
+
+}  // namespace host
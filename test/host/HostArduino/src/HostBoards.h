@@ -0,0 +1,128 @@
+/**
+ * HostBoards.h - NetworkComm boards on a HostNetwork, for host tests
+ *
+ * The fixture the network tests share. run() forks the boards, gives each
+ * board process its own NetworkComm, named "board<node>" and started ESP-NOW
+ * only on channel 1 unless the test starts it itself, and calls update()
+ * before the test's loop function. The results the boards report live in
+ * memory shared with the test process:
+ *
+ *   struct Results { bool found; };
+ *   static HostBoards<Results> boards;
+ *
+ *   static void loopBoard(int node) {
+ *     if (node == 1 && boards.comm->isBoardAvailable("board0")) {
+ *       boards.results->found = true;
+ *     }
+ *   }
+ *
+ *   HostNetwork network(2);
+ *   TEST_ASSERT_TRUE(boards.run(network, NULL, loopBoard, 5000));
+ *   TEST_ASSERT_TRUE(boards.results->found);
+ *
+ * Only one HostBoards runs at a time. Its results stay readable after
+ * run() returns, until the network is destroyed.
+ */
+
+#ifndef HostArduino_HostBoards_h
+#define HostArduino_HostBoards_h
+
+#include <HostNetwork.h>
+
+#include "NetworkComm.h"
+
+template <typename Results>
+class HostBoards {
+ public:
+  typedef void (*BoardFunction)(int node);
+
+  /**
+   * Starts a board in place of beginEspNowOnly(boardId, 1), through comm
+   *
+   * @param node The board
+   * @param boardId Its name, "board<node>"
+   */
+  typedef void (*StartFunction)(int node, const char* boardId);
+
+  // Shared by the boards and the test, zeroed by run()
+  Results* results = NULL;
+
+  // The board's own NetworkComm and number, in each board process
+  NetworkComm* comm = NULL;
+  int self = -1;
+
+  /**
+   * Name of a board: "board<node>"
+   */
+  static void boardName(int node, char* name, size_t size) {
+    snprintf(name, size, "board%d", node);
+  }
+
+  /**
+   * Run the boards, each started ESP-NOW only on channel 1
+   *
+   * @param network The boards' network, set up by the test
+   * @param setup Called once the board has started, or NULL
+   * @param loop Called every tick after comm->update(), or NULL
+   * @param durationMs Simulated time to run for
+   * @param tickUs Length of a tick
+   * @return true if every board ran to the end
+   */
+  bool run(HostNetwork& network, BoardFunction setup, BoardFunction loop,
+           uint32_t durationMs, uint32_t tickUs = 1000) {
+    return runBoards(network, NULL, setup, loop, durationMs, tickUs);
+  }
+
+  /**
+   * Run the boards, each started by start()
+   */
+  bool run(HostNetwork& network, StartFunction start, BoardFunction setup,
+           BoardFunction loop, uint32_t durationMs, uint32_t tickUs = 1000) {
+    return runBoards(network, start, setup, loop, durationMs, tickUs);
+  }
+
+ private:
+  bool runBoards(HostNetwork& network, StartFunction start,
+                 BoardFunction setup, BoardFunction loop, uint32_t durationMs,
+                 uint32_t tickUs) {
+    results = (Results*)network.sharedMemory(sizeof(Results));
+    _start = start;
+    _setup = setup;
+    _loop = loop;
+    _running = this;
+    bool ran = network.run(setupNode, loopNode, durationMs, tickUs);
+    _running = NULL;
+    return ran;
+  }
+
+  static void setupNode(int node) {
+    HostBoards& boards = *_running;
+    char boardId[16];
+    boardName(node, boardId, sizeof(boardId));
+    boards.self = node;
+    boards.comm = new NetworkComm();
+    if (boards._start != NULL) {
+      boards._start(node, boardId);
+    } else {
+      boards.comm->beginEspNowOnly(boardId, 1);
+    }
+    if (boards._setup != NULL) boards._setup(node);
+  }
+
+  static void loopNode(int node) {
+    HostBoards& boards = *_running;
+    boards.comm->update();
+    if (boards._loop != NULL) boards._loop(node);
+  }
+
+  static HostBoards* _running;
+
+  StartFunction _start = NULL;
+  BoardFunction _setup = NULL;
+  BoardFunction _loop = NULL;
+};
+
+template <typename Results>
+HostBoards<Results>* HostBoards<Results>::_running = NULL;
+
+#endif
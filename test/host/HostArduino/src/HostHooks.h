@@ -0,0 +1,99 @@
+/**
+ * HostHooks.h - Test-side controls of the host shim
+ *
+ * What a test, or the HostNetwork simulator, uses to drive one board: its
+ * clock, its radio, its access point, its timers and its pins.
+ */
+
+#ifndef HostArduino_HostHooks_h
+#define HostArduino_HostHooks_h
+
+#include <Arduino.h>
+#include <esp_wifi.h>
+
+#include <vector>
+
+namespace host {
+
+// A frame handed to esp_now_send
+struct SentFrame {
+  uint8_t mac[6];
+  std::vector<uint8_t> data;
+};
+
+/**
+ * Drive millis() and micros() from setTime() instead of the wall clock.
+ * delay() then moves the simulated clock forward rather than sleeping.
+ */
+void useSimulatedClock(bool enable);
+void setTime(uint64_t micros);
+uint64_t now();
+
+/**
+ * Set the label put in front of each line written to Serial. Serial output
+ * is only printed when the HOST_VERBOSE environment variable is set.
+ */
+void setLogLabel(const char* label);
+
+/**
+ * Set the station MAC address, and seed random() and esp_random() from it
+ * so every board draws different numbers
+ */
+void setMacAddress(const uint8_t* mac);
+void seedRandom(const uint8_t* mac);
+
+/**
+ * Configure the access point WiFi.begin() joins
+ *
+ * @param available Whether the access point is in range
+ * @param channel The channel it is on
+ * @param associationMs How long joining it takes
+ */
+void setAccessPoint(bool available, uint8_t channel, uint32_t associationMs);
+
+// The channel the radio is on, and whether ESP-NOW is running
+uint8_t channel();
+bool isEspNowStarted();
+
+// The rate ESP-NOW frames are sent at
+wifi_phy_rate_t phyRate();
+
+/**
+ * Hand a received frame to the ESP-NOW receive callback
+ */
+void receiveFrame(const uint8_t* mac, const uint8_t* data, size_t length);
+
+/**
+ * Report the outcome of the oldest frame sent to mac that is still pending
+ */
+void completeSend(const uint8_t* mac, bool success);
+
+/**
+ * Take the frames handed to esp_now_send since the last call
+ */
+std::vector<SentFrame> takeSentFrames();
+
+/**
+ * Run the esp_timer callbacks that are due
+ */
+void runTimers();
+
+/**
+ * Level read back by digitalRead() on an input pin
+ */
+void setPinInput(uint8_t pin, uint8_t value);
+uint8_t pinOutput(uint8_t pin);
+
+/**
+ * Mode last given to pinMode(), or 0 if it was never called for the pin
+ */
+uint8_t pinModeOf(uint8_t pin);
+
+/**
+ * Forget everything stored with Preferences
+ */
+void clearPreferences();
+
+}  // namespace host
+
+#endif
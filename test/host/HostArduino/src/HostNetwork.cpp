@@ -0,0 +1,454 @@
+/**
+ * HostNetwork.cpp - Simulated ESP-NOW network of boards
+ *
+ * The hub and each board exchange one message per tick over a sequenced
+ * packet socket pair. The hub sends the time and the frames and send
+ * results due on the board; the board answers with the frames it handed to
+ * esp_now_send, the channel its radio is on and its ESP-NOW rate.
+ */
+
+#include "HostNetwork.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "HostHooks.h"
+
+namespace {
+
+const size_t kSharedMemorySize = 4 << 20;
+
+const uint8_t kEventStatus = 1;
+const uint8_t kEventFrame = 2;
+const uint8_t kMessageTick = 1;
+const uint8_t kMessageStop = 2;
+
+void put(std::vector<uint8_t>& out, const void* data, size_t length) {
+  out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + length);
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+  put(out, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const std::vector<uint8_t>& in, size_t& offset) {
+  T value;
+  memcpy(&value, in.data() + offset, sizeof(value));
+  offset += sizeof(value);
+  return value;
+}
+
+// Largest message between the hub and a board: the frames of one tick
+const size_t kMaxMessage = 1 << 20;
+
+bool sendMessage(int fd, const std::vector<uint8_t>& message) {
+  ssize_t n;
+  do {
+    n = send(fd, message.data(), message.size(), 0);
+  } while (n < 0 && errno == EINTR);
+  return n == (ssize_t)message.size();
+}
+
+bool receiveMessage(int fd, std::vector<uint8_t>& message) {
+  static uint8_t buffer[kMaxMessage];
+  ssize_t n;
+  do {
+    n = recv(fd, buffer, sizeof(buffer), 0);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) return false;
+  message.assign(buffer, buffer + n);
+  return true;
+}
+
+// Time to send a frame of the given length at an 802.11b rate, preamble
+// included
+uint32_t frameUs(uint8_t rate, size_t length) {
+  uint32_t unitsOf100k = 10;  // Bit rate in 100 kbps units
+  switch (rate) {
+    case WIFI_PHY_RATE_2M_L:
+    case WIFI_PHY_RATE_2M_S:
+      unitsOf100k = 20;
+      break;
+    case WIFI_PHY_RATE_5M_L:
+    case WIFI_PHY_RATE_5M_S:
+      unitsOf100k = 55;
+      break;
+    case WIFI_PHY_RATE_11M_L:
+    case WIFI_PHY_RATE_11M_S:
+      unitsOf100k = 110;
+      break;
+  }
+  bool shortPreamble =
+      rate >= WIFI_PHY_RATE_2M_S && rate <= WIFI_PHY_RATE_11M_S;
+  uint32_t preamble =
+      shortPreamble ? HOST_PHY_SHORT_PREAMBLE_US : HOST_PHY_PREAMBLE_US;
+  return preamble + (length * 80 + unitsOf100k - 1) / unitsOf100k;
+}
+
+}  // namespace
+
+HostNetwork::HostNetwork(int nodeCount, uint32_t seed)
+    : _nodeCount(std::min(std::max(nodeCount, 1), HOST_MAX_NODES)),
+      _random(seed * 0x9E3779B97F4A7C15ULL | 1),
+      _observer(NULL),
+      _sharedUsed(0) {
+  for (int i = 0; i < HOST_MAX_NODES; i++) {
+    _nodes[i].socket = -1;
+    _nodes[i].pid = -1;
+    _nodes[i].bootMs = 0;
+    _nodes[i].powerOffMs = 0;
+    _nodes[i].apAvailable = false;
+    _nodes[i].apChannel = 1;
+    _nodes[i].associationMs = 0;
+    _nodes[i].channel = 0;
+    _nodes[i].rate = WIFI_PHY_RATE_1M_L;
+    for (int j = 0; j < HOST_MAX_NODES; j++) {
+      _inRange[i][j] = true;
+      _loss[i][j] = 0;
+    }
+  }
+  _shared = (uint8_t*)mmap(NULL, kSharedMemorySize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (_shared == MAP_FAILED) _shared = NULL;
+}
+
+HostNetwork::~HostNetwork() {
+  if (_shared) munmap(_shared, kSharedMemorySize);
+}
+
+void HostNetwork::setInRange(int a, int b, bool inRange) {
+  if (a < 0 || b < 0 || a >= _nodeCount || b >= _nodeCount) return;
+  _inRange[a][b] = inRange;
+  _inRange[b][a] = inRange;
+}
+
+void HostNetwork::setLoss(int a, int b, float loss) {
+  if (a < 0 || b < 0 || a >= _nodeCount || b >= _nodeCount) return;
+  _loss[a][b] = loss;
+  _loss[b][a] = loss;
+}
+
+void HostNetwork::setLoss(float loss) {
+  for (int a = 0; a < _nodeCount; a++) {
+    for (int b = 0; b < _nodeCount; b++) _loss[a][b] = loss;
+  }
+}
+
+void HostNetwork::setLine(int range) {
+  for (int a = 0; a < _nodeCount; a++) {
+    for (int b = 0; b < _nodeCount; b++) {
+      _inRange[a][b] = abs(a - b) <= range;
+    }
+  }
+}
+
+void HostNetwork::setAccessPoint(int node, bool available, uint8_t channel,
+                                 uint32_t associationMs) {
+  if (node < 0 || node >= _nodeCount) return;
+  _nodes[node].apAvailable = available;
+  _nodes[node].apChannel = channel;
+  _nodes[node].associationMs = associationMs;
+}
+
+void HostNetwork::setPower(int node, uint32_t bootMs, uint32_t powerOffMs) {
+  if (node < 0 || node >= _nodeCount) return;
+  _nodes[node].bootMs = bootMs;
+  _nodes[node].powerOffMs = powerOffMs;
+}
+
+void* HostNetwork::sharedMemory(size_t size) {
+  size = (size + 15) & ~(size_t)15;
+  if (!_shared || _sharedUsed + size > kSharedMemorySize) return NULL;
+  void* block = _shared + _sharedUsed;
+  _sharedUsed += size;
+  memset(block, 0, size);
+  return block;
+}
+
+void HostNetwork::macAddress(int node, uint8_t* mac) {
+  mac[0] = 0x24;
+  mac[1] = 0x0A;
+  mac[2] = 0xC4;
+  mac[3] = 0x10;
+  mac[4] = (node + 1) >> 8;
+  mac[5] = (node + 1) & 0xFF;
+}
+
+int HostNetwork::nodeForMac(const uint8_t* mac) {
+  if (mac[0] != 0x24 || mac[1] != 0x0A || mac[2] != 0xC4 || mac[3] != 0x10) {
+    return -1;
+  }
+  int node = (mac[4] << 8 | mac[5]) - 1;
+  return node >= 0 && node < HOST_MAX_NODES ? node : -1;
+}
+
+bool HostNetwork::run(NodeFunction setup, NodeFunction loop,
+                      uint32_t durationMs, uint32_t tickUs) {
+  _now = 0;
+  _busyUntil = 0;
+  _nextSender = 0;
+  _events.clear();
+  _airtimeUs = 0;
+  _broadcastFrames = 0;
+  _unicastFrames = 0;
+  _unicastFailures = 0;
+  _receptions = 0;
+
+  fflush(stdout);
+  fflush(stderr);
+  for (int i = 0; i < _nodeCount; i++) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) != 0) return false;
+    int pid = fork();
+    if (pid == 0) {
+      for (int j = 0; j < i; j++) close(_nodes[j].socket);
+      close(pair[0]);
+      _nodes[i].socket = pair[1];
+      runNode(i, setup, loop);
+      _exit(0);
+    }
+    close(pair[1]);
+    _nodes[i].socket = pair[0];
+    _nodes[i].pid = pid;
+    _nodes[i].channel = 0;
+    _nodes[i].rate = WIFI_PHY_RATE_1M_L;
+    _nodes[i].queue.clear();
+  }
+
+  bool ok = true;
+  std::vector<uint8_t> message;
+  for (_now = 0; ok && _now <= (uint64_t)durationMs * 1000; _now += tickUs) {
+    // Hand every board what is due on it
+    std::stable_sort(_events.begin(), _events.end(),
+                     [](const Event& a, const Event& b) {
+                       return a.time < b.time;
+                     });
+    std::vector<uint8_t> messages[HOST_MAX_NODES];
+    for (int i = 0; i < _nodeCount; i++) {
+      put<uint8_t>(messages[i], kMessageTick);
+      put<uint64_t>(messages[i], _now);
+    }
+    size_t due = 0;
+    while (due < _events.size() && _events[due].time <= _now) {
+      const Event& event = _events[due++];
+      std::vector<uint8_t>& out = messages[event.node];
+      put<uint8_t>(out, event.isStatus ? kEventStatus : kEventFrame);
+      put(out, event.mac, 6);
+      put<uint8_t>(out, event.success);
+      put<uint16_t>(out, event.data.size());
+      put(out, event.data.data(), event.data.size());
+    }
+    _events.erase(_events.begin(), _events.begin() + due);
+
+    for (int i = 0; i < _nodeCount; i++) {
+      ok = ok && sendMessage(_nodes[i].socket, messages[i]);
+    }
+
+    // Collect what they sent
+    for (int i = 0; ok && i < _nodeCount; i++) {
+      if (!receiveMessage(_nodes[i].socket, message)) {
+        ok = false;
+        break;
+      }
+      size_t offset = 0;
+      _nodes[i].channel = get<uint8_t>(message, offset);
+      _nodes[i].rate = get<uint8_t>(message, offset);
+      while (offset < message.size()) {
+        uint16_t length = get<uint16_t>(message, offset);
+        _nodes[i].queue.push_back(std::vector<uint8_t>(
+            message.begin() + offset, message.begin() + offset + length));
+        offset += length;
+      }
+    }
+
+    // Boards take turns on the channel for the rest of the tick
+    while (ok && _busyUntil < _now + tickUs) {
+      int sender = -1;
+      for (int k = 0; k < _nodeCount; k++) {
+        int i = (_nextSender + k) % _nodeCount;
+        if (!_nodes[i].queue.empty()) {
+          sender = i;
+          break;
+        }
+      }
+      if (sender < 0) break;
+      _nextSender = (sender + 1) % _nodeCount;
+      std::vector<uint8_t> entry = _nodes[sender].queue.front();
+      _nodes[sender].queue.erase(_nodes[sender].queue.begin());
+      transmit(sender, entry, std::max(_busyUntil, _now));
+    }
+  }
+
+  std::vector<uint8_t> stop(1, kMessageStop);
+  for (int i = 0; i < _nodeCount; i++) {
+    sendMessage(_nodes[i].socket, stop);
+    close(_nodes[i].socket);
+    _nodes[i].socket = -1;
+  }
+  for (int i = 0; i < _nodeCount; i++) {
+    int status = 0;
+    if (waitpid(_nodes[i].pid, &status, 0) != _nodes[i].pid ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void HostNetwork::runNode(int node, NodeFunction setup, NodeFunction loop) {
+  Node& self = _nodes[node];
+  uint8_t mac[6];
+  macAddress(node, mac);
+  char label[16];
+  snprintf(label, sizeof(label), "node%d", node);
+  host::useSimulatedClock(true);
+  host::setLogLabel(label);
+  host::setMacAddress(mac);
+  host::setAccessPoint(self.apAvailable, self.apChannel, self.associationMs);
+
+  bool booted = false;
+  bool poweredOff = false;
+  std::vector<uint8_t> message;
+  while (receiveMessage(self.socket, message)) {
+    size_t offset = 0;
+    if (get<uint8_t>(message, offset) != kMessageTick) break;
+    uint64_t now = get<uint64_t>(message, offset);
+    host::setTime(now);
+    if (self.powerOffMs && now >= (uint64_t)self.powerOffMs * 1000) {
+      poweredOff = true;
+    }
+
+    if (!booted && !poweredOff && now >= (uint64_t)self.bootMs * 1000) {
+      booted = true;
+      setup(node);
+    }
+
+    while (offset < message.size()) {
+      uint8_t kind = get<uint8_t>(message, offset);
+      uint8_t eventMac[6];
+      memcpy(eventMac, message.data() + offset, 6);
+      offset += 6;
+      bool success = get<uint8_t>(message, offset);
+      uint16_t length = get<uint16_t>(message, offset);
+      const uint8_t* data = message.data() + offset;
+      offset += length;
+      if (!booted || poweredOff) continue;
+      if (kind == kEventStatus) {
+        host::completeSend(eventMac, success);
+      } else {
+        host::receiveFrame(eventMac, data, length);
+      }
+    }
+
+    if (booted && !poweredOff) {
+      host::runTimers();
+      loop(node);
+      host::runTimers();
+    }
+
+    std::vector<host::SentFrame> sent = host::takeSentFrames();
+    std::vector<uint8_t> reply;
+    bool radioOn = booted && !poweredOff && host::isEspNowStarted();
+    put<uint8_t>(reply, radioOn ? host::channel() : 0);
+    put<uint8_t>(reply, host::phyRate());
+    if (!poweredOff) {
+      for (const host::SentFrame& frame : sent) {
+        put<uint16_t>(reply, 6 + frame.data.size());
+        put(reply, frame.mac, 6);
+        put(reply, frame.data.data(), frame.data.size());
+      }
+    }
+    if (!sendMessage(self.socket, reply)) break;
+  }
+  fflush(stdout);
+}
+
+bool HostNetwork::heard(int sender, int receiver) {
+  if (receiver < 0 || receiver >= _nodeCount || receiver == sender) {
+    return false;
+  }
+  return _inRange[sender][receiver] && _nodes[receiver].channel != 0 &&
+         _nodes[receiver].channel == _nodes[sender].channel &&
+         draw() >= _loss[sender][receiver];
+}
+
+double HostNetwork::draw() {
+  _random ^= _random >> 12;
+  _random ^= _random << 25;
+  _random ^= _random >> 27;
+  return ((_random * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void HostNetwork::transmit(int sender, const std::vector<uint8_t>& entry,
+                           uint64_t start) {
+  const uint8_t* mac = entry.data();
+  const uint8_t* data = entry.data() + 6;
+  size_t length = entry.size() - 6;
+  // The acknowledgement goes back at the frame's rate
+  uint8_t rate = _nodes[sender].rate;
+  uint32_t dataUs = frameUs(rate, HOST_PHY_OVERHEAD_BYTES + length);
+  uint32_t ackUs = HOST_PHY_SIFS_US + frameUs(rate, HOST_PHY_ACK_BYTES);
+
+  static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF,
+                                          0xFF, 0xFF, 0xFF};
+  bool broadcast = memcmp(mac, broadcastMac, 6) == 0;
+  int receiver = broadcast ? -1 : nodeForMac(mac);
+  uint32_t airtime = 0;
+  int delivered = 0;
+  std::vector<int> receivers;
+
+  if (broadcast) {
+    airtime = dataUs;
+    _broadcastFrames++;
+    for (int i = 0; i < _nodeCount; i++) {
+      if (heard(sender, i)) receivers.push_back(i);
+    }
+  } else {
+    _unicastFrames++;
+    for (int attempt = 0; attempt < HOST_PHY_ATTEMPTS; attempt++) {
+      airtime += dataUs + ackUs;
+      if (heard(sender, receiver)) {
+        receivers.push_back(receiver);
+        break;
+      }
+    }
+    if (receivers.empty()) _unicastFailures++;
+  }
+
+  uint64_t end = start + airtime;
+  uint8_t senderMac[6];
+  macAddress(sender, senderMac);
+  for (int i : receivers) {
+    Event event;
+    event.time = end;
+    event.node = i;
+    event.isStatus = false;
+    event.success = true;
+    memcpy(event.mac, senderMac, 6);
+    event.data.assign(data, data + length);
+    _events.push_back(event);
+    delivered++;
+  }
+
+  Event status;
+  status.time = end;
+  status.node = sender;
+  status.isStatus = true;
+  status.success = broadcast || delivered > 0;
+  memcpy(status.mac, mac, 6);
+  _events.push_back(status);
+
+  _busyUntil = end;
+  _airtimeUs += airtime;
+  _receptions += delivered;
+  if (_observer) {
+    _observer(sender, receiver, data, length, delivered, airtime);
+  }
+}
@@ -0,0 +1,182 @@
+/**
+ * HostNetwork.h - Simulated ESP-NOW network of boards for host tests
+ *
+ * Every board runs in its own process, forked from the test, so each has
+ * its own copy of the library's globals and static state. A hub in the
+ * test process moves the simulated clock forward one tick at a time and
+ * carries frames between the boards over a shared 802.11b channel:
+ *
+ * - A frame takes 192 us of preamble (96 us short) plus its bytes at the
+ *   sender's ESP-NOW rate, 1 Mbps unless set with
+ *   esp_wifi_config_espnow_rate(), counting 43 bytes of 802.11 and ESP-NOW
+ *   header. Boards take turns on the channel.
+ * - A unicast frame is acknowledged (304 us at 1 Mbps, after a 10 us gap)
+ *   and tried up to 7 times; a broadcast frame is sent once and never
+ *   acknowledged.
+ * - Each link has a range and a loss probability, applied per receiver and
+ *   per attempt. Boards only hear boards on the same WiFi channel.
+ *
+ * Boards report results through sharedMemory(), since their own memory is
+ * gone when run() returns. Unity assertions belong in the test process,
+ * after run(), not in the board functions. HostBoards.h runs a NetworkComm
+ * on each board and sets up the shared results.
+ */
+
+#ifndef HostArduino_HostNetwork_h
+#define HostArduino_HostNetwork_h
+
+#include <Arduino.h>
+
+#include <vector>
+
+#define HOST_MAX_NODES 64
+
+#define HOST_PHY_PREAMBLE_US 192       // Long preamble and PLCP header
+#define HOST_PHY_SHORT_PREAMBLE_US 96  // Short preamble and PLCP header
+#define HOST_PHY_OVERHEAD_BYTES 43     // MAC header, action frame header, FCS
+#define HOST_PHY_SIFS_US 10            // Gap before the acknowledgement
+#define HOST_PHY_ACK_BYTES 14          // Acknowledgement frame
+#define HOST_PHY_ATTEMPTS 7            // Transmissions of a unicast frame
+
+class HostNetwork {
+ public:
+  typedef void (*NodeFunction)(int node);
+
+  /**
+   * Called by the hub for each frame put on the air
+   *
+   * @param sender The sending board
+   * @param receiver The addressed board, or -1 for a broadcast
+   * @param data The frame
+   * @param length Its length
+   * @param delivered Boards that received it
+   * @param airtimeUs Channel time used, with retries and acknowledgements
+   */
+  typedef void (*FrameObserver)(int sender, int receiver, const uint8_t* data,
+                                size_t length, int delivered,
+                                uint32_t airtimeUs);
+
+  /**
+   * Create a network of boards, all in range of each other with no loss
+   *
+   * @param nodeCount Number of boards, up to HOST_MAX_NODES
+   * @param seed Seed for the channel's loss draws
+   */
+  explicit HostNetwork(int nodeCount, uint32_t seed = 1);
+  ~HostNetwork();
+
+  int nodeCount() const { return _nodeCount; }
+
+  void setInRange(int a, int b, bool inRange);
+  void setLoss(int a, int b, float loss);
+  void setLoss(float loss);  // Every link
+
+  /**
+   * Put the boards on a line, each hearing the boards up to range places
+   * away on either side
+   */
+  void setLine(int range);
+
+  /**
+   * Configure the access point a board joins
+   */
+  void setAccessPoint(int node, bool available, uint8_t channel,
+                      uint32_t associationMs);
+
+  /**
+   * Power a board on late, or off during the run
+   *
+   * @param node The board
+   * @param bootMs When setup() runs
+   * @param powerOffMs When the board stops, 0 for never
+   */
+  void setPower(int node, uint32_t bootMs, uint32_t powerOffMs = 0);
+
+  void setFrameObserver(FrameObserver observer) { _observer = observer; }
+
+  /**
+   * Memory shared by the boards and the test, zeroed. Allocate it before
+   * run().
+   */
+  void* sharedMemory(size_t size);
+
+  /**
+   * Run the boards: setup(node) at boot, then loop(node) every tick
+   *
+   * @param setup Called once per board, in the board's process
+   * @param loop Called every tick, in the board's process
+   * @param durationMs Simulated time to run for
+   * @param tickUs Length of a tick
+   * @return true if every board ran to the end
+   */
+  bool run(NodeFunction setup, NodeFunction loop, uint32_t durationMs,
+           uint32_t tickUs = 1000);
+
+  // Simulated time of the run, for frame observers
+  uint64_t nowUs() const { return _now; }
+
+  // Channel statistics of the last run
+  uint64_t airtimeUs() const { return _airtimeUs; }
+  uint32_t broadcastFrames() const { return _broadcastFrames; }
+  uint32_t unicastFrames() const { return _unicastFrames; }
+  uint32_t unicastFailures() const { return _unicastFailures; }
+  uint32_t receptions() const { return _receptions; }
+
+  static void macAddress(int node, uint8_t* mac);
+  static int nodeForMac(const uint8_t* mac);
+
+ private:
+  struct Event {
+    uint64_t time;
+    int node;
+    bool isStatus;
+    bool success;
+    uint8_t mac[6];
+    std::vector<uint8_t> data;
+  };
+
+  struct Node {
+    int socket;
+    int pid;
+    uint32_t bootMs;
+    uint32_t powerOffMs;
+    bool apAvailable;
+    uint8_t apChannel;
+    uint32_t associationMs;
+    uint8_t channel;  // 0 while ESP-NOW is not running
+    uint8_t rate;     // wifi_phy_rate_t ESP-NOW frames are sent at
+    std::vector<std::vector<uint8_t> > queue;  // MAC then frame, to send
+  };
+
+  HostNetwork(const HostNetwork&) = delete;
+  HostNetwork& operator=(const HostNetwork&) = delete;
+
+  void runNode(int node, NodeFunction setup, NodeFunction loop);
+  void transmit(int sender, const std::vector<uint8_t>& entry,
+                uint64_t start);
+  bool heard(int sender, int receiver);
+  double draw();
+
+  int _nodeCount;
+  uint64_t _random;
+  Node _nodes[HOST_MAX_NODES];
+  bool _inRange[HOST_MAX_NODES][HOST_MAX_NODES];
+  float _loss[HOST_MAX_NODES][HOST_MAX_NODES];
+  FrameObserver _observer;
+
+  uint8_t* _shared;
+  size_t _sharedUsed;
+
+  uint64_t _now;
+  uint64_t _busyUntil;
+  int _nextSender;
+  std::vector<Event> _events;
+
+  uint64_t _airtimeUs;
+  uint32_t _broadcastFrames;
+  uint32_t _unicastFrames;
+  uint32_t _unicastFailures;
+  uint32_t _receptions;
+};
+
+#endif
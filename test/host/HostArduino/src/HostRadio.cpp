@@ -0,0 +1,390 @@
+/**
+ * HostRadio.cpp - WiFi station, ESP-NOW and TCP client shims
+ *
+ * ESP-NOW frames are queued for whoever drives the board, the HostNetwork
+ * simulator or a test, which delivers them and reports their send status
+ * through HostHooks.h.
+ */
+
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <esp_now.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include "HostHooks.h"
+
+namespace {
+
+// Frames the ESP-NOW driver accepts before esp_now_send reports no memory
+const size_t kSendQueueLength = 32;
+
+uint8_t stationMac[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+uint8_t currentChannel = 1;
+wifi_phy_rate_t espNowRate = WIFI_PHY_RATE_1M_L;
+
+bool accessPointAvailable = true;
+uint8_t accessPointChannel = 6;
+uint32_t associationMs = 0;
+
+bool stationStarted = false;
+bool associating = false;
+bool associated = false;
+uint64_t associationStart = 0;
+int32_t associationChannel = 0;  // Channel searched, 0 for all
+
+bool espNowStarted = false;
+esp_now_recv_cb_t receiveCallback = NULL;
+esp_now_send_cb_t sendCallback = NULL;
+std::deque<esp_now_peer_info_t> peers;
+std::vector<host::SentFrame> sentFrames;
+std::deque<host::SentFrame> pendingSends;  // Sent, status not reported
+
+const uint8_t kBroadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+void updateAssociation() {
+  if (!associating || !accessPointAvailable) return;
+  if (associationChannel != 0 && associationChannel != accessPointChannel) {
+    return;
+  }
+  if (host::now() - associationStart < (uint64_t)associationMs * 1000) return;
+  associating = false;
+  associated = true;
+  currentChannel = accessPointChannel;
+}
+
+esp_now_peer_info_t* findPeer(const uint8_t* mac) {
+  for (esp_now_peer_info_t& peer : peers) {
+    if (memcmp(peer.peer_addr, mac, 6) == 0) return &peer;
+  }
+  return NULL;
+}
+
+}  // namespace
+
+// ---- IPAddress
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2],
+           _bytes[3]);
+  return String(text);
+}
+
+size_t IPAddress::printTo(Print& out) const {
+  return out.print(toString());
+}
+
+// ---- WiFi station
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  stationStarted = mode == WIFI_STA || mode == WIFI_AP_STA;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password,
+                             int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+  stationStarted = true;
+  associated = false;
+  associating = connect;
+  associationStart = host::now();
+  associationChannel = channel;
+  return status();
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  associating = false;
+  associated = false;
+  if (wifiOff) stationStarted = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  updateAssociation();
+  if (associated) return WL_CONNECTED;
+  if (associating && !accessPointAvailable &&
+      host::now() - associationStart > 3000000) {
+    return WL_NO_SSID_AVAIL;
+  }
+  return associating ? WL_IDLE_STATUS : WL_DISCONNECTED;
+}
+
+int32_t WiFiClass::channel() {
+  updateAssociation();
+  return currentChannel;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return IPAddress(192, 168, 4, 100 + stationMac[5] % 100);
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, stationMac, 6);
+  return mac;
+}
+
+String WiFiClass::macAddress() {
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+           stationMac[0], stationMac[1], stationMac[2], stationMac[3],
+           stationMac[4], stationMac[5]);
+  return String(text);
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second) {
+  if (primary < 1 || primary > 14) return ESP_ERR_INVALID_ARG;
+  updateAssociation();
+  // The station follows the access point while associated
+  if (associated && primary != currentChannel) return ESP_FAIL;
+  currentChannel = primary;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second) {
+  if (primary) *primary = currentChannel;
+  if (second) *second = WIFI_SECOND_CHAN_NONE;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_config_espnow_rate(wifi_interface_t ifx,
+                                      wifi_phy_rate_t rate) {
+  if (!stationStarted) return ESP_ERR_INVALID_STATE;
+  // Only the 802.11b rates are simulated
+  if (rate > WIFI_PHY_RATE_11M_S || rate == 0x04) return ESP_ERR_INVALID_ARG;
+  espNowRate = rate;
+  return ESP_OK;
+}
+
+// ---- ESP-NOW
+
+esp_err_t esp_now_init() {
+  if (!stationStarted) return ESP_ERR_ESPNOW_IF;
+  espNowStarted = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit() {
+  espNowStarted = false;
+  receiveCallback = NULL;
+  sendCallback = NULL;
+  peers.clear();
+  pendingSends.clear();
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback) {
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  receiveCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t callback) {
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  sendCallback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer) {
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (!peer || peer->channel > 14) return ESP_ERR_ESPNOW_ARG;
+  if (findPeer(peer->peer_addr)) return ESP_ERR_ESPNOW_EXIST;
+  if (peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+  peers.push_back(*peer);
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t* peerAddress) {
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (!peerAddress) return ESP_ERR_ESPNOW_ARG;
+  for (size_t i = 0; i < peers.size(); i++) {
+    if (memcmp(peers[i].peer_addr, peerAddress, 6) == 0) {
+      peers.erase(peers.begin() + i);
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+bool esp_now_is_peer_exist(const uint8_t* peerAddress) {
+  return peerAddress && findPeer(peerAddress) != NULL;
+}
+
+esp_err_t esp_now_send(const uint8_t* peerAddress, const uint8_t* data,
+                       size_t length) {
+  if (!espNowStarted) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (!peerAddress || !data || length == 0 ||
+      length > ESP_NOW_MAX_DATA_LEN) {
+    return ESP_ERR_ESPNOW_ARG;
+  }
+  esp_now_peer_info_t* peer = findPeer(peerAddress);
+  if (!peer) return ESP_ERR_ESPNOW_NOT_FOUND;
+  updateAssociation();
+  if (peer->channel != 0 && peer->channel != currentChannel) {
+    return ESP_ERR_ESPNOW_CHAN;
+  }
+  if (pendingSends.size() >= kSendQueueLength) return ESP_ERR_ESPNOW_NO_MEM;
+
+  host::SentFrame frame;
+  memcpy(frame.mac, peerAddress, 6);
+  frame.data.assign(data, data + length);
+  sentFrames.push_back(frame);
+  pendingSends.push_back(frame);
+  return ESP_OK;
+}
+
+// ---- TCP client
+
+WiFiClient::WiFiClient() : _socket(-1) {}
+
+WiFiClient::~WiFiClient() { stop(); }
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return connect(host, port);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  stop();
+  char service[6];
+  snprintf(service, sizeof(service), "%u", port);
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = NULL;
+  if (getaddrinfo(host, service, &hints, &result) != 0) return 0;
+
+  int fd = socket(result->ai_family, result->ai_socktype, 0);
+  if (fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0) return 0;
+
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  _socket = fd;
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if (_socket < 0) return 0;
+  size_t written = 0;
+  while (written < size) {
+    ssize_t n = send(_socket, buffer + written, size - written, MSG_NOSIGNAL);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) continue;
+      stop();
+      break;
+    }
+    written += n;
+  }
+  return written;
+}
+
+int WiFiClient::available() {
+  if (_socket < 0) return 0;
+  int count = 0;
+  if (ioctl(_socket, FIONREAD, &count) != 0) return 0;
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (_socket < 0) return -1;
+  ssize_t n = recv(_socket, buffer, size, MSG_DONTWAIT);
+  if (n == 0) {
+    stop();
+    return -1;
+  }
+  return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::peek() {
+  if (_socket < 0) return -1;
+  uint8_t c;
+  return recv(_socket, &c, 1, MSG_DONTWAIT | MSG_PEEK) == 1 ? c : -1;
+}
+
+void WiFiClient::stop() {
+  if (_socket >= 0) close(_socket);
+  _socket = -1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (_socket < 0) return 0;
+  uint8_t c;
+  ssize_t n = recv(_socket, &c, 1, MSG_DONTWAIT | MSG_PEEK);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    // Unread data stays readable after the broker closes the connection
+    return available() > 0;
+  }
+  return 1;
+}
+
+// ---- Host controls
+
+namespace host {
+
+void setMacAddress(const uint8_t* mac) {
+  memcpy(stationMac, mac, 6);
+  seedRandom(mac);
+}
+
+void setAccessPoint(bool available, uint8_t channel, uint32_t delayMs) {
+  accessPointAvailable = available;
+  accessPointChannel = channel;
+  associationMs = delayMs;
+}
+
+uint8_t channel() {
+  updateAssociation();
+  return currentChannel;
+}
+
+bool isEspNowStarted() { return espNowStarted; }
+
+wifi_phy_rate_t phyRate() { return espNowRate; }
+
+void receiveFrame(const uint8_t* mac, const uint8_t* data, size_t length) {
+  if (espNowStarted && receiveCallback) receiveCallback(mac, data, length);
+}
+
+void completeSend(const uint8_t* mac, bool success) {
+  for (size_t i = 0; i < pendingSends.size(); i++) {
+    if (memcmp(pendingSends[i].mac, mac, 6) == 0) {
+      pendingSends.erase(pendingSends.begin() + i);
+      // Broadcasts are never acknowledged, so they always succeed
+      if (memcmp(mac, kBroadcastMac, 6) == 0) success = true;
+      if (sendCallback) {
+        sendCallback(mac, success ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+      }
+      return;
+    }
+  }
+}
+
+std::vector<SentFrame> takeSentFrames() {
+  std::vector<SentFrame> taken;
+  taken.swap(sentFrames);
+  return taken;
+}
+
+}  // namespace host
@@ -0,0 +1,37 @@
+#ifndef HostArduino_IPAddress_h
+#define HostArduino_IPAddress_h
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() { memset(_bytes, 0, sizeof(_bytes)); }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    _bytes[0] = a;
+    _bytes[1] = b;
+    _bytes[2] = c;
+    _bytes[3] = d;
+  }
+  explicit IPAddress(uint32_t address) { memcpy(_bytes, &address, 4); }
+
+  operator uint32_t() const {
+    uint32_t address;
+    memcpy(&address, _bytes, 4);
+    return address;
+  }
+  bool operator==(const IPAddress& other) const {
+    return memcmp(_bytes, other._bytes, 4) == 0;
+  }
+  bool operator!=(const IPAddress& other) const { return !(*this == other); }
+  uint8_t operator[](int index) const { return _bytes[index]; }
+  uint8_t& operator[](int index) { return _bytes[index]; }
+  uint8_t* raw_address() { return _bytes; }
+
+  String toString() const;
+  size_t printTo(Print& out) const override;
+
+ private:
+  uint8_t _bytes[4];
+};
+
+#endif
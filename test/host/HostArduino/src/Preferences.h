@@ -0,0 +1,49 @@
+/**
+ * Preferences.h - NVS key-value storage for host builds
+ *
+ * Kept in memory for the life of the process. host::clearPreferences()
+ * wipes it, as erasing the flash would.
+ */
+
+#ifndef HostArduino_Preferences_h
+#define HostArduino_Preferences_h
+
+#include <Arduino.h>
+
+#include <string>
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end() { _open = false; }
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+  size_t putBytes(const char* key, const void* value, size_t length);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buffer, size_t maxLength);
+  size_t putUChar(const char* key, uint8_t value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) {
+    uint8_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+  size_t putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+    uint32_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+  }
+
+ private:
+  std::string _namespace;
+  bool _open = false;
+  bool _readOnly = false;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef HostArduino_SPI_h
+#define HostArduino_SPI_h
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+class SPISettings {
+ public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+// An SPI bus with MISO tied to MOSI
+class SPIClass {
+ public:
+  explicit SPIClass(uint8_t bus = 0) {}
+  void begin() {}
+  void end() {}
+  void beginTransaction(SPISettings settings) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data) { return data; }
+};
+
+extern SPIClass SPI;
+
+#endif
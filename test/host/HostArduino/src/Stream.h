@@ -0,0 +1,6 @@
+#ifndef HostArduino_Stream_h
+#define HostArduino_Stream_h
+
+#include <Arduino.h>
+
+#endif
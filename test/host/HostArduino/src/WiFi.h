@@ -0,0 +1,79 @@
+/**
+ * WiFi.h - Station interface and TCP client for host builds
+ *
+ * Association with the access point is simulated: it completes after the
+ * delay set with host::setAccessPoint(), or never if there is no access
+ * point or begin() was given a channel other than the access point's. WiFiClient is a real TCP socket, so the MQTT gateway can talk to a
+ * broker running on the host.
+ */
+
+#ifndef HostArduino_WiFi_h
+#define HostArduino_WiFi_h
+
+#include <Arduino.h>
+#include <Client.h>
+#include <IPAddress.h>
+#include <esp_wifi.h>
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class WiFiClass {
+ public:
+  bool mode(wifi_mode_t mode);
+  wl_status_t begin(const char* ssid, const char* password = NULL,
+                    int32_t channel = 0, const uint8_t* bssid = NULL,
+                    bool connect = true);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  int32_t channel();
+  IPAddress localIP();
+  uint8_t* macAddress(uint8_t* mac);
+  String macAddress();
+  bool setSleep(bool enable) { return true; }
+  bool setAutoReconnect(bool enable) { return true; }
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+ public:
+  WiFiClient();
+  ~WiFiClient() override;
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return _socket >= 0; }
+
+ private:
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+
+  int _socket;
+};
+
+#endif
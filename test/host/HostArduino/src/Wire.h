@@ -0,0 +1,34 @@
+#ifndef HostArduino_Wire_h
+#define HostArduino_Wire_h
+
+#include <Arduino.h>
+
+// An I2C bus with no devices on it that acknowledge everything
+class TwoWire : public Stream {
+ public:
+  explicit TwoWire(uint8_t bus) {}
+  bool begin() { return true; }
+  void beginTransmission(uint16_t address) {}
+  uint8_t endTransmission(bool sendStop = true) { return 0; }
+  size_t requestFrom(uint16_t address, size_t length, bool sendStop = true) {
+    _pending = length;
+    return length;
+  }
+  size_t write(uint8_t c) override { return 1; }
+  size_t write(const uint8_t* buffer, size_t size) override { return size; }
+  using Print::write;
+  int available() override { return (int)_pending; }
+  int read() override {
+    if (_pending == 0) return -1;
+    _pending--;
+    return 0;
+  }
+  int peek() override { return _pending ? 0 : -1; }
+
+ private:
+  size_t _pending = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef HostArduino_esp_wifi_h
+#define HostArduino_esp_wifi_h
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef enum {
+  WIFI_IF_STA = 0,
+  WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+  WIFI_SECOND_CHAN_NONE = 0,
+  WIFI_SECOND_CHAN_ABOVE,
+  WIFI_SECOND_CHAN_BELOW,
+} wifi_second_chan_t;
+
+// Rates as numbered by ESP-IDF; the simulator models the 802.11b ones
+typedef enum {
+  WIFI_PHY_RATE_1M_L = 0x00,
+  WIFI_PHY_RATE_2M_L = 0x01,
+  WIFI_PHY_RATE_5M_L = 0x02,
+  WIFI_PHY_RATE_11M_L = 0x03,
+  WIFI_PHY_RATE_2M_S = 0x05,
+  WIFI_PHY_RATE_5M_S = 0x06,
+  WIFI_PHY_RATE_11M_S = 0x07,
+  WIFI_PHY_RATE_48M = 0x08,
+  WIFI_PHY_RATE_24M = 0x09,
+  WIFI_PHY_RATE_12M = 0x0A,
+  WIFI_PHY_RATE_6M = 0x0B,
+  WIFI_PHY_RATE_54M = 0x0C,
+  WIFI_PHY_RATE_36M = 0x0D,
+  WIFI_PHY_RATE_18M = 0x0E,
+  WIFI_PHY_RATE_9M = 0x0F,
+} wifi_phy_rate_t;
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_channel(uint8_t* primary, wifi_second_chan_t* second);
+esp_err_t esp_wifi_config_espnow_rate(wifi_interface_t ifx,
+                                      wifi_phy_rate_t rate);
+
+#endif
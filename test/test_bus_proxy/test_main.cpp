@@ -0,0 +1,113 @@
+/**
+ * Remote bus transactions in a simulated cell
+ *
+ * A peripheral proxies its I2C bus to a controller two hops away, both with
+ * board IDs of the longest allowed length, so the response carries the
+ * largest mesh header there is. A batch that reads MAX_BUS_READ_BYTES must
+ * still come back in full.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <Wire.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define PERIPHERAL 2
+#define SUBMIT_AT_MS 5000
+#define READ_CHUNK 16  // Bytes per read transaction
+
+static const char* kBoardIds[] = {
+    "controller-with-a-long-board-id",  // 31 characters, the most allowed
+    "relay",
+    "peripheral-with-a-long-board-id",
+};
+
+struct Results {
+  bool submitted;
+  int responses;
+  uint8_t status;
+  size_t length;
+  size_t largestFrame;  // Of the peripheral's frames
+};
+
+static HostBoards<Results> boards;
+
+// Board state, one copy per board process
+static bool started;
+static bool submitted;
+
+static void onBus(const char* boardId, uint8_t batchId, uint8_t status,
+                  uint8_t failedIndex, const uint8_t* data, size_t length) {
+  boards.results->responses++;
+  boards.results->status = status;
+  boards.results->length = length;
+}
+
+static void observeFrame(int sender, int receiver, const uint8_t* data,
+                         size_t length, int delivered, uint32_t airtimeUs) {
+  if (sender == PERIPHERAL && length > boards.results->largestFrame) {
+    boards.results->largestFrame = length;
+  }
+}
+
+// The boards go by kBoardIds rather than "board<node>"
+static void startBoard(int node, const char* boardId) {
+  boards.comm->beginEspNowOnly(kBoardIds[node], 1);
+}
+
+static void setupBoard(int node) {
+  if (node == PERIPHERAL) boards.comm->enableBusProxy(kBoardIds, 1, &Wire);
+  if (node == 0) boards.comm->onBusResponse(onBus);
+}
+
+static void loopBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+  if (!started) {
+    started = true;
+    boards.comm->enableMeshRelay(true);
+  }
+  if (node != 0 || submitted || millis() < SUBMIT_AT_MS) return;
+
+  submitted = true;
+  BusTransactionBatch batch;
+  for (int i = 0; i < MAX_BUS_READ_BYTES / READ_CHUNK; i++) {
+    batch.i2cReadRegister(0x68, i * READ_CHUNK, READ_CHUNK);
+  }
+  boards.results->submitted =
+      boards.comm->submitBusTransactions(kBoardIds[PERIPHERAL], 1, batch);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// Every read byte comes back, whatever the length of the board IDs and
+// the route
+void test_full_read_over_mesh_with_long_board_ids() {
+  HostNetwork network(3, 3);
+  network.setLine(1);
+  network.setFrameObserver(observeFrame);
+
+  TEST_ASSERT_TRUE(boards.run(network, startBoard, setupBoard, loopBoard,
+                              SUBMIT_AT_MS + 1000));
+  const Results* results = boards.results;
+  TEST_ASSERT_TRUE(results->submitted);
+  TEST_ASSERT_EQUAL(1, results->responses);
+  TEST_ASSERT_EQUAL(BUS_BATCH_OK, results->status);
+  TEST_ASSERT_EQUAL(MAX_BUS_READ_BYTES, results->length);
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_ESP_NOW_DATA_SIZE, results->largestFrame);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "%u read bytes returned, largest peripheral frame %u bytes",
+           (unsigned)results->length, (unsigned)results->largestFrame);
+  TEST_MESSAGE(report);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_read_over_mesh_with_long_board_ids);
+  return UNITY_END();
+}
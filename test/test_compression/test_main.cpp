@@ -0,0 +1,254 @@
+/**
+ * Frame body compression
+ *
+ * compress() and decompress() must round-trip random, repetitive and
+ * text-like bodies of every length a frame can carry. decompress() parses
+ * bodies from any board in range, so on random, truncated and corrupted
+ * input it must fail cleanly and never write past its buffer. Two boards
+ * check that text messages for a board that decompresses travel in
+ * compressed binary frames and arrive unchanged.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define ROUNDS 2000
+#define GUARD 16           // Bytes checked past the output buffer
+#define GUARD_BYTE 0xA5
+#define SEND_AT_MS (TOPIC_INTEREST_REFRESH + 5000)  // Interests are known
+#define TOPIC "log/line1"
+
+static const char* kText =
+    "{\"sensor\":\"temperature\",\"unit\":\"C\",\"values\":[21.5,21.5,21.6,"
+    "21.6,21.5,21.5],\"sensor\":\"humidity\",\"unit\":\"%\",\"values\":[40,"
+    "40,41,41,40,40]}";
+
+struct Results {
+  bool topicText;   // Board 1 got the published text unchanged
+  bool directText;  // Board 1 got the direct message unchanged
+};
+
+static HostBoards<Results> boards;
+
+// Board state, one copy per board process
+static bool started;
+static bool sent;
+
+// Compressed text frames from board 0, counted by the hub
+static uint32_t compressedTopicFrames;
+static uint32_t compressedDirectFrames;
+
+static uint32_t randomState;
+
+static uint8_t nextRandom() {
+  randomState = randomState * 1103515245 + 12345;
+  return randomState >> 16;
+}
+
+// Fill a buffer with one of the kinds of body a board sends
+static void fillBody(uint8_t* data, size_t length, int kind) {
+  for (size_t i = 0; i < length; i++) {
+    switch (kind) {
+      case 0:  // Noise
+        data[i] = nextRandom();
+        break;
+      case 1:  // Few symbols, many repeats
+        data[i] = 'a' + nextRandom() % 3;
+        break;
+      case 2:  // Text with repeated words
+        data[i] = kText[(i % 7 == 0 ? nextRandom() : i) % strlen(kText)];
+        break;
+      default:  // Runs of one byte
+        data[i] = i / 20;
+        break;
+    }
+  }
+}
+
+// Decompress into a buffer with a guard after capacity, and check the guard
+static size_t guardedDecompress(const uint8_t* data, size_t length,
+                                uint8_t* output, size_t capacity) {
+  memset(output, GUARD_BYTE, capacity + GUARD);
+  size_t written = NetworkCore::decompress(data, length, output, capacity);
+  TEST_ASSERT_LESS_OR_EQUAL(capacity, written);
+  for (size_t i = capacity; i < capacity + GUARD; i++) {
+    TEST_ASSERT_EQUAL_HEX8(GUARD_BYTE, output[i]);
+  }
+  return written;
+}
+
+void setUp() {
+  randomState = 1;
+  compressedTopicFrames = 0;
+  compressedDirectFrames = 0;
+}
+
+void tearDown() {}
+
+// Whatever compress() returns, decompress() turns back into the input
+void test_round_trip() {
+  uint8_t data[COMPRESSION_MAX_INPUT];
+  uint8_t packed[COMPRESSION_MAX_INPUT];
+  uint8_t unpacked[COMPRESSION_MAX_INPUT + GUARD];
+  int compressed = 0;
+
+  for (int round = 0; round < ROUNDS; round++) {
+    size_t length = round % (COMPRESSION_MAX_INPUT + 1);
+    fillBody(data, length, round % 4);
+
+    // As buildBinaryFrame() does: only keep it if it saves a byte
+    size_t capacity = length > 0 ? length - 1 : 0;
+    size_t packedLength =
+        NetworkCore::compress(data, length, packed, capacity);
+    if (packedLength == 0) continue;
+    compressed++;
+
+    TEST_ASSERT_LESS_THAN(length, packedLength);
+    TEST_ASSERT_EQUAL(length, guardedDecompress(packed, packedLength, unpacked,
+                                                COMPRESSION_MAX_INPUT));
+    TEST_ASSERT_EQUAL_MEMORY(data, unpacked, length);
+
+    // An exact fit is enough, a byte less is not
+    TEST_ASSERT_EQUAL(
+        length, guardedDecompress(packed, packedLength, unpacked, length));
+    TEST_ASSERT_EQUAL(
+        0, guardedDecompress(packed, packedLength, unpacked, length - 1));
+  }
+  TEST_ASSERT_GREATER_THAN(ROUNDS / 2, compressed);
+}
+
+// Bodies that are too short, too long or do not get smaller are refused
+void test_incompressible_input() {
+  uint8_t data[COMPRESSION_MAX_INPUT + 1];
+  uint8_t packed[COMPRESSION_MAX_INPUT + 1];
+  memset(data, 'x', sizeof(data));
+
+  TEST_ASSERT_EQUAL(0, NetworkCore::compress(data, 3, packed, sizeof(packed)));
+  TEST_ASSERT_EQUAL(0, NetworkCore::compress(data, COMPRESSION_MAX_INPUT + 1,
+                                             packed, sizeof(packed)));
+
+  fillBody(data, 64, 0);
+  TEST_ASSERT_EQUAL(0, NetworkCore::compress(data, 64, packed, 63));
+}
+
+// Tokens that point outside the body or the output are rejected
+void test_malformed_tokens() {
+  uint8_t output[64 + GUARD];
+  const uint8_t matchFirst[] = {0x80, 0x00};         // Nothing to copy yet
+  const uint8_t shortLiterals[] = {0x05, 'a', 'b'};  // 6 literals promised
+  const uint8_t noDistance[] = {0x00, 'a', 0x81};    // Match without distance
+  const uint8_t tooFar[] = {0x01, 'a', 'b', 0x80, 0x02};  // Distance 3 of 2
+  const uint8_t tooLong[] = {0x00, 'a', 0xFF, 0x00};      // 130 bytes of 64
+
+  TEST_ASSERT_EQUAL(0, guardedDecompress(matchFirst, sizeof(matchFirst),
+                                         output, 64));
+  TEST_ASSERT_EQUAL(0, guardedDecompress(shortLiterals, sizeof(shortLiterals),
+                                         output, 64));
+  TEST_ASSERT_EQUAL(0, guardedDecompress(noDistance, sizeof(noDistance),
+                                         output, 64));
+  TEST_ASSERT_EQUAL(0, guardedDecompress(tooFar, sizeof(tooFar), output, 64));
+  TEST_ASSERT_EQUAL(0,
+                    guardedDecompress(tooLong, sizeof(tooLong), output, 64));
+
+  // Overlapping copies are valid: one literal repeated
+  const uint8_t run[] = {0x00, 'a', 0x82, 0x00};
+  TEST_ASSERT_EQUAL(6, guardedDecompress(run, sizeof(run), output, 64));
+  TEST_ASSERT_EQUAL_MEMORY("aaaaaa", output, 6);
+}
+
+// Random bytes, and valid bodies cut short or with a byte changed, never
+// make decompress() write past its buffer
+void test_random_and_corrupted_input() {
+  uint8_t data[COMPRESSION_MAX_INPUT];
+  uint8_t packed[COMPRESSION_MAX_INPUT];
+  uint8_t output[COMPRESSION_MAX_INPUT + GUARD];
+
+  for (int round = 0; round < ROUNDS; round++) {
+    size_t capacity = nextRandom() % (COMPRESSION_MAX_INPUT + 1);
+
+    size_t length = 1 + nextRandom() % 64;
+    fillBody(data, length, 0);
+    guardedDecompress(data, length, output, capacity);
+
+    length = COMPRESSION_MIN_SIZE + nextRandom() % 128;
+    fillBody(data, length, 1 + round % 3);
+    size_t packedLength =
+        NetworkCore::compress(data, length, packed, length - 1);
+    if (packedLength < 2) continue;
+
+    guardedDecompress(packed, 1 + nextRandom() % (packedLength - 1), output,
+                      capacity);
+    packed[nextRandom() % packedLength] ^= 1 << (nextRandom() % 8);
+    guardedDecompress(packed, packedLength, output, capacity);
+  }
+}
+
+static void onTopic(const char* sender, const char* topic,
+                    const char* message) {
+  boards.results->topicText = strcmp(message, kText) == 0;
+}
+
+static void onDirect(const char* sender, const char* topic,
+                     const char* message) {
+  boards.results->directText = strcmp(message, kText) == 0;
+}
+
+static void setupBoard(int node) {
+  boards.comm->enableCompression(true);
+}
+
+static void loopBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+
+  if (!started) {
+    started = true;
+    if (node == 1) {
+      boards.comm->subscribeTopic(TOPIC, onTopic);
+      boards.comm->receiveMessagesFromBoards(onDirect);
+    }
+  }
+
+  if (node == 0 && !sent && millis() >= SEND_AT_MS) {
+    sent = true;
+    boards.comm->publishTopic(TOPIC, kText);
+    boards.comm->sendMessageToBoardId("board1", kText);
+  }
+}
+
+static void countCompressedText(int sender, int receiver, const uint8_t* data,
+                                size_t length, int delivered,
+                                uint32_t airtimeUs) {
+  if (sender != 0 || length < BINARY_FRAME_HEADER_SIZE) return;
+  if (data[0] != BINARY_FRAME_MAGIC || !(data[2] & BINARY_FRAME_COMPRESSED)) {
+    return;
+  }
+  if (data[1] == MSG_TYPE_MESSAGE) compressedTopicFrames++;
+  if (data[1] == MSG_TYPE_DIRECT_MESSAGE) compressedDirectFrames++;
+}
+
+// Text publishes and direct messages for a board that decompresses are
+// sent compressed and delivered as they were written
+void test_text_messages_are_compressed() {
+  HostNetwork network(2, 3);
+  network.setFrameObserver(countCompressedText);
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, setupBoard, loopBoard, SEND_AT_MS + 2000));
+  TEST_ASSERT_TRUE(boards.results->topicText);
+  TEST_ASSERT_TRUE(boards.results->directText);
+  TEST_ASSERT_EQUAL(1, compressedTopicFrames);
+  TEST_ASSERT_EQUAL(1, compressedDirectFrames);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_incompressible_input);
+  RUN_TEST(test_malformed_tokens);
+  RUN_TEST(test_random_and_corrupted_input);
+  RUN_TEST(test_text_messages_are_compressed);
+  return UNITY_END();
+}
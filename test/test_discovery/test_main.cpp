@@ -0,0 +1,246 @@
+/**
+ * Discovery and peer liveness in a simulated 30-board network
+ *
+ * All boards are in range of each other and power on within 50 ms. The
+ * tests measure the channel time discovery takes as it backs off, how many
+ * discovery responses the known-boards digest saves, and how long the other
+ * boards take to report a board that powers off. Two boards check that the
+ * advertised features follow what a board is set up to do.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define BOARD_COUNT 30
+#define MINUTES 5
+#define LOST_BOARD (BOARD_COUNT - 1)
+#define POWER_OFF_MS 120000
+#define SET_UP_AT_MS 20000  // When board 1 starts accepting pin control
+
+struct Results {
+  uint32_t knewLostBoard[BOARD_COUNT];  // Had it as a peer at power off
+  uint32_t lostAt[BOARD_COUNT];         // When it was reported lost, or 0
+  uint8_t featuresBefore;  // Board 1's features, as seen by board 0
+  uint8_t featuresAfter;
+  uint32_t featuresSeenAt;  // When board 0 saw them change, or 0
+};
+
+// Discovery frames seen by the hub, per minute of the run
+struct Minute {
+  uint32_t broadcasts;
+  uint32_t responses;
+  uint32_t heard;  // Boards that received a discovery broadcast
+  uint64_t airtimeUs;
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static bool trackLostBoard;
+
+// Board state, one copy per board process
+static bool checkedAtPowerOff;
+static bool setUpBoard;
+
+// Hub state
+static HostNetwork* hub;
+static Minute minutes[MINUTES];
+
+static void onLost(const char* boardId) {
+  char lost[16];
+  boards.boardName(LOST_BOARD, lost, sizeof(lost));
+  if (strcmp(boardId, lost) == 0 && boards.results->lostAt[boards.self] == 0) {
+    boards.results->lostAt[boards.self] = millis();
+  }
+}
+
+static void setupBoard(int node) {
+  if (trackLostBoard) boards.comm->onBoardLost(onLost);
+}
+
+static void loopBoard(int node) {
+  if (!trackLostBoard || checkedAtPowerOff || millis() < POWER_OFF_MS) return;
+
+  char lost[16];
+  boards.boardName(LOST_BOARD, lost, sizeof(lost));
+  checkedAtPowerOff = true;
+  boards.results->knewLostBoard[node] = boards.comm->isBoardAvailable(lost);
+}
+
+static void onPinControl(const char* sender, uint8_t pin, uint8_t value) {}
+
+static void onTopic(const char* sender, const char* topic,
+                    const uint8_t* data, size_t length) {}
+
+// Board 1 starts accepting pin control and subscribes to a topic; board 0
+// watches the features it advertises
+static void loopFeatures(int node) {
+  uint32_t now = millis();
+
+  if (node == 1) {
+    if (!setUpBoard && now >= SET_UP_AT_MS) {
+      setUpBoard = true;
+      boards.comm->acceptPinControlFrom("board0", 2, onPinControl);
+      boards.comm->subscribeTopic("lights/#", onTopic);
+    }
+    return;
+  }
+
+  uint8_t features = boards.comm->getBoardFeatures("board1");
+  if (now < SET_UP_AT_MS) {
+    boards.results->featuresBefore = features;
+  } else if (features != boards.results->featuresBefore &&
+             boards.results->featuresSeenAt == 0) {
+    boards.results->featuresSeenAt = now;
+  }
+  boards.results->featuresAfter = features;
+}
+
+static bool hasType(const uint8_t* data, size_t length, const char* type) {
+  if (length == 0 || data[0] != '{') return false;
+  return strstr((const char*)data, type) != NULL;
+}
+
+static void countDiscovery(int sender, int receiver, const uint8_t* data,
+                           size_t length, int delivered,
+                           uint32_t airtimeUs) {
+  uint32_t minute = hub->nowUs() / 60000000;
+  if (minute >= MINUTES) return;
+
+  Minute& counts = minutes[minute];
+  if (hasType(data, length, "\"type\":7")) {
+    if (receiver < 0) {
+      counts.broadcasts++;
+      counts.heard += delivered;
+    }
+    counts.airtimeUs += airtimeUs;
+  } else if (hasType(data, length, "\"type\":8")) {
+    counts.responses++;
+    counts.airtimeUs += airtimeUs;
+  }
+}
+
+void setUp() {
+  trackLostBoard = false;
+  memset(minutes, 0, sizeof(minutes));
+}
+
+void tearDown() {}
+
+static void powerOnTogether(HostNetwork& network) {
+  for (int i = 0; i < BOARD_COUNT; i++) {
+    bool lost = trackLostBoard && i == LOST_BOARD;
+    network.setPower(i, random(0, 50), lost ? POWER_OFF_MS : 0);
+  }
+}
+
+// Discovery frames and airtime fall off once the boards know each other,
+// and most broadcasts need no response, as the boards are in the sender's
+// digest or its peer table is full
+void test_discovery_airtime_and_suppression() {
+  HostNetwork network(BOARD_COUNT, 7);
+  hub = &network;
+  network.setFrameObserver(countDiscovery);
+  powerOnTogether(network);
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, MINUTES * 60000));
+
+  char report[160];
+  for (int i = 0; i < MINUTES; i++) {
+    const Minute& counts = minutes[i];
+    snprintf(report, sizeof(report),
+             "minute %d: %u broadcasts, %u responses, %.1f ms airtime",
+             i + 1, (unsigned)counts.broadcasts, (unsigned)counts.responses,
+             counts.airtimeUs / 1000.0);
+    TEST_MESSAGE(report);
+  }
+
+  uint32_t heard = 0, responses = 0;
+  for (int i = 0; i < MINUTES; i++) {
+    heard += minutes[i].heard;
+    responses += minutes[i].responses;
+  }
+  snprintf(report, sizeof(report),
+           "%u boards heard a discovery broadcast, %u responded: %.1f%% of "
+           "responses suppressed",
+           (unsigned)heard, (unsigned)responses,
+           heard == 0 ? 0.0 : 100.0 * (heard - responses) / heard);
+  TEST_MESSAGE(report);
+
+  const Minute& first = minutes[0];
+  const Minute& last = minutes[MINUTES - 1];
+  TEST_ASSERT_GREATER_THAN(0, first.broadcasts);
+  TEST_ASSERT_LESS_THAN(first.airtimeUs / 4, last.airtimeUs);
+  TEST_ASSERT_LESS_THAN(heard / 5, responses);
+}
+
+// A board that powers off is reported lost by every board that had it as a
+// peer, within the peer timeout and the probes that follow it
+void test_lost_board_detection() {
+  trackLostBoard = true;
+  HostNetwork network(BOARD_COUNT, 7);
+  powerOnTogether(network);
+
+  uint32_t limit = PEER_SUSPECT_TIMEOUT +
+                   PEER_PROBE_COUNT * PEER_PROBE_INTERVAL +
+                   2 * PEER_CHECK_INTERVAL;
+  TEST_ASSERT_TRUE(
+      boards.run(network, setupBoard, loopBoard, POWER_OFF_MS + limit + 5000));
+
+  int knew = 0, reported = 0;
+  uint32_t totalMs = 0, worstMs = 0;
+  for (int i = 0; i < BOARD_COUNT; i++) {
+    if (i == LOST_BOARD || !boards.results->knewLostBoard[i]) continue;
+    knew++;
+    if (boards.results->lostAt[i] == 0) continue;
+    reported++;
+    uint32_t detectMs = boards.results->lostAt[i] - POWER_OFF_MS;
+    totalMs += detectMs;
+    if (detectMs > worstMs) worstMs = detectMs;
+  }
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "%d of %d boards knew the lost board; reported lost after %.1f s "
+           "on average, %.1f s at worst",
+           knew, BOARD_COUNT - 1,
+           reported == 0 ? 0.0 : totalMs / 1000.0 / reported,
+           worstMs / 1000.0);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_GREATER_THAN(0, knew);
+  TEST_ASSERT_EQUAL(knew, reported);
+  TEST_ASSERT_LESS_OR_EQUAL(limit, worstMs);
+}
+
+// Features are advertised once a board is set up to use them, and peers see
+// the change within seconds, not at the next backed-off broadcast
+void test_features_follow_state() {
+  HostNetwork network(2, 7);
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopFeatures,
+                              SET_UP_AT_MS + 10000));
+  TEST_ASSERT_EQUAL(PEER_FEATURE_COMPRESSION, boards.results->featuresBefore);
+  TEST_ASSERT_EQUAL(PEER_FEATURE_COMPRESSION | PEER_FEATURE_PIN_CONTROL |
+                        PEER_FEATURE_MESSAGING,
+                    boards.results->featuresAfter);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->featuresSeenAt);
+
+  char report[96];
+  snprintf(report, sizeof(report), "new features seen by the peer after %u ms",
+           (unsigned)(boards.results->featuresSeenAt - SET_UP_AT_MS));
+  TEST_MESSAGE(report);
+  TEST_ASSERT_LESS_THAN(DISCOVERY_INTERVAL_MIN + 1000,
+                        boards.results->featuresSeenAt - SET_UP_AT_MS);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_features_follow_state);
+  RUN_TEST(test_discovery_airtime_and_suppression);
+  RUN_TEST(test_lost_board_detection);
+  return UNITY_END();
+}
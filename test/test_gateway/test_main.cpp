@@ -0,0 +1,230 @@
+/**
+ * MQTT gateway against a real broker
+ *
+ * The board runs on the wall clock and talks to an MQTT broker on
+ * 127.0.0.1:1883, e.g. Mosquitto, over a real TCP connection. A second
+ * MQTT client in the test watches and feeds the broker. The tests are
+ * ignored when no broker is listening.
+ */
+
+#include <HostHooks.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "NetworkComm.h"
+
+#define BROKER_HOST "127.0.0.1"
+#define BROKER_PORT 1883
+#define MESSAGE_COUNT 200
+
+// A broker connection the test can cut. Writes fail once it is cut, as
+// they do when the WiFi link drops, and reconnecting fails until restored.
+class CuttableClient : public Client {
+ public:
+  bool cut = false;
+
+  int connect(IPAddress ip, uint16_t port) override {
+    return cut ? 0 : _client.connect(ip, port);
+  }
+  int connect(const char* host, uint16_t port) override {
+    return cut ? 0 : _client.connect(host, port);
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (cut) {
+      _client.stop();
+      return 0;
+    }
+    return _client.write(buffer, size);
+  }
+  int available() override { return _client.available(); }
+  int read() override { return _client.read(); }
+  int read(uint8_t* buffer, size_t size) override {
+    return _client.read(buffer, size);
+  }
+  int peek() override { return _client.peek(); }
+  void flush() override {}
+  void stop() override { _client.stop(); }
+  uint8_t connected() override { return _client.connected(); }
+  operator bool() override { return connected(); }
+
+ private:
+  WiFiClient _client;
+};
+
+struct Received {
+  std::string topic;
+  std::string payload;
+  uint32_t atUs;
+};
+
+static NetworkComm netComm;
+static CuttableClient brokerLink;
+static bool boardStarted;
+
+// The test's own MQTT client
+static WiFiClient observerClient;
+static PubSubClient observer(observerClient);
+static std::vector<Received> observed;
+
+// Publishes bridged from MQTT to local topics
+static std::vector<std::string> bridgedIn;
+
+static void onBridgedIn(const char* sender, const char* topic,
+                        const uint8_t* data, size_t length) {
+  bridgedIn.push_back(std::string(topic) + "=" +
+                      std::string((const char*)data, length));
+}
+
+// Run the board and the observer for a while, completing every ESP-NOW
+// send as if it had been acknowledged
+static void pump(uint32_t ms) {
+  uint32_t start = millis();
+  do {
+    netComm.update();
+    for (const host::SentFrame& frame : host::takeSentFrames()) {
+      host::completeSend(frame.mac, true);
+    }
+    host::runTimers();
+    observer.loop();
+    delay(1);
+  } while (millis() - start < ms);
+}
+
+static bool pumpUntil(bool (*done)(), uint32_t timeoutMs) {
+  uint32_t start = millis();
+  while (!done()) {
+    if (millis() - start > timeoutMs) return false;
+    pump(1);
+  }
+  return true;
+}
+
+static bool boardReady() { return netComm.isConnected(); }
+static bool gatewayConnected() { return netComm.isMqttConnected(); }
+
+static bool brokerAvailable() {
+  WiFiClient probe;
+  bool available = probe.connect(BROKER_HOST, BROKER_PORT);
+  probe.stop();
+  return available;
+}
+
+static void publishLocal(const char* topic, uint32_t sequence) {
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%u", sequence);
+  netComm.publishTopic(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+void setUp() {
+  if (!brokerAvailable()) {
+    TEST_IGNORE_MESSAGE("No MQTT broker on " BROKER_HOST ":1883");
+  }
+
+  if (!boardStarted) {
+    boardStarted = true;
+    host::setAccessPoint(true, 6, 100);
+    netComm.begin("test-ap", "password", "gateway");
+    TEST_ASSERT_TRUE(pumpUntil(boardReady, 5000));
+    netComm.setMqttClient(brokerLink);
+  }
+
+  observed.clear();
+  bridgedIn.clear();
+  brokerLink.cut = false;
+  observer.setServer(BROKER_HOST, BROKER_PORT);
+  observer.setCallback([](char* topic, uint8_t* payload, unsigned int length) {
+    observed.push_back({topic, std::string((const char*)payload, length),
+                        (uint32_t)micros()});
+  });
+  TEST_ASSERT_TRUE(observer.connect("observer"));
+  TEST_ASSERT_TRUE(observer.subscribe("gw/#"));
+
+  netComm.clearGatewayRoutes();
+  TEST_ASSERT_TRUE(netComm.bridgeTopicToMqtt("sensors/#", "gw/"));
+  TEST_ASSERT_TRUE(netComm.bridgeTopicFromMqtt("cmd/", "remote/"));
+  TEST_ASSERT_TRUE(
+      netComm.startMqttGateway(BROKER_HOST, BROKER_PORT, "gateway"));
+  TEST_ASSERT_TRUE(pumpUntil(gatewayConnected, 5000));
+  pump(100);  // Let the broker take the subscriptions
+}
+
+void tearDown() {
+  netComm.stopMqttGateway();
+  observer.disconnect();
+}
+
+// Publishes on bridged topics reach the broker in order, none dropped
+void test_bridges_topics_to_broker() {
+  uint32_t publishedAt[MESSAGE_COUNT];
+  for (uint32_t i = 0; i < MESSAGE_COUNT; i++) {
+    publishedAt[i] = micros();
+    publishLocal("sensors/temp", i);
+    pump(2);
+  }
+  pump(500);
+
+  TEST_ASSERT_EQUAL(MESSAGE_COUNT, observed.size());
+  uint64_t latencyUs = 0;
+  for (uint32_t i = 0; i < observed.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING("gw/sensors/temp", observed[i].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING(std::to_string(i).c_str(),
+                             observed[i].payload.c_str());
+    latencyUs += observed[i].atUs - publishedAt[i];
+  }
+  TEST_ASSERT_EQUAL(0, netComm.getGatewayDropped());
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "%d publishes bridged, %.0f us from publishTopic() to the broker's "
+           "subscriber",
+           MESSAGE_COUNT, (double)latencyUs / MESSAGE_COUNT);
+  TEST_MESSAGE(report);
+}
+
+// Broker publishes under the inbound prefix become local topic publishes
+void test_bridges_broker_to_topics() {
+  TEST_ASSERT_TRUE(netComm.subscribeTopic("remote/#", onBridgedIn));
+  pump(50);
+  TEST_ASSERT_TRUE(observer.publish("cmd/light", "on"));
+  TEST_ASSERT_TRUE(observer.publish("other/light", "off"));
+  pump(200);
+  netComm.unsubscribeTopic("remote/#");
+
+  TEST_ASSERT_EQUAL(1, bridgedIn.size());
+  TEST_ASSERT_EQUAL_STRING("remote/light=on", bridgedIn[0].c_str());
+}
+
+// A publish that fails because the connection dropped is sent again after
+// reconnecting, not dropped
+void test_requeues_publishes_when_connection_drops() {
+  uint32_t droppedBefore = netComm.getGatewayDropped();
+  for (uint32_t i = 0; i < 4; i++) publishLocal("sensors/door", i);
+  brokerLink.cut = true;
+  pump(100);
+  TEST_ASSERT_FALSE(netComm.isMqttConnected());
+  TEST_ASSERT_EQUAL(4, netComm.getGatewayBacklog());
+
+  brokerLink.cut = false;
+  TEST_ASSERT_TRUE(pumpUntil(gatewayConnected, 5000));
+  pump(200);
+
+  TEST_ASSERT_EQUAL(droppedBefore, netComm.getGatewayDropped());
+  TEST_ASSERT_EQUAL(4, observed.size());
+  for (uint32_t i = 0; i < observed.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING(std::to_string(i).c_str(),
+                             observed[i].payload.c_str());
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bridges_topics_to_broker);
+  RUN_TEST(test_bridges_broker_to_topics);
+  RUN_TEST(test_requeues_publishes_when_connection_drops);
+  return UNITY_END();
+}
@@ -0,0 +1,218 @@
+/**
+ * Mesh relaying in simulated multi-hop networks
+ *
+ * Boards stand on a line, each hearing only its neighbours, so messages
+ * from one end reach the other through every board in between. The tests
+ * measure the latency per hop and the delivery ratio on lossy links, and
+ * check that relays fall back to flooding when their ESP-NOW peer table is
+ * full and that messages for unknown boards are not flooded over and over.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define LINE_LENGTH 5  // Four hops, the default TTL
+#define MESSAGE_INTERVAL 200
+#define MAX_MESSAGES 200
+#define TICK_US 250
+
+struct Results {
+  uint32_t sent;
+  uint32_t received;
+  uint64_t latencyUs;  // Summed over the messages received
+  int hopCount;        // Route to the far end, as seen by the sender
+};
+
+struct Payload {
+  uint32_t sequence;
+  uint32_t sentAtUs;
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static int source;
+static int destination;
+static uint32_t sendStart;
+static uint32_t messageCount;
+static uint8_t messageFlags;
+static const char* ghostBoard;  // Target of a stored message, if any
+static bool fillPeerTable;      // Leave the relay no room for its neighbours
+
+// Board state, one copy per board process
+static bool started;
+static uint32_t sent;
+static uint32_t lastSend;
+static uint8_t seen[MAX_MESSAGES];
+
+// Mesh frames addressed to the ghost board, counted by the hub
+static uint32_t ghostFrames;
+
+static void onMessage(const char* sender, const char* topic,
+                      const uint8_t* data, size_t length) {
+  Payload payload;
+  if (length != sizeof(payload)) return;
+  memcpy(&payload, data, sizeof(payload));
+  if (payload.sequence >= MAX_MESSAGES || seen[payload.sequence]) return;
+  seen[payload.sequence] = 1;
+  boards.results->received++;
+  boards.results->latencyUs += micros() - payload.sentAtUs;
+}
+
+static void setupBoard(int node) {
+  // Take every ESP-NOW peer slot but the broadcast address, as a sketch
+  // with its own ESP-NOW peers might
+  if (fillPeerTable && node == 1) {
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM - 1; i++) {
+      esp_now_peer_info_t peer = {};
+      uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t)i};
+      memcpy(peer.peer_addr, mac, 6);
+      esp_now_add_peer(&peer);
+    }
+  }
+}
+
+static void loopBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+
+  if (!started) {
+    started = true;
+    boards.comm->enableMeshRelay(true);
+    if (node == destination) {
+      boards.comm->receiveMessagesFromBoards(onMessage);
+    }
+  }
+
+  if (node != source || millis() < sendStart) return;
+  if (ghostBoard != NULL && sent == 0) {
+    sent = 1;
+    boards.comm->sendMessageToBoardId(ghostBoard, "hello",
+                                      MESSAGE_STORE_AND_FORWARD);
+    return;
+  }
+
+  if (sent < messageCount && millis() - lastSend >= MESSAGE_INTERVAL) {
+    lastSend = millis();
+    char target[16];
+    boards.boardName(destination, target, sizeof(target));
+    Payload payload = {sent++, (uint32_t)micros()};
+    boards.comm->sendMessageToBoardId(target, (const uint8_t*)&payload,
+                                      sizeof(payload), messageFlags);
+    boards.results->sent = sent;
+    boards.results->hopCount = boards.comm->getHopCount(target);
+  }
+}
+
+static void countGhostFrames(int sender, int receiver, const uint8_t* data,
+                             size_t length, int delivered,
+                             uint32_t airtimeUs) {
+  if (length < 7 || data[0] != MESH_FRAME_MAGIC) return;
+  size_t offset = 6 + data[5];
+  size_t ghostLength = strlen(ghostBoard);
+  if (offset + 1 + ghostLength <= length && data[offset] == ghostLength &&
+      memcmp(data + offset + 1, ghostBoard, ghostLength) == 0) {
+    ghostFrames++;
+  }
+}
+
+void setUp() {
+  source = 0;
+  destination = LINE_LENGTH - 1;
+  sendStart = 5000;
+  messageCount = 0;
+  messageFlags = 0;
+  ghostBoard = NULL;
+  fillPeerTable = false;
+  ghostFrames = 0;
+}
+
+void tearDown() {}
+
+static void runLine(float loss, uint8_t flags, float* ratio,
+                    float* hopLatencyUs, int* hopCount) {
+  HostNetwork network(LINE_LENGTH, 3);
+  network.setLine(1);
+  network.setLoss(loss);
+  messageCount = MAX_MESSAGES;
+  messageFlags = flags;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard,
+                              sendStart + MAX_MESSAGES * MESSAGE_INTERVAL +
+                                  5000,
+                              TICK_US));
+  const Results* results = boards.results;
+  TEST_ASSERT_EQUAL(MAX_MESSAGES, results->sent);
+  *ratio = (float)results->received / results->sent;
+  *hopCount = results->hopCount;
+  *hopLatencyUs = results->received == 0
+                      ? 0
+                      : (float)results->latencyUs / results->received /
+                            (LINE_LENGTH - 1);
+}
+
+// Four hops with 10% frame loss per link, with and without QoS 1
+void test_hop_latency_and_delivery() {
+  float qos0Ratio, qos0Latency, qos1Ratio, qos1Latency;
+  int qos0Hops, qos1Hops;
+  runLine(0.1f, 0, &qos0Ratio, &qos0Latency, &qos0Hops);
+  runLine(0.1f, MESSAGE_QOS1, &qos1Ratio, &qos1Latency, &qos1Hops);
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "4 hops, 10%% loss: QoS 0 %.2f%% delivered, %.0f us/hop; "
+           "QoS 1 %.2f%% delivered, %.0f us/hop",
+           qos0Ratio * 100, qos0Latency, qos1Ratio * 100, qos1Latency);
+  TEST_MESSAGE(report);
+
+  // Acknowledgements teach the sender the route. QoS 0 messages teach it
+  // nothing, so they stay flooded, and a flood is not retried on loss.
+  TEST_ASSERT_EQUAL(-1, qos0Hops);
+  TEST_ASSERT_EQUAL(LINE_LENGTH - 1, qos1Hops);
+  TEST_ASSERT_GREATER_THAN(0.99f, qos1Ratio);
+  TEST_ASSERT_GREATER_THAN(qos0Ratio, qos1Ratio);
+  TEST_ASSERT_LESS_THAN(5000.0f, qos1Latency);
+}
+
+// A relay whose ESP-NOW peer table is full still forwards frames to a next
+// hop it cannot register
+void test_relay_with_full_peer_table() {
+  HostNetwork network(3, 5);
+  network.setLine(1);
+  source = 0;
+  destination = 2;
+  fillPeerTable = true;
+  messageCount = 20;
+  messageFlags = MESSAGE_QOS1;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard,
+                              sendStart + 20 * MESSAGE_INTERVAL + 2000,
+                              TICK_US * 4));
+  TEST_ASSERT_EQUAL(20, boards.results->sent);
+  TEST_ASSERT_EQUAL(20, boards.results->received);
+}
+
+// A stored message for a board nobody has heard of is flooded once, not
+// every STORED_RETRY_INTERVAL
+void test_unknown_board_is_not_flooded() {
+  HostNetwork network(LINE_LENGTH);
+  network.setLine(1);
+  network.setFrameObserver(countGhostFrames);
+  ghostBoard = "ghost";
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard,
+                              sendStart + 6 * STORED_RETRY_INTERVAL,
+                              TICK_US * 4));
+  TEST_ASSERT_GREATER_THAN(0, ghostFrames);
+  TEST_ASSERT_LESS_OR_EQUAL(LINE_LENGTH, ghostFrames);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_hop_latency_and_delivery);
+  RUN_TEST(test_relay_with_full_peer_table);
+  RUN_TEST(test_unknown_board_is_not_flooded);
+  return UNITY_END();
+}
@@ -0,0 +1,209 @@
+/**
+ * Group pin control in a simulated cell
+ *
+ * Board 0 controls a pin on every member of a group, first with one group
+ * command per round and then with one unicast command per member. The
+ * benchmark compares the time until every member has applied the command
+ * for 10 and 19 members, the most a board can unicast to, with and without
+ * frame loss. Two controllers using the same group name must not control
+ * each other's members.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+// ESP-NOW registers 20 peers, one of them the broadcast address
+#define MAX_MEMBERS (ESP_NOW_MAX_TOTAL_PEER_NUM - 1)
+#define ROUNDS 20       // Per mode; round r controls pin r
+#define ROUND_INTERVAL 1000
+#define DEFINE_AT_MS 2000
+#define ROUNDS_START_MS 15000
+#define TICK_US 250
+
+#define PIN_FROM_A 6  // Controller-check test: pins used by each controller
+#define PIN_FROM_B 5
+
+struct Results {
+  uint32_t startUs[2 * ROUNDS];
+  uint32_t appliedUs[2 * ROUNDS][MAX_MEMBERS + 1];
+  uint8_t applied[4][NUM_DIGITAL_PINS];  // Controller-check test
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static int memberCount;
+static bool twoControllers;
+
+// Board state, one copy per board process
+static bool defined;
+static int nextRound;  // Controller: the next round to start
+static uint32_t lastRound;
+
+static void onPin(const char* sender, uint8_t pin, uint8_t value) {
+  if (twoControllers) {
+    if (pin < NUM_DIGITAL_PINS) {
+      boards.results->applied[boards.self][pin] = 1;
+    }
+    return;
+  }
+  if (pin < 2 * ROUNDS && boards.results->appliedUs[pin][boards.self] == 0) {
+    boards.results->appliedUs[pin][boards.self] = micros();
+  }
+}
+
+static void setupBoard(int node) {
+  boards.comm->handlePinControl(onPin);
+}
+
+static void defineGroup(int firstMember, int count) {
+  char names[MAX_MEMBERS][16];
+  const char* ids[MAX_MEMBERS];
+  for (int i = 0; i < count; i++) {
+    boards.boardName(firstMember + i, names[i], sizeof(names[i]));
+    ids[i] = names[i];
+  }
+  boards.comm->defineBoardGroup("all", ids, count);
+}
+
+static void loopBenchmark(int node) {
+  if (node != 0) return;
+
+  uint32_t now = millis();
+  if (!defined && now >= DEFINE_AT_MS) {
+    defined = true;
+    defineGroup(1, memberCount);
+  }
+  if (now < ROUNDS_START_MS || nextRound >= 2 * ROUNDS ||
+      now - lastRound < ROUND_INTERVAL) {
+    return;
+  }
+
+  lastRound = now;
+  boards.results->startUs[nextRound] = micros();
+  if (nextRound < ROUNDS) {
+    boards.comm->controlGroupPin("all", nextRound, HIGH);
+  } else {
+    for (int m = 1; m <= memberCount; m++) {
+      char target[16];
+      boards.boardName(m, target, sizeof(target));
+      boards.comm->controlRemotePin(target, nextRound, HIGH);
+    }
+  }
+  nextRound++;
+}
+
+// Boards 0 and 1 each control a group named "all", with board 2 and board
+// 3 as their only members
+static void loopTwoControllers(int node) {
+  if (node > 1) return;
+
+  uint32_t now = millis();
+  if (!defined && now >= DEFINE_AT_MS) {
+    defined = true;
+    defineGroup(node + 2, 1);
+  }
+  if (nextRound == 0 && now >= ROUNDS_START_MS) {
+    nextRound = 1;
+    boards.comm->controlGroupPin("all", node == 0 ? PIN_FROM_A : PIN_FROM_B,
+                                 HIGH);
+  }
+}
+
+void setUp() { twoControllers = false; }
+
+void tearDown() {}
+
+struct Completion {
+  float averageMs;
+  float worstMs;
+  int incomplete;  // Rounds some member never applied
+};
+
+static Completion completion(int firstRound) {
+  const Results* results = boards.results;
+  Completion result = {0, 0, 0};
+  int complete = 0;
+  for (int r = firstRound; r < firstRound + ROUNDS; r++) {
+    uint32_t last = 0;
+    bool missing = false;
+    for (int m = 1; m <= memberCount; m++) {
+      uint32_t at = results->appliedUs[r][m];
+      if (at == 0) missing = true;
+      if (at - results->startUs[r] > last) last = at - results->startUs[r];
+    }
+    if (missing) {
+      result.incomplete++;
+      continue;
+    }
+    complete++;
+    result.averageMs += last / 1000.0f;
+    if (last / 1000.0f > result.worstMs) result.worstMs = last / 1000.0f;
+  }
+  if (complete > 0) result.averageMs /= complete;
+  return result;
+}
+
+static void runBenchmark(int members, float loss, Completion* group,
+                         Completion* unicast) {
+  HostNetwork network(members + 1, 9);
+  network.setLoss(loss);
+  memberCount = members;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBenchmark,
+                              ROUNDS_START_MS + 2 * ROUNDS * ROUND_INTERVAL +
+                                  1000,
+                              TICK_US));
+  *group = completion(0);
+  *unicast = completion(ROUNDS);
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "%d members, %.0f%% loss: group %.1f ms average, %.1f ms worst; "
+           "per-board unicast %.1f ms average, %.1f ms worst",
+           members, loss * 100, group->averageMs, group->worstMs,
+           unicast->averageMs, unicast->worstMs);
+  TEST_MESSAGE(report);
+}
+
+// Time until every member has applied a command, group versus unicast
+void test_group_versus_unicast_completion() {
+  const int sizes[] = {10, MAX_MEMBERS};
+  const float losses[] = {0.0f, 0.1f};
+  for (int s = 0; s < 2; s++) {
+    for (int l = 0; l < 2; l++) {
+      Completion group, unicast;
+      runBenchmark(sizes[s], losses[l], &group, &unicast);
+      TEST_ASSERT_EQUAL(0, group.incomplete);
+      TEST_ASSERT_EQUAL(0, unicast.incomplete);
+      if (losses[l] == 0.0f) {
+        TEST_ASSERT_LESS_THAN(unicast.averageMs, group.averageMs);
+      }
+    }
+  }
+}
+
+// A member only answers to the controller that enrolled it, even when
+// another controller's group has the same name and ID
+void test_member_ignores_other_controllers() {
+  HostNetwork network(4, 3);
+  twoControllers = true;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopTwoControllers,
+                              ROUNDS_START_MS + 1000));
+  const Results* results = boards.results;
+  TEST_ASSERT_EQUAL(1, results->applied[2][PIN_FROM_A]);
+  TEST_ASSERT_EQUAL(0, results->applied[2][PIN_FROM_B]);
+  TEST_ASSERT_EQUAL(1, results->applied[3][PIN_FROM_B]);
+  TEST_ASSERT_EQUAL(0, results->applied[3][PIN_FROM_A]);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_member_ignores_other_controllers);
+  RUN_TEST(test_group_versus_unicast_completion);
+  return UNITY_END();
+}
@@ -0,0 +1,180 @@
+/**
+ * Scheduled pin control in a simulated cell
+ *
+ * Board 0 schedules a pin on every other board, alternating between one
+ * unicast command per board and one group broadcast, while the responders
+ * load the channel with topic messages. The simulated clock is shared by all
+ * boards, so each responder records when its pin actually switched and the
+ * test compares that with the target time, with and without frame loss. The
+ * skew the controller is told about must match the one measured.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define RESPONDERS 4
+#define ROUNDS 40  // Round r switches pin r; even rounds unicast, odd group
+#define LEAD_US 50000
+#define ROUND_INTERVAL 100
+#define SYNC_AT_MS 2000
+#define ROUNDS_START_MS 3000
+#define LOAD_INTERVAL 50  // Topic messages from each responder (ms)
+#define TICK_US 20
+
+struct Results {
+  uint32_t targetUs[ROUNDS];
+  uint32_t appliedUs[ROUNDS][RESPONDERS + 1];
+  int32_t reportedSkew[ROUNDS][RESPONDERS + 1];
+  bool reported[ROUNDS][RESPONDERS + 1];
+};
+
+static HostBoards<Results> boards;
+
+// Board state, one copy per board process
+static bool synced;
+static int nextRound;  // Controller: the next round to start
+static uint32_t lastRound;
+static uint32_t lastLoad;
+
+static void onPin(const char* sender, uint8_t pin, uint8_t value) {
+  if (pin < ROUNDS && boards.results->appliedUs[pin][boards.self] == 0) {
+    boards.results->appliedUs[pin][boards.self] = micros();
+  }
+}
+
+static void onScheduled(const char* boardId, uint8_t pin, uint8_t value,
+                        uint8_t status, int32_t skewUs) {
+  int board = atoi(boardId + strlen("board"));
+  if (pin < ROUNDS && board > 0 && board <= RESPONDERS) {
+    boards.results->reportedSkew[pin][board] = skewUs;
+    boards.results->reported[pin][board] = true;
+  }
+}
+
+static void setupBoard(int node) {
+  boards.comm->handlePinControl(onPin);
+  boards.comm->onScheduledPinResult(onScheduled);
+}
+
+static void loopBoard(int node) {
+  uint32_t now = millis();
+
+  if (node != 0) {
+    if (now - lastLoad >= LOAD_INTERVAL) {
+      lastLoad = now;
+      boards.comm->publishTopic("load",
+                                "0123456789012345678901234567890123456789"
+                                "0123456789012345678901234567890123456789");
+    }
+    return;
+  }
+
+  char names[RESPONDERS][16];
+  const char* ids[RESPONDERS];
+  for (int i = 0; i < RESPONDERS; i++) {
+    boards.boardName(i + 1, names[i], sizeof(names[i]));
+    ids[i] = names[i];
+  }
+
+  if (!synced && now >= SYNC_AT_MS) {
+    synced = true;
+    for (int i = 0; i < RESPONDERS; i++) boards.comm->syncClockWith(ids[i]);
+  }
+  if (now < ROUNDS_START_MS || nextRound >= ROUNDS ||
+      now - lastRound < ROUND_INTERVAL) {
+    return;
+  }
+
+  lastRound = now;
+  uint32_t target = boards.comm->getNetworkTime() + LEAD_US;
+  boards.results->targetUs[nextRound] = target;
+  if (nextRound % 2 == 0) {
+    for (int i = 0; i < RESPONDERS; i++) {
+      boards.comm->controlRemotePinAt(ids[i], nextRound, HIGH, target);
+    }
+  } else {
+    boards.comm->controlRemotePinsAt(ids, RESPONDERS, nextRound, HIGH, target);
+  }
+  nextRound++;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+struct Accuracy {
+  int applied;
+  int missing;
+  float averageUs;  // Of the absolute error
+  int32_t worstUs;
+  int32_t worstReportErrorUs;  // Reported skew against the measured one
+};
+
+static Accuracy runSchedule(float loss, uint32_t seed) {
+  HostNetwork network(RESPONDERS + 1, seed);
+  network.setLoss(loss);
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard,
+                              ROUNDS_START_MS + ROUNDS * ROUND_INTERVAL + 1000,
+                              TICK_US));
+
+  const Results* results = boards.results;
+  Accuracy accuracy = {0, 0, 0, 0, 0};
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int b = 1; b <= RESPONDERS; b++) {
+      if (results->appliedUs[r][b] == 0) {
+        accuracy.missing++;
+        continue;
+      }
+      int32_t error =
+          (int32_t)(results->appliedUs[r][b] - results->targetUs[r]);
+      accuracy.applied++;
+      accuracy.averageUs += abs(error);
+      if (abs(error) > accuracy.worstUs) accuracy.worstUs = abs(error);
+      if (results->reported[r][b]) {
+        int32_t reportError = abs(results->reportedSkew[r][b] - error);
+        if (reportError > accuracy.worstReportErrorUs) {
+          accuracy.worstReportErrorUs = reportError;
+        }
+      }
+    }
+  }
+  if (accuracy.applied > 0) accuracy.averageUs /= accuracy.applied;
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "%.0f%% loss: %d commands applied, %d lost; error from target "
+           "%.1f us average, %d us worst; reported skew off by %d us",
+           loss * 100, accuracy.applied, accuracy.missing, accuracy.averageUs,
+           (int)accuracy.worstUs, (int)accuracy.worstReportErrorUs);
+  TEST_MESSAGE(report);
+  return accuracy;
+}
+
+// Commands fire at the target time on the responder's clock, whatever
+// their delivery latency
+void test_fire_time_matches_target() {
+  Accuracy accuracy = runSchedule(0.0f, 3);
+  TEST_ASSERT_EQUAL(0, accuracy.missing);
+  TEST_ASSERT_LESS_THAN(100, accuracy.worstUs);
+  TEST_ASSERT_LESS_THAN(100, accuracy.worstReportErrorUs);
+}
+
+// Unicast retransmissions delay the frame but not the switching instant.
+// Group broadcasts are sent once, so some of them are lost.
+void test_fire_time_with_retransmissions() {
+  Accuracy accuracy = runSchedule(0.2f, 5);
+  TEST_ASSERT_GREATER_THAN(ROUNDS * RESPONDERS / 2, accuracy.applied);
+  TEST_ASSERT_LESS_THAN(100, accuracy.worstUs);
+  TEST_ASSERT_LESS_THAN(100, accuracy.worstReportErrorUs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fire_time_matches_target);
+  RUN_TEST(test_fire_time_with_retransmissions);
+  return UNITY_END();
+}
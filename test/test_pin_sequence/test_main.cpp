@@ -0,0 +1,226 @@
+/**
+ * Remote pin sequences between two simulated boards
+ *
+ * Board 0 uploads a program to board 1 and collects its status reports.
+ * The tests run a program with a loop and a progress report, and programs
+ * that wait for an input which arrives or times out, and check the pin
+ * writes and the order of the reports. A wait pin is switched to an input
+ * only when the library drives pin control itself; a pin the sketch hands
+ * to a callback keeps the mode the sketch gave it.
+ */
+
+#include <HostBoards.h>
+#include <HostHooks.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define BLINK_PIN 13
+#define WAIT_PIN 4
+#define RELAY_PIN 26
+#define BLINKS 3
+#define SEND_AT_MS 2000
+#define INPUT_AT_MS (SEND_AT_MS + 300)
+#define WAIT_TIMEOUT_MS 500
+#define RUN_MS (SEND_AT_MS + 1500)
+#define MAX_REPORTS 8
+
+// How the peripheral's sketch takes pin control
+#define HANDLER_NONE 0    // The library sets pins itself
+#define HANDLER_GLOBAL 1  // handlePinControl() callback
+#define HANDLER_PIN 2     // acceptPinControlFrom() for the relay and wait pins
+
+struct Results {
+  uint32_t sentAt;  // When the controller uploaded the program
+  uint8_t highs;  // Blink pin writes the peripheral's callback got
+  uint8_t lows;
+  uint32_t relayHighAt;  // When the peripheral's relay pin went high, or 0
+  uint32_t relayLowAt;   // When it went low again, or 0
+  uint8_t waitPinMode;   // The peripheral's wait pin mode at the end
+  uint8_t reportCount;   // Status reports the controller got, in order
+  uint8_t statuses[MAX_REPORTS];
+  uint8_t tags[MAX_REPORTS];
+  uint32_t reportedAt[MAX_REPORTS];
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static uint8_t handler;
+static bool inputArrives;  // The peripheral's wait pin goes high
+static void (*buildProgram)(PinSequence& sequence);
+
+// Board state, one copy per board process
+static bool sent;
+static bool relayHigh;
+
+static void buildBlinkProgram(PinSequence& sequence) {
+  sequence.loop(BLINKS);
+  sequence.set(BLINK_PIN, HIGH);
+  sequence.delayMs(10);
+  sequence.set(BLINK_PIN, LOW);
+  sequence.delayMs(10);
+  sequence.endLoop();
+  sequence.report(1);
+  sequence.set(RELAY_PIN, HIGH);
+}
+
+static void buildWaitProgram(PinSequence& sequence) {
+  sequence.set(RELAY_PIN, HIGH);
+  sequence.report(1);
+  sequence.waitInput(WAIT_PIN, HIGH, WAIT_TIMEOUT_MS);
+  sequence.report(2);
+  sequence.set(RELAY_PIN, LOW);
+}
+
+// Pin control callback that drives the pin, as a sketch would
+static void onPin(const char* sender, uint8_t pin, uint8_t value) {
+  if (pin == BLINK_PIN) {
+    if (value == HIGH) boards.results->highs++;
+    if (value == LOW) boards.results->lows++;
+  }
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, value);
+}
+
+static void onSequence(const char* boardId, uint8_t sequenceId,
+                       uint8_t status, uint8_t tag) {
+  Results* results = boards.results;
+  if (sequenceId != 1 || results->reportCount == MAX_REPORTS) return;
+  results->statuses[results->reportCount] = status;
+  results->tags[results->reportCount] = tag;
+  results->reportedAt[results->reportCount] = millis();
+  results->reportCount++;
+}
+
+static void setupBoard(int node) {
+  if (node == 0) {
+    boards.comm->onPinSequenceStatus(onSequence);
+    return;
+  }
+
+  // The sketch's own choice of mode for the wait pin
+  pinMode(WAIT_PIN, INPUT_PULLUP);
+  if (handler == HANDLER_GLOBAL) {
+    boards.comm->handlePinControl(onPin);
+  } else if (handler == HANDLER_PIN) {
+    boards.comm->acceptPinControlFrom("board0", RELAY_PIN, onPin);
+    boards.comm->acceptPinControlFrom("board0", WAIT_PIN, onPin);
+  }
+}
+
+static void loopBoard(int node) {
+  if (node == 0) {
+    if (!sent && millis() >= SEND_AT_MS &&
+        boards.comm->isBoardAvailable("board1")) {
+      sent = true;
+      boards.results->sentAt = millis();
+      PinSequence sequence;
+      buildProgram(sequence);
+      boards.comm->runRemotePinSequence("board1", 1, sequence);
+    }
+    return;
+  }
+
+  if (inputArrives && millis() >= INPUT_AT_MS) {
+    host::setPinInput(WAIT_PIN, HIGH);
+  }
+
+  bool high = host::pinOutput(RELAY_PIN) == HIGH;
+  if (high && !relayHigh) boards.results->relayHighAt = millis();
+  if (!high && relayHigh) boards.results->relayLowAt = millis();
+  relayHigh = high;
+  boards.results->waitPinMode = host::pinModeOf(WAIT_PIN);
+}
+
+void setUp() {
+  handler = HANDLER_NONE;
+  inputArrives = false;
+}
+
+void tearDown() {}
+
+static void assertReport(int index, uint8_t status, uint8_t tag) {
+  TEST_ASSERT_GREATER_THAN(index, boards.results->reportCount);
+  TEST_ASSERT_EQUAL(status, boards.results->statuses[index]);
+  TEST_ASSERT_EQUAL(tag, boards.results->tags[index]);
+}
+
+// A loop runs its body the given number of times, and the report and the
+// completion arrive in order once the writes after the loop are made
+void test_program_runs_loop_and_reports() {
+  HostNetwork network(2);
+  handler = HANDLER_GLOBAL;
+  buildProgram = buildBlinkProgram;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, RUN_MS));
+  TEST_ASSERT_EQUAL(BLINKS, boards.results->highs);
+  TEST_ASSERT_EQUAL(BLINKS, boards.results->lows);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->relayHighAt);
+  TEST_ASSERT_EQUAL(2, boards.results->reportCount);
+  assertReport(0, PIN_SEQUENCE_PROGRESS, 1);
+  assertReport(1, PIN_SEQUENCE_COMPLETE, 0);
+}
+
+// The program holds at the wait until the input arrives, then runs on
+void test_wait_resumes_on_input() {
+  HostNetwork network(2);
+  inputArrives = true;
+  buildProgram = buildWaitProgram;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, RUN_MS));
+  TEST_ASSERT_LESS_THAN(INPUT_AT_MS, boards.results->sentAt);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->relayHighAt);
+  TEST_ASSERT_LESS_THAN(INPUT_AT_MS, boards.results->relayHighAt);
+  TEST_ASSERT_GREATER_OR_EQUAL(INPUT_AT_MS, boards.results->relayLowAt);
+  TEST_ASSERT_EQUAL(3, boards.results->reportCount);
+  assertReport(0, PIN_SEQUENCE_PROGRESS, 1);
+  assertReport(1, PIN_SEQUENCE_PROGRESS, 2);
+  assertReport(2, PIN_SEQUENCE_COMPLETE, 0);
+  TEST_ASSERT_GREATER_OR_EQUAL(INPUT_AT_MS, boards.results->reportedAt[1]);
+}
+
+// Without the input the wait times out and the rest is skipped
+void test_wait_times_out() {
+  HostNetwork network(2);
+  buildProgram = buildWaitProgram;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, RUN_MS));
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->relayHighAt);
+  TEST_ASSERT_EQUAL(0, boards.results->relayLowAt);
+  TEST_ASSERT_EQUAL(2, boards.results->reportCount);
+  assertReport(0, PIN_SEQUENCE_PROGRESS, 1);
+  assertReport(1, PIN_SEQUENCE_TIMEOUT, 0);
+  TEST_ASSERT_GREATER_OR_EQUAL(boards.results->sentAt + WAIT_TIMEOUT_MS,
+                               boards.results->reportedAt[1]);
+}
+
+// The library switches the wait pin to an input only when it drives pin
+// control itself. The wait reads the pin in whatever mode it is in.
+void test_wait_pin_mode_is_left_to_callbacks() {
+  static const uint8_t handlers[] = {HANDLER_NONE, HANDLER_GLOBAL,
+                                     HANDLER_PIN};
+  static const uint8_t modes[] = {INPUT, INPUT_PULLUP, INPUT_PULLUP};
+
+  for (int i = 0; i < 3; i++) {
+    HostNetwork network(2);
+    handler = handlers[i];
+    inputArrives = true;
+    buildProgram = buildWaitProgram;
+
+    TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, RUN_MS));
+    TEST_ASSERT_EQUAL_HEX8(modes[i], boards.results->waitPinMode);
+    TEST_ASSERT_GREATER_OR_EQUAL(INPUT_AT_MS, boards.results->relayLowAt);
+    assertReport(2, PIN_SEQUENCE_COMPLETE, 0);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_program_runs_loop_and_reports);
+  RUN_TEST(test_wait_resumes_on_input);
+  RUN_TEST(test_wait_times_out);
+  RUN_TEST(test_wait_pin_mode_is_left_to_callbacks);
+  return UNITY_END();
+}
@@ -0,0 +1,260 @@
+/**
+ * Startup with and without an access point
+ *
+ * Boards join a simulated access point after an association delay, or run
+ * ESP-NOW only. The tests measure the time from begin() to the first frame
+ * in both modes, check that a sketch can register its subscriptions before
+ * the board is ready, and that a board that fell back to ESP-NOW only
+ * tries the access point again only when asked to, and then only on the
+ * channel its peers are on.
+ */
+
+#include <HostBoards.h>
+#include <HostHooks.h>
+#include <HostNetwork.h>
+#include <WiFi.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define AP_CHANNEL 6
+#define CONTROL_PIN 2
+#define SEND_INTERVAL 500
+#define AP_BACK_AT_MS 20000  // When the access point comes back
+
+// Boards of the time to first frame test, by startup mode
+enum StartupMode { MODE_ESPNOW_ONLY, MODE_AP_FAST, MODE_AP_SLOW, MODE_COUNT };
+
+static const uint32_t kAssociationMs[MODE_COUNT] = {0, 300, 3000};
+
+struct Results {
+  int32_t firstFrameMs[MODE_COUNT];
+  bool registered;           // Every registration before READY returned true
+  uint32_t readyAt;          // When board 1 was ready
+  uint32_t pinControlAt;     // When board 1 took pin control, or 0
+  uint32_t topicAt;          // When board 1 got a topic message, or 0
+  uint32_t pinStateAt;       // When board 1 got a pin state, or 0
+  uint32_t joinedAt;         // When board 1 joined the access point, or 0
+  uint8_t fallbackChannel;   // Board 1's channel before the retry
+  uint8_t finalChannel;      // Board 1's channel at the end
+  bool peerAvailable;        // Board 1 still saw board 0 at the end
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static uint32_t retryInterval;  // Board 1's enableWifiRetry(), 0 for off
+static uint8_t apBackChannel;   // Channel the access point comes back on
+
+// Board state, one copy per board process
+static uint32_t lastSend;
+static bool apBack;
+
+static void startFirstFrame(int node, const char* boardId) {
+  if (node == MODE_ESPNOW_ONLY) {
+    boards.comm->beginEspNowOnly(boardId, AP_CHANNEL);
+  } else {
+    boards.comm->begin("test-ap", "password", boardId);
+  }
+}
+
+static void loopFirstFrame(int node) {
+  boards.results->firstFrameMs[node] = boards.comm->getTimeToFirstFrame();
+}
+
+static void onPinControl(const char* sender, uint8_t pin, uint8_t value) {
+  if (boards.results->pinControlAt == 0) {
+    boards.results->pinControlAt = millis();
+  }
+}
+
+static void onPinState(const char* sender, uint8_t pin, uint8_t value) {
+  if (boards.results->pinStateAt == 0) boards.results->pinStateAt = millis();
+}
+
+static void onTopic(const char* sender, const char* topic,
+                    const char* message) {
+  if (boards.results->topicAt == 0) boards.results->topicAt = millis();
+}
+
+static void startWithAccessPoint(int node, const char* boardId) {
+  boards.comm->begin("test-ap", "password", boardId);
+}
+
+// Board 1 registers everything in setup(), before it is ready; board 0
+// controls its pin and publishes to it once it sees it
+static void setupRegistration(int node) {
+  if (node != 1) return;
+
+  boards.results->registered =
+      boards.comm->acceptPinControlFrom("board0", CONTROL_PIN, onPinControl) &&
+      boards.comm->listenForPinStateFrom("board0", CONTROL_PIN, onPinState) &&
+      boards.comm->subscribeTopic("lights/#", onTopic) &&
+      boards.comm->getStartupState() != STARTUP_READY;
+}
+
+static void loopRegistration(int node) {
+  if (node == 1) {
+    if (boards.results->readyAt == 0 &&
+        boards.comm->getStartupState() == STARTUP_READY) {
+      boards.results->readyAt = millis();
+    }
+    return;
+  }
+
+  if (!boards.comm->isBoardAvailable("board1")) return;
+  if (millis() - lastSend < SEND_INTERVAL) return;
+  lastSend = millis();
+  boards.comm->controlRemotePin("board1", CONTROL_PIN, HIGH);
+  boards.comm->broadcastPinState(CONTROL_PIN, HIGH);
+  boards.comm->publishTopic("lights/kitchen", "on");
+}
+
+// Board 0 runs ESP-NOW only on the default channel. Board 1 finds its
+// access point out of reach, falls back to the same channel, and the access
+// point comes back later.
+static void startRetry(int node, const char* boardId) {
+  if (node == 0) {
+    boards.comm->beginEspNowOnly(boardId);
+    return;
+  }
+  boards.comm->begin("test-ap", "password", boardId);
+  if (retryInterval != 0) boards.comm->enableWifiRetry(retryInterval);
+}
+
+static void loopRetry(int node) {
+  if (node != 1) return;
+
+  uint32_t now = millis();
+  if (!apBack && now >= AP_BACK_AT_MS) {
+    apBack = true;
+    boards.results->fallbackChannel = WiFi.channel();
+    host::setAccessPoint(true, apBackChannel, 300);
+  }
+  if (boards.results->joinedAt == 0 && WiFi.status() == WL_CONNECTED) {
+    boards.results->joinedAt = now;
+  }
+  boards.results->finalChannel = host::channel();
+  boards.results->peerAvailable = boards.comm->isBoardAvailable("board0");
+}
+
+// Run the retry boards until the access point has had two chances
+//
+// @return When board 1 joined the access point, or 0
+static uint32_t runRetry() {
+  HostNetwork network(2, 7);
+  network.setAccessPoint(1, false, apBackChannel, 300);
+
+  uint32_t duration = AP_BACK_AT_MS + 2 * WIFI_RETRY_INTERVAL;
+  TEST_ASSERT_TRUE(boards.run(network, startRetry, NULL, loopRetry, duration));
+  TEST_ASSERT_EQUAL(ESPNOW_DEFAULT_CHANNEL, boards.results->fallbackChannel);
+  TEST_ASSERT_EQUAL(ESPNOW_DEFAULT_CHANNEL, boards.results->finalChannel);
+  TEST_ASSERT_TRUE(boards.results->peerAvailable);
+  return boards.results->joinedAt;
+}
+
+void setUp() {
+  retryInterval = 0;
+  apBackChannel = ESPNOW_DEFAULT_CHANNEL;
+}
+
+void tearDown() {}
+
+// ESP-NOW only puts the first frame on the air at once; with an access
+// point it waits for the association
+void test_time_to_first_frame() {
+  HostNetwork network(MODE_COUNT, 3);
+  for (int i = MODE_AP_FAST; i < MODE_COUNT; i++) {
+    network.setAccessPoint(i, true, AP_CHANNEL, kAssociationMs[i]);
+  }
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, startFirstFrame, NULL, loopFirstFrame, 6000));
+  const Results* results = boards.results;
+
+  char report[128];
+  snprintf(report, sizeof(report),
+           "first frame after %d ms ESP-NOW only, %d ms with a %u ms "
+           "association, %d ms with a %u ms association",
+           (int)results->firstFrameMs[MODE_ESPNOW_ONLY],
+           (int)results->firstFrameMs[MODE_AP_FAST],
+           (unsigned)kAssociationMs[MODE_AP_FAST],
+           (int)results->firstFrameMs[MODE_AP_SLOW],
+           (unsigned)kAssociationMs[MODE_AP_SLOW]);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, results->firstFrameMs[MODE_ESPNOW_ONLY]);
+  TEST_ASSERT_LESS_THAN(100, results->firstFrameMs[MODE_ESPNOW_ONLY]);
+  for (int i = MODE_AP_FAST; i < MODE_COUNT; i++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(kAssociationMs[i], results->firstFrameMs[i]);
+    TEST_ASSERT_LESS_THAN(kAssociationMs[i] + 100, results->firstFrameMs[i]);
+  }
+}
+
+// Subscriptions registered before READY are announced once the board is
+// up, so pin control and topic messages reach it without a second call
+void test_registration_before_ready() {
+  HostNetwork network(2, 5);
+  for (int i = 0; i < 2; i++) {
+    network.setAccessPoint(i, true, AP_CHANNEL, 2000);
+  }
+
+  TEST_ASSERT_TRUE(boards.run(network, startWithAccessPoint, setupRegistration,
+                              loopRegistration, 10000));
+  const Results* results = boards.results;
+  TEST_ASSERT_TRUE(results->registered);
+  TEST_ASSERT_NOT_EQUAL(0, results->readyAt);
+  TEST_ASSERT_NOT_EQUAL(0, results->pinControlAt);
+  TEST_ASSERT_NOT_EQUAL(0, results->pinStateAt);
+  TEST_ASSERT_NOT_EQUAL(0, results->topicAt);
+
+  char report[128];
+  snprintf(report, sizeof(report),
+           "registered before READY: pin control %u ms, pin state %u ms "
+           "and topic %u ms after READY",
+           (unsigned)(results->pinControlAt - results->readyAt),
+           (unsigned)(results->pinStateAt - results->readyAt),
+           (unsigned)(results->topicAt - results->readyAt));
+  TEST_MESSAGE(report);
+}
+
+// Without enableWifiRetry() the board stays on ESP-NOW only, with its
+// radio on its peers' channel, even once the access point is back
+void test_access_point_not_retried_by_default() {
+  TEST_ASSERT_EQUAL(0, runRetry());
+}
+
+// With the retry on, the board joins an access point on its own channel
+// and keeps hearing its peers
+void test_access_point_retried_on_own_channel() {
+  retryInterval = WIFI_RETRY_INTERVAL;
+  uint32_t joinedAt = runRetry();
+  TEST_ASSERT_NOT_EQUAL(0, joinedAt);
+  TEST_ASSERT_LESS_OR_EQUAL(AP_BACK_AT_MS + WIFI_RETRY_INTERVAL +
+                                WIFI_CONNECT_TIMEOUT,
+                            joinedAt);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "access point back at %u ms, joined at %u ms",
+           (unsigned)AP_BACK_AT_MS, (unsigned)joinedAt);
+  TEST_MESSAGE(report);
+}
+
+// An access point on another channel is not joined, so the board does not
+// leave the boards on its channel
+void test_access_point_on_other_channel_not_joined() {
+  retryInterval = WIFI_RETRY_INTERVAL;
+  apBackChannel = AP_CHANNEL;
+  TEST_ASSERT_EQUAL(0, runRetry());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_time_to_first_frame);
+  RUN_TEST(test_registration_before_ready);
+  RUN_TEST(test_access_point_not_retried_by_default);
+  RUN_TEST(test_access_point_retried_on_own_channel);
+  RUN_TEST(test_access_point_on_other_channel_not_joined);
+  return UNITY_END();
+}
@@ -0,0 +1,204 @@
+/**
+ * Reliable serial stream between two simulated boards
+ *
+ * Board 0 writes a counting byte pattern into the stream as fast as it is
+ * taken, board 1 reads it and checks that no byte is missing or out of
+ * order. Reopening the receiving side mid-stream must not stall the sender.
+ * Without loss, the stream must fill the link at the default 1 Mbps and
+ * keep up with a 921600 baud UART at 2 Mbps.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define PATTERN_PERIOD 251  // Prime, so the pattern never lines up with a ring
+#define MEASURE_FROM 1000   // Throughput window, once the stream is up (ms)
+#define MEASURE_TO 6000
+#define UART_BAUD 921600
+#define UART_BITS_PER_BYTE 10  // Start, 8 data and stop bits
+
+struct Results {
+  uint32_t received;       // Bytes read by board 1
+  uint32_t receivedAfter;  // Of those, read after it reopened its stream
+  uint32_t errors;         // Bytes that did not continue the pattern
+  uint32_t reopenedAt;
+  uint32_t resumedAt;  // First byte read after reopening, 0 if none
+  uint32_t measured;   // Bytes read from MEASURE_FROM to MEASURE_TO
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static uint32_t reopenAt;  // When board 1 reopens its stream, 0 for never
+static wifi_phy_rate_t phyRate;
+
+// Board state, one copy per board process
+static bool opened;
+static bool reopened;
+static uint8_t nextByte;
+static bool haveLast;
+static uint8_t lastByte;
+
+static void startAtRate(int node, const char* boardId) {
+  boards.comm->setEspNowRate(phyRate);
+  boards.comm->beginEspNowOnly(boardId, 1);
+}
+
+static void writePattern() {
+  uint8_t buffer[256];
+  int writable = boards.comm->serialStreamWritable();
+  size_t count = writable < (int)sizeof(buffer) ? writable : sizeof(buffer);
+  for (size_t i = 0; i < count; i++) {
+    buffer[i] = nextByte;
+    nextByte = (nextByte + 1) % PATTERN_PERIOD;
+  }
+  if (count > 0) boards.comm->writeSerialStream(buffer, count);
+}
+
+static void readPattern() {
+  uint8_t buffer[256];
+  size_t count = boards.comm->readSerialStream(buffer, sizeof(buffer));
+  for (size_t i = 0; i < count; i++) {
+    if (haveLast && buffer[i] != (lastByte + 1) % PATTERN_PERIOD) {
+      boards.results->errors++;
+    }
+    lastByte = buffer[i];
+    haveLast = true;
+  }
+
+  boards.results->received += count;
+  if (millis() >= MEASURE_FROM && millis() < MEASURE_TO) {
+    boards.results->measured += count;
+  }
+  if (reopened && count > 0) {
+    if (boards.results->resumedAt == 0) boards.results->resumedAt = millis();
+    boards.results->receivedAfter += count;
+  }
+}
+
+static void loopBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+
+  if (!opened) {
+    opened = true;
+    boards.comm->openSerialStream(node == 0 ? "board1" : "board0");
+  }
+
+  if (node == 0) {
+    writePattern();
+    return;
+  }
+
+  if (reopenAt != 0 && !reopened && millis() >= reopenAt) {
+    // Bytes in flight to the old stream are lost; the pattern restarts
+    reopened = true;
+    haveLast = false;
+    boards.comm->closeSerialStream();
+    boards.comm->openSerialStream("board0");
+    boards.results->reopenedAt = millis();
+  }
+  readPattern();
+}
+
+void setUp() {
+  reopenAt = 0;
+  phyRate = WIFI_PHY_RATE_1M_L;
+}
+
+void tearDown() {}
+
+// The pattern arrives complete and in order on a lossy link
+void test_stream_delivers_in_order() {
+  HostNetwork network(2, 11);
+  network.setLoss(0.1f);
+
+  TEST_ASSERT_TRUE(boards.run(network, startAtRate, NULL, loopBoard, 5000));
+  TEST_ASSERT_GREATER_THAN(10000, boards.results->received);
+  TEST_ASSERT_EQUAL(0, boards.results->errors);
+}
+
+// Stream bytes per second from board 0 to board 1 without loss
+static float measureThroughput(wifi_phy_rate_t rate) {
+  HostNetwork network(2, 11);
+  phyRate = rate;
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, startAtRate, NULL, loopBoard, MEASURE_TO + 500));
+  TEST_ASSERT_EQUAL(0, boards.results->errors);
+  return boards.results->measured * 1000.0f / (MEASURE_TO - MEASURE_FROM);
+}
+
+// The most a stream can carry at 1 Mbps: one full segment and its
+// acknowledgement, each acknowledged by the radio, per round
+static float linkLimit() {
+  size_t segment = MAX_ESP_NOW_DATA_SIZE - BINARY_FRAME_HEADER_SIZE -
+                   strlen("board0") - STREAM_HEADER_SIZE;
+  size_t ack = BINARY_FRAME_HEADER_SIZE + strlen("board1") + STREAM_ACK_SIZE;
+  uint32_t radioAckUs = HOST_PHY_SIFS_US + HOST_PHY_PREAMBLE_US +
+                        HOST_PHY_ACK_BYTES * 8;
+  uint32_t roundUs =
+      2 * HOST_PHY_PREAMBLE_US +
+      (2 * HOST_PHY_OVERHEAD_BYTES + MAX_ESP_NOW_DATA_SIZE + ack) * 8 +
+      2 * radioAckUs;
+  return segment * 1e6f / roundUs;
+}
+
+// Full segments go out as soon as the peer acknowledges the ones before,
+// so the stream takes the whole link
+void test_stream_fills_link() {
+  float limit = linkLimit();
+  float throughput = measureThroughput(WIFI_PHY_RATE_1M_L);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "1 Mbps: %.0f bytes/s, %.0f%% of the %.0f bytes/s link limit",
+           throughput, throughput * 100 / limit, limit);
+  TEST_MESSAGE(report);
+  TEST_ASSERT_GREATER_THAN(0.95f * limit, throughput);
+}
+
+// A 921600 baud UART needs a faster rate than 1 Mbps; at 2 Mbps the stream
+// keeps up with it
+void test_stream_keeps_up_with_uart() {
+  float uart = (float)UART_BAUD / UART_BITS_PER_BYTE;
+  float throughput = measureThroughput(WIFI_PHY_RATE_2M_L);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "2 Mbps: %.0f bytes/s, %.0f%% of a %u baud UART", throughput,
+           throughput * 100 / uart, (unsigned)UART_BAUD);
+  TEST_MESSAGE(report);
+  TEST_ASSERT_GREATER_THAN(uart, throughput);
+}
+
+// The receiver reopens its side mid-stream. The sender's next segments
+// belong to a session the receiver no longer holds, and the stream has to
+// restart instead of stalling.
+void test_stream_resumes_after_receiver_reopens() {
+  HostNetwork network(2, 11);
+  network.setLoss(0.1f);
+  reopenAt = 3000;
+
+  TEST_ASSERT_TRUE(boards.run(network, startAtRate, NULL, loopBoard, 8000));
+  TEST_ASSERT_EQUAL(0, boards.results->errors);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->resumedAt);
+  TEST_ASSERT_GREATER_THAN(10000, boards.results->receivedAfter);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "stream resumed %u ms after the receiver reopened, 10%% loss",
+           (unsigned)(boards.results->resumedAt - boards.results->reopenedAt));
+  TEST_MESSAGE(report);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stream_delivers_in_order);
+  RUN_TEST(test_stream_fills_link);
+  RUN_TEST(test_stream_keeps_up_with_uart);
+  RUN_TEST(test_stream_resumes_after_receiver_reopens);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+/**
+ * Topic IDs shared by two topic names
+ *
+ * "line171/temp" and "line536/temp" hash to the same 16-bit topic ID.
+ * Board 0 publishes one of them, and board 1 starts publishing the other
+ * once board 0 has stopped sending its topic's name. Board 2 subscribes to
+ * both names and board 3 to a wildcard matching both. Whichever name comes
+ * second, the two topics must end up under different IDs, and every message
+ * must reach its subscribers under its own name.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define BOARDS 4
+#define PUBLISHERS 2  // Boards 0 and 1
+#define SMALLER_TOPIC "line171/temp"
+#define LARGER_TOPIC "line536/temp"
+#define WILDCARD "+/temp"
+#define EARLY_START_MS 1000
+#define LATE_START_MS 3000  // The early topic's name is no longer sent
+#define PUBLISH_END_MS 6000
+#define PUBLISH_INTERVAL 100
+#define MAX_PUBLISHES 64
+
+struct Results {
+  uint16_t initialIds[PUBLISHERS];  // Before the publisher heard the other
+  uint16_t finalIds[PUBLISHERS];
+  uint32_t published[PUBLISHERS];
+  uint32_t received[BOARDS][PUBLISHERS];
+  uint32_t misdelivered[BOARDS];  // Delivered under the other topic's name
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static const char* topics[PUBLISHERS];  // Published by boards 0 and 1
+
+// Board state, one copy per board process
+static uint32_t publishes;
+static uint32_t lastPublish;
+static uint8_t seen[PUBLISHERS][MAX_PUBLISHES];
+
+static void onTopic(const char* sender, const char* topic,
+                    const uint8_t* data, size_t length) {
+  int publisher = atoi(sender + strlen("board"));
+  uint32_t sequence;
+  if (publisher >= PUBLISHERS || length != sizeof(sequence)) return;
+  memcpy(&sequence, data, sizeof(sequence));
+
+  if (strcmp(topic, topics[publisher]) != 0) {
+    boards.results->misdelivered[boards.self]++;
+    return;
+  }
+  if (sequence >= MAX_PUBLISHES || seen[publisher][sequence]) return;
+  seen[publisher][sequence] = 1;
+  boards.results->received[boards.self][publisher]++;
+}
+
+static void setupBoard(int node) {
+  if (node < PUBLISHERS) {
+    boards.results->initialIds[node] = boards.comm->getTopicId(topics[node]);
+  } else if (node == 2) {
+    boards.comm->subscribeTopic(SMALLER_TOPIC, onTopic);
+    boards.comm->subscribeTopic(LARGER_TOPIC, onTopic);
+  } else {
+    boards.comm->subscribeTopic(WILDCARD, onTopic);
+  }
+}
+
+static void loopBoard(int node) {
+  if (node >= PUBLISHERS) return;
+
+  uint32_t start = node == 0 ? EARLY_START_MS : LATE_START_MS;
+  if (millis() >= start && millis() < PUBLISH_END_MS &&
+      millis() - lastPublish >= PUBLISH_INTERVAL) {
+    lastPublish = millis();
+    uint32_t sequence = publishes++;
+    boards.comm->publishTopic(topics[node], (const uint8_t*)&sequence,
+                              sizeof(sequence));
+    boards.results->published[node] = publishes;
+  }
+  boards.results->finalIds[node] = boards.comm->getTopicId(topics[node]);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void runPublishers(const char* early, const char* late) {
+  HostNetwork network(BOARDS);
+  topics[0] = early;
+  topics[1] = late;
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, setupBoard, loopBoard, PUBLISH_END_MS + 500));
+
+  const Results* results = boards.results;
+  char report[120];
+  snprintf(report, sizeof(report), "%s: ID %u, %s: ID %u", early,
+           (unsigned)results->finalIds[0], late,
+           (unsigned)results->finalIds[1]);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_EQUAL(results->initialIds[0], results->initialIds[1]);
+  TEST_ASSERT_NOT_EQUAL(results->finalIds[0], results->finalIds[1]);
+  for (int b = PUBLISHERS; b < BOARDS; b++) {
+    TEST_ASSERT_EQUAL(0, results->misdelivered[b]);
+    for (int p = 0; p < PUBLISHERS; p++) {
+      TEST_ASSERT_NOT_EQUAL(0, results->published[p]);
+      TEST_ASSERT_EQUAL(results->published[p], results->received[b][p]);
+    }
+  }
+}
+
+// The name that keeps the ID is there first; the newcomer moves
+void test_late_topic_moves_to_next_id() {
+  runPublishers(SMALLER_TOPIC, LARGER_TOPIC);
+}
+
+// The newcomer keeps the ID, and the topic already in use has to move
+void test_early_topic_moves_to_next_id() {
+  runPublishers(LARGER_TOPIC, SMALLER_TOPIC);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_late_topic_moves_to_next_id);
+  RUN_TEST(test_early_topic_moves_to_next_id);
+  return UNITY_END();
+}
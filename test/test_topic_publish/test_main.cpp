@@ -0,0 +1,444 @@
+/**
+ * Topic publishing in a simulated 15-board cell
+ *
+ * Board 0 publishes binary messages on a topic three boards subscribe to.
+ * The tests check that publishes are not lost while the publisher has yet
+ * to learn who subscribes, or when boards subscribe or power on late and
+ * do not know the topic ID, and compare the delivery ratio and airtime of
+ * interest-based unicast with plain broadcast on a lossy channel. The
+ * default unicast threshold must not cost more airtime than a broadcast.
+ * A board whose every subscription matches must have all of them called.
+ * A QoS 1 publish with more subscribers than the outbox tracks must be
+ * refused rather than sent unacknowledged. Retained values must reach
+ * boards that subscribe later, and a full table must evict the least
+ * recently used value.
+ */
+
+#include <HostBoards.h>
+#include <HostNetwork.h>
+#include <unity.h>
+
+#include "NetworkComm.h"
+
+#define CELL_SIZE 15
+#define SUBSCRIBERS 3  // Boards 1 to 3
+#define TOPIC "cell/line1/temp"
+#define PUBLISH_INTERVAL 250
+#define MAX_PUBLISHES 400
+#define LATE_SUBSCRIBER 4   // Powers on once the publisher unicasts
+#define LATE_BOARD 5        // Powers on while it broadcasts, subscribes
+#define LATE_BYSTANDER 6    // Powers on while it broadcasts
+#define SUBSCRIBE_GRACE 50  // For the subscription to reach the publisher
+
+// Retained values: board 0 fills its table, board 1 subscribes to the first
+// topic, then one topic more is published and board 2 subscribes to all
+#define RETAINED_TOPICS (MAX_RETAINED_TOPICS + 1)
+#define RETAINED_START_MS 1000
+#define RETAINED_INTERVAL 50
+#define FIRST_SUBSCRIBE_MS 1600
+#define OVERFLOW_PUBLISH_MS 2000
+#define ALL_SUBSCRIBE_MS 2500
+
+struct Results {
+  uint32_t published;
+  uint32_t refused;  // Publishes publishTopic() returned false for
+  uint32_t received[CELL_SIZE];
+  uint32_t subscribedAt[CELL_SIZE];   // When each board subscribed, or 0
+  uint32_t publishedAt[MAX_PUBLISHES];
+  uint8_t got[CELL_SIZE][MAX_PUBLISHES];
+  uint32_t deliveries[MAX_TOPIC_SUBSCRIPTIONS];  // Per overlapping filter
+  uint8_t retainedCount[CELL_SIZE][RETAINED_TOPICS];  // Per retained topic
+  uint8_t retainedValue[CELL_SIZE][RETAINED_TOPICS];
+};
+
+static HostBoards<Results> boards;
+
+// Run parameters, set by each test before the boards are forked
+static uint32_t publishStart;
+static uint32_t publishCount;
+static uint8_t publishFlags;
+static int subscribers;  // Boards 1 to subscribers subscribe
+static uint8_t unicastThreshold;
+static uint8_t noiseFilters;  // Unrelated filters every board subscribes to
+static uint32_t lateSubscribeAt;  // When LATE_SUBSCRIBER subscribes, 0 never
+static bool lateBoards;           // LATE_BOARD subscribes too
+static bool overlapping;  // Board 1 fills its table with matching filters
+
+// Board state, one copy per board process
+static bool subscribed;
+static uint32_t publishes;
+static uint32_t lastPublish;
+static uint8_t seen[MAX_PUBLISHES];
+
+// Airtime of board 0's topic frames, counted by the hub
+static uint64_t topicAirtime;
+static uint32_t topicFrames;
+
+// Topic ID queries and announcements, counted by the hub
+static uint32_t topicQueries;
+static uint32_t bystanderQueries;
+static uint32_t topicAnnouncements;
+
+static void onTopic(const char* sender, const char* topic,
+                    const uint8_t* data, size_t length) {
+  uint32_t sequence;
+  if (length != sizeof(sequence)) return;
+  memcpy(&sequence, data, sizeof(sequence));
+  if (sequence >= MAX_PUBLISHES || seen[sequence]) return;
+  seen[sequence] = 1;
+  boards.results->got[boards.self][sequence] = 1;
+  boards.results->received[boards.self]++;
+}
+
+// Context is the subscription's index
+static void onOverlappingTopic(void* context, const char* sender,
+                               const char* topic, const uint8_t* data,
+                               size_t length) {
+  boards.results->deliveries[(intptr_t)context]++;
+}
+
+static void ignoreTopic(const char* sender, const char* topic,
+                        const uint8_t* data, size_t length) {}
+
+// Topics are "retained/<index>", each retaining its index
+static void onRetained(const char* sender, const char* topic,
+                       const uint8_t* data, size_t length) {
+  int index = atoi(topic + strlen("retained/"));
+  if (index >= RETAINED_TOPICS || length != 1) return;
+  boards.results->retainedCount[boards.self][index]++;
+  boards.results->retainedValue[boards.self][index] = data[0];
+}
+
+static void setupBoard(int node) {
+  boards.comm->setTopicUnicastThreshold(unicastThreshold);
+}
+
+static void loopBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+
+  if (!subscribed) {
+    subscribed = true;
+    for (int i = 0; i < noiseFilters; i++) {
+      char filter[32];
+      snprintf(filter, sizeof(filter), "noise/%d/%d/#", node, i);
+      boards.comm->subscribeTopic(filter, ignoreTopic);
+    }
+    if (overlapping && node == 1) {
+      // Exact, "+" and "#" filters, each stacked several times
+      static const char* filters[] = {TOPIC, "cell/#", "cell/+/temp",
+                                      "+/line1/#"};
+      for (intptr_t i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+        boards.comm->subscribeTopic(filters[i % 4], onOverlappingTopic,
+                                    (void*)i);
+      }
+      boards.results->subscribedAt[node] = millis();
+    } else if ((node >= 1 && node <= subscribers) ||
+               (lateBoards && node == LATE_BOARD)) {
+      boards.comm->subscribeTopic(TOPIC, onTopic);
+      boards.results->subscribedAt[node] = millis();
+    }
+  }
+
+  if (lateSubscribeAt != 0 && node == LATE_SUBSCRIBER &&
+      boards.results->subscribedAt[node] == 0 && millis() >= lateSubscribeAt) {
+    boards.comm->subscribeTopic(TOPIC, onTopic);
+    boards.results->subscribedAt[node] = millis();
+  }
+
+  if (node == 0 && publishes < publishCount && millis() >= publishStart &&
+      millis() - lastPublish >= PUBLISH_INTERVAL) {
+    lastPublish = millis();
+    uint32_t sequence = publishes++;
+    boards.results->publishedAt[sequence] = millis();
+    if (!boards.comm->publishTopic(TOPIC, (const uint8_t*)&sequence,
+                                   sizeof(sequence), publishFlags)) {
+      boards.results->refused++;
+    }
+    boards.results->published = publishes;
+  }
+}
+
+static void loopRetainedBoard(int node) {
+  if (boards.comm->getStartupState() != STARTUP_READY) return;
+
+  uint32_t now = millis();
+  if (node == 0 && publishes < RETAINED_TOPICS) {
+    uint32_t publishAt = publishes < MAX_RETAINED_TOPICS
+                             ? RETAINED_START_MS + publishes * RETAINED_INTERVAL
+                             : OVERFLOW_PUBLISH_MS;
+    if (now >= publishAt) {
+      char topic[32];
+      snprintf(topic, sizeof(topic), "retained/%u", (unsigned)publishes);
+      uint8_t value = publishes++;
+      boards.comm->publishTopic(topic, &value, 1, PUBLISH_RETAINED);
+      boards.results->published = publishes;
+    }
+  }
+
+  if (!subscribed && node == 1 && now >= FIRST_SUBSCRIBE_MS) {
+    subscribed = true;
+    boards.comm->subscribeTopic("retained/0", onRetained);
+  }
+  if (!subscribed && node == 2 && now >= ALL_SUBSCRIBE_MS) {
+    subscribed = true;
+    boards.comm->subscribeTopic("retained/#", onRetained);
+  }
+}
+
+static void countTopicFrames(int sender, int receiver, const uint8_t* data,
+                             size_t length, int delivered,
+                             uint32_t airtimeUs) {
+  if (sender != 0 || length < 2) return;
+  if (data[0] == BINARY_FRAME_MAGIC && data[1] == MSG_TYPE_MESSAGE) {
+    topicAirtime += airtimeUs;
+    topicFrames++;
+  }
+}
+
+static void countTopicAnnounces(int sender, int receiver, const uint8_t* data,
+                                size_t length, int delivered,
+                                uint32_t airtimeUs) {
+  if (length == 0 || data[0] != '{') return;
+  const char* text = (const char*)data;
+  const char* type = strstr(text, "\"type\":18");
+  if (type == NULL || isdigit(type[9])) return;
+
+  // Queries carry only the ID, announcements the name as well
+  if (strstr(text, "\"topic\"") != NULL) {
+    topicAnnouncements++;
+  } else {
+    topicQueries++;
+    if (sender == LATE_BYSTANDER) bystanderQueries++;
+  }
+}
+
+// Publishes a board missed after it subscribed
+static int missedAfterSubscribing(int node) {
+  const Results* results = boards.results;
+  int missed = 0;
+  for (uint32_t i = 0; i < results->published; i++) {
+    if (results->publishedAt[i] >=
+            results->subscribedAt[node] + SUBSCRIBE_GRACE &&
+        !results->got[node][i]) {
+      missed++;
+    }
+  }
+  return missed;
+}
+
+static float deliveryRatio() {
+  const Results* results = boards.results;
+  uint32_t received = 0;
+  for (int i = 1; i <= SUBSCRIBERS; i++) received += results->received[i];
+  return (float)received / (results->published * SUBSCRIBERS);
+}
+
+void setUp() {
+  topicAirtime = 0;
+  topicFrames = 0;
+  noiseFilters = 0;
+  lateSubscribeAt = 0;
+  lateBoards = false;
+  overlapping = false;
+  topicQueries = 0;
+  bystanderQueries = 0;
+  topicAnnouncements = 0;
+  unicastThreshold = TOPIC_UNICAST_THRESHOLD;
+  publishFlags = 0;
+  subscribers = SUBSCRIBERS;
+}
+
+void tearDown() {}
+
+// The publisher boots after the subscribers have advertised, and publishes
+// before any advertisement reaches it
+void test_publish_before_interests_are_known() {
+  HostNetwork network(SUBSCRIBERS + 1);
+  network.setPower(0, 5000);
+  publishStart = 0;
+  publishCount = 1;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, 6000));
+  TEST_ASSERT_EQUAL(1, boards.results->published);
+  for (int i = 1; i <= SUBSCRIBERS; i++) {
+    TEST_ASSERT_EQUAL(1, boards.results->received[i]);
+  }
+}
+
+// Every subscription on the board matches the topic, more than the 16 a
+// message used to be delivered to, and each must be called once
+void test_publish_reaches_every_matching_subscription() {
+  HostNetwork network(2);
+  overlapping = true;
+  publishStart = 2000;
+  publishCount = 1;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, 3000));
+  TEST_ASSERT_EQUAL(1, boards.results->published);
+  for (int i = 0; i < MAX_TOPIC_SUBSCRIPTIONS; i++) {
+    TEST_ASSERT_EQUAL(1, boards.results->deliveries[i]);
+  }
+}
+
+// More subscriptions than the publisher's interest table holds: evicted
+// subscribers must still get the messages
+void test_publish_after_interest_eviction() {
+  HostNetwork network(CELL_SIZE);
+  noiseFilters = 3;
+  unicastThreshold = SUBSCRIBERS;
+  publishStart = 40000;
+  publishCount = 100;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, 67000));
+  TEST_ASSERT_EQUAL(100, boards.results->published);
+  for (int i = 1; i <= SUBSCRIBERS; i++) {
+    TEST_ASSERT_EQUAL(100, boards.results->received[i]);
+  }
+}
+
+// Boards that power on after the topic's first frames know no topic ID,
+// and one that subscribes while the publisher unicasts to others hears no
+// frames for the topic at all. They must still get every message published
+// once they subscribe, and only boards that subscribe may ask for the name.
+void test_late_subscribers_get_every_message() {
+  HostNetwork network(CELL_SIZE, 5);
+  network.setFrameObserver(countTopicAnnounces);
+  network.setPower(LATE_SUBSCRIBER, 38000);
+  network.setPower(LATE_BOARD, 20000);
+  network.setPower(LATE_BYSTANDER, 20000);
+  lateBoards = true;
+  lateSubscribeAt = 45000;
+  unicastThreshold = MAX_TOPIC_UNICAST_PEERS;
+  publishStart = 5000;
+  publishCount = 180;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard, 51000));
+  TEST_ASSERT_EQUAL(publishCount, boards.results->published);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->subscribedAt[LATE_SUBSCRIBER]);
+  TEST_ASSERT_NOT_EQUAL(0, boards.results->subscribedAt[LATE_BOARD]);
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "late subscriber missed %d, late board missed %d; %u topic ID "
+           "queries, %u announcements",
+           missedAfterSubscribing(LATE_SUBSCRIBER),
+           missedAfterSubscribing(LATE_BOARD), (unsigned)topicQueries,
+           (unsigned)topicAnnouncements);
+  TEST_MESSAGE(report);
+
+  for (int i = 1; i <= SUBSCRIBERS; i++) {
+    TEST_ASSERT_EQUAL(0, missedAfterSubscribing(i));
+  }
+  TEST_ASSERT_EQUAL(0, missedAfterSubscribing(LATE_SUBSCRIBER));
+  TEST_ASSERT_EQUAL(0, missedAfterSubscribing(LATE_BOARD));
+  TEST_ASSERT_EQUAL(0, bystanderQueries);
+  TEST_ASSERT_LESS_OR_EQUAL(2, topicAnnouncements);
+}
+
+// One QoS 1 publish, once the publisher knows its subscribers
+static void runQos1Publish(int count) {
+  HostNetwork network(CELL_SIZE, 3);
+  subscribers = count;
+  publishFlags = MESSAGE_QOS1;
+  publishStart = TOPIC_INTEREST_REFRESH + 5000;
+  publishCount = 1;
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, setupBoard, loopBoard, publishStart + 2000));
+  TEST_ASSERT_EQUAL(1, boards.results->published);
+}
+
+// As many subscribers as the outbox tracks all get a QoS 1 publish. With
+// one more it is refused, and reaches nobody.
+void test_qos1_publish_with_too_many_subscribers() {
+  TEST_ASSERT_LESS_THAN(CELL_SIZE, MAX_OUTBOX_RECIPIENTS + 1);
+
+  runQos1Publish(MAX_OUTBOX_RECIPIENTS);
+  TEST_ASSERT_EQUAL(0, boards.results->refused);
+  for (int i = 1; i <= subscribers; i++) {
+    TEST_ASSERT_EQUAL(1, boards.results->received[i]);
+  }
+
+  runQos1Publish(MAX_OUTBOX_RECIPIENTS + 1);
+  TEST_ASSERT_EQUAL(1, boards.results->refused);
+  for (int i = 1; i <= subscribers; i++) {
+    TEST_ASSERT_EQUAL(0, boards.results->received[i]);
+  }
+}
+
+// Board 1 subscribes after the first topic was published, which also makes
+// that value the most recently used. The next topic evicts the value used
+// least recently, topic 1, so board 2 gets every value but that one.
+void test_retained_values_reach_late_subscribers() {
+  HostNetwork network(3);
+
+  TEST_ASSERT_TRUE(
+      boards.run(network, NULL, loopRetainedBoard, ALL_SUBSCRIBE_MS + 1000));
+  TEST_ASSERT_EQUAL(RETAINED_TOPICS, boards.results->published);
+
+  TEST_ASSERT_EQUAL(1, boards.results->retainedCount[1][0]);
+  TEST_ASSERT_EQUAL(0, boards.results->retainedValue[1][0]);
+  for (int i = 1; i < RETAINED_TOPICS; i++) {
+    TEST_ASSERT_EQUAL(0, boards.results->retainedCount[1][i]);
+  }
+
+  for (int i = 0; i < RETAINED_TOPICS; i++) {
+    TEST_ASSERT_EQUAL(i == 1 ? 0 : 1, boards.results->retainedCount[2][i]);
+    if (i != 1) TEST_ASSERT_EQUAL(i, boards.results->retainedValue[2][i]);
+  }
+}
+
+static void runCell(uint8_t threshold, float loss, float* ratio,
+                    uint64_t* airtimeUs) {
+  HostNetwork network(CELL_SIZE, 7);
+  network.setLoss(loss);
+  network.setFrameObserver(countTopicFrames);
+  unicastThreshold = threshold;
+  publishStart = 40000;
+  publishCount = MAX_PUBLISHES;
+  topicAirtime = 0;
+  topicFrames = 0;
+
+  TEST_ASSERT_TRUE(boards.run(network, setupBoard, loopBoard,
+                              publishStart +
+                                  MAX_PUBLISHES * PUBLISH_INTERVAL + 1000));
+  TEST_ASSERT_EQUAL(MAX_PUBLISHES, boards.results->published);
+  *ratio = deliveryRatio();
+  *airtimeUs = topicAirtime;
+}
+
+// Steady state with 10% frame loss per link, with the default threshold,
+// always broadcasting, and unicasting to every subscriber
+void test_unicast_delivery_and_airtime() {
+  float defaultRatio, broadcastRatio, unicastRatio;
+  uint64_t defaultAirtime, broadcastAirtime, unicastAirtime;
+  runCell(TOPIC_UNICAST_THRESHOLD, 0.1f, &defaultRatio, &defaultAirtime);
+  runCell(0, 0.1f, &broadcastRatio, &broadcastAirtime);
+  runCell(SUBSCRIBERS, 0.1f, &unicastRatio, &unicastAirtime);
+
+  char report[200];
+  snprintf(report, sizeof(report),
+           "default: %.2f%% delivered, %.1f us/publish; "
+           "broadcast: %.2f%% delivered, %.1f us/publish; "
+           "unicast: %.2f%% delivered, %.1f us/publish",
+           defaultRatio * 100, (double)defaultAirtime / MAX_PUBLISHES,
+           broadcastRatio * 100, (double)broadcastAirtime / MAX_PUBLISHES,
+           unicastRatio * 100, (double)unicastAirtime / MAX_PUBLISHES);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_LESS_OR_EQUAL(broadcastAirtime, defaultAirtime);
+  TEST_ASSERT_GREATER_THAN(0.99f, unicastRatio);
+  TEST_ASSERT_GREATER_THAN(broadcastRatio, unicastRatio);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_publish_before_interests_are_known);
+  RUN_TEST(test_publish_reaches_every_matching_subscription);
+  RUN_TEST(test_publish_after_interest_eviction);
+  RUN_TEST(test_late_subscribers_get_every_message);
+  RUN_TEST(test_qos1_publish_with_too_many_subscribers);
+  RUN_TEST(test_retained_values_reach_late_subscribers);
+  RUN_TEST(test_unicast_delivery_and_airtime);
+  return UNITY_END();
+}